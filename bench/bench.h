@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef BENCH_BENCH_H_
+#define BENCH_BENCH_H_
+
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Number of iterations given as the first command line argument.
+ */
+static inline unsigned int
+bench_iterations(int argc, char **argv, unsigned int def) {
+	long value;
+
+	if (argc < 2)
+		return def;
+	value = strtol(argv[1], NULL, 10);
+	if (value <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		exit(1);
+	}
+	return (unsigned int)value;
+}
+
+static inline void
+bench_start(isc_time_t *start) {
+	RUNTIME_CHECK(isc_time_now(start) == ISC_R_SUCCESS);
+}
+
+/**
+ * Print time per operation since start and return it in nanoseconds.
+ */
+static inline double
+bench_report(const char *name, const isc_time_t *start, unsigned int ops) {
+	isc_time_t now;
+	double ns;
+
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+	ns = (double)isc_time_microdiff(&now, start) * 1000 / ops;
+	printf("%-32s %10u ops %12.1f ns/op\n", name, ops, ns);
+	return ns;
+}
+
+#endif /* BENCH_BENCH_H_ */
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+/*
+ * Microbenchmark: metaLDAP hash index against RBT keyed by
+ * "<entryUUID>.uuid.ldap." DNS names, i.e. the index which was used
+ * for metaLDAP before. Only the tree is measured for RBT, the former
+ * implementation also stored data in rdatasets on top of it.
+ *
+ * Usage: bench_mldap [entries]
+ */
+
+#include <isc/mem.h>
+#include <isc/util.h>
+
+#include <dns/name.h>
+#include <dns/rbt.h>
+#include <dns/result.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ldap_entry.h"
+#include "mldap.h"
+#include "util.h"
+
+#include "bench.h"
+
+#define ZONES	100
+
+/**
+ * Generate deterministic pseudo-random UUID for entry number i.
+ */
+static void
+make_uuid(unsigned int i, unsigned char *uuid) {
+	isc_uint64_t x = i * 0x9E3779B97F4A7C15ULL + 1;
+	unsigned int j;
+
+	for (j = 0; j < 16; j++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		uuid[j] = (unsigned char)x;
+	}
+}
+
+/**
+ * Convert UUID to "01234567-89ab-cdef-0123-456789abcdef.uuid.ldap." name
+ * in the same way as the RBT-based metaLDAP did.
+ */
+static void
+uuid_to_mname(const unsigned char *uuid, dns_name_t *name) {
+	char text[sizeof("01234567-89ab-cdef-0123-456789abcdef.uuid.ldap.")];
+	char *p = text;
+	unsigned int j;
+
+	for (j = 0; j < 16; j++) {
+		if (j == 4 || j == 6 || j == 8 || j == 10)
+			*p++ = '-';
+		p += sprintf(p, "%02x", uuid[j]);
+	}
+	strcpy(p, ".uuid.ldap.");
+	RUNTIME_CHECK(dns_name_fromstring(name, text, 0, NULL)
+		      == ISC_R_SUCCESS);
+}
+
+static void
+make_names(unsigned int i, dns_name_t *fqdn, dns_name_t *zone) {
+	char text[64];
+
+	snprintf(text, sizeof(text), "zone%u.example.", i % ZONES);
+	RUNTIME_CHECK(dns_name_fromstring(zone, text, 0, NULL)
+		      == ISC_R_SUCCESS);
+	snprintf(text, sizeof(text), "host%u.zone%u.example.", i, i % ZONES);
+	RUNTIME_CHECK(dns_name_fromstring(fqdn, text, 0, NULL)
+		      == ISC_R_SUCCESS);
+}
+
+/**
+ * Visit entries in pseudo-random order so lookups do not benefit
+ * from insertion order.
+ */
+static inline unsigned int
+lookup_order(unsigned int i, unsigned int entries) {
+	return (unsigned int)((i * 2654435761ULL) % entries);
+}
+
+static void
+bench_hash(unsigned int entries) {
+	isc_mem_t *mctx = NULL;
+	mldapdb_t *mldap = NULL;
+	mldap_node_t *node = NULL;
+	ldap_entry_t entry;
+	ldap_entryclass_t class;
+	unsigned char uuid[16];
+	struct berval bv;
+	isc_time_t start;
+	size_t inuse;
+	unsigned int i;
+	DECLARE_BUFFERED_NAME(fqdn);
+	DECLARE_BUFFERED_NAME(zone);
+
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(mldap_new(mctx, &mldap) == ISC_R_SUCCESS);
+	INIT_BUFFERED_NAME(fqdn);
+	INIT_BUFFERED_NAME(zone);
+	memset(&entry, 0, sizeof(entry));
+	entry.class = LDAP_ENTRYCLASS_RR;
+	entry.uuid = &bv;
+	bv.bv_val = (char *)uuid;
+	bv.bv_len = sizeof(uuid);
+	inuse = isc_mem_inuse(mctx);
+
+	bench_start(&start);
+	RUNTIME_CHECK(mldap_newversion(mldap) == ISC_R_SUCCESS);
+	for (i = 0; i < entries; i++) {
+		make_uuid(i, uuid);
+		make_names(i, &fqdn, &zone);
+		RUNTIME_CHECK(mldap_entry_create(&entry, mldap, &node)
+			      == ISC_R_SUCCESS);
+		RUNTIME_CHECK(mldap_dnsname_store(&fqdn, &zone, node)
+			      == ISC_R_SUCCESS);
+		mldap_node_close(&node);
+	}
+	mldap_closeversion(mldap, ISC_TRUE);
+	bench_report("hash index insert", &start, entries);
+	printf("%-32s %10zu bytes/entry\n", "hash index memory",
+	       (isc_mem_inuse(mctx) - inuse) / entries);
+
+	bench_start(&start);
+	for (i = 0; i < entries; i++) {
+		make_uuid(lookup_order(i, entries), uuid);
+		RUNTIME_CHECK(mldap_entry_read(mldap, &bv, &node)
+			      == ISC_R_SUCCESS);
+		RUNTIME_CHECK(mldap_class_get(node, &class) == ISC_R_SUCCESS);
+		mldap_node_close(&node);
+	}
+	bench_report("hash index lookup", &start, entries);
+
+	mldap_destroy(&mldap);
+	isc_mem_destroy(&mctx);
+}
+
+static void
+bench_rbt(unsigned int entries) {
+	isc_mem_t *mctx = NULL;
+	dns_rbt_t *rbt = NULL;
+	ldap_entryclass_t *classes = NULL;
+	void *data;
+	unsigned char uuid[16];
+	isc_time_t start;
+	size_t inuse;
+	unsigned int i;
+	DECLARE_BUFFERED_NAME(mname);
+
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	INIT_BUFFERED_NAME(mname);
+	classes = isc_mem_get(mctx, entries * sizeof(*classes));
+	RUNTIME_CHECK(classes != NULL);
+	inuse = isc_mem_inuse(mctx);
+	RUNTIME_CHECK(dns_rbt_create(mctx, NULL, NULL, &rbt) == ISC_R_SUCCESS);
+
+	bench_start(&start);
+	for (i = 0; i < entries; i++) {
+		make_uuid(i, uuid);
+		uuid_to_mname(uuid, &mname);
+		classes[i] = LDAP_ENTRYCLASS_RR;
+		RUNTIME_CHECK(dns_rbt_addname(rbt, &mname, &classes[i])
+			      == ISC_R_SUCCESS);
+	}
+	bench_report("RBT insert", &start, entries);
+	printf("%-32s %10zu bytes/entry\n", "RBT memory (tree only)",
+	       (isc_mem_inuse(mctx) - inuse) / entries);
+
+	bench_start(&start);
+	for (i = 0; i < entries; i++) {
+		make_uuid(lookup_order(i, entries), uuid);
+		uuid_to_mname(uuid, &mname);
+		data = NULL;
+		RUNTIME_CHECK(dns_rbt_findname(rbt, &mname, 0, NULL, &data)
+			      == ISC_R_SUCCESS);
+		RUNTIME_CHECK(*(ldap_entryclass_t *)data
+			      == LDAP_ENTRYCLASS_RR);
+	}
+	bench_report("RBT lookup", &start, entries);
+
+	dns_rbt_destroy(&rbt);
+	isc_mem_put(mctx, classes, entries * sizeof(*classes));
+	isc_mem_destroy(&mctx);
+}
+
+int
+main(int argc, char **argv) {
+	unsigned int entries;
+
+	entries = bench_iterations(argc, argv, 100000);
+	dns_result_register();
+
+	bench_hash(entries);
+	printf("\n");
+	bench_rbt(entries);
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+/*
+ * Microbenchmark: rdata_fromtext_fast() against isc_lex
+ * and dns_rdata_fromtext() for typical values of the most common
+ * record types stored in LDAP.
+ *
+ * Usage: bench_rdata [iterations]
+ */
+
+#include <isc/buffer.h>
+#include <isc/lex.h>
+#include <isc/mem.h>
+#include <isc/util.h>
+
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatatype.h>
+#include <dns/result.h>
+
+#include <string.h>
+
+#include "ldap_convert.h"
+#include "util.h"
+
+#include "bench.h"
+
+static const struct {
+	dns_rdatatype_t	type;
+	const char	*text;
+} values[] = {
+	{ dns_rdatatype_a,	"192.0.2.1" },
+	{ dns_rdatatype_aaaa,	"2001:db8:1:2::1" },
+	{ dns_rdatatype_cname,	"host.example.com." },
+	{ dns_rdatatype_ns,	"ns1" },
+	{ dns_rdatatype_ptr,	"host.example.com." },
+	{ dns_rdatatype_mx,	"10 mail" },
+	{ dns_rdatatype_srv,	"0 100 389 ldap.example.com." },
+	{ dns_rdatatype_txt,	"\"v=spf1 mx -all\"" },
+};
+
+static unsigned char fast_mem[DNS_RDATA_MAXLENGTH];
+static unsigned char lex_mem[DNS_RDATA_MAXLENGTH];
+
+/**
+ * Parse value in the same way as parse_rdata() does when the fast path
+ * is not applicable.
+ */
+static isc_result_t
+fromtext_lex(isc_mem_t *mctx, isc_lex_t *lex, dns_rdatatype_t type,
+	     dns_name_t *origin, const char *text, isc_buffer_t *target) {
+	isc_result_t result;
+	isc_buffer_t source;
+	unsigned int length = strlen(text);
+
+	isc_buffer_init(&source, (char *)text, length);
+	isc_buffer_add(&source, length);
+	isc_buffer_setactive(&source, length);
+
+	CHECK(isc_lex_openbuffer(lex, &source));
+	result = dns_rdata_fromtext(NULL, dns_rdataclass_in, type, lex,
+				    origin, 0, mctx, target, NULL);
+	isc_lex_close(lex);
+
+cleanup:
+	return result;
+}
+
+int
+main(int argc, char **argv) {
+	isc_mem_t *mctx = NULL;
+	isc_lex_t *lex = NULL;
+	isc_buffer_t fast;
+	isc_buffer_t slow;
+	isc_consttextregion_t text;
+	isc_time_t start;
+	unsigned int iterations;
+	unsigned int i;
+	unsigned int v;
+	double fast_ns;
+	double lex_ns;
+	char type_name[DNS_RDATATYPE_FORMATSIZE];
+	char label[64];
+	DECLARE_BUFFERED_NAME(origin);
+
+	iterations = bench_iterations(argc, argv, 1000000);
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	dns_result_register();
+	RUNTIME_CHECK(isc_lex_create(mctx, 1024, &lex) == ISC_R_SUCCESS);
+	INIT_BUFFERED_NAME(origin);
+	RUNTIME_CHECK(dns_name_fromstring(&origin, "example.com.", 0, NULL)
+		      == ISC_R_SUCCESS);
+
+	for (v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+		text.base = values[v].text;
+		text.length = strlen(values[v].text);
+		dns_rdatatype_format(values[v].type, type_name,
+				     sizeof(type_name));
+
+		/* the fast path must produce the same wire format */
+		isc_buffer_init(&fast, fast_mem, sizeof(fast_mem));
+		isc_buffer_init(&slow, lex_mem, sizeof(lex_mem));
+		if (rdata_fromtext_fast(dns_rdataclass_in, values[v].type,
+					&origin, &text, &fast)
+		    != ISC_R_SUCCESS ||
+		    fromtext_lex(mctx, lex, values[v].type, &origin,
+				 values[v].text, &slow) != ISC_R_SUCCESS ||
+		    isc_buffer_usedlength(&fast)
+		    != isc_buffer_usedlength(&slow) ||
+		    memcmp(fast_mem, lex_mem, isc_buffer_usedlength(&fast))
+		    != 0) {
+			fprintf(stderr, "%s '%s': results differ\n",
+				type_name, values[v].text);
+			return 1;
+		}
+
+		bench_start(&start);
+		for (i = 0; i < iterations; i++) {
+			isc_buffer_init(&fast, fast_mem, sizeof(fast_mem));
+			RUNTIME_CHECK(rdata_fromtext_fast(dns_rdataclass_in,
+							  values[v].type,
+							  &origin, &text,
+							  &fast)
+				      == ISC_R_SUCCESS);
+		}
+		snprintf(label, sizeof(label), "%s rdata_fromtext_fast",
+			 type_name);
+		fast_ns = bench_report(label, &start, iterations);
+
+		bench_start(&start);
+		for (i = 0; i < iterations; i++) {
+			isc_buffer_init(&slow, lex_mem, sizeof(lex_mem));
+			RUNTIME_CHECK(fromtext_lex(mctx, lex, values[v].type,
+						   &origin, values[v].text,
+						   &slow)
+				      == ISC_R_SUCCESS);
+		}
+		snprintf(label, sizeof(label), "%s dns_rdata_fromtext",
+			 type_name);
+		lex_ns = bench_report(label, &start, iterations);
+		printf("%-32s %.1fx\n\n", "speed-up", lex_ns / fast_ns);
+	}
+
+	isc_lex_destroy(&lex);
+	isc_mem_destroy(&mctx);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+/*
+ * Microbenchmark: conversion between LDAP attribute names and RR types
+ * using the precomputed table in ldap_attribute_to_rdatatype()
+ * and rdatatype_to_ldap_attribute() against the former implementation
+ * based on strcasecmp(), dns_rdatatype_fromtext()
+ * and dns_rdatatype_format().
+ *
+ * Usage: bench_rdtype [iterations]
+ */
+
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/rdatatype.h>
+#include <dns/result.h>
+
+#include <string.h>
+#include <strings.h>
+
+#include "ldap_convert.h"
+#include "util.h"
+
+#include "bench.h"
+
+static const char *names[] = {
+	"ARecord", "AAAARecord", "CNAMERecord", "NSRecord", "PTRRecord",
+	"MXRecord", "SRVRecord", "TXTRecord", "SSHFPRecord", "aaaarecord",
+};
+
+#define NAMES_COUNT	(sizeof(names) / sizeof(names[0]))
+
+/**
+ * Former ldap_attribute_to_rdatatype() without generic names.
+ */
+static isc_result_t
+attr_to_rdtype_parse(const char *attribute, dns_rdatatype_t *rdtype) {
+	isc_consttextregion_t region;
+	unsigned int len;
+
+	len = strlen(attribute);
+	if (len <= LDAP_RDATATYPE_SUFFIX_LEN)
+		return ISC_R_UNEXPECTEDEND;
+	if (strcasecmp(attribute + len - LDAP_RDATATYPE_SUFFIX_LEN,
+		       LDAP_RDATATYPE_SUFFIX) != 0)
+		return ISC_R_UNEXPECTED;
+	region.base = attribute;
+	region.length = len - LDAP_RDATATYPE_SUFFIX_LEN;
+	return dns_rdatatype_fromtext(rdtype, (isc_textregion_t *)&region);
+}
+
+/**
+ * Former rdatatype_to_ldap_attribute() without generic names.
+ */
+static isc_result_t
+rdtype_to_attr_format(dns_rdatatype_t rdtype, char *target,
+		      unsigned int size) {
+	isc_result_t result;
+	char rdtype_str[DNS_RDATATYPE_FORMATSIZE];
+
+	dns_rdatatype_format(rdtype, rdtype_str, DNS_RDATATYPE_FORMATSIZE);
+	CHECK(isc_string_copy(target, size, rdtype_str));
+	CHECK(isc_string_append(target, size, LDAP_RDATATYPE_SUFFIX));
+
+cleanup:
+	return result;
+}
+
+int
+main(int argc, char **argv) {
+	dns_rdatatype_t types[NAMES_COUNT];
+	dns_rdatatype_t rdtype;
+	dns_rdatatype_t expected;
+	char table_attr[LDAP_ATTR_FORMATSIZE];
+	char format_attr[LDAP_ATTR_FORMATSIZE];
+	isc_time_t start;
+	unsigned int iterations;
+	unsigned int i;
+	unsigned int n;
+	double table_ns;
+	double parse_ns;
+
+	iterations = bench_iterations(argc, argv, 1000000);
+	dns_result_register();
+
+	/* both implementations must give the same results */
+	for (n = 0; n < NAMES_COUNT; n++) {
+		if (ldap_attribute_to_rdatatype(names[n], &rdtype)
+		    != ISC_R_SUCCESS ||
+		    attr_to_rdtype_parse(names[n], &expected)
+		    != ISC_R_SUCCESS || rdtype != expected ||
+		    rdatatype_to_ldap_attribute(rdtype, table_attr,
+						sizeof(table_attr), ISC_FALSE)
+		    != ISC_R_SUCCESS ||
+		    rdtype_to_attr_format(rdtype, format_attr,
+					  sizeof(format_attr))
+		    != ISC_R_SUCCESS ||
+		    strcmp(table_attr, format_attr) != 0) {
+			fprintf(stderr, "'%s': results differ\n", names[n]);
+			return 1;
+		}
+		types[n] = rdtype;
+	}
+
+	bench_start(&start);
+	for (i = 0; i < iterations; i++) {
+		n = i % NAMES_COUNT;
+		RUNTIME_CHECK(ldap_attribute_to_rdatatype(names[n], &rdtype)
+			      == ISC_R_SUCCESS);
+	}
+	table_ns = bench_report("attribute -> type, table", &start,
+				iterations);
+
+	bench_start(&start);
+	for (i = 0; i < iterations; i++) {
+		n = i % NAMES_COUNT;
+		RUNTIME_CHECK(attr_to_rdtype_parse(names[n], &rdtype)
+			      == ISC_R_SUCCESS);
+	}
+	parse_ns = bench_report("attribute -> type, parser", &start,
+				iterations);
+	printf("%-32s %.1fx\n\n", "speed-up", parse_ns / table_ns);
+
+	bench_start(&start);
+	for (i = 0; i < iterations; i++) {
+		n = i % NAMES_COUNT;
+		RUNTIME_CHECK(rdatatype_to_ldap_attribute(types[n], table_attr,
+							  sizeof(table_attr),
+							  ISC_FALSE)
+			      == ISC_R_SUCCESS);
+	}
+	table_ns = bench_report("type -> attribute, table", &start,
+				iterations);
+
+	bench_start(&start);
+	for (i = 0; i < iterations; i++) {
+		n = i % NAMES_COUNT;
+		RUNTIME_CHECK(rdtype_to_attr_format(types[n], format_attr,
+						    sizeof(format_attr))
+			      == ISC_R_SUCCESS);
+	}
+	parse_ns = bench_report("type -> attribute, formatter", &start,
+				iterations);
+	printf("%-32s %.1fx\n", "speed-up", parse_ns / table_ns);
+
+	return 0;
+}
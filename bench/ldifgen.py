@@ -0,0 +1,203 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+#
+
+"""
+Generate synthetic DNS tree in LDIF format for load testing.
+
+Objects have the same shape as objects described in doc/schema.ldif
+and README section 4: master zones (idnsZone) with records (idnsRecord),
+record templates (idnsTemplateObject), forward zones (idnsForwardZone)
+and optionally per-server configuration object (idnsServerConfigObject)
+with substitution variable used by templates.
+
+Output is deterministic for given parameters and --seed.
+
+Usage:
+- ldifgen.py --zones 100 --records 1000 > data.ldif
+- ldifgen.py --zones 10 --records 50000 --mix A=50,AAAA=30,TXT=20
+"""
+
+import argparse
+import random
+import sys
+
+# RR type -> function(zone index, record index, random) -> list of values
+RR_VALUES = {
+    'A': lambda z, r, rnd: ['10.%d.%d.%d' % (z % 256, (r // 256) % 256,
+                                             r % 256)],
+    'AAAA': lambda z, r, rnd: ['fd00:%x::%x' % (z, r)],
+    'CNAME': lambda z, r, rnd: ['ns1'],
+    'MX': lambda z, r, rnd: ['%d ns1' % (10 * rnd.randint(1, 5))],
+    'SRV': lambda z, r, rnd: ['0 100 %d ns1' % rnd.randint(1, 65535)],
+    'TXT': lambda z, r, rnd: ['"bench record %d in zone %d"' % (r, z)],
+    'SSHFP': lambda z, r, rnd: ['1 1 %040x' % rnd.getrandbits(160)],
+}
+
+DEFAULT_MIX = 'A=60,AAAA=20,CNAME=5,MX=5,SRV=5,TXT=5'
+
+
+def parse_mix(text):
+    """Parse RR type mix 'A=60,AAAA=20' to list of (type, weight)."""
+    mix = []
+    for item in text.split(','):
+        try:
+            rrtype, weight = item.split('=')
+            rrtype = rrtype.strip().upper()
+            weight = int(weight)
+        except ValueError:
+            raise argparse.ArgumentTypeError(
+                'invalid RR type mix item "%s"' % item)
+        if rrtype not in RR_VALUES:
+            raise argparse.ArgumentTypeError(
+                'unsupported RR type "%s", use one of %s'
+                % (rrtype, ', '.join(sorted(RR_VALUES))))
+        if weight < 0:
+            raise argparse.ArgumentTypeError(
+                'weight of "%s" cannot be negative' % rrtype)
+        mix.append((rrtype, weight))
+    if sum(weight for _, weight in mix) == 0:
+        raise argparse.ArgumentTypeError('RR type mix is empty')
+    return mix
+
+
+def pick_type(mix, rnd):
+    """Pick RR type from weighted mix."""
+    point = rnd.uniform(0, sum(weight for _, weight in mix))
+    for rrtype, weight in mix:
+        point -= weight
+        if point < 0:
+            return rrtype
+    return mix[-1][0]
+
+
+def entry(out, dn, attrs):
+    """Write one LDIF entry; attrs is list of (name, value)."""
+    out.write('dn: %s\n' % dn)
+    for name, value in attrs:
+        out.write('%s: %s\n' % (name, value))
+    out.write('\n')
+
+
+def zone_name(args, z):
+    return 'zone%d.%s' % (z, args.domain)
+
+
+def generate(args, out):
+    rnd = random.Random(args.seed)
+    base = args.base
+
+    entry(out, base, [('objectClass', args.container_class),
+                      ('objectClass', 'top'),
+                      ('cn', base.split(',')[0].split('=')[1].strip())])
+    if args.server_id:
+        entry(out, 'idnsServerId=%s, %s' % (args.server_id, base),
+              [('objectClass', 'idnsServerConfigObject'),
+               ('objectClass', 'top'),
+               ('idnsServerId', args.server_id),
+               ('idnsSubstitutionVariable;ipalocation', args.location)])
+
+    for z in range(args.zones):
+        zone = zone_name(args, z)
+        zone_dn = 'idnsName=%s., %s' % (zone, base)
+        attrs = [('objectClass', 'top'),
+                 ('objectClass', 'idnsZone'),
+                 ('objectClass', 'idnsRecord'),
+                 ('idnsName', '%s.' % zone),
+                 ('idnsZoneActive', 'TRUE'),
+                 ('idnsSOAmName', 'ns1.%s.' % zone),
+                 ('idnsSOArName', 'hostmaster.%s.' % zone),
+                 ('idnsSOAserial', '1'),
+                 ('idnsSOArefresh', '10800'),
+                 ('idnsSOAretry', '900'),
+                 ('idnsSOAexpire', '604800'),
+                 ('idnsSOAminimum', '86400'),
+                 ('NSRecord', 'ns1.%s.' % zone)]
+        if args.update_policy:
+            attrs.append(('idnsAllowDynUpdate', 'TRUE'))
+            attrs.append(('idnsUpdatePolicy', args.update_policy))
+        entry(out, zone_dn, attrs)
+        entry(out, 'idnsName=ns1, %s' % zone_dn,
+              [('objectClass', 'idnsRecord'),
+               ('objectClass', 'top'),
+               ('idnsName', 'ns1'),
+               ('ARecord', '10.255.%d.%d' % ((z // 256) % 256, z % 256))])
+
+        for r in range(args.records):
+            rrtype = pick_type(args.mix, rnd)
+            attrs = [('objectClass', 'idnsRecord'),
+                     ('objectClass', 'top'),
+                     ('idnsName', 'host%d' % r)]
+            attrs.extend(('%sRecord' % rrtype, value)
+                         for value in RR_VALUES[rrtype](z, r, rnd))
+            entry(out, 'idnsName=host%d, %s' % (r, zone_dn), attrs)
+
+        for t in range(args.templates):
+            entry(out, 'idnsName=tmpl%d, %s' % (t, zone_dn),
+                  [('objectClass', 'idnsTemplateObject'),
+                   ('objectClass', 'idnsRecord'),
+                   ('objectClass', 'top'),
+                   ('idnsName', 'tmpl%d' % t),
+                   ('idnsTemplateAttribute;CNAMERecord',
+                    'host%d.\\{substitutionvariable_ipalocation\\}' % t),
+                   ('CNAMERecord', 'ns1')])
+
+    for f in range(args.forward_zones):
+        entry(out, 'idnsName=fwd%d.%s., %s' % (f, args.domain, base),
+              [('objectClass', 'idnsForwardZone'),
+               ('objectClass', 'top'),
+               ('idnsName', 'fwd%d.%s.' % (f, args.domain)),
+               ('idnsZoneActive', 'TRUE'),
+               ('idnsForwardPolicy', 'only'),
+               ('idnsForwarders', '192.0.2.%d' % (f % 254 + 1))])
+
+
+def parser(add_help=True):
+    p = argparse.ArgumentParser(
+        description='Generate synthetic DNS tree in LDIF format.',
+        add_help=add_help)
+    p.add_argument('--base', default='cn=dns, dc=example, dc=com',
+                   help='DN of container with DNS objects '
+                        '(default: %(default)s)')
+    p.add_argument('--container-class', default='nsContainer',
+                   help='object class of the container, use '
+                        'organizationalRole for OpenLDAP '
+                        '(default: %(default)s)')
+    p.add_argument('--domain', default='bench.test',
+                   help='parent domain of generated zones '
+                        '(default: %(default)s)')
+    p.add_argument('--zones', type=int, default=10,
+                   help='number of master zones (default: %(default)s)')
+    p.add_argument('--records', type=int, default=100,
+                   help='number of records per zone (default: %(default)s)')
+    p.add_argument('--mix', type=parse_mix, default=parse_mix(DEFAULT_MIX),
+                   help='weighted RR type mix (default: %s)' % DEFAULT_MIX)
+    p.add_argument('--templates', type=int, default=0,
+                   help='number of record templates per zone, requires '
+                        '--server-id (default: %(default)s)')
+    p.add_argument('--forward-zones', type=int, default=0,
+                   help='number of forward zones (default: %(default)s)')
+    p.add_argument('--server-id', default='',
+                   help='generate idnsServerConfigObject with this '
+                        'idnsServerId')
+    p.add_argument('--location', default='bench',
+                   help='value of substitution variable ipalocation '
+                        '(default: %(default)s)')
+    p.add_argument('--update-policy', default='',
+                   help='idnsUpdatePolicy for all zones; dynamic updates '
+                        'are disabled if empty')
+    p.add_argument('--seed', type=int, default=0,
+                   help='seed for random choices (default: %(default)s)')
+    return p
+
+
+def main():
+    args = parser().parse_args()
+    if args.templates > 0 and not args.server_id:
+        parser().error('--templates requires --server-id')
+    generate(args, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,495 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+#
+
+"""
+End-to-end load test of bind-dyndb-ldap against throwaway local slapd.
+
+Steps:
+- Generate synthetic DNS tree using ldifgen.py.
+- Load it using slapadd into new slapd database with syncprov overlay
+  and start slapd on loopback.
+- Start named with the plug-in built in this tree and measure time until
+  the plug-in reports that initial synchronization is finished.
+- Send dynamic updates using nsupdate and measure their throughput;
+  every update is written to LDAP by ldap_modify_do().
+- Modify records using ldapmodify and measure latency until the change
+  is visible in DNS answers.
+
+Everything runs in a temporary directory which is removed at the end
+unless --keep is specified. OpenLDAP (slapd, slapadd, ldapmodify) and BIND
+(named, nsupdate) binaries have to be installed; paths can be overridden
+on command line.
+
+Usage:
+- loadtest.py --zones 100 --records 1000
+- loadtest.py --zones 10 --records 10000 --updates 5000 --ddns-clients 4
+- loadtest.py --arg "sync_refresh_sessions 4" --arg "stats_interval 10"
+"""
+
+import argparse
+import base64
+import logging
+import os
+import random
+import re
+import shutil
+import signal
+import socket
+import struct
+import subprocess
+import tempfile
+import threading
+import time
+
+import ldifgen
+
+logging.basicConfig(level=logging.INFO,
+                    format='%(asctime)s %(name)s: %(message)s')
+log = logging.getLogger('loadtest')
+
+SRCDIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SUFFIX = 'dc=example,dc=com'
+ROOTDN = 'cn=Manager,%s' % SUFFIX
+ROOTPW = 'bench'
+INSTANCE = 'bench'
+TSIG_NAME = 'bench'
+
+# logged by the plug-in when sync_finished state is reached
+SYNC_FINISHED_RE = re.compile(r"master zones from LDAP instance '%s' loaded"
+                              % INSTANCE)
+
+SLAPD_CONF = """\
+include %(schema_dir)s/core.schema
+include %(workdir)s/dyndb.schema
+pidfile %(workdir)s/slapd.pid
+%(modules)s
+database %(backend)s
+suffix "%(suffix)s"
+rootdn "%(rootdn)s"
+rootpw %(rootpw)s
+directory %(workdir)s/slapd-db
+maxsize 10737418240
+index objectClass,entryCSN,entryUUID eq
+overlay syncprov
+"""
+
+NAMED_CONF = """\
+options {
+	directory "%(named_dir)s";
+	pid-file "%(named_dir)s/named.pid";
+	listen-on port %(dns_port)d { 127.0.0.1; };
+	listen-on-v6 { none; };
+	recursion no;
+	notify no;
+};
+
+controls { };
+
+key "%(tsig_name)s" {
+	algorithm hmac-sha256;
+	secret "%(tsig_secret)s";
+};
+
+dynamic-db "%(instance)s" {
+	library "%(plugin)s";
+	arg "uri ldap://127.0.0.1:%(ldap_port)d";
+	arg "base %(base)s";
+	arg "auth_method simple";
+	arg "bind_dn %(rootdn)s";
+	arg "password %(rootpw)s";
+%(extra_args)s};
+"""
+
+
+class Process(object):
+    """
+    Child process with output collected by background thread.
+    Each output line is stored together with time when it was read.
+    """
+    def __init__(self, name, cmd):
+        self.name = name
+        self.lines = []
+        self.cond = threading.Condition()
+        log.debug('starting %s: %s', name, ' '.join(cmd))
+        self.start = time.time()
+        self.proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT,
+                                     universal_newlines=True)
+        self.thread = threading.Thread(target=self._reader)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def _reader(self):
+        for line in iter(self.proc.stdout.readline, ''):
+            with self.cond:
+                self.lines.append((time.time(), line.rstrip('\n')))
+                self.cond.notify_all()
+        with self.cond:
+            self.cond.notify_all()
+
+    def wait_for(self, regex, timeout):
+        """Return time when a line matching regex was printed."""
+        deadline = time.time() + timeout
+        seen = 0
+        with self.cond:
+            while True:
+                for stamp, line in self.lines[seen:]:
+                    if regex.search(line):
+                        return stamp
+                seen = len(self.lines)
+                if self.proc.poll() is not None:
+                    raise RuntimeError('%s exited with code %s:\n%s'
+                                       % (self.name, self.proc.returncode,
+                                          self.tail()))
+                remains = deadline - time.time()
+                if remains <= 0:
+                    raise RuntimeError('%s did not print "%s" in %d s:\n%s'
+                                       % (self.name, regex.pattern,
+                                          timeout, self.tail()))
+                self.cond.wait(min(remains, 1))
+
+    def tail(self, count=20):
+        with self.cond:
+            return '\n'.join(line for _, line in self.lines[-count:])
+
+    def stop(self):
+        if self.proc.poll() is None:
+            self.proc.send_signal(signal.SIGTERM)
+            for _ in range(300):
+                if self.proc.poll() is not None:
+                    break
+                time.sleep(0.1)
+            else:
+                log.warning('%s did not stop, killing it', self.name)
+                self.proc.kill()
+                self.proc.wait()
+        self.thread.join(5)
+
+
+def convert_schema(src, dst):
+    """Convert doc/schema.ldif to slapd.conf schema format.
+    The file contains also excerpt from COSINE schema with DNS attributes
+    so cosine.schema must not be included."""
+    items = []
+    with open(src) as fsrc:
+        for line in fsrc:
+            line = line.rstrip('\n')
+            if line.startswith(' ') and items:
+                items[-1] += line
+            elif line.startswith('attributeTypes:'):
+                items.append('attributetype' + line[len('attributeTypes:'):])
+            elif line.startswith('objectClasses:'):
+                items.append('objectclass' + line[len('objectClasses:'):])
+    with open(dst, 'w') as fdst:
+        fdst.write('\n\n'.join(items) + '\n')
+
+
+def wait_for_port(port, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        try:
+            sock.connect(('127.0.0.1', port))
+            return
+        except socket.error:
+            time.sleep(0.05)
+        finally:
+            sock.close()
+    raise RuntimeError('nothing is listening on port %d' % port)
+
+
+def dns_query_a(name, port, timeout=1.0):
+    """Send DNS query for A records and return list of addresses."""
+    qid = random.randint(0, 0xffff)
+    query = struct.pack('>HHHHHH', qid, 0, 1, 0, 0, 0)
+    for label in name.rstrip('.').split('.'):
+        query += struct.pack('B', len(label)) + label.encode('ascii')
+    query += b'\0' + struct.pack('>HH', 1, 1)
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(timeout)
+    try:
+        sock.sendto(query, ('127.0.0.1', port))
+        answer = sock.recv(4096)
+    except socket.timeout:
+        return []
+    finally:
+        sock.close()
+
+    rid, _, qdcount, ancount = struct.unpack('>HHHH', answer[:8])
+    if rid != qid:
+        return []
+    pos = 12
+
+    def skip_name(pos):
+        while True:
+            length = struct.unpack('B', answer[pos:pos + 1])[0]
+            if length >= 0xc0:
+                return pos + 2
+            pos += 1 + length
+            if length == 0:
+                return pos
+
+    for _ in range(qdcount):
+        pos = skip_name(pos) + 4
+    addresses = []
+    for _ in range(ancount):
+        pos = skip_name(pos)
+        rrtype, _, _, rdlength = struct.unpack('>HHIH', answer[pos:pos + 10])
+        pos += 10
+        if rrtype == 1 and rdlength == 4:
+            addresses.append(socket.inet_ntoa(answer[pos:pos + 4]))
+        pos += rdlength
+    return addresses
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * pct / 100.0))]
+
+
+class LoadTest(object):
+    def __init__(self, args):
+        self.args = args
+        self.workdir = args.workdir or tempfile.mkdtemp(prefix='dyndb-bench-')
+        self.named_dir = os.path.join(self.workdir, 'named')
+        self.tsig_secret = base64.b64encode(os.urandom(32)).decode('ascii')
+        self.slapd = None
+        self.named = None
+        self.entries = 0
+        self.results = []
+
+    def result(self, fmt, *args):
+        msg = fmt % args
+        log.info('%s', msg)
+        self.results.append(msg)
+
+    def prepare(self):
+        args = self.args
+        for path in ['slapd-db', 'named',
+                     os.path.join('named', 'dyndb-ldap', INSTANCE)]:
+            os.makedirs(os.path.join(self.workdir, path))
+        log.info('working directory: %s', self.workdir)
+
+        convert_schema(os.path.join(SRCDIR, 'doc', 'schema.ldif'),
+                       os.path.join(self.workdir, 'dyndb.schema'))
+        modules = ''
+        if args.slapd_modulepath:
+            modules = ('modulepath %s\nmoduleload back_%s\n'
+                       'moduleload syncprov\n'
+                       % (args.slapd_modulepath, args.slapd_backend))
+        with open(os.path.join(self.workdir, 'slapd.conf'), 'w') as fconf:
+            fconf.write(SLAPD_CONF % dict(
+                schema_dir=args.schema_dir, workdir=self.workdir,
+                modules=modules, backend=args.slapd_backend,
+                suffix=SUFFIX, rootdn=ROOTDN, rootpw=ROOTPW))
+
+        extra_args = ''
+        if args.server_id:
+            extra_args += '\targ "server_id %s";\n' % args.server_id
+        for arg in args.arg:
+            extra_args += '\targ "%s";\n' % arg
+        with open(os.path.join(self.workdir, 'named.conf'), 'w') as fconf:
+            fconf.write(NAMED_CONF % dict(
+                named_dir=self.named_dir, dns_port=args.dns_port,
+                tsig_name=TSIG_NAME, tsig_secret=self.tsig_secret,
+                instance=INSTANCE, plugin=os.path.abspath(args.plugin),
+                ldap_port=args.ldap_port, base=args.base,
+                rootdn=ROOTDN, rootpw=ROOTPW, extra_args=extra_args))
+
+    def load_ldap(self):
+        args = self.args
+        ldif = os.path.join(self.workdir, 'data.ldif')
+        with open(ldif, 'w') as fldif:
+            ldifgen.entry(fldif, SUFFIX, [('objectClass', 'dcObject'),
+                                          ('objectClass', 'organization'),
+                                          ('dc', 'example'),
+                                          ('o', 'bind-dyndb-ldap bench')])
+            ldifgen.generate(args, fldif)
+            # target of latency measurement
+            ldifgen.entry(fldif, self.latency_dn(),
+                          [('objectClass', 'idnsRecord'),
+                           ('objectClass', 'top'),
+                           ('idnsName', 'latency'),
+                           ('ARecord', '10.254.255.255')])
+        with open(ldif) as fldif:
+            entries = sum(1 for line in fldif if line.startswith('dn: '))
+
+        start = time.time()
+        subprocess.check_call([args.slapadd, '-q', '-f',
+                               os.path.join(self.workdir, 'slapd.conf'),
+                               '-l', ldif])
+        self.result('slapadd: %d entries loaded in %.1f s',
+                    entries, time.time() - start)
+        self.entries = entries
+
+        self.slapd = Process('slapd', [
+            args.slapd, '-d', '0', '-f',
+            os.path.join(self.workdir, 'slapd.conf'),
+            '-h', 'ldap://127.0.0.1:%d/' % args.ldap_port])
+        wait_for_port(args.ldap_port, args.timeout)
+
+    def start_named(self):
+        args = self.args
+        self.named = Process('named', [
+            args.named, '-g', '-c', os.path.join(self.workdir, 'named.conf')])
+        finished = self.named.wait_for(SYNC_FINISHED_RE, args.timeout)
+        elapsed = finished - self.named.start
+        self.result('initial synchronization: %d entries in %.2f s '
+                    '(%.0f entries/s)', self.entries, elapsed,
+                    self.entries / max(elapsed, 1e-6))
+
+    def latency_dn(self):
+        return 'idnsName=latency, idnsName=%s., %s' % (
+            ldifgen.zone_name(self.args, 0), self.args.base)
+
+    def ddns_throughput(self):
+        args = self.args
+        if args.updates == 0:
+            return
+        scripts = []
+        clients = max(1, min(args.ddns_clients, args.updates))
+        for client in range(clients):
+            lines = ['server 127.0.0.1 %d' % args.dns_port]
+            for i in range(client, args.updates, clients):
+                zone = ldifgen.zone_name(args, i % args.zones)
+                lines.append('zone %s.' % zone)
+                lines.append('update add ddns%d.%s. 300 IN A 10.%d.%d.%d'
+                             % (i, zone, 128 + (i >> 16) % 128,
+                                (i >> 8) % 256, i % 256))
+                lines.append('send')
+            scripts.append('\n'.join(lines) + '\n')
+
+        start = time.time()
+        procs = [subprocess.Popen([args.nsupdate, '-y', 'hmac-sha256:%s:%s'
+                                   % (TSIG_NAME, self.tsig_secret)],
+                                  stdin=subprocess.PIPE,
+                                  universal_newlines=True)
+                 for _ in scripts]
+        for proc, script in zip(procs, scripts):
+            proc.stdin.write(script)
+            proc.stdin.close()
+        failed = sum(1 for proc in procs if proc.wait() != 0)
+        elapsed = time.time() - start
+        # nsupdate does not tell which updates failed so the throughput
+        # would be meaningless
+        if failed:
+            raise RuntimeError('%d of %d nsupdate clients failed'
+                               % (failed, clients))
+        self.result('dynamic updates: %d updates from %d clients '
+                    'in %.2f s (%.0f updates/s)', args.updates, clients,
+                    elapsed, args.updates / max(elapsed, 1e-6))
+
+    def modify_latency(self):
+        args = self.args
+        if args.latency_samples == 0:
+            return
+        name = 'latency.%s.' % ldifgen.zone_name(args, 0)
+        samples = []
+        for i in range(args.latency_samples):
+            address = '10.254.%d.%d' % ((i >> 8) % 256, i % 256)
+            change = ('dn: %s\nchangetype: modify\nreplace: ARecord\n'
+                      'ARecord: %s\n' % (self.latency_dn(), address))
+            start = time.time()
+            proc = subprocess.Popen([args.ldapmodify, '-x', '-H',
+                                     'ldap://127.0.0.1:%d' % args.ldap_port,
+                                     '-D', ROOTDN, '-w', ROOTPW],
+                                    stdin=subprocess.PIPE,
+                                    stdout=subprocess.PIPE,
+                                    universal_newlines=True)
+            proc.communicate(change)
+            if proc.returncode != 0:
+                raise RuntimeError('ldapmodify failed with code %d'
+                                   % proc.returncode)
+            while dns_query_a(name, args.dns_port) != [address]:
+                if time.time() - start > args.timeout:
+                    raise RuntimeError('change of %s is not visible in DNS'
+                                       % name)
+                time.sleep(0.001)
+            samples.append((time.time() - start) * 1000)
+        self.result('LDAP modify -> DNS latency (%d samples, includes '
+                    'ldapmodify process start-up and LDAP bind): '
+                    'min %.1f ms, median %.1f ms, '
+                    '95th percentile %.1f ms, max %.1f ms', len(samples),
+                    min(samples), percentile(samples, 50),
+                    percentile(samples, 95), max(samples))
+
+    def run(self):
+        try:
+            self.prepare()
+            self.load_ldap()
+            self.start_named()
+            self.ddns_throughput()
+            self.modify_latency()
+        finally:
+            if self.named is not None:
+                self.named.stop()
+            if self.slapd is not None:
+                self.slapd.stop()
+            if self.args.keep:
+                log.info('working directory kept: %s', self.workdir)
+            else:
+                shutil.rmtree(self.workdir, ignore_errors=True)
+        print('\n'.join(self.results))
+
+
+def parser():
+    p = argparse.ArgumentParser(
+        description='End-to-end load test of bind-dyndb-ldap.',
+        parents=[ldifgen.parser(add_help=False)])
+    p.add_argument('--plugin',
+                   default=os.path.join(SRCDIR, 'src', '.libs', 'ldap.so'),
+                   help='plug-in to test (default: %(default)s)')
+    p.add_argument('--arg', action='append', default=[],
+                   help='additional dynamic-db argument, '
+                        'e.g. "stats_interval 10"; can be repeated')
+    p.add_argument('--updates', type=int, default=1000,
+                   help='number of dynamic updates (default: %(default)s)')
+    p.add_argument('--ddns-clients', type=int, default=1,
+                   help='number of parallel nsupdate clients '
+                        '(default: %(default)s)')
+    p.add_argument('--latency-samples', type=int, default=100,
+                   help='number of LDAP modifications for latency '
+                        'measurement (default: %(default)s)')
+    p.add_argument('--ldap-port', type=int, default=3890,
+                   help='(default: %(default)s)')
+    p.add_argument('--dns-port', type=int, default=5300,
+                   help='(default: %(default)s)')
+    p.add_argument('--timeout', type=int, default=3600,
+                   help='limit for each step in seconds '
+                        '(default: %(default)s)')
+    p.add_argument('--workdir',
+                   help='use this empty directory instead of temporary one')
+    p.add_argument('--keep', action='store_true',
+                   help='do not remove working directory')
+    p.add_argument('--schema-dir', default='/etc/openldap/schema',
+                   help='directory with core.schema; DNS attributes from '
+                        'COSINE are included in doc/schema.ldif '
+                        '(default: %(default)s)')
+    p.add_argument('--slapd-backend', default='mdb',
+                   help='(default: %(default)s)')
+    p.add_argument('--slapd-modulepath',
+                   help='load slapd backend and syncprov overlay as '
+                        'modules from this directory')
+    for tool in ['slapd', 'slapadd', 'ldapmodify', 'named', 'nsupdate']:
+        p.add_argument('--%s' % tool, default=tool,
+                       help='path to %s (default: %%(default)s)' % tool)
+    p.set_defaults(container_class='organizationalRole',
+                   update_policy='grant %s zonesub ANY;' % TSIG_NAME)
+    return p
+
+
+def main():
+    args = parser().parse_args()
+    if args.zones < 1:
+        parser().error('at least one zone is required')
+    if args.templates > 0 and not args.server_id:
+        args.server_id = INSTANCE
+    LoadTest(args).run()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#include <isc/buffer.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/rwlock.h>
+#include <isc/util.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+
+#include <ldap.h>
+
+#include <string.h>
+#include <strings.h>
+
+#include "dn_cache.h"
+#include "ldap_convert.h"
+#include "log.h"
+
+/**
+ * Cache for conversions between LDAP DNs and DNS names.
+ *
+ * DN of a record entry consists of the leading idnsName RDN and DN of the
+ * zone entry (suffix). The suffix cache maps zone DN strings (as received
+ * from LDAP) to zone names so a record DN can be converted by parsing
+ * only the leading RDN. Only suffixes from successful conversions of
+ * record DNs are stored so a cache hit gives the same result as the full
+ * parser in dn_to_dnsname().
+ *
+ * The owner cache maps owner names to the "idnsName=<relative name>, "
+ * prefix of their DN. The prefix depends only on owner name and the number
+ * of labels in zone name so zone DN from zone register is appended
+ * on each lookup.
+ *
+ * Both caches are direct-mapped tables with bounded size. Colliding
+ * entries replace each other, a miss falls back to the full conversion.
+ */
+
+#define DN_CACHE_SUFFIXES	1024
+#define DN_CACHE_OWNERS		4096
+
+typedef struct dn_suffix {
+	isc_uint32_t	hash;
+	char		*suffix;
+	dns_name_t	origin;
+} dn_suffix_t;
+
+typedef struct dn_owner {
+	isc_uint32_t	hash;
+	unsigned int	zone_labels;
+	dns_name_t	owner;
+	char		*prefix;
+} dn_owner_t;
+
+struct dn_cache {
+	isc_mem_t	*mctx;
+	isc_rwlock_t	suffix_lock;
+	dn_suffix_t	suffixes[DN_CACHE_SUFFIXES];
+	isc_mutex_t	owner_lock;
+	dn_owner_t	owners[DN_CACHE_OWNERS];
+};
+
+/**
+ * FNV-1a hash of NUL terminated string. DN suffixes are compared
+ * case-sensitively so the origin is always derived from identical text.
+ */
+static isc_uint32_t ATTR_NONNULLS ATTR_CHECKRESULT
+dn_cache_strhash(const char *str) {
+	isc_uint32_t hash = 2166136261U;
+
+	for (; *str != '\0'; str++) {
+		hash ^= (unsigned char)*str;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+isc_result_t
+dn_cache_create(isc_mem_t *mctx, dn_cache_t **cachep)
+{
+	isc_result_t result;
+	dn_cache_t *cache = NULL;
+	isc_boolean_t suffix_lock_ready = ISC_FALSE;
+	unsigned int i;
+
+	REQUIRE(cachep != NULL && *cachep == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, cache);
+	ZERO_PTR(cache);
+	isc_mem_attach(mctx, &cache->mctx);
+	for (i = 0; i < DN_CACHE_SUFFIXES; i++)
+		dns_name_init(&cache->suffixes[i].origin, NULL);
+	for (i = 0; i < DN_CACHE_OWNERS; i++)
+		dns_name_init(&cache->owners[i].owner, NULL);
+
+	CHECK(isc_rwlock_init(&cache->suffix_lock, 0, 0));
+	suffix_lock_ready = ISC_TRUE;
+	CHECK(isc_mutex_init(&cache->owner_lock));
+
+	*cachep = cache;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (cache != NULL) {
+		if (suffix_lock_ready == ISC_TRUE)
+			isc_rwlock_destroy(&cache->suffix_lock);
+		MEM_PUT_AND_DETACH(cache);
+	}
+	return result;
+}
+
+static void ATTR_NONNULLS
+dn_suffix_clear(isc_mem_t *mctx, dn_suffix_t *slot) {
+	if (slot->suffix != NULL)
+		isc_mem_free(mctx, slot->suffix);
+	slot->suffix = NULL;
+	if (dns_name_dynamic(&slot->origin)) {
+		dns_name_free(&slot->origin, mctx);
+		dns_name_init(&slot->origin, NULL);
+	}
+}
+
+static void ATTR_NONNULLS
+dn_owner_clear(isc_mem_t *mctx, dn_owner_t *slot) {
+	if (slot->prefix != NULL)
+		isc_mem_free(mctx, slot->prefix);
+	slot->prefix = NULL;
+	if (dns_name_dynamic(&slot->owner)) {
+		dns_name_free(&slot->owner, mctx);
+		dns_name_init(&slot->owner, NULL);
+	}
+}
+
+void
+dn_cache_destroy(dn_cache_t **cachep)
+{
+	dn_cache_t *cache;
+	unsigned int i;
+
+	REQUIRE(cachep != NULL);
+
+	cache = *cachep;
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < DN_CACHE_SUFFIXES; i++)
+		dn_suffix_clear(cache->mctx, &cache->suffixes[i]);
+	for (i = 0; i < DN_CACHE_OWNERS; i++)
+		dn_owner_clear(cache->mctx, &cache->owners[i]);
+	isc_rwlock_destroy(&cache->suffix_lock);
+	DESTROYLOCK(&cache->owner_lock);
+	MEM_PUT_AND_DETACH(cache);
+	*cachep = NULL;
+}
+
+/**
+ * Copy zone name cached for given DN suffix to origin.
+ *
+ * @retval ISC_TRUE if the suffix was found in cache.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+dn_suffix_find(dn_cache_t *cache, const char *suffix, isc_uint32_t hash,
+	       dns_name_t *origin) {
+	dn_suffix_t *slot = &cache->suffixes[hash % DN_CACHE_SUFFIXES];
+	isc_boolean_t found = ISC_FALSE;
+
+	RWLOCK(&cache->suffix_lock, isc_rwlocktype_read);
+	if (slot->suffix != NULL && slot->hash == hash
+	    && strcmp(slot->suffix, suffix) == 0)
+		found = ISC_TF(dns_name_copy(&slot->origin, origin, NULL)
+			       == ISC_R_SUCCESS);
+	RWUNLOCK(&cache->suffix_lock, isc_rwlocktype_read);
+
+	return found;
+}
+
+/**
+ * Remember zone name for given DN suffix. Failures are ignored,
+ * the suffix will be parsed again next time.
+ */
+static void ATTR_NONNULLS
+dn_suffix_add(dn_cache_t *cache, const char *suffix, isc_uint32_t hash,
+	      dns_name_t *origin) {
+	dn_suffix_t *slot = &cache->suffixes[hash % DN_CACHE_SUFFIXES];
+
+	RWLOCK(&cache->suffix_lock, isc_rwlocktype_write);
+	dn_suffix_clear(cache->mctx, slot);
+	if (dns_name_dupwithoffsets(origin, cache->mctx, &slot->origin)
+	    == ISC_R_SUCCESS) {
+		slot->suffix = isc_mem_strdup(cache->mctx, suffix);
+		slot->hash = hash;
+		if (slot->suffix == NULL)
+			dn_suffix_clear(cache->mctx, slot);
+	}
+	RWUNLOCK(&cache->suffix_lock, isc_rwlocktype_write);
+}
+
+/**
+ * Convert LDAP DN to absolute DNS names. Semantics of all parameters
+ * is the same as for dn_to_dnsname().
+ *
+ * Record DNs with known zone suffix are converted by parsing only
+ * the leading RDN. All other DNs and all errors are handled
+ * by dn_to_dnsname().
+ */
+isc_result_t
+dn_cache_dnsname(dn_cache_t *cache, isc_mem_t *mctx, const char *dn,
+		 dns_name_t *target, dns_name_t *otarget, isc_boolean_t *iszone)
+{
+	isc_result_t result;
+	LDAPRDN rdn = NULL;
+	LDAPAVA *attr;
+	char *next = NULL;
+	const char *suffix = NULL;
+	isc_uint32_t hash = 0;
+	isc_buffer_t name_buf;
+	dns_fixedname_t fname;
+	dns_fixedname_t forigin;
+	dns_name_t *name;
+	dns_name_t *origin;
+	dns_name_t slow_origin;
+	isc_boolean_t zone;
+
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	dns_fixedname_init(&forigin);
+	origin = dns_fixedname_name(&forigin);
+	dns_name_init(&slow_origin, NULL);
+
+	if (ldap_str2rdn(dn, &rdn, &next, LDAP_DN_FORMAT_LDAPV3)
+	    != LDAP_SUCCESS || rdn == NULL || next == NULL)
+		goto slow;
+
+	attr = rdn[0];
+	if (attr == NULL || rdn[1] != NULL
+	    || (attr->la_flags & LDAP_AVA_STRING) == 0
+	    || attr->la_attr.bv_len != sizeof("idnsName") - 1
+	    || strncasecmp("idnsName", attr->la_attr.bv_val,
+			   attr->la_attr.bv_len) != 0)
+		goto slow;
+
+	for (suffix = next; *suffix == ',' || *suffix == ' '; suffix++)
+		;
+	if (*suffix == '\0') {
+		suffix = NULL;
+		goto slow;
+	}
+
+	hash = dn_cache_strhash(suffix);
+	if (dn_suffix_find(cache, suffix, hash, origin) == ISC_FALSE)
+		goto slow;
+
+	isc_buffer_init(&name_buf, attr->la_value.bv_val,
+			attr->la_value.bv_len);
+	isc_buffer_add(&name_buf, attr->la_value.bv_len);
+	if (dns_name_fromtext(name, &name_buf, origin, 0, NULL)
+	    != ISC_R_SUCCESS
+	    || dns_name_issubdomain(name, origin) == ISC_FALSE
+	    || dns_name_equal(name, origin) == ISC_TRUE)
+		/* let the full parser report the error */
+		goto slow;
+
+	ldap_rdnfree(rdn);
+	rdn = NULL;
+
+	CHECK(dns_name_dupwithoffsets(name, mctx, target));
+	if (otarget != NULL) {
+		result = dns_name_dupwithoffsets(origin, mctx, otarget);
+		if (result != ISC_R_SUCCESS) {
+			dns_name_free(target, mctx);
+			goto cleanup;
+		}
+	}
+	if (iszone != NULL)
+		*iszone = ISC_FALSE;
+	return ISC_R_SUCCESS;
+
+slow:
+	CHECK(dn_to_dnsname(mctx, dn, target, &slow_origin, &zone));
+	if (otarget != NULL) {
+		result = dns_name_dupwithoffsets(&slow_origin, mctx, otarget);
+		if (result != ISC_R_SUCCESS) {
+			dns_name_free(target, mctx);
+			goto cleanup;
+		}
+	}
+	if (iszone != NULL)
+		*iszone = zone;
+	if (zone == ISC_FALSE && suffix != NULL)
+		dn_suffix_add(cache, suffix, hash, &slow_origin);
+
+cleanup:
+	if (rdn != NULL)
+		ldap_rdnfree(rdn);
+	if (dns_name_dynamic(&slow_origin))
+		dns_name_free(&slow_origin, mctx);
+	return result;
+}
+
+/**
+ * Convert owner name to LDAP DN. The relative part of the DN
+ * is cached, zone_dn is appended to it.
+ *
+ * @param[in] zone_dn DN of the zone entry, e.g. from zone register.
+ */
+isc_result_t
+dn_cache_ownerdn(dn_cache_t *cache, dns_name_t *owner, dns_name_t *zone,
+		 const char *zone_dn, ld_string_t *target)
+{
+	isc_result_t result;
+	dn_owner_t *slot;
+	isc_uint32_t hash;
+	unsigned int zone_labels;
+	isc_boolean_t found = ISC_FALSE;
+
+	/* owner outside of zone would break the cache key */
+	if (dns_name_issubdomain(owner, zone) == ISC_FALSE)
+		return dnsname_zone_to_dn(cache->mctx, owner, zone, zone_dn,
+					  target);
+
+	zone_labels = dns_name_countlabels(zone);
+	hash = dns_name_hash(owner, ISC_TRUE) ^ (zone_labels * 2654435761U);
+	slot = &cache->owners[hash % DN_CACHE_OWNERS];
+
+	str_clear(target);
+	LOCK(&cache->owner_lock);
+	if (slot->prefix != NULL && slot->hash == hash
+	    && slot->zone_labels == zone_labels
+	    && dns_name_caseequal(&slot->owner, owner) == ISC_TRUE) {
+		result = str_cat_char(target, slot->prefix);
+		found = ISC_TRUE;
+	}
+	UNLOCK(&cache->owner_lock);
+
+	if (found == ISC_TRUE) {
+		CHECK(result);
+	} else {
+		/* empty zone DN gives only "idnsName=<relative name>, " */
+		CHECK(dnsname_zone_to_dn(cache->mctx, owner, zone, "",
+					 target));
+		LOCK(&cache->owner_lock);
+		dn_owner_clear(cache->mctx, slot);
+		if (dns_name_dupwithoffsets(owner, cache->mctx, &slot->owner)
+		    == ISC_R_SUCCESS) {
+			slot->prefix = isc_mem_strdup(cache->mctx,
+						      str_buf(target));
+			slot->hash = hash;
+			slot->zone_labels = zone_labels;
+			if (slot->prefix == NULL)
+				dn_owner_clear(cache->mctx, slot);
+		}
+		UNLOCK(&cache->owner_lock);
+	}
+	CHECK(str_cat_char(target, zone_dn));
+
+cleanup:
+	return result;
+}
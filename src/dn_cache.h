@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_DN_CACHE_H_
+#define SRC_DN_CACHE_H_
+
+#include <isc/types.h>
+
+#include <dns/types.h>
+
+#include "str.h"
+#include "util.h"
+
+typedef struct dn_cache dn_cache_t;
+
+isc_result_t
+dn_cache_create(isc_mem_t *mctx, dn_cache_t **cachep) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+dn_cache_destroy(dn_cache_t **cachep) ATTR_NONNULLS;
+
+isc_result_t
+dn_cache_dnsname(dn_cache_t *cache, isc_mem_t *mctx, const char *dn,
+		 dns_name_t *target, dns_name_t *origin, isc_boolean_t *iszone)
+		 ATTR_NONNULL(1, 2, 3, 4) ATTR_CHECKRESULT;
+
+isc_result_t
+dn_cache_ownerdn(dn_cache_t *cache, dns_name_t *owner, dns_name_t *zone,
+		 const char *zone_dn, ld_string_t *target)
+		 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+#endif /* SRC_DN_CACHE_H_ */
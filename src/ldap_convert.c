@@ -5,6 +5,7 @@
 #include <isc/buffer.h>
 #include <isc/hex.h>
 #include <isc/mem.h>
+#include <isc/once.h>
 #include <isc/util.h>
 #include <isc/string.h>
 
@@ -16,6 +17,7 @@
 #define LDAP_DEPRECATED 1
 #include <ldap.h>
 
+#include <arpa/inet.h>
 #include <errno.h>
 #include <strings.h>
 #include <ctype.h>
@@ -24,7 +26,6 @@
 #include "ldap_convert.h"
 #include "log.h"
 #include "util.h"
-#include "zone_register.h"
 
 /**
  * Convert LDAP DN to absolute DNS names.
@@ -309,13 +310,17 @@ cleanup:
 	return result;
 }
 
+/**
+ * Convert DNS name to LDAP DN using DN of the zone the name belongs to.
+ * Caller is responsible for keeping zone_dn valid during the call,
+ * e.g. by holding zone handle from zr_get_zone_handle().
+ */
 isc_result_t
-dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
-	      ld_string_t *target)
+dnsname_zone_to_dn(isc_mem_t *mctx, dns_name_t *name, dns_name_t *zone,
+		   const char *zone_dn, ld_string_t *target)
 {
 	isc_result_t result;
 	int label_count;
-	const char *zone_dn = NULL;
 	char *dns_str = NULL;
 	char *escaped_name = NULL;
 	int dummy;
@@ -323,17 +328,12 @@ dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
 	unsigned int common_labels;
 	dns_namereln_t namereln;
 
-
-	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
+	REQUIRE(zone_dn != NULL);
 	REQUIRE(target != NULL);
 
-	isc_mem_t * mctx = zr_get_mctx(zr);
 	str_clear(target);
 
-	/* Find the DN of the zone we belong to. */
-	CHECK(zr_get_zone_dn(zr, zone, &zone_dn));
-
 	namereln = dns_name_fullcompare(name, zone, &dummy, &common_labels);
 	if (namereln != dns_namereln_equal) {
 		label_count = dns_name_countlabels(name) - common_labels;
@@ -345,10 +345,6 @@ dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
 		CHECK(dns_to_ldap_dn_escape(mctx, dns_str, &escaped_name));
 		CHECK(str_cat_char(target, "idnsName="));
 		CHECK(str_cat_char(target, escaped_name));
-		/* 
-		 * Modification of following line can affect modify_ldap_common().
-		 * See line with: char *zone_dn = strstr(str_buf(owner_dn),", ") + 1;  
-		 */
 		CHECK(str_cat_char(target, ", "));
 	}
 	CHECK(str_cat_char(target, zone_dn));
@@ -361,9 +357,115 @@ cleanup:
 	return result;
 }
 
+/**
+ * Attribute names for all RR types known to BIND, e.g. "ARecord".
+ * The table is filled once and then it is only read. Hash tables
+ * use open addressing and hold index into rdtype_attrs + 1, 0 = empty slot.
+ */
+#define RDTYPE_ATTR_MAX		256
+#define RDTYPE_ATTR_HASH_SIZE	1024
+
+typedef struct rdtype_attr {
+	dns_rdatatype_t	rdtype;
+	char		name[LDAP_ATTR_FORMATSIZE];
+} rdtype_attr_t;
+
+static isc_once_t rdtype_attr_once = ISC_ONCE_INIT;
+static rdtype_attr_t rdtype_attrs[RDTYPE_ATTR_MAX];
+static unsigned short rdtype_attr_byname[RDTYPE_ATTR_HASH_SIZE];
+static unsigned short rdtype_attr_bytype[RDTYPE_ATTR_HASH_SIZE];
+
+static inline unsigned int
+rdtype_attr_hash(const char *name) {
+	unsigned int h = 2166136261U; /* FNV-1a, case-insensitive */
+
+	while (*name != '\0') {
+		h ^= (unsigned char)tolower((unsigned char)*name++);
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void
+rdtype_attr_init(void) {
+	char rdtype_str[DNS_RDATATYPE_FORMATSIZE];
+	rdtype_attr_t *attr;
+	unsigned int count = 0;
+	unsigned int rdtype;
+	unsigned int slot;
+	int len;
+
+	for (rdtype = 1; rdtype <= 0xFFFF; rdtype++) {
+		if ((dns_rdatatype_attributes(rdtype)
+		     & DNS_RDATATYPEATTR_UNKNOWN) != 0)
+			continue;
+		INSIST(count < RDTYPE_ATTR_MAX);
+		attr = &rdtype_attrs[count];
+		dns_rdatatype_format(rdtype, rdtype_str, sizeof(rdtype_str));
+		len = snprintf(attr->name, sizeof(attr->name), "%s%s",
+			       rdtype_str, LDAP_RDATATYPE_SUFFIX);
+		if (len < 0 || (unsigned int)len >= sizeof(attr->name))
+			continue;
+		attr->rdtype = rdtype;
+		count++;
+
+		for (slot = rdtype_attr_hash(attr->name);
+		     rdtype_attr_byname[slot % RDTYPE_ATTR_HASH_SIZE] != 0;
+		     slot++)
+			;
+		rdtype_attr_byname[slot % RDTYPE_ATTR_HASH_SIZE] = count;
+		for (slot = rdtype;
+		     rdtype_attr_bytype[slot % RDTYPE_ATTR_HASH_SIZE] != 0;
+		     slot++)
+			;
+		rdtype_attr_bytype[slot % RDTYPE_ATTR_HASH_SIZE] = count;
+	}
+}
+
+static const rdtype_attr_t * ATTR_NONNULLS ATTR_CHECKRESULT
+rdtype_attr_find_name(const char *name) {
+	const rdtype_attr_t *attr;
+	unsigned int slot;
+	unsigned int idx;
+
+	RUNTIME_CHECK(isc_once_do(&rdtype_attr_once, rdtype_attr_init)
+		      == ISC_R_SUCCESS);
+
+	for (slot = rdtype_attr_hash(name);
+	     (idx = rdtype_attr_byname[slot % RDTYPE_ATTR_HASH_SIZE]) != 0;
+	     slot++) {
+		attr = &rdtype_attrs[idx - 1];
+		if (strcasecmp(attr->name, name) == 0)
+			return attr;
+	}
+	return NULL;
+}
+
+static const rdtype_attr_t * ATTR_CHECKRESULT
+rdtype_attr_find_type(dns_rdatatype_t rdtype) {
+	const rdtype_attr_t *attr;
+	unsigned int slot;
+	unsigned int idx;
+
+	RUNTIME_CHECK(isc_once_do(&rdtype_attr_once, rdtype_attr_init)
+		      == ISC_R_SUCCESS);
+
+	for (slot = rdtype;
+	     (idx = rdtype_attr_bytype[slot % RDTYPE_ATTR_HASH_SIZE]) != 0;
+	     slot++) {
+		attr = &rdtype_attrs[idx - 1];
+		if (attr->rdtype == rdtype)
+			return attr;
+	}
+	return NULL;
+}
+
 /**
  * Convert attribute name to dns_rdatatype.
  *
+ * Names of known RR types are found in precomputed table, generic names
+ * like "TYPE65280Record" and "UnknownRecord;TYPE65280" are parsed.
+ *
  * @param[in]  ldap_attribute String with attribute name terminated by \0.
  * @param[out] rdtype
  */
@@ -373,6 +475,13 @@ ldap_attribute_to_rdatatype(const char *ldap_attribute, dns_rdatatype_t *rdtype)
 	isc_result_t result;
 	unsigned len;
 	isc_consttextregion_t region;
+	const rdtype_attr_t *attr;
+
+	attr = rdtype_attr_find_name(ldap_attribute);
+	if (attr != NULL) {
+		*rdtype = attr->rdtype;
+		return ISC_R_SUCCESS;
+	}
 
 	len = strlen(ldap_attribute);
 	if (len <= LDAP_RDATATYPE_SUFFIX_LEN)
@@ -415,6 +524,10 @@ rdatatype_to_ldap_attribute(dns_rdatatype_t rdtype, char *target,
 {
 	isc_result_t result;
 	char rdtype_str[DNS_RDATATYPE_FORMATSIZE];
+	const rdtype_attr_t *attr;
+
+	if (!unknown && (attr = rdtype_attr_find_type(rdtype)) != NULL)
+		return isc_string_copy(target, size, attr->name);
 
 	if (unknown) {
 		/* "UnknownRecord;TYPE65333" */
@@ -457,3 +570,231 @@ rdata_to_generic(dns_rdata_t *rdata, isc_buffer_t *target)
 cleanup:
 	return result;
 }
+
+/** Maximal number of fields in values handled by rdata_fromtext_fast(). */
+#define FAST_MAXFIELDS 4
+
+/**
+ * Split value into fields separated by blanks.
+ *
+ * Values containing characters which have special meaning for isc_lex
+ * (quotes, parentheses, comments and escapes) or control characters
+ * are rejected.
+ *
+ * @retval ISC_R_SUCCESS     Exactly 'count' fields were found.
+ * @retval ISC_R_UNEXPECTED  Value has to be parsed by dns_rdata_fromtext().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+fast_split(const isc_consttextregion_t *text, isc_textregion_t *fields,
+	   unsigned int count) {
+	const char *p = text->base;
+	const char *end = text->base + text->length;
+	unsigned int found = 0;
+
+	for (;;) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (p == end)
+			break;
+		if (found == count)
+			return ISC_R_UNEXPECTED;
+		fields[found].base = (char *)p;
+		while (p < end && *p != ' ' && *p != '\t') {
+			if ((unsigned char)*p < 0x20 || *p == 0x7f ||
+			    strchr("\"();\\", *p))
+				return ISC_R_UNEXPECTED;
+			p++;
+		}
+		fields[found].length = p - fields[found].base;
+		found++;
+	}
+
+	return (found == count) ? ISC_R_SUCCESS : ISC_R_UNEXPECTED;
+}
+
+/**
+ * Parse decimal 16-bit number in the same way as isc_lex does.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+fast_uint16(isc_textregion_t *field, isc_buffer_t *target) {
+	isc_uint32_t value = 0;
+	unsigned int i;
+
+	for (i = 0; i < field->length; i++) {
+		if (!isdigit((unsigned char)field->base[i]))
+			return ISC_R_UNEXPECTED;
+		value = value * 10 + (field->base[i] - '0');
+		if (value > 0xffff)
+			return ISC_R_UNEXPECTED;
+	}
+	if (isc_buffer_availablelength(target) < 2)
+		return ISC_R_NOSPACE;
+	isc_buffer_putuint16(target, (isc_uint16_t)value);
+
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Convert domain name to uncompressed wire format, relative names
+ * are completed by origin.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+fast_name(isc_textregion_t *field, dns_name_t *origin, isc_buffer_t *target) {
+	dns_name_t name;
+	isc_buffer_t source;
+
+	dns_name_init(&name, NULL);
+	isc_buffer_init(&source, field->base, field->length);
+	isc_buffer_add(&source, field->length);
+
+	return dns_name_fromtext(&name, &source, origin, 0, target);
+}
+
+/**
+ * Convert IPv4 or IPv6 address to wire format.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+fast_address(isc_textregion_t *field, int af, isc_buffer_t *target) {
+	char text[INET6_ADDRSTRLEN];
+	unsigned char addr[sizeof(struct in6_addr)];
+	unsigned int length;
+
+	length = (af == AF_INET) ? sizeof(struct in_addr)
+				 : sizeof(struct in6_addr);
+	if (field->length >= sizeof(text))
+		return ISC_R_UNEXPECTED;
+	memcpy(text, field->base, field->length);
+	text[field->length] = '\0';
+	if (inet_pton(af, text, addr) != 1)
+		return ISC_R_UNEXPECTED;
+	if (isc_buffer_availablelength(target) < length)
+		return ISC_R_NOSPACE;
+	isc_buffer_putmem(target, addr, length);
+
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Convert TXT value consisting of simple tokens and quoted strings
+ * without escape sequences to wire format.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+fast_txt(const isc_consttextregion_t *text, isc_buffer_t *target) {
+	const char *p = text->base;
+	const char *end = text->base + text->length;
+	const char *start;
+	unsigned int length;
+	unsigned int strings = 0;
+	isc_boolean_t quoted;
+
+	for (;;) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (p == end)
+			break;
+		quoted = ISC_TF(*p == '"');
+		if (quoted == ISC_TRUE)
+			p++;
+		start = p;
+		while (p < end && (quoted == ISC_TRUE
+				      ? *p != '"'
+				      : (*p != ' ' && *p != '\t'))) {
+			if ((unsigned char)*p < 0x20 || *p == 0x7f ||
+			    *p == '\\' ||
+			    (quoted == ISC_FALSE && strchr("\"();", *p)))
+				return ISC_R_UNEXPECTED;
+			p++;
+		}
+		length = p - start;
+		if (quoted == ISC_TRUE) {
+			if (p == end)
+				return ISC_R_UNEXPECTED;
+			p++;
+			/* string has to be followed by separator */
+			if (p < end && *p != ' ' && *p != '\t')
+				return ISC_R_UNEXPECTED;
+		}
+		if (length > 255)
+			return ISC_R_UNEXPECTED;
+		if (isc_buffer_availablelength(target) < length + 1)
+			return ISC_R_NOSPACE;
+		isc_buffer_putuint8(target, (isc_uint8_t)length);
+		isc_buffer_putmem(target, (const unsigned char *)start, length);
+		strings++;
+	}
+
+	return (strings > 0) ? ISC_R_SUCCESS : ISC_R_UNEXPECTED;
+}
+
+/**
+ * Convert text representation of the most common record types directly
+ * to wire format without going through isc_lex and dns_rdata_fromtext().
+ * Supported types are A, AAAA, CNAME, NS, PTR, MX, SRV and TXT in class IN.
+ *
+ * Only values which are parsed by dns_rdata_fromtext() to the same
+ * wire format are accepted. Everything else (escape sequences, comments,
+ * parentheses etc.) has to be handled by dns_rdata_fromtext().
+ *
+ * @param[in]  origin  Origin for relative names or NULL for root.
+ * @param[in]  text    Value which does not need to be NUL-terminated.
+ * @param[out] target  Buffer for rdata in wire format. It is not modified
+ *                     if the conversion failed.
+ *
+ * @retval ISC_R_SUCCESS        Value was converted.
+ * @retval ISC_R_NOTIMPLEMENTED Type or class is not supported.
+ * @retval others               Value has to be parsed by dns_rdata_fromtext().
+ */
+isc_result_t
+rdata_fromtext_fast(dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+		    dns_name_t *origin, const isc_consttextregion_t *text,
+		    isc_buffer_t *target)
+{
+	isc_result_t result;
+	isc_textregion_t fields[FAST_MAXFIELDS];
+	unsigned int used;
+
+	if (rdclass != dns_rdataclass_in)
+		return ISC_R_NOTIMPLEMENTED;
+	if (origin == NULL)
+		origin = dns_rootname;
+
+	used = isc_buffer_usedlength(target);
+	switch (rdtype) {
+	case dns_rdatatype_a:
+		CHECK(fast_split(text, fields, 1));
+		CHECK(fast_address(&fields[0], AF_INET, target));
+		break;
+	case dns_rdatatype_aaaa:
+		CHECK(fast_split(text, fields, 1));
+		CHECK(fast_address(&fields[0], AF_INET6, target));
+		break;
+	case dns_rdatatype_cname:
+	case dns_rdatatype_ns:
+	case dns_rdatatype_ptr:
+		CHECK(fast_split(text, fields, 1));
+		CHECK(fast_name(&fields[0], origin, target));
+		break;
+	case dns_rdatatype_mx:
+		CHECK(fast_split(text, fields, 2));
+		CHECK(fast_uint16(&fields[0], target));
+		CHECK(fast_name(&fields[1], origin, target));
+		break;
+	case dns_rdatatype_srv:
+		CHECK(fast_split(text, fields, 4));
+		CHECK(fast_uint16(&fields[0], target));
+		CHECK(fast_uint16(&fields[1], target));
+		CHECK(fast_uint16(&fields[2], target));
+		CHECK(fast_name(&fields[3], origin, target));
+		break;
+	case dns_rdatatype_txt:
+		CHECK(fast_txt(text, target));
+		break;
+	default:
+		CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+	}
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		isc_buffer_subtract(target, isc_buffer_usedlength(target) - used);
+	return result;
+}
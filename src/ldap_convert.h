@@ -33,8 +33,9 @@ isc_result_t dn_want_zone(const char * const prefix, const char * const dn,
 			  isc_boolean_t dniszone, isc_boolean_t classiszone)
 			  ATTR_NONNULLS ATTR_CHECKRESULT;
 
-isc_result_t dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
-			   ld_string_t *target) ATTR_NONNULLS ATTR_CHECKRESULT;
+isc_result_t dnsname_zone_to_dn(isc_mem_t *mctx, dns_name_t *name,
+				dns_name_t *zone, const char *zone_dn,
+				ld_string_t *target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t ldap_attribute_to_rdatatype(const char *ldap_record,
 				      dns_rdatatype_t *rdtype) ATTR_NONNULLS ATTR_CHECKRESULT;
@@ -51,4 +52,9 @@ rdata_to_generic(dns_rdata_t *rdata, isc_buffer_t *target)
 isc_result_t dn_to_text(const char *dn, ld_string_t *target,
 			ld_string_t *origin) ATTR_NONNULL(1, 2) ATTR_CHECKRESULT;
 
+isc_result_t
+rdata_fromtext_fast(dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+		    dns_name_t *origin, const isc_consttextregion_t *text,
+		    isc_buffer_t *target) ATTR_NONNULL(4, 5) ATTR_CHECKRESULT;
+
 #endif /* !_LD_LDAP_CONVERT_H_ */
@@ -48,6 +48,12 @@
 #define VALID_LDAPDB(ldapdb) \
 	((ldapdb) != NULL && (ldapdb)->common.impmagic == LDAPDB_MAGIC)
 
+typedef struct ldapdb_owner ldapdb_owner_t;
+struct ldapdb_owner {
+	dns_fixedname_t			name;
+	LINK(ldapdb_owner_t)		link;
+};
+
 struct ldapdb {
 	dns_db_t			common;
 	isc_refcount_t			refs;
@@ -74,6 +80,23 @@ struct ldapdb {
 	 * The purpose is to detect moment when the new version is closed.
 	 * That is the right time for unlocking newversion_lock. */
 	dns_dbversion_t			*newversion;
+
+	/**
+	 * Names modified in newversion. Changes are written to LDAP
+	 * when SOA serial is incremented in newversion or when newversion
+	 * is committed. Protected by newversion_lock. */
+	LIST(ldapdb_owner_t)		owners;
+
+	/**
+	 * Changes in newversion were already written to LDAP by
+	 * ldapdb_owners_flush(), all subsequent changes in the same version
+	 * are written to LDAP immediately. Protected by newversion_lock. */
+	isc_boolean_t			owners_written;
+
+	/**
+	 * Changes received from LDAP which were applied to RBTDB
+	 * but were not written to zone journal yet. */
+	zone_batch_t			*batch;
 };
 
 dns_db_t * ATTR_NONNULLS
@@ -85,6 +108,119 @@ ldapdb_get_rbtdb(dns_db_t *db) {
 	return ldapdb->rbtdb;
 }
 
+zone_batch_t * ATTR_NONNULLS
+ldapdb_get_batch(dns_db_t *db) {
+	ldapdb_t *ldapdb = (ldapdb_t *)db;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	return ldapdb->batch;
+}
+
+/**
+ * Remember that a name was modified in ldapdb->newversion.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldapdb_owner_add(ldapdb_t *ldapdb, dns_name_t *name) {
+	isc_result_t result;
+	ldapdb_owner_t *owner;
+
+	for (owner = HEAD(ldapdb->owners);
+	     owner != NULL;
+	     owner = NEXT(owner, link)) {
+		if (dns_name_equal(dns_fixedname_name(&owner->name), name))
+			return ISC_R_SUCCESS;
+	}
+
+	CHECKED_MEM_GET_PTR(ldapdb->common.mctx, owner);
+	ZERO_PTR(owner);
+	dns_fixedname_init(&owner->name);
+	INIT_LINK(owner, link);
+	result = dns_name_copy(name, dns_fixedname_name(&owner->name), NULL);
+	if (result != ISC_R_SUCCESS) {
+		SAFE_MEM_PUT_PTR(ldapdb->common.mctx, owner);
+		goto cleanup;
+	}
+	APPEND(ldapdb->owners, owner, link);
+
+cleanup:
+	return result;
+}
+
+static void ATTR_NONNULLS
+ldapdb_owners_free(ldapdb_t *ldapdb) {
+	ldapdb_owner_t *owner;
+
+	while ((owner = HEAD(ldapdb->owners)) != NULL) {
+		UNLINK(ldapdb->owners, owner, link);
+		SAFE_MEM_PUT_PTR(ldapdb->common.mctx, owner);
+	}
+}
+
+/**
+ * Write all changes made in ldapdb->newversion to LDAP.
+ * All changes of one name are sent to LDAP as one modify operation.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldapdb_owners_write(ldapdb_t *ldapdb, dns_dbversion_t *newver) {
+	isc_result_t result;
+	isc_mem_t *mctx = ldapdb->common.mctx;
+	dns_dbversion_t *oldver = NULL;
+	dns_name_t **names = NULL;
+	ldapdb_owner_t *owner;
+	unsigned int count = 0;
+	unsigned int i;
+
+	for (owner = HEAD(ldapdb->owners);
+	     owner != NULL;
+	     owner = NEXT(owner, link))
+		count++;
+	if (count == 0)
+		return ISC_R_SUCCESS;
+
+	CHECKED_MEM_GET(mctx, names, count * sizeof(dns_name_t *));
+	for (owner = HEAD(ldapdb->owners), i = 0;
+	     owner != NULL;
+	     owner = NEXT(owner, link), i++)
+		names[i] = dns_fixedname_name(&owner->name);
+
+	dns_db_currentversion(ldapdb->rbtdb, &oldver);
+	result = write_version_to_ldap(ldapdb->ldap_inst,
+				       dns_db_origin(ldapdb->rbtdb),
+				       ldapdb->rbtdb, oldver, newver,
+				       names, count);
+	dns_db_closeversion(ldapdb->rbtdb, &oldver, ISC_FALSE);
+
+cleanup:
+	if (names != NULL)
+		isc_mem_put(mctx, names, count * sizeof(dns_name_t *));
+	return result;
+}
+
+/**
+ * Write all changes made in ldapdb->newversion so far to LDAP.
+ *
+ * DNS UPDATE increments SOA serial after all changes from the update
+ * message and before the journal is written and the version is committed,
+ * so a failure returned from here still rejects the whole update.
+ *
+ * @warning BIND can still reject the update after the SOA serial
+ *          increment, e.g. in check_mx(), add_signing_records(),
+ *          add_nsec3param_records() or dns_update_signatures().
+ *          The version is rolled back in that case but LDAP already
+ *          holds the changes and SyncRepl brings them back to DNS.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldapdb_owners_flush(ldapdb_t *ldapdb, dns_dbversion_t *newver) {
+	isc_result_t result;
+
+	result = ldapdb_owners_write(ldapdb, newver);
+	ldapdb_owners_free(ldapdb);
+	ldapdb->owners_written = ISC_TRUE;
+
+	return result;
+}
+
 /**
  * Get full DNS name from the node.
  *
@@ -148,6 +284,7 @@ cleanup:
 	}
 	str_destroy(&file_name);
 #endif
+	zone_batch_destroy(&ldapdb->batch);
 	dns_db_detach(&ldapdb->rbtdb);
 	dns_name_free(&ldapdb->common.origin, ldapdb->common.mctx);
 	RUNTIME_CHECK(isc_mutex_destroy(&ldapdb->newversion_lock)
@@ -332,9 +469,33 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit)
 {
 	ldapdb_t *ldapdb = (ldapdb_t *)db;
 	dns_dbversion_t *closed_version = *versionp;
+	isc_result_t result;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
 	REQUIRE(VALID_LDAPDB(ldapdb));
 
+	if (closed_version == ldapdb->newversion) {
+		/* Rolled back changes were never written to LDAP.
+		 * Changes which were not flushed by SOA serial increment
+		 * are written now. The version must not be rolled back
+		 * if LDAP refuses them because the caller might have written
+		 * it to the zone journal already, so the instance is
+		 * tainted and the next resynchronization repairs it. */
+		if (commit == ISC_TRUE) {
+			result = ldapdb_owners_write(ldapdb, closed_version);
+			if (result != ISC_R_SUCCESS) {
+				dns_name_format(dns_db_origin(ldapdb->rbtdb),
+						zone_name, DNS_NAME_FORMATSIZE);
+				log_error_r("zone '%s': unable to write "
+					    "changes to LDAP, DNS and LDAP "
+					    "differ until the next "
+					    "resynchronization", zone_name);
+				ldap_instance_taint(ldapdb->ldap_inst);
+			}
+		}
+		ldapdb_owners_free(ldapdb);
+		ldapdb->owners_written = ISC_FALSE;
+	}
 	dns_db_closeversion(ldapdb->rbtdb, versionp, commit);
 	if (closed_version == ldapdb->newversion) {
 		ldapdb->newversion = NULL;
@@ -485,6 +646,17 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 				  rdataset, options, addedrdataset));
 
 	CHECK(ldapdb_name_fromnode(node, dns_fixedname_name(&fname)));
+	if (version == ldapdb->newversion &&
+	    ldapdb->owners_written == ISC_FALSE) {
+		/* Written to LDAP together with SOA serial increment.
+		 * This depends on the call order in BIND's DNS UPDATE code
+		 * which adds the new SOA after all changes from the update
+		 * message and before the journal is written. */
+		CHECK(ldapdb_owner_add(ldapdb, dns_fixedname_name(&fname)));
+		if (rdataset->type == dns_rdatatype_soa)
+			CHECK(ldapdb_owners_flush(ldapdb, version));
+		goto cleanup;
+	}
 	result = dns_rdatalist_fromrdataset(rdataset, &rdlist);
 	INSIST(result == ISC_R_SUCCESS);
 	CHECK(write_to_ldap(dns_fixedname_name(&fname), zname, ldapdb->ldap_inst, rdlist));
@@ -561,6 +733,13 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		goto cleanup;
 
 	substract_result = result;
+	if (version == ldapdb->newversion &&
+	    ldapdb->owners_written == ISC_FALSE) {
+		/* Written to LDAP together with SOA serial increment. */
+		CHECK(ldapdb_name_fromnode(node, dns_fixedname_name(&fname)));
+		CHECK(ldapdb_owner_add(ldapdb, dns_fixedname_name(&fname)));
+		goto cleanup;
+	}
 	/* TODO: Could it create some race-condition? What about unprocessed
 	 * changes in synrepl queue? */
 	if (substract_result == DNS_R_NXRRSET) {
@@ -604,10 +783,17 @@ deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup;
 
+	CHECK(ldapdb_name_fromnode(node, dns_fixedname_name(&fname)));
+	if (version == ldapdb->newversion &&
+	    ldapdb->owners_written == ISC_FALSE) {
+		/* Written to LDAP together with SOA serial increment. */
+		CHECK(ldapdb_owner_add(ldapdb, dns_fixedname_name(&fname)));
+		goto cleanup;
+	}
+
 	/* TODO: Could it create some race-condition? What about unprocessed
 	 * changes in synrepl queue? */
 	CHECK(node_isempty(ldapdb->rbtdb, node, version, 0, &empty_node));
-	CHECK(ldapdb_name_fromnode(node, dns_fixedname_name(&fname)));
 
 	if (empty_node == ISC_TRUE) {
 		CHECK(remove_entry_from_ldap(dns_fixedname_name(&fname), zname,
@@ -1043,6 +1229,7 @@ ldapdb_create(isc_mem_t *mctx, dns_name_t *name, dns_dbtype_t type,
 
 	CHECKED_MEM_GET_PTR(mctx, ldapdb);
 	ZERO_PTR(ldapdb);
+	INIT_LIST(ldapdb->owners);
 
 	isc_mem_attach(mctx, &ldapdb->common.mctx);
 	CHECK(isc_mutex_init(&ldapdb->newversion_lock));
@@ -1064,6 +1251,7 @@ ldapdb_create(isc_mem_t *mctx, dns_name_t *name, dns_dbtype_t type,
 
 	CHECK(dns_db_create(mctx, "rbt", name, dns_dbtype_zone,
 			    dns_rdataclass_in, 0, NULL, &ldapdb->rbtdb));
+	CHECK(zone_batch_create(mctx, &ldapdb->batch));
 
 	*dbp = (dns_db_t *)ldapdb;
 
@@ -1076,6 +1264,8 @@ cleanup:
 				      == ISC_R_SUCCESS);
 		if (dns_name_dynamic(&ldapdb->common.origin))
 			dns_name_free(&ldapdb->common.origin, mctx);
+		if (ldapdb->rbtdb != NULL)
+			dns_db_detach(&ldapdb->rbtdb);
 
 		isc_mem_putanddetach(&ldapdb->common.mctx, ldapdb,
 				     sizeof(*ldapdb));
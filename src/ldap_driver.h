@@ -9,6 +9,7 @@
 #include <dns/types.h>
 
 #include "util.h"
+#include "zone_batch.h"
 
 /* values shared by all LDAP database instances */
 #define LDAP_DB_TYPE		dns_dbtype_zone
@@ -25,4 +26,7 @@ ldapdb_create(isc_mem_t *mctx, dns_name_t *name, dns_dbtype_t type,
 dns_db_t *
 ldapdb_get_rbtdb(dns_db_t *db) ATTR_NONNULLS;
 
+zone_batch_t *
+ldapdb_get_batch(dns_db_t *db) ATTR_NONNULLS;
+
 #endif /* LDAP_DRIVER_H_ */
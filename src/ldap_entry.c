@@ -7,6 +7,7 @@
 #include <dns/ttl.h>
 #include <dns/types.h>
 
+#include <isc/mutex.h>
 #include <isc/region.h>
 #include <isc/types.h>
 #include <isc/util.h>
@@ -17,7 +18,6 @@
 #include "ldap_convert.h"
 #include "ldap_entry.h"
 #include "mldap.h"
-#include "metadb.h"
 #include "str.h"
 #include "util.h"
 #include "zone_register.h"
@@ -31,71 +31,146 @@
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 ldap_entry_parseclass(ldap_entry_t *entry, ldap_entryclass_t *class);
 
-/* Represents values associated with LDAP attribute */
-static void ATTR_NONNULLS
-ldap_valuelist_destroy(isc_mem_t *mctx, ldap_valuelist_t *values)
-{
-	ldap_value_t *value, *next;
-
-	value = HEAD(*values);
-	while (value != NULL) {
-		next = NEXT(value, link);
-		UNLINK(*values, value, link);
-		SAFE_MEM_PUT_PTR(mctx, value);
-		value = next;
+struct ldap_arena_chunk {
+	ldap_arena_chunk_t	*next;
+	size_t			size; /* including this header */
+};
+
+/* The first chunk is small enough for entries reconstructed from metaLDAP
+ * which contain only UUID. Each subsequent chunk is twice as big
+ * up to the maximum so typical record entry needs two or three chunks. */
+#define LDAP_ARENA_CHUNK_MIN	256
+#define LDAP_ARENA_CHUNK_MAX	4096
+#define LDAP_ARENA_ALIGN(size) \
+	(((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define LDAP_ARENA_HEADER	LDAP_ARENA_ALIGN(sizeof(ldap_arena_chunk_t))
+
+/**
+ * Allocate memory which lives as long as the entry itself. There is no way
+ * to free the memory separately, all chunks are released
+ * by ldap_entry_destroy().
+ *
+ * @retval NULL if memory allocation failed
+ */
+static void * ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_entry_alloc(ldap_entry_t *entry, size_t size) {
+	ldap_arena_chunk_t *chunk;
+	size_t chunk_size;
+	void *ptr;
+
+	size = LDAP_ARENA_ALIGN(size);
+	if (size > entry->arena_left) {
+		chunk_size = ISC_MAX(entry->arena_chunk_size,
+				     LDAP_ARENA_HEADER + size);
+		chunk = isc_mem_get(entry->mctx, chunk_size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->size = chunk_size;
+		chunk->next = entry->arena_chunks;
+		entry->arena_chunks = chunk;
+		entry->arena_next = (unsigned char *)chunk + LDAP_ARENA_HEADER;
+		entry->arena_left = chunk_size - LDAP_ARENA_HEADER;
+		entry->arena_chunk_size = ISC_MIN(2 * chunk_size,
+						  LDAP_ARENA_CHUNK_MAX);
 	}
+
+	ptr = entry->arena_next;
+	entry->arena_next += size;
+	entry->arena_left -= size;
+	entry->arena_used += size;
+	return ptr;
 }
 
-static void ATTR_NONNULLS
-ldap_attributelist_destroy(isc_mem_t *mctx, ldap_attributelist_t *attrlist)
-{
-        ldap_attribute_t *attr, *next;
-
-        attr = HEAD(*attrlist);
-        while (attr != NULL) {
-                next = NEXT(attr, link);
-                UNLINK(*attrlist, attr, link);
-		ldap_valuelist_destroy(mctx, &attr->values);
-                ldap_value_free(attr->ldap_values);
-                ldap_memfree(attr->name);
-                SAFE_MEM_PUT_PTR(mctx, attr);
-                attr = next;
-        }
+/**
+ * Copy value of the berval to the entry arena and NUL-terminate it.
+ * Source does not need to be NUL-terminated.
+ *
+ * @param[in] extra Number of bytes to reserve in front of the string.
+ *                  The returned pointer points to the reserved space.
+ */
+static void * ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_entry_dupstr(ldap_entry_t *entry, const struct berval *src,
+		  size_t extra, char **strp) {
+	unsigned char *base;
+
+	extra = LDAP_ARENA_ALIGN(extra);
+	base = ldap_entry_alloc(entry, extra + src->bv_len + 1);
+	if (base == NULL)
+		return NULL;
+	*strp = (char *)base + extra;
+	memcpy(*strp, src->bv_val, src->bv_len);
+	(*strp)[src->bv_len] = '\0';
+
+	return base;
+}
+
+/**
+ * Copy berval including its value to the entry arena.
+ */
+static struct berval * ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_entry_dupbv(ldap_entry_t *entry, const struct berval *src) {
+	struct berval *dst;
+	char *val;
+
+	dst = ldap_entry_dupstr(entry, src, sizeof(*dst), &val);
+	if (dst == NULL)
+		return NULL;
+	dst->bv_len = src->bv_len;
+	dst->bv_val = val;
+
+	return dst;
 }
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_attr_create(isc_mem_t *mctx, LDAP *ld, LDAPMessage *ldap_entry,
-		 ldap_attribute_t *attr)
+ldap_attr_addvalue(ldap_entry_t *entry, ldap_attribute_t *attr,
+		   const struct berval *value)
 {
-	isc_result_t result;
-	char **values;
 	ldap_value_t *val;
+	char *val_str;
 
-	REQUIRE(ld != NULL);
-	REQUIRE(ldap_entry != NULL);
-	REQUIRE(attr != NULL);
+	val = ldap_entry_dupstr(entry, value, sizeof(*val), &val_str);
+	if (val == NULL)
+		return ISC_R_NOMEMORY;
+	val->value = val_str;
+	val->length = value->bv_len;
+	INIT_LINK(val, link);
 
-	values = ldap_get_values(ld, ldap_entry, attr->name);
-	/* TODO: proper ldap error handling */
-	if (values == NULL)
-		return ISC_R_FAILURE;
+	APPEND(attr->values, val, link);
+	return ISC_R_SUCCESS;
+}
 
-	attr->ldap_values = values;
+/**
+ * Create attribute with values decoded by ldap_get_attribute_ber().
+ * The name and values point to BER buffer inside LDAPMessage
+ * which is freed sooner than the entry, so this is the only place
+ * where they are copied.
+ */
+static isc_result_t ATTR_NONNULL(1,2,4) ATTR_CHECKRESULT
+ldap_attr_create(ldap_entry_t *entry, const struct berval *name,
+		 const struct berval *values, ldap_attribute_t **attrp)
+{
+	isc_result_t result;
+	ldap_attribute_t *attr;
+	char *name_str;
 
-	for (unsigned int i = 0; values[i] != NULL; i++) {
-		CHECKED_MEM_GET_PTR(mctx, val);
-		val->value = values[i];
-		INIT_LINK(val, link);
+	attr = ldap_entry_dupstr(entry, name, sizeof(*attr), &name_str);
+	if (attr == NULL)
+		return ISC_R_NOMEMORY;
+	attr->name = name_str;
+	attr->lastval = NULL;
+	INIT_LIST(attr->values);
+	INIT_LINK(attr, link);
+	attr->rdtype_cached = ISC_FALSE;
 
-		APPEND(attr->values, val, link);
-	}
+	for (unsigned int i = 0;
+	     values != NULL && values[i].bv_val != NULL;
+	     i++)
+		CHECK(ldap_attr_addvalue(entry, attr, &values[i]));
 
+	*attrp = attr;
 	return ISC_R_SUCCESS;
 
 cleanup:
-	ldap_valuelist_destroy(mctx, &attr->values);
-	ldap_value_free(values);
-
 	return result;
 }
 
@@ -118,16 +193,12 @@ ldap_entry_init(isc_mem_t *mctx, ldap_entry_t **entryp) {
 	INIT_LINK(entry, link);
 	INIT_BUFFERED_NAME(entry->fqdn);
 	INIT_BUFFERED_NAME(entry->zone_name);
-
-	CHECKED_MEM_GET(mctx, entry->rdata_target_mem, DNS_RDATA_MAXLENGTH);
-	CHECK(isc_lex_create(mctx, TOKENSIZ, &entry->lex));
+	entry->arena_chunk_size = LDAP_ARENA_CHUNK_MIN;
 
 	*entryp = entry;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	if (result != ISC_R_SUCCESS)
-		ldap_entry_destroy(&entry);
-
 	return result;
 }
 
@@ -147,7 +218,7 @@ ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 	isc_result_t result;
 	ldap_entry_t *entry = NULL;
 	ld_string_t *str = NULL;
-	metadb_node_t *node = NULL;
+	mldap_node_t *node = NULL;
 
 	CHECK(str_new(mctx, &str));
 	result = mldap_entry_read(mldap, uuid, &node);
@@ -158,7 +229,7 @@ ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 	}
 	CHECK(ldap_entry_init(mctx, &entry));
 
-	entry->uuid = ber_dupbv(NULL, uuid);
+	entry->uuid = ldap_entry_dupbv(entry, uuid);
 	if (entry->uuid == NULL)
 		CLEANUP_WITH(ISC_R_NOMEMORY);
 
@@ -172,54 +243,58 @@ ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 cleanup:
 	if (result != ISC_R_SUCCESS)
 		ldap_entry_destroy(&entry);
-	metadb_node_close(&node);
+	mldap_node_close(&node);
 	str_destroy(&str);
 	return result;
 }
 
 /**
- * Allocate new ldap_entry and fill it with data from LDAPMessage.
+ * Set DN of an entry created by ldap_entry_init().
  */
 isc_result_t
-ldap_entry_parse(isc_mem_t *mctx, LDAP *ld, LDAPMessage *ldap_entry,
-		  struct berval	*uuid, ldap_entry_t **entryp)
-{
+ldap_entry_setdn(ldap_entry_t *entry, const struct berval *dn) {
+	REQUIRE(entry->dn == NULL);
+
+	if (ldap_entry_dupstr(entry, dn, 0, &entry->dn) == NULL)
+		return ISC_R_NOMEMORY;
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Append attribute to an entry.
+ *
+ * @param[in] values Array of values terminated by value with NULL bv_val,
+ *                   NULL for attribute without values.
+ */
+isc_result_t
+ldap_entry_addattr(ldap_entry_t *entry, const struct berval *name,
+		   const struct berval *values) {
 	isc_result_t result;
 	ldap_attribute_t *attr = NULL;
-	char *attribute;
-	BerElement *ber = NULL;
-	ldap_entry_t *entry = NULL;
-	isc_boolean_t has_zone_dn;
-	isc_boolean_t has_zone_class;
 
-	REQUIRE(ld != NULL);
-	REQUIRE(ldap_entry != NULL);
-	REQUIRE(entryp != NULL);
-	REQUIRE(*entryp == NULL);
+	CHECK(ldap_attr_create(entry, name, values, &attr));
+	APPEND(entry->attrs, attr, link);
 
-	CHECK(ldap_entry_init(mctx, &entry));
-
-	for (attribute = ldap_first_attribute(ld, ldap_entry, &ber);
-	     attribute != NULL;
-	     attribute = ldap_next_attribute(ld, ldap_entry, ber)) {
-		CHECKED_MEM_GET_PTR(mctx, attr);
-		ZERO_PTR(attr);
+cleanup:
+	return result;
+}
 
-		attr->name = attribute;
-		INIT_LIST(attr->values);
-		INIT_LINK(attr, link);
-		CHECK(ldap_attr_create(mctx, ld, ldap_entry, attr));
+/**
+ * Fill UUID, object class and DNS names of an entry with DN
+ * and attributes already set.
+ */
+isc_result_t
+ldap_entry_complete(ldap_entry_t *entry, dn_cache_t *dncache,
+		    struct berval *uuid) {
+	isc_result_t result;
+	isc_boolean_t has_zone_dn;
+	isc_boolean_t has_zone_class;
 
-		APPEND(entry->attrs, attr, link);
-	}
-	attr = NULL;
+	REQUIRE(entry->dn != NULL);
 
-	entry->dn = ldap_get_dn(ld, ldap_entry);
-	if (entry->dn == NULL) {
-		log_ldap_error(ld, "unable to get entry DN");
-		CLEANUP_WITH(ISC_R_FAILURE);
-	}
-	entry->uuid = ber_dupbv(NULL, uuid);
+	entry->uuid = ldap_entry_dupbv(entry, uuid);
+	if (entry->uuid == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
 	CHECK(ldap_entry_parseclass(entry, &entry->class));
 	if ((entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0
 	    && (entry->class
@@ -231,26 +306,139 @@ ldap_entry_parse(isc_mem_t *mctx, LDAP *ld, LDAPMessage *ldap_entry,
 	if ((entry->class &
 	    (LDAP_ENTRYCLASS_MASTER | LDAP_ENTRYCLASS_FORWARD
 	     | LDAP_ENTRYCLASS_RR)) != 0)
-		CHECK(dn_to_dnsname(mctx, entry->dn, &entry->fqdn,
-				    &entry->zone_name, &has_zone_dn));
+		CHECK(dn_cache_dnsname(dncache, entry->mctx, entry->dn,
+				       &entry->fqdn, &entry->zone_name,
+				       &has_zone_dn));
 	else
 		has_zone_dn = ISC_FALSE;
 	has_zone_class = ISC_TF(entry->class & (LDAP_ENTRYCLASS_MASTER
 						| LDAP_ENTRYCLASS_FORWARD));
 	CHECK(dn_want_zone(__func__, entry->dn, has_zone_dn, has_zone_class));
 
+cleanup:
+	return result;
+}
+
+/**
+ * Allocate new ldap_entry and fill it with data from LDAPMessage.
+ */
+isc_result_t
+ldap_entry_parse(isc_mem_t *mctx, dn_cache_t *dncache, LDAP *ld,
+		 LDAPMessage *ldap_entry, struct berval *uuid,
+		 ldap_entry_t **entryp)
+{
+	isc_result_t result;
+	struct berval dn;
+	struct berval name;
+	struct berval *values = NULL;
+	BerElement *ber = NULL;
+	ldap_entry_t *entry = NULL;
+
+	REQUIRE(ld != NULL);
+	REQUIRE(ldap_entry != NULL);
+	REQUIRE(entryp != NULL);
+	REQUIRE(*entryp == NULL);
+
+	CHECK(ldap_entry_init(mctx, &entry));
+
+	/* DN, attribute names and values are decoded in place, i.e. without
+	 * copies made by ldap_get_dn() and ldap_get_values(). */
+	if (ldap_get_dn_ber(ld, ldap_entry, &ber, &dn) != LDAP_SUCCESS) {
+		log_ldap_error(ld, "unable to get entry DN");
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	CHECK(ldap_entry_setdn(entry, &dn));
+
+	for (;;) {
+		if (ldap_get_attribute_ber(ld, ldap_entry, ber, &name, &values)
+		    != LDAP_SUCCESS) {
+			log_ldap_error(ld, "unable to get attributes of entry "
+				       "'%s'", entry->dn);
+			CLEANUP_WITH(ISC_R_FAILURE);
+		}
+		if (name.bv_val == NULL)
+			break;
+
+		CHECK(ldap_entry_addattr(entry, &name, values));
+		if (values != NULL) {
+			ber_memfree(values);
+			values = NULL;
+		}
+	}
+
+	CHECK(ldap_entry_complete(entry, dncache, uuid));
 
 	*entryp = entry;
 
 cleanup:
+	if (values != NULL)
+		ber_memfree(values);
 	if (ber != NULL)
 		ber_free(ber, 0);
-	if (result != ISC_R_SUCCESS) {
-		if (entry != NULL)
-			ldap_entry_destroy(&entry);
-		SAFE_MEM_PUT_PTR(mctx, attr);
+	if (result != ISC_R_SUCCESS && entry != NULL)
+		ldap_entry_destroy(&entry);
+
+	return result;
+}
+
+/**
+ * Make a copy of the entry with all its attributes and values.
+ * Copy does not share any memory with the original entry.
+ */
+isc_result_t
+ldap_entry_clone(isc_mem_t *mctx, ldap_entry_t *src, ldap_entry_t **entryp)
+{
+	isc_result_t result;
+	ldap_entry_t *entry = NULL;
+	ldap_attribute_t *src_attr;
+	ldap_attribute_t *attr = NULL;
+	ldap_value_t *src_val;
+	struct berval bv;
+
+	REQUIRE(entryp != NULL && *entryp == NULL);
+
+	CHECK(ldap_entry_init(mctx, &entry));
+	/* the copy needs exactly the same space as the original */
+	entry->arena_chunk_size = ISC_MAX(LDAP_ARENA_CHUNK_MIN,
+					  LDAP_ARENA_HEADER + src->arena_used);
+	if (src->dn != NULL) {
+		bv.bv_val = src->dn;
+		bv.bv_len = strlen(src->dn);
+		if (ldap_entry_dupstr(entry, &bv, 0, &entry->dn) == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+	}
+	if (src->uuid != NULL) {
+		entry->uuid = ldap_entry_dupbv(entry, src->uuid);
+		if (entry->uuid == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
 	}
+	entry->class = src->class;
+	if (dns_name_countlabels(&src->fqdn) > 0)
+		CHECK(dns_name_copy(&src->fqdn, &entry->fqdn, NULL));
+	if (dns_name_countlabels(&src->zone_name) > 0)
+		CHECK(dns_name_copy(&src->zone_name, &entry->zone_name, NULL));
+
+	for (src_attr = HEAD(src->attrs);
+	     src_attr != NULL;
+	     src_attr = NEXT(src_attr, link)) {
+		bv.bv_val = src_attr->name;
+		bv.bv_len = strlen(src_attr->name);
+		CHECK(ldap_attr_create(entry, &bv, NULL, &attr));
+		for (src_val = HEAD(src_attr->values);
+		     src_val != NULL;
+		     src_val = NEXT(src_val, link)) {
+			bv.bv_val = src_val->value;
+			bv.bv_len = src_val->length;
+			CHECK(ldap_attr_addvalue(entry, attr, &bv));
+		}
+		APPEND(entry->attrs, attr, link);
+	}
+
+	*entryp = entry;
+	return ISC_R_SUCCESS;
 
+cleanup:
+	ldap_entry_destroy(&entry);
 	return result;
 }
 
@@ -258,6 +446,7 @@ void
 ldap_entry_destroy(ldap_entry_t **entryp)
 {
 	ldap_entry_t *entry;
+	ldap_arena_chunk_t *chunk;
 
 	REQUIRE(entryp != NULL);
 
@@ -265,23 +454,15 @@ ldap_entry_destroy(ldap_entry_t **entryp)
 	if (entry == NULL)
 		return;
 
-	ldap_attributelist_destroy(entry->mctx, &entry->attrs);
-	if (entry->dn != NULL)
-		ldap_memfree(entry->dn);
-	if (entry->uuid != NULL)
-		ber_bvfree(entry->uuid);
 	if (dns_name_dynamic(&entry->fqdn))
 		dns_name_free(&entry->fqdn, entry->mctx);
 	if (dns_name_dynamic(&entry->zone_name))
 		dns_name_free(&entry->zone_name, entry->mctx);
-	if (entry->lex != NULL) {
-		isc_lex_close(entry->lex);
-		isc_lex_destroy(&entry->lex);
-	}
-	if (entry->rdata_target_mem != NULL)
-		SAFE_MEM_PUT(entry->mctx, entry->rdata_target_mem,
-			     DNS_RDATA_MAXLENGTH);
 	str_destroy(&entry->logname);
+	while ((chunk = entry->arena_chunks) != NULL) {
+		entry->arena_chunks = chunk->next;
+		isc_mem_put(entry->mctx, chunk, chunk->size);
+	}
 
 	MEM_PUT_AND_DETACH(entry);
 
@@ -363,10 +544,19 @@ ldap_entry_nextrdtype(ldap_entry_t *entry, ldap_attribute_t **attrp,
 	result = ISC_R_NOTFOUND;
 
 	while ((attr = ldap_entry_nextattr(entry)) != NULL) {
-		result = ldap_attribute_to_rdatatype(attr->name, rdtype);
+		/* Entries are iterated repeatedly during parsing and diffing,
+		 * convert each attribute name only once. */
+		if (attr->rdtype_cached == ISC_FALSE) {
+			attr->rdtype_result = ldap_attribute_to_rdatatype(
+						attr->name, &attr->rdtype);
+			attr->rdtype_cached = ISC_TRUE;
+		}
+		result = attr->rdtype_result;
 		/* FIXME: Emit warning in case of unknown rdtype? */
-		if (result == ISC_R_SUCCESS)
+		if (result == ISC_R_SUCCESS) {
+			*rdtype = attr->rdtype;
 			break;
+		}
 	}
 
 	if (result == ISC_R_SUCCESS)
@@ -479,7 +669,7 @@ ldap_entry_parseclass(ldap_entry_t *entry, ldap_entryclass_t *class)
 }
 
 isc_result_t
-ldap_attr_firstvalue(ldap_attribute_t *attr, ld_string_t *str)
+ldap_attr_firstvalue(ldap_attribute_t *attr, isc_consttextregion_t *str)
 {
 	REQUIRE(attr != NULL);
 	REQUIRE(str != NULL);
@@ -489,16 +679,13 @@ ldap_attr_firstvalue(ldap_attribute_t *attr, ld_string_t *str)
 }
 
 isc_result_t
-ldap_attr_nextvalue(ldap_attribute_t *attr, ld_string_t *str)
+ldap_attr_nextvalue(ldap_attribute_t *attr, isc_consttextregion_t *str)
 {
-	isc_result_t result;
 	ldap_value_t *value;
 
 	REQUIRE(attr != NULL);
         REQUIRE(str != NULL);
 
-	str_clear(str);
-
 	if (attr->lastval == NULL)
 		value = HEAD(attr->values);
 	else
@@ -509,10 +696,10 @@ ldap_attr_nextvalue(ldap_attribute_t *attr, ld_string_t *str)
 	else
 		return ISC_R_NOMORE;
 
-	CHECK(str_init_char(str, value->value));
+	str->base = value->value;
+	str->length = value->length;
 
-cleanup:
-	return result;
+	return ISC_R_SUCCESS;
 }
 
 dns_ttl_t
@@ -539,7 +726,8 @@ ldap_entry_getttl(ldap_entry_t *entry, const settings_set_t * settings)
 	return ttl;
 
 cleanup:
-	INSIST(setting_get_uint("default_ttl", settings, &ttl) == ISC_R_SUCCESS);
+	INSIST(setting_get_uint_id(SETTING_default_ttl, settings, &ttl)
+	       == ISC_R_SUCCESS);
 	return ttl;
 }
 
@@ -607,3 +795,142 @@ cleanup:
 	str_destroy(&str);
 	return "<failed to obtain LDAP entry identifier>";
 }
+
+/**
+ * Pool of parsing contexts shared by all threads working with one
+ * LDAP instance. Contexts are handed out in LIFO order so the most recently
+ * used (i.e. cache-hot) buffer is reused first.
+ */
+struct ldap_parsepool {
+	isc_mem_t			*mctx;
+	isc_mutex_t			lock;
+	LIST(ldap_parsectx_t)		free;
+};
+
+isc_result_t
+ldap_parsectx_create(isc_mem_t *mctx, ldap_parsectx_t **ctxp) {
+	isc_result_t result;
+	ldap_parsectx_t *ctx = NULL;
+
+	REQUIRE(ctxp != NULL && *ctxp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, ctx);
+	ZERO_PTR(ctx);
+	INIT_LINK(ctx, link);
+	CHECKED_MEM_GET(mctx, ctx->rdata_target_mem, DNS_RDATA_MAXLENGTH);
+	CHECK(isc_lex_create(mctx, TOKENSIZ, &ctx->lex));
+
+	*ctxp = ctx;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	ldap_parsectx_destroy(mctx, &ctx);
+	return result;
+}
+
+void
+ldap_parsectx_destroy(isc_mem_t *mctx, ldap_parsectx_t **ctxp) {
+	ldap_parsectx_t *ctx;
+
+	REQUIRE(ctxp != NULL);
+
+	ctx = *ctxp;
+	if (ctx == NULL)
+		return;
+
+	if (ctx->lex != NULL) {
+		isc_lex_close(ctx->lex);
+		isc_lex_destroy(&ctx->lex);
+	}
+	if (ctx->rdata_target_mem != NULL)
+		SAFE_MEM_PUT(mctx, ctx->rdata_target_mem,
+			     DNS_RDATA_MAXLENGTH);
+	SAFE_MEM_PUT_PTR(mctx, ctx);
+	*ctxp = NULL;
+}
+
+isc_result_t
+ldap_parsepool_create(isc_mem_t *mctx, ldap_parsepool_t **poolp) {
+	isc_result_t result;
+	ldap_parsepool_t *pool = NULL;
+
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, pool);
+	ZERO_PTR(pool);
+	isc_mem_attach(mctx, &pool->mctx);
+	INIT_LIST(pool->free);
+	CHECK(isc_mutex_init(&pool->lock));
+
+	*poolp = pool;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (pool != NULL)
+		MEM_PUT_AND_DETACH(pool);
+	return result;
+}
+
+/**
+ * Destroy the pool and all idle contexts. All contexts have to be returned
+ * to the pool before this call.
+ */
+void
+ldap_parsepool_destroy(ldap_parsepool_t **poolp) {
+	ldap_parsepool_t *pool;
+	ldap_parsectx_t *ctx;
+
+	REQUIRE(poolp != NULL);
+
+	pool = *poolp;
+	if (pool == NULL)
+		return;
+
+	while ((ctx = HEAD(pool->free)) != NULL) {
+		UNLINK(pool->free, ctx, link);
+		ldap_parsectx_destroy(pool->mctx, &ctx);
+	}
+	DESTROYLOCK(&pool->lock);
+	MEM_PUT_AND_DETACH(pool);
+	*poolp = NULL;
+}
+
+/**
+ * Borrow idle context from the pool or create a new one if all contexts
+ * are in use. The context has to be returned by ldap_parsepool_put().
+ */
+isc_result_t
+ldap_parsepool_get(ldap_parsepool_t *pool, ldap_parsectx_t **ctxp) {
+	ldap_parsectx_t *ctx;
+
+	REQUIRE(ctxp != NULL && *ctxp == NULL);
+
+	LOCK(&pool->lock);
+	ctx = HEAD(pool->free);
+	if (ctx != NULL)
+		UNLINK(pool->free, ctx, link);
+	UNLOCK(&pool->lock);
+
+	if (ctx == NULL)
+		return ldap_parsectx_create(pool->mctx, ctxp);
+
+	*ctxp = ctx;
+	return ISC_R_SUCCESS;
+}
+
+void
+ldap_parsepool_put(ldap_parsepool_t *pool, ldap_parsectx_t **ctxp) {
+	ldap_parsectx_t *ctx;
+
+	REQUIRE(ctxp != NULL);
+
+	ctx = *ctxp;
+	if (ctx == NULL)
+		return;
+
+	isc_lex_close(ctx->lex);
+	LOCK(&pool->lock);
+	PREPEND(pool->free, ctx, link);
+	UNLOCK(&pool->lock);
+	*ctxp = NULL;
+}
@@ -6,9 +6,11 @@
 #define _LD_LDAP_ENTRY_H_
 
 #include <isc/lex.h>
+#include <isc/region.h>
 #include <isc/util.h>
 #include <dns/types.h>
 
+#include "dn_cache.h"
 #include "fwd_register.h"
 #include "util.h"
 #include "str.h"
@@ -17,17 +19,23 @@
 #define LDAP_DEPRECATED 1
 #include <ldap.h>
 
-/* Represents values associated with LDAP attribute */
+/* Represents values associated with LDAP attribute. The value is
+ * NUL-terminated copy of the BER-encoded value stored in the entry arena. */
 typedef struct ldap_value ldap_value_t;
 typedef LIST(ldap_value_t) ldap_valuelist_t;
 struct ldap_value {
         char                    *value;
+        ber_len_t               length;
         LINK(ldap_value_t)      link;
 };
 
 /* Represents LDAP attribute and it's values */
 typedef struct ldap_attribute	ldap_attribute_t;
 typedef LIST(ldap_attribute_t)	ldap_attributelist_t;
+typedef LIST(ldap_entry_t)	ldap_entrylist_t;
+
+/* Allocations which live as long as the entry, see ldap_entry_alloc(). */
+typedef struct ldap_arena_chunk	ldap_arena_chunk_t;
 
 /* Represents LDAP entry and it's attributes */
 typedef unsigned char		ldap_entryclass_t;
@@ -43,23 +51,42 @@ struct ldap_entry {
 	ldap_attributelist_t	attrs;
 	LINK(ldap_entry_t)	link;
 
-	/* Parsing. */
-	isc_lex_t		*lex;
-	isc_buffer_t		rdata_target;
-	unsigned char		*rdata_target_mem;
-
 	/* Human-readable identifier. It has to be accessed via
 	 * ldap_entry_logname(). */
 	ld_string_t		*logname;
+
+	/* Bump allocator for DN, attributes, values and UUID. Chunks are
+	 * allocated on first use and all memory is released at once
+	 * by ldap_entry_destroy(). */
+	unsigned char		*arena_next;
+	size_t			arena_left;
+	size_t			arena_used;
+	size_t			arena_chunk_size; /* size of the next chunk */
+	ldap_arena_chunk_t	*arena_chunks;
+};
+
+/* Scratch space for conversion of textual RDATA from LDAP. Contexts are
+ * expensive to create so they are recycled via ldap_parsepool_t. */
+typedef struct ldap_parsectx	ldap_parsectx_t;
+struct ldap_parsectx {
+	isc_lex_t		*lex;
+	isc_buffer_t		rdata_target;
+	unsigned char		*rdata_target_mem;
+	LINK(ldap_parsectx_t)	link;
 };
 
+typedef struct ldap_parsepool	ldap_parsepool_t;
+
 /* Represents LDAP attribute and it's values */
 struct ldap_attribute {
 	char			*name;
-	char			**ldap_values;
 	ldap_value_t		*lastval;
 	ldap_valuelist_t	values;
 	LINK(ldap_attribute_t)	link;
+	/* Result of name to RR type conversion, see ldap_entry_nextrdtype(). */
+	isc_boolean_t		rdtype_cached;
+	isc_result_t		rdtype_result;
+	dns_rdatatype_t		rdtype;
 };
 
 #define LDAP_ENTRYCLASS_NONE	0x0
@@ -77,8 +104,25 @@ isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 ldap_entry_init(isc_mem_t *mctx, ldap_entry_t **entryp);
 
 isc_result_t
-ldap_entry_parse(isc_mem_t *mctx, LDAP *ld, LDAPMessage *ldap_entry,
-		  struct berval	*uuid, ldap_entry_t **entryp) ATTR_NONNULLS ATTR_CHECKRESULT;
+ldap_entry_parse(isc_mem_t *mctx, dn_cache_t *dncache, LDAP *ld,
+		 LDAPMessage *ldap_entry, struct berval *uuid,
+		 ldap_entry_t **entryp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldap_entry_setdn(ldap_entry_t *entry,
+		 const struct berval *dn) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldap_entry_addattr(ldap_entry_t *entry, const struct berval *name,
+		   const struct berval *values) ATTR_NONNULL(1,2) ATTR_CHECKRESULT;
+
+isc_result_t
+ldap_entry_complete(ldap_entry_t *entry, dn_cache_t *dncache,
+		    struct berval *uuid) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldap_entry_clone(isc_mem_t *mctx, ldap_entry_t *src,
+		 ldap_entry_t **entryp) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
 ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
@@ -110,16 +154,18 @@ ldap_entry_getfakesoa(ldap_entry_t *entry, const char *fake_mname,
 		      ld_string_t *target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
-ldap_attr_firstvalue(ldap_attribute_t *attr, ld_string_t *str) ATTR_NONNULLS ATTR_CHECKRESULT;
+ldap_attr_firstvalue(ldap_attribute_t *attr,
+		     isc_consttextregion_t *value) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 /*
  * ldap_attr_nextvalue
  *
- * Returns pointer to value in case of success, NULL if no other val is
- * available
+ * Returns ISC_R_SUCCESS and region pointing to the value stored in the entry,
+ * ISC_R_NOMORE if no other val is available
  */
 isc_result_t
-ldap_attr_nextvalue(ldap_attribute_t *attr, ld_string_t *value) ATTR_NONNULLS ATTR_CHECKRESULT;
+ldap_attr_nextvalue(ldap_attribute_t *attr,
+		    isc_consttextregion_t *value) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 dns_ttl_t
 ldap_entry_getttl(ldap_entry_t *entry, const settings_set_t * settings) ATTR_NONNULLS ATTR_CHECKRESULT;
@@ -127,4 +173,22 @@ ldap_entry_getttl(ldap_entry_t *entry, const settings_set_t * settings) ATTR_NON
 const char *
 ldap_entry_logname(ldap_entry_t * const entry) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+ldap_parsectx_create(isc_mem_t *mctx, ldap_parsectx_t **ctxp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_parsectx_destroy(isc_mem_t *mctx, ldap_parsectx_t **ctxp) ATTR_NONNULLS;
+
+isc_result_t
+ldap_parsepool_create(isc_mem_t *mctx, ldap_parsepool_t **poolp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_parsepool_destroy(ldap_parsepool_t **poolp) ATTR_NONNULLS;
+
+isc_result_t
+ldap_parsepool_get(ldap_parsepool_t *pool, ldap_parsectx_t **ctxp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_parsepool_put(ldap_parsepool_t *pool, ldap_parsectx_t **ctxp) ATTR_NONNULLS;
+
 #endif /* !_LD_LDAP_ENTRY_H_ */
@@ -25,7 +25,9 @@
 #include <dns/update.h>
 
 #include <isc/buffer.h>
+#include <isc/condition.h>
 #include <isc/dir.h>
+#include <isc/file.h>
 #include <isc/mem.h>
 #include <isc/mutex.h>
 #include <isc/region.h>
@@ -35,6 +37,7 @@
 #include <isc/time.h>
 #include <isc/util.h>
 #include <isc/netaddr.h>
+#include <isc/os.h>
 #include <isc/parseint.h>
 #include <isc/refcount.h>
 #include <isc/timer.h>
@@ -47,7 +50,6 @@
 #define LDAP_DEPRECATED 1
 #include <ldap.h>
 #include <limits.h>
-#include <regex.h>
 #include <sasl/sasl.h>
 #include <signal.h>
 #include <stddef.h>
@@ -58,6 +60,7 @@
 #include <netdb.h>
 
 #include "acl.h"
+#include "dn_cache.h"
 #include "empty_zones.h"
 #include "fs.h"
 #include "fwd.h"
@@ -66,17 +69,21 @@
 #include "ldap_driver.h"
 #include "ldap_entry.h"
 #include "ldap_helper.h"
+#include "ldap_stats.h"
 #include "lock.h"
 #include "log.h"
-#include "metadb.h"
 #include "mldap.h"
+#include "rr_template.h"
 #include "semaphore.h"
+#include "server_list.h"
 #include "settings.h"
 #include "str.h"
+#include "sync_record.h"
 #include "syncptr.h"
 #include "syncrepl.h"
 #include "util.h"
 #include "zone.h"
+#include "zone_batch.h"
 #include "zone_manager.h"
 #include "zone_register.h"
 #include "rbt_helper.h"
@@ -104,10 +111,12 @@
  * isc_task_beginexclusive() and then return back via isc_task_endexclusive()!
  *
  * ldap_connection_t structure represents connection to the LDAP database and
- * per-connection specific data. Access is controlled via
- * ldap_connection_t->lock and ldap_pool_t->conn_semaphore. Each read
- * or write access to ldap_connection_t structure (except create/destroy)
- * must acquire the semaphore and the lock.
+ * per-connection specific data. Connection is owned by the thread which
+ * obtained it from ldap_pool_getconnection() until it is returned by
+ * ldap_pool_putconnection(); nobody else can touch it in the meantime.
+ * Idle connections are kept on a lock-free stack inside ldap_pool_t.
+ * ldap_pool_t->lock protects slot allocation and the list of broken
+ * connections and it is used for waiting on a returned connection.
  */
 
 typedef struct ldap_connection  ldap_connection_t;
@@ -115,6 +124,41 @@ typedef struct ldap_pool	ldap_pool_t;
 typedef struct ldap_auth_pair	ldap_auth_pair_t;
 typedef struct settings		settings_t;
 
+#define LDAPDB_EVENT_ZONE_BATCH	(LDAPDB_EVENTCLASS + 6)
+#define LDAPDB_EVENT_ZONE_REFRESHED	(LDAPDB_EVENTCLASS + 7)
+#define LDAPDB_EVENT_ZONE_LOAD		(LDAPDB_EVENTCLASS + 8)
+#define LDAPDB_EVENT_STATS_STOP		(LDAPDB_EVENTCLASS + 9)
+
+/* Number of zones with most changes listed in statistics */
+#define LDAP_STATS_TOP_ZONES	10
+
+/*
+ * Event for delayed flush of changes accumulated in zone batch.
+ */
+typedef struct zone_batchev zone_batchev_t;
+struct zone_batchev {
+	ISC_EVENT_COMMON(zone_batchev_t);
+	/* reference keeps the instance valid, see syncrepl_event_instance() */
+	ldap_instance_t *inst;
+	DECLARE_BUFFERED_NAME(zone_name);
+	/* number of changes in batch when the event was sent */
+	unsigned int changes;
+};
+
+/*
+ * Event for activation of a zone whose records were completely downloaded
+ * before the end of initial synchronization.
+ */
+typedef struct zone_refreshev zone_refreshev_t;
+struct zone_refreshev {
+	ISC_EVENT_COMMON(zone_refreshev_t);
+	/* reference keeps the instance valid, see syncrepl_event_instance() */
+	ldap_instance_t *inst;
+	DECLARE_BUFFERED_NAME(zone_name);
+};
+
+typedef struct ldap_writeop	ldap_writeop_t;
+
 /* Authentication method. */
 typedef enum ldap_auth {
 	AUTH_INVALID = 0,
@@ -128,6 +172,34 @@ struct ldap_auth_pair {
 	char *name;	/* String representation used in configuration file */
 };
 
+/* SyncRepl event waiting for commit of metaLDAP version in sync group. */
+typedef struct sync_group_item sync_group_item_t;
+struct sync_group_item {
+	ldap_syncreplevent_t	*pevent;
+	isc_task_t		*task;
+	isc_boolean_t		synchronous;
+	ISC_LINK(sync_group_item_t) link;
+};
+
+/*
+ * Changes from consecutive SyncRepl messages share one metaLDAP version.
+ * Events produced by the changes are held back until the version
+ * is committed so zone tasks never see uncommitted metaLDAP state.
+ */
+typedef struct sync_group {
+	isc_mutex_t		lock;
+	isc_boolean_t		open;		/* metaLDAP version is open */
+	isc_time_t		start;		/* when the version was opened */
+	unsigned int		entries;	/* entries in the open version */
+	isc_uint32_t		max_entries;	/* sync_commit_size */
+	isc_uint32_t		max_delay;	/* sync_commit_delay */
+	/* State before the entry being processed, used for rollback. */
+	unsigned int		savepoint;
+	unsigned int		mark;
+	unsigned int		items;
+	ISC_LIST(sync_group_item_t) events;
+} sync_group_t;
+
 /* These are typedefed in ldap_helper.h */
 struct ldap_instance {
 	isc_mem_t		*mctx;
@@ -139,6 +211,8 @@ struct ldap_instance {
 
 	/* Pool of LDAP connections */
 	ldap_pool_t		*pool;
+	/* LDAP servers from options uri and replica_uri */
+	server_list_t		*servers;
 
 	/* Our own list of zones. */
 	zone_register_t		*zone_register;
@@ -150,8 +224,12 @@ struct ldap_instance {
 	isc_task_t		*task;
 	isc_thread_t		watcher;
 	isc_boolean_t		exiting;
+	/* Instance was destroyed, only memory referenced by events is left. */
+	isc_boolean_t		destroyed;
 	/* Non-zero if this instance is 'tainted' by an unrecoverable problem. */
 	isc_refcount_t		errors;
+	/* Syncrepl events hold references so the instance outlives them. */
+	isc_refcount_t		references;
 
 	/* Settings. */
 	settings_set_t		*local_settings;
@@ -161,20 +239,101 @@ struct ldap_instance {
 
 	sync_ctx_t		*sctx;
 	mldapdb_t		*mldapdb;
+	/* Conversions between LDAP DNs and DNS names */
+	dn_cache_t		*dncache;
+	/* Template records indexed by substitution variables they use */
+	rr_template_index_t	*templates;
+	/* Runtime statistics, see stats_interval */
+	ldap_stats_t		*stats;
+	isc_timer_t		*stats_timer;
+	/* releases reference held by stats_timer, see ldap_stats_stop() */
+	isc_event_t		*stats_stopev;
+	/* SyncRepl callbacks are written here, see sync_record_file */
+	sync_record_t		*sync_record;
+	sync_group_t		sync_group;
+
+	/* Lexers and buffers for RDATA parsing recycled across entries */
+	ldap_parsepool_t	*parsepool;
+
+	/* RFC 4533 cookie for resuming data synchronization;
+	 * used only with persistent_cache */
+	struct berval		*sync_cookie;
+	/* SyncRepl refresh reports all live entries so stale entries
+	 * can be detected by their generation number */
+	isc_boolean_t		sync_refresh_presents;
+	/* zone data cached during last shutdown can be loaded */
+	isc_boolean_t		zone_cache;
+	/* zone data cache was not loaded for some zone */
+	isc_boolean_t		zone_cache_failed;
 };
 
 struct ldap_pool {
 	isc_mem_t		*mctx;
-	/* List of LDAP connections. */
-	unsigned int		connections; /* number of connections */
-	semaphore_t		conn_semaphore;
+	ldap_instance_t		*inst;
+	/* Pool grows on demand from conn_min up to conn_max connections. */
+	unsigned int		conn_min;
+	unsigned int		conn_max;
+	unsigned int		conn_size; /* number of allocated connections */
+	/* Slots for up to conn_max connections, NULL means free slot. */
 	ldap_connection_t	**conns;
 
+	/* Lock-free stack of idle healthy connections. Lower 32 bits
+	 * hold index of the top slot + 1 (0 = empty stack), upper 32 bits
+	 * hold modification tag which prevents ABA problem. */
+	volatile isc_uint64_t	idle_head;
+	/* idle_next[slot] = index of the next slot in stack + 1 */
+	unsigned int		*idle_next;
+	/* Scratch space for conn_max connections used by the maintenance
+	 * thread. */
+	ldap_connection_t	**maint_conns;
+	/* Number of threads waiting for an idle connection. */
+	volatile unsigned int	waiters;
+
+	isc_mutex_t		lock;
+	isc_condition_t		idle_cond;
+	/* Connections without working handle waiting for reconnect. */
+	ISC_LIST(ldap_connection_t) broken;
+
+	/* Maintenance thread reconnects broken connections and closes
+	 * connections which were idle for too long. */
+	isc_thread_t		maintainer;
+	isc_boolean_t		maintainer_running;
+	isc_condition_t		maint_cond;
+	isc_boolean_t		exiting;
+};
+
+/* State of LDAP write operation in ldap_modify_pipeline(). */
+typedef enum ldap_writeop_state {
+	WRITEOP_QUEUED = 0,	/* request has to be sent */
+	WRITEOP_SENT,		/* waiting for result from LDAP server */
+	WRITEOP_RETRY,		/* failed, will be retried after reconnect */
+	WRITEOP_DONE,		/* final result is available */
+} ldap_writeop_state_t;
+
+/* One LDAP write operation which can be pipelined with others. */
+struct ldap_writeop {
+	const char		*dn;
+	LDAPMod			**mods;
+	isc_boolean_t		delete_node;
+
+	const char		*operation_str;
+	ldap_writeop_state_t	state;
+	int			msgid;
+	/* time when the operation was sent, for round-trip statistics */
+	isc_time_t		sent;
+	isc_boolean_t		retried;
+	/* modify operation was converted to add of a new entry */
+	isc_boolean_t		adding;
+	LDAPMod			**add_mods;
+	unsigned int		add_mods_cnt;
+	LDAPMod			obj_class;
+	char			*obj_str[2];
+
+	isc_result_t		result;
 };
 
 struct ldap_connection {
 	isc_mem_t		*mctx;
-	isc_mutex_t		lock;
 
 	LDAP			*handle;
 	int			msgid;
@@ -182,6 +341,16 @@ struct ldap_connection {
 	/* For reconnection logic. */
 	isc_time_t		next_reconnect;
 	unsigned int		tries;
+
+	/* Server the handle is connected to and role used for selecting it. */
+	ldap_server_t		*server;
+	server_role_t		role;
+
+	/* Position in ldap_pool_t->conns. */
+	unsigned int		slot;
+	/* Time when the connection was returned to the pool. */
+	isc_time_t		last_used;
+	ISC_LINK(ldap_connection_t) link;
 };
 
 /*
@@ -203,7 +372,9 @@ extern const settings_set_t settings_default_set;
 /** Local configuration file */
 static const setting_t settings_local_default[] = {
 	{ "uri",			no_default_string	},
+	{ "replica_uri",		no_default_string	},
 	{ "connections",		no_default_uint		},
+	{ "connections_max",		no_default_uint		},
 	{ "reconnect_interval",		no_default_uint		},
 	{ "timeout",			no_default_uint		},
 	{ "cache_ttl",			no_default_string	}, /* No longer supported */
@@ -235,6 +406,20 @@ static const setting_t settings_local_default[] = {
 	{ "forward_policy",		no_default_string	},
 	{ "forwarders",			no_default_string	},
 	{ "server_id",			no_default_string	},
+	{ "persistent_cache",		no_default_boolean	},
+	{ "stats_interval",		no_default_uint		},
+	{ "serial_batch_size",		no_default_uint		},
+	{ "serial_batch_delay",		no_default_uint		},
+	{ "sync_concurrency_limit",	no_default_uint		},
+	{ "sync_concurrency_max",	no_default_uint		},
+	{ "sync_concurrency_adaptive",	no_default_boolean	},
+	{ "sync_concurrency_latency",	no_default_uint		},
+	{ "sync_concurrency_memory",	no_default_uint		},
+	{ "sync_commit_size",		no_default_uint		},
+	{ "sync_commit_delay",		no_default_uint		},
+	{ "sync_refresh_sessions",	no_default_uint		},
+	{ "sync_record_file",		no_default_string	},
+	{ "sync_replay_file",		no_default_string	},
 	end_of_settings
 };
 
@@ -274,12 +459,13 @@ static void destroy_ldap_connection(ldap_connection_t **ldap_connp) ATTR_NONNULL
 static isc_result_t findrdatatype_or_create(isc_mem_t *mctx,
 		ldapdb_rdatalist_t *rdatalist, dns_rdataclass_t rdclass,
 		dns_rdatatype_t rdtype, dns_ttl_t ttl, dns_rdatalist_t **rdlistp) ATTR_NONNULLS ATTR_CHECKRESULT;
-static isc_result_t add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
-		ldap_entry_t *entry, dns_ttl_t ttl, ldapdb_rdatalist_t *rdatalist,
+static isc_result_t add_soa_record(isc_mem_t *mctx, ldap_parsectx_t *parser,
+		dns_name_t *origin, ldap_entry_t *entry, dns_ttl_t ttl,
+		ldapdb_rdatalist_t *rdatalist,
 		const char *fake_mname) ATTR_NONNULLS ATTR_CHECKRESULT;
-static isc_result_t parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
+static isc_result_t parse_rdata(isc_mem_t *mctx, ldap_parsectx_t *parser,
 		dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
-		dns_name_t *origin, const char *rdata_text,
+		dns_name_t *origin, const isc_consttextregion_t *rdata_text,
 		dns_rdata_t **rdatap) ATTR_NONNULLS ATTR_CHECKRESULT;
 static isc_result_t
 ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
@@ -288,10 +474,20 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 			    ATTR_NONNULL(1,3,4) ATTR_CHECKRESULT;
 
 static isc_result_t
-ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
+ldap_parse_rrentry(isc_mem_t *mctx, ldap_parsepool_t *parsepool,
+		   rr_template_index_t *templates,
+		   ldap_entry_t *entry, dns_name_t *origin,
 		   const settings_set_t * const settings,
 		   ldapdb_rdatalist_t *rdatalist) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+static isc_result_t
+ldap_templates_rerender(ldap_instance_t *inst,
+			const char *variable) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+static isc_result_t
+ldap_stats_start(ldap_instance_t *inst, isc_timermgr_t *timermgr,
+		 isc_uint32_t seconds) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 static isc_result_t ldap_connect(ldap_instance_t *ldap_inst,
 		ldap_connection_t *ldap_conn, isc_boolean_t force) ATTR_NONNULLS ATTR_CHECKRESULT;
 static isc_result_t ldap_reconnect(ldap_instance_t *ldap_inst,
@@ -317,13 +513,13 @@ static isc_result_t modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap
 		dns_rdatalist_t *rdlist, int mod_op, isc_boolean_t delete_node) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 /* Functions for maintaining pool of LDAP connections */
-static isc_result_t ldap_pool_create(isc_mem_t *mctx, unsigned int connections,
-		ldap_pool_t **poolp) ATTR_NONNULLS ATTR_CHECKRESULT;
+static isc_result_t ldap_pool_create(isc_mem_t *mctx, unsigned int conn_min,
+		unsigned int conn_max, ldap_pool_t **poolp) ATTR_NONNULLS ATTR_CHECKRESULT;
 static void ldap_pool_destroy(ldap_pool_t **poolp);
 static isc_result_t ldap_pool_getconnection(ldap_pool_t *pool,
-		ldap_connection_t ** conn) ATTR_NONNULLS ATTR_CHECKRESULT;
+		ldap_connection_t ** conn) ATTR_NONNULL(2) ATTR_CHECKRESULT;
 static void ldap_pool_putconnection(ldap_pool_t *pool,
-		ldap_connection_t ** conn) ATTR_NONNULLS;
+		ldap_connection_t ** conn) ATTR_NONNULL(2);
 static isc_result_t ldap_pool_connect(ldap_pool_t *pool,
 		ldap_instance_t *ldap_inst) ATTR_NONNULLS ATTR_CHECKRESULT;
 
@@ -331,6 +527,22 @@ static isc_result_t ldap_pool_connect(ldap_pool_t *pool,
 static isc_threadresult_t
 ldap_syncrepl_watcher(isc_threadarg_t arg) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+/* Cache for resuming SyncRepl session after restart */
+static isc_result_t
+ldap_cache_load(ldap_instance_t *inst) ATTR_NONNULLS ATTR_CHECKRESULT;
+static void
+ldap_cache_save(ldap_instance_t *inst) ATTR_NONNULLS;
+static void
+sync_group_flush(ldap_instance_t *inst) ATTR_NONNULLS;
+
+/* Batching of changes received from LDAP */
+static void
+zone_batch_handler(isc_task_t *task, isc_event_t *event) ATTR_NONNULLS;
+static isc_result_t
+zone_batch_flush_zone(ldap_instance_t *inst, dns_name_t *name) ATTR_NONNULLS ATTR_CHECKRESULT;
+static void
+zone_batch_flush_all(ldap_instance_t *inst) ATTR_NONNULLS;
+
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
 				   dns_zone_t *secure);
@@ -341,6 +553,7 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 	isc_result_t result;
 
 	isc_uint32_t uint;
+	isc_uint32_t uint2;
 	const char *sasl_mech = NULL;
 	const char *sasl_user = NULL;
 	const char *sasl_realm = NULL;
@@ -350,6 +563,8 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 	const char *password = NULL;
 	const char *dir_name = NULL;
 	isc_boolean_t dir_default;
+	const char *record_file = NULL;
+	const char *replay_file = NULL;
 	ld_string_t *buff = NULL;
 
 	/* handle cache_ttl, psearch, serial_autoincrement, and zone_refresh
@@ -402,6 +617,18 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 		/* watcher needs one and update_*() requests second connection */
 		CLEANUP_WITH(ISC_R_RANGE);
 	}
+	CHECK(setting_get_uint("connections_max", set, &uint2));
+	if (uint2 != 0 && uint2 < uint) {
+		log_error("connections_max %u must not be lower than "
+			  "connections %u", uint2, uint);
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+
+	CHECK(sync_concurr_limit_configure(inst->sctx, set));
+	CHECK(setting_get_uint("sync_commit_size", set,
+			       &inst->sync_group.max_entries));
+	CHECK(setting_get_uint("sync_commit_delay", set,
+			       &inst->sync_group.max_delay));
 
 	/* Select authentication method. */
 	CHECK(setting_get_str("auth_method", set, &auth_method_str));
@@ -485,6 +712,14 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 			 "are untested; expect problems");
 	}
 
+	CHECK(setting_get_str("sync_record_file", set, &record_file));
+	CHECK(setting_get_str("sync_replay_file", set, &replay_file));
+	if (strlen(record_file) != 0 && strlen(replay_file) != 0) {
+		log_error("options 'sync_record_file' and 'sync_replay_file' "
+			  "are mutually exclusive");
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+
 	for (char **option = obsolete_options; *option != NULL; option++) {
 		CHECK(setting_get_str(*option, set, &obsolete_value));
 		if (memcmp("", obsolete_value, 1) != 0)
@@ -516,15 +751,22 @@ new_ldap_instance(isc_mem_t *mctx, const char *db_name,
 	isc_buffer_t *forwarders_list = NULL;
 	const char *forward_policy = NULL;
 	isc_uint32_t connections;
+	isc_uint32_t connections_max;
 	char settings_name[PRINT_BUFF_SIZE];
 	ldap_globalfwd_handleez_t *gfwdevent = NULL;
 	const char *server_id = NULL;
+	const char *uri = NULL;
+	const char *replica_uri = NULL;
+	const char *record_file = NULL;
+	const char *replay_file = NULL;
+	isc_uint32_t stats_interval;
 
 	REQUIRE(ldap_instp != NULL && *ldap_instp == NULL);
 
 	CHECKED_MEM_GET_PTR(mctx, ldap_inst);
 	ZERO_PTR(ldap_inst);
 	CHECK(isc_refcount_init(&ldap_inst->errors, 0));
+	CHECK(isc_refcount_init(&ldap_inst->references, 1));
 	isc_mem_attach(mctx, &ldap_inst->mctx);
 
 	ldap_inst->db_name = db_name;
@@ -534,6 +776,7 @@ new_ldap_instance(isc_mem_t *mctx, const char *db_name,
 	ldap_inst->task = task;
 	ldap_inst->watcher = 0;
 	CHECK(sync_ctx_init(ldap_inst->mctx, ldap_inst, &ldap_inst->sctx));
+	CHECK(ldap_parsepool_create(ldap_inst->mctx, &ldap_inst->parsepool));
 
 	isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
 				   SETTING_SET_NAME_LOCAL " for database %s",
@@ -628,16 +871,51 @@ new_ldap_instance(isc_mem_t *mctx, const char *db_name,
 	};
 
 	CHECK(setting_get_uint("connections", ldap_inst->local_settings, &connections));
+	CHECK(setting_get_uint("connections_max", ldap_inst->local_settings,
+			       &connections_max));
+	if (connections_max == 0)
+		connections_max = connections;
 
 	CHECK(zr_create(mctx, ldap_inst, ldap_inst->server_ldap_settings,
 			&ldap_inst->zone_register));
 	CHECK(fwdr_create(ldap_inst->mctx, &ldap_inst->fwd_register));
 	CHECK(mldap_new(mctx, &ldap_inst->mldapdb));
+	CHECK(dn_cache_create(mctx, &ldap_inst->dncache));
+	CHECK(rr_template_index_create(mctx, &ldap_inst->templates));
+	CHECK(ldap_stats_create(mctx, &ldap_inst->stats));
+	CHECK(setting_get_str("sync_record_file", ldap_inst->local_settings,
+			      &record_file));
+	if (strlen(record_file) != 0)
+		CHECK(sync_record_create(mctx, record_file, ISC_TRUE,
+					 &ldap_inst->sync_record));
+	CHECK(ldap_cache_load(ldap_inst));
 
 	CHECK(isc_mutex_init(&ldap_inst->kinit_lock));
+	CHECK(isc_mutex_init(&ldap_inst->sync_group.lock));
+	ISC_LIST_INIT(ldap_inst->sync_group.events);
+
+	CHECK(setting_get_str("uri", ldap_inst->local_settings, &uri));
+	CHECK(setting_get_str("replica_uri", ldap_inst->local_settings,
+			      &replica_uri));
+	CHECK(server_list_create(mctx, uri, replica_uri,
+				 &ldap_inst->servers));
+
+	/* Replay does not talk to LDAP at all so it measures only
+	 * the plug-in itself. Writes to LDAP fail without the pool. */
+	CHECK(setting_get_str("sync_replay_file", ldap_inst->local_settings,
+			      &replay_file));
+	if (strlen(replay_file) == 0) {
+		CHECK(ldap_pool_create(mctx, connections, connections_max,
+				       &ldap_inst->pool));
+		CHECK(ldap_pool_connect(ldap_inst->pool, ldap_inst));
+	}
 
-	CHECK(ldap_pool_create(mctx, connections, &ldap_inst->pool));
-	CHECK(ldap_pool_connect(ldap_inst->pool, ldap_inst));
+	CHECK(setting_get_uint("stats_interval", ldap_inst->local_settings,
+			       &stats_interval));
+	if (stats_interval > 0)
+		CHECK(ldap_stats_start(ldap_inst,
+				       dns_dyndb_get_timermgr(dyndb_args),
+				       stats_interval));
 
 	/* Start the watcher thread */
 	result = isc_thread_create(ldap_syncrepl_watcher, ldap_inst,
@@ -659,6 +937,263 @@ cleanup:
 }
 #undef PRINT_BUFF_SIZE
 
+/** Change rates of one zone for statistics. */
+typedef struct zone_stats {
+	dns_fixedname_t	name;
+	isc_uint64_t	changes;
+	isc_uint64_t	serials;
+	unsigned int	age;
+} zone_stats_t;
+
+/**
+ * Copy names of all zones in the zone register. The register is locked
+ * only while names are copied so zones can be examined afterwards
+ * without holding the iterator.
+ *
+ * @param[out] namesp Array of names, free it with zone_names_free().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_names_get(ldap_instance_t *inst, dns_name_t **namesp,
+	       unsigned int *countp, unsigned int *sizep) {
+	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	dns_name_t *names = NULL;
+	dns_name_t *bigger;
+	unsigned int count = 0;
+	unsigned int size = 64;
+	DECLARE_BUFFERED_NAME(name);
+
+	CHECKED_MEM_GET(inst->mctx, names, size * sizeof(*names));
+	INIT_BUFFERED_NAME(name);
+	for (result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		if (count == size) {
+			CHECKED_MEM_GET(inst->mctx, bigger,
+					2 * size * sizeof(*names));
+			memcpy(bigger, names, size * sizeof(*names));
+			isc_mem_put(inst->mctx, names, size * sizeof(*names));
+			names = bigger;
+			size *= 2;
+		}
+		dns_name_init(&names[count], NULL);
+		CHECK(dns_name_dup(&name, inst->mctx, &names[count]));
+		count++;
+	}
+	if (result != ISC_R_NOTFOUND && result != ISC_R_NOMORE)
+		goto cleanup;
+
+	*namesp = names;
+	*countp = count;
+	*sizep = size;
+	names = NULL;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	rbt_iter_stop(&iter);
+	if (names != NULL) {
+		while (count > 0)
+			dns_name_free(&names[--count], inst->mctx);
+		isc_mem_put(inst->mctx, names, size * sizeof(*names));
+	}
+	return result;
+}
+
+static void ATTR_NONNULLS
+zone_names_free(ldap_instance_t *inst, dns_name_t **namesp,
+		unsigned int count, unsigned int size) {
+	dns_name_t *names = *namesp;
+
+	while (count > 0)
+		dns_name_free(&names[--count], inst->mctx);
+	isc_mem_put(inst->mctx, names, size * sizeof(*names));
+	*namesp = NULL;
+}
+
+/**
+ * Insert zone into array of zones with most changes sorted
+ * in descending order. Zone is dropped if the array is full
+ * and all zones in it have more changes.
+ */
+static void ATTR_NONNULLS
+zone_stats_top_add(zone_stats_t *top, unsigned int *countp,
+		   dns_name_t *name, isc_uint64_t changes,
+		   isc_uint64_t serials, unsigned int age) {
+	unsigned int i;
+
+	i = *countp;
+	if (i == LDAP_STATS_TOP_ZONES) {
+		if (top[i - 1].changes >= changes)
+			return;
+		i--;
+	} else {
+		(*countp)++;
+	}
+	for (; i > 0 && top[i - 1].changes < changes; i--) {
+		dns_fixedname_init(&top[i].name);
+		dns_name_copy(dns_fixedname_name(&top[i - 1].name),
+			      dns_fixedname_name(&top[i].name), NULL);
+		top[i].changes = top[i - 1].changes;
+		top[i].serials = top[i - 1].serials;
+		top[i].age = top[i - 1].age;
+	}
+	dns_fixedname_init(&top[i].name);
+	dns_name_copy(name, dns_fixedname_name(&top[i].name), NULL);
+	top[i].changes = changes;
+	top[i].serials = serials;
+	top[i].age = age;
+}
+
+/**
+ * Write runtime statistics of the instance to the log: counters
+ * and histograms, SyncRepl queue, metaLDAP, total change rates of all zones
+ * and zones with most changes.
+ */
+static void ATTR_NONNULLS
+ldap_instance_stats_log(ldap_instance_t *inst) {
+	isc_result_t result;
+	dns_db_t *ldapdb = NULL;
+	dns_name_t *names = NULL;
+	unsigned int names_count = 0;
+	unsigned int names_size = 0;
+	zone_stats_t top[LDAP_STATS_TOP_ZONES];
+	unsigned int top_count = 0;
+	unsigned int used;
+	unsigned int peak;
+	unsigned int limit;
+	isc_uint64_t changes;
+	isc_uint64_t serials;
+	isc_uint64_t changes_sum = 0;
+	isc_uint64_t serials_sum = 0;
+	isc_uint64_t changes_rate = 0;
+	isc_uint64_t serials_rate = 0;
+	unsigned int age;
+	unsigned int i;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	ldap_stats_log(inst->stats, inst->db_name);
+	sync_concurr_limit_getstats(inst->sctx, &used, &peak, &limit);
+	log_info("LDAP instance '%s' statistics: changes waiting for "
+		 "processing: %u, peak %u, limit %u",
+		 inst->db_name, used, peak, limit);
+	log_info("LDAP instance '%s' statistics: metaLDAP entries: %u, "
+		 "memory in use: %zu bytes", inst->db_name,
+		 mldap_count(inst->mldapdb), isc_mem_inuse(inst->mctx));
+
+	CHECK(zone_names_get(inst, &names, &names_count, &names_size));
+	for (i = 0; i < names_count; i++) {
+		result = zr_get_zone_dbs(inst->zone_register, &names[i],
+					 &ldapdb, NULL);
+		if (result == ISC_R_NOTFOUND)
+			continue; /* zone was deleted in the meantime */
+		else if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		zone_batch_getstats(ldapdb_get_batch(ldapdb), &changes,
+				    &serials, &age);
+		dns_db_detach(&ldapdb);
+
+		changes_sum += changes;
+		serials_sum += serials;
+		changes_rate += changes * 3600 / ISC_MAX(age, 1);
+		serials_rate += serials * 3600 / ISC_MAX(age, 1);
+		if (changes > 0)
+			zone_stats_top_add(top, &top_count, &names[i],
+					   changes, serials, age);
+	}
+
+	log_info("LDAP instance '%s' statistics: %u zones: "
+		 "%llu changes, %llu serial increments "
+		 "(%llu and %llu per hour)", inst->db_name, names_count,
+		 (unsigned long long)changes_sum,
+		 (unsigned long long)serials_sum,
+		 (unsigned long long)changes_rate,
+		 (unsigned long long)serials_rate);
+	for (i = 0; i < top_count; i++) {
+		age = ISC_MAX(top[i].age, 1);
+		dns_name_format(dns_fixedname_name(&top[i].name), zone_name,
+				sizeof(zone_name));
+		log_info("LDAP instance '%s' statistics: zone '%s': "
+			 "%llu changes, %llu serial increments "
+			 "(%llu and %llu per hour)", inst->db_name, zone_name,
+			 (unsigned long long)top[i].changes,
+			 (unsigned long long)top[i].serials,
+			 (unsigned long long)(top[i].changes * 3600 / age),
+			 (unsigned long long)(top[i].serials * 3600 / age));
+	}
+
+cleanup:
+	if (names != NULL)
+		zone_names_free(inst, &names, names_count, names_size);
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		log_error_r("unable to get statistics for zones of "
+			    "LDAP instance '%s'", inst->db_name);
+}
+
+/**
+ * Periodic dump of statistics, runs in inst->task.
+ */
+static void
+ldap_stats_action(isc_task_t *task, isc_event_t *event) {
+	ldap_instance_t *inst = event->ev_arg;
+
+	UNUSED(task);
+
+	if (inst->destroyed == ISC_FALSE)
+		ldap_instance_stats_log(inst);
+	isc_event_free(&event);
+}
+
+/**
+ * Release reference to the instance held by stats timer. The event is
+ * sent to inst->task after the timer was detached so it is processed
+ * after timer event which might be in progress.
+ */
+static void
+ldap_stats_stop(isc_task_t *task, isc_event_t *event) {
+	ldap_instance_t *inst = event->ev_arg;
+
+	UNUSED(task);
+
+	/* event memory belongs to inst->mctx */
+	isc_event_free(&event);
+	ldap_instance_detach(&inst);
+}
+
+/**
+ * Start timer which writes statistics to the log every 'interval'
+ * seconds from inst->task.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_stats_start(ldap_instance_t *inst, isc_timermgr_t *timermgr,
+		 isc_uint32_t seconds) {
+	isc_result_t result;
+	isc_interval_t interval;
+	ldap_instance_t *ref = NULL;
+
+	REQUIRE(inst->stats_timer == NULL);
+
+	inst->stats_stopev = isc_event_allocate(inst->mctx, inst,
+						LDAPDB_EVENT_STATS_STOP,
+						ldap_stats_stop, NULL,
+						sizeof(isc_event_t));
+	if (inst->stats_stopev == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	isc_interval_set(&interval, seconds, 0);
+	CHECK(isc_timer_create(timermgr, isc_timertype_ticker, NULL,
+			       &interval, inst->task, ldap_stats_action,
+			       inst, &inst->stats_timer));
+	ldap_instance_attach(inst, &ref);
+	inst->stats_stopev->ev_arg = ref;
+
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (inst->stats_stopev != NULL)
+		isc_event_free(&inst->stats_stopev);
+	return result;
+}
+
 void
 destroy_ldap_instance(ldap_instance_t **ldap_instp)
 {
@@ -689,30 +1224,87 @@ destroy_ldap_instance(ldap_instance_t **ldap_instp)
 		ldap_inst->watcher = 0;
 	}
 
+	if (ldap_inst->stats_timer != NULL) {
+		isc_timer_detach(&ldap_inst->stats_timer);
+		isc_task_send(ldap_inst->task, &ldap_inst->stats_stopev);
+	}
+
+	/* watcher is stopped, nobody can add more changes */
+	sync_group_flush(ldap_inst);
+	if (ldap_inst->zone_register != NULL)
+		zone_batch_flush_all(ldap_inst);
+	ldap_cache_save(ldap_inst);
+	/* events still waiting in task queues will be dropped */
+	ldap_inst->destroyed = ISC_TRUE;
+	if (ldap_inst->stats != NULL)
+		ldap_instance_stats_log(ldap_inst);
+	sync_record_destroy(&ldap_inst->sync_record);
+
 	/* Unregister all zones already registered in BIND. */
 	zr_destroy(&ldap_inst->zone_register);
 	fwdr_destroy(&ldap_inst->fwd_register);
 	mldap_destroy(&ldap_inst->mldapdb);
+	dn_cache_destroy(&ldap_inst->dncache);
+	rr_template_index_destroy(&ldap_inst->templates);
+	if (ldap_inst->sync_cookie != NULL)
+		ber_bvfree(ldap_inst->sync_cookie);
 
 	ldap_pool_destroy(&ldap_inst->pool);
+	ldap_stats_destroy(&ldap_inst->stats);
+	server_list_destroy(&ldap_inst->servers);
+	ldap_parsepool_destroy(&ldap_inst->parsepool);
 	dns_view_detach(&ldap_inst->view);
 
 	DESTROYLOCK(&ldap_inst->kinit_lock);
+	DESTROYLOCK(&ldap_inst->sync_group.lock);
 
 	settings_set_free(&ldap_inst->global_settings);
 	settings_set_free(&ldap_inst->local_settings);
 	settings_set_free(&ldap_inst->server_ldap_settings);
 
+	*ldap_instp = NULL;
+	ldap_instance_detach(&ldap_inst);
+	log_debug(1, "LDAP instance '%s' destroyed", db_name);
+}
+
+void
+ldap_instance_attach(ldap_instance_t *source, ldap_instance_t **targetp)
+{
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references, NULL);
+	*targetp = source;
+}
+
+/**
+ * Release reference to LDAP instance. Memory is freed when the last
+ * reference is released, i.e. after destroy_ldap_instance() and after
+ * all syncrepl events were freed.
+ */
+void
+ldap_instance_detach(ldap_instance_t **ldap_instp)
+{
+	ldap_instance_t *ldap_inst;
+	unsigned int refs;
+
+	REQUIRE(ldap_instp != NULL && *ldap_instp != NULL);
+
+	ldap_inst = *ldap_instp;
+	*ldap_instp = NULL;
+
+	isc_refcount_decrement(&ldap_inst->references, &refs);
+	if (refs > 0)
+		return;
+
+	/* pool with syncrepl events is freed together with sync context */
 	sync_ctx_free(&ldap_inst->sctx);
 	/* zero out error counter (and do nothing other than that) */
 	ldap_instance_untaint_finish(ldap_inst,
 				     ldap_instance_untaint_start(ldap_inst));
 	isc_refcount_destroy(&ldap_inst->errors);
+	isc_refcount_destroy(&ldap_inst->references);
 
 	MEM_PUT_AND_DETACH(ldap_inst);
-
-	*ldap_instp = NULL;
-	log_debug(1, "LDAP instance '%s' destroyed", db_name);
 }
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
@@ -726,12 +1318,7 @@ new_ldap_connection(ldap_pool_t *pool, ldap_connection_t **ldap_connp)
 
 	CHECKED_MEM_GET_PTR(pool->mctx, ldap_conn);
 	ZERO_PTR(ldap_conn);
-
-	result = isc_mutex_init(&ldap_conn->lock);
-	if (result != ISC_R_SUCCESS) {
-		SAFE_MEM_PUT_PTR(pool->mctx, ldap_conn);
-		return result;
-	}
+	ISC_LINK_INIT(ldap_conn, link);
 
 	isc_mem_attach(pool->mctx, &ldap_conn->mctx);
 
@@ -756,7 +1343,6 @@ destroy_ldap_connection(ldap_connection_t **ldap_connp)
 	if (ldap_conn == NULL)
 		return;
 
-	DESTROYLOCK(&ldap_conn->lock);
 	if (ldap_conn->handle != NULL)
 		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
 
@@ -841,92 +1427,367 @@ cleanup:
 }
 
 /**
- * Unload empty zone from given view.
- *
- * @retval ISC_R_EXISTS   if a zone with given name is not an empty zone
- * @retval ISC_R_SUCCESS  if name was an empty zone
- *                        and it was unloaded successfully
- * @retval ISC_R_NOTFOUND if name does not match any zone in given view
- * @retval other errors
+ * Get path to file with metaLDAP snapshot and SyncRepl cookie.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-zone_unload_ifempty(dns_view_t *view, dns_name_t *name) {
+ldap_cache_path(ldap_instance_t *inst, ld_string_t **path) {
 	isc_result_t result;
-	dns_zone_t *zone = NULL;
-	char zone_name[DNS_NAME_FORMATSIZE];
+	const char *dir_name = NULL;
+	ld_string_t *cache_path = NULL;
 
-	CHECK(dns_view_findzone(view, name, &zone));
+	REQUIRE(path != NULL && *path == NULL);
 
-	if (zone_isempty(zone) == ISC_TRUE) {
-		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
-		result = delete_bind_zone(view->zonetable, &zone);
-		if (result != ISC_R_SUCCESS)
-			log_error_r("unable to unload automatic empty zone "
-				    "%s", zone_name);
-		else
-			log_info("automatic empty zone %s unloaded",
-				 zone_name);
-	} else {
-		result = ISC_R_EXISTS;
-	}
+	CHECK(str_new(inst->mctx, &cache_path));
+	CHECK(setting_get_str("directory", inst->local_settings, &dir_name));
+	CHECK(str_cat_char(cache_path, dir_name));
+	CHECK(str_cat_char(cache_path, "metaldap.cache"));
+
+	*path = cache_path;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	if (zone != NULL)
-		dns_zone_detach(&zone);
+	str_destroy(&cache_path);
 	return result;
 }
 
+/**
+ * Dump data of all zones in ZR into zone cache files. The files are read
+ * by zone_cache_load() when the SyncRepl session is resumed after restart.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-configure_paths(isc_mem_t *mctx, ldap_instance_t *inst, dns_zone_t *zone,
-		isc_boolean_t issecure) {
+zone_cache_save_all(ldap_instance_t *inst) {
 	isc_result_t result;
-	ld_string_t *file_name = NULL;
-	ld_string_t *key_dir = NULL;
+	rbt_iterator_t *iter = NULL;
+	dns_db_t *ldapdb = NULL;
+	dns_db_t *rbtdb = NULL;
+	ld_string_t *path = NULL;
+	DECLARE_BUFFERED_NAME(name);
 
-	CHECK(zr_get_zone_path(mctx, ldap_instance_getsettings_local(inst),
-			       dns_zone_getorigin(zone),
-			       (issecure ? "signed" : "raw"), &file_name));
-	CHECK(dns_zone_setfile(zone, str_buf(file_name)));
-	if (issecure == ISC_TRUE) {
-		CHECK(zr_get_zone_path(mctx,
+	INIT_BUFFERED_NAME(name);
+	CHECK(zr_rbt_iter_init(inst->zone_register, &iter, &name));
+	do {
+		CHECK(zr_get_zone_dbs(inst->zone_register, &name, &ldapdb,
+				      &rbtdb));
+		/* cached zone would not match the zone journal */
+		if (zone_batch_changes(ldapdb_get_batch(ldapdb)) != 0)
+			CLEANUP_WITH(ISC_R_BUSY);
+		CHECK(zr_get_zone_path(inst->mctx,
 				       ldap_instance_getsettings_local(inst),
-				       dns_zone_getorigin(zone), "keys/",
-				       &key_dir));
-		dns_zone_setkeydirectory(zone, str_buf(key_dir));
-	}
-	CHECK(fs_file_remove(dns_zone_getfile(zone)));
-	CHECK(fs_file_remove(dns_zone_getjournal(zone)));
+				       &name, "cache", &path));
+		CHECK(dns_db_dump2(rbtdb, NULL, str_buf(path),
+				   dns_masterformat_raw));
+		dns_db_detach(&rbtdb);
+		dns_db_detach(&ldapdb);
+		str_destroy(&path);
+
+		INIT_BUFFERED_NAME(name);
+		CHECK(rbt_iter_next(&iter, &name));
+	} while (result == ISC_R_SUCCESS);
 
 cleanup:
-	str_destroy(&file_name);
-	str_destroy(&key_dir);
+	rbt_iter_stop(&iter);
+	if (rbtdb != NULL)
+		dns_db_detach(&rbtdb);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	str_destroy(&path);
+	if (result == ISC_R_NOTFOUND || result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
 	return result;
 }
 
-/*
- * Create a new zone with origin 'name'. The zone will be added to the
- * ldap_inst->view.
+/**
+ * Load zone data cached by zone_cache_save_all() into a new LDAP DB.
+ * The cache file is removed after use so it cannot be used again.
+ *
+ * @param[out] ldapdbp LDAP DB with zone data or NULL if there is nothing
+ *                     to load, i.e. zone caches are not in use
+ *                     or the zone is already loaded.
+ *
+ * @pre The zone entry was known to metaLDAP, i.e. the zone existed
+ *      when the zone cache was saved.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-create_zone(ldap_instance_t * const inst, const char * const dn,
-	    dns_name_t * const name, dns_db_t * const ldapdb,
-	    const isc_boolean_t want_secure, dns_zone_t ** const rawp,
-	    dns_zone_t ** const securep)
-{
+zone_cache_load(ldap_instance_t *inst, dns_name_t *name, dns_db_t **ldapdbp) {
 	isc_result_t result;
+	dns_db_t *ldapdb = NULL;
+	ld_string_t *path = NULL;
 	dns_zone_t *raw = NULL;
-	dns_zone_t *secure = NULL;
-	const char *ldap_argv[2];
-	const char *rbt_argv[1] = { "rbt" };
-	sync_state_t sync_state;
-	isc_task_t *task = NULL;
-	char zone_name[DNS_NAME_FORMATSIZE];
+	char *argv[1];
 
-	REQUIRE(inst != NULL);
-	REQUIRE(name != NULL);
-	REQUIRE(rawp != NULL && *rawp == NULL);
+	REQUIRE(ldapdbp != NULL && *ldapdbp == NULL);
 
-	ldap_argv[0] = ldapdb_impname;
+	if (inst->zone_cache == ISC_FALSE)
+		return ISC_R_SUCCESS;
+
+	result = zr_get_zone_ptr(inst->zone_register, name, &raw, NULL);
+	if (result == ISC_R_SUCCESS) {
+		dns_zone_detach(&raw);
+		return ISC_R_SUCCESS;
+	}
+
+	CHECK(zr_get_zone_path(inst->mctx,
+			       ldap_instance_getsettings_local(inst),
+			       name, "cache", &path));
+	DE_CONST(inst->db_name, argv[0]);
+	CHECK(ldapdb_create(inst->mctx, name, LDAP_DB_TYPE, LDAP_DB_RDATACLASS,
+			    sizeof(argv)/sizeof(argv[0]), argv, NULL,
+			    &ldapdb));
+	CHECK(dns_db_load2(ldapdb_get_rbtdb(ldapdb), str_buf(path),
+			   dns_masterformat_raw));
+
+	*ldapdbp = ldapdb;
+	ldapdb = NULL;
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		/* metaLDAP does not match zone content without the cache,
+		 * data synchronization cannot be resumed */
+		inst->zone_cache_failed = ISC_TRUE;
+		log_error_r("unable to load zone cache '%s', full "
+			    "synchronization will be done",
+			    (path != NULL) ? str_buf(path) : "<NULL>");
+	}
+	if (path != NULL && fs_file_remove(str_buf(path)) != ISC_R_SUCCESS)
+		inst->zone_cache_failed = ISC_TRUE;
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	str_destroy(&path);
+	/* failure means only that full synchronization is necessary */
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Load metaLDAP snapshot and SyncRepl cookie stored by ldap_cache_save()
+ * so the data synchronization can be resumed from the point where
+ * it ended before restart.
+ *
+ * The snapshot is removed immediately so it cannot be used again
+ * after a crash. A missing or invalid snapshot is not an error,
+ * full synchronization will be done instead.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_cache_load(ldap_instance_t *inst) {
+	isc_result_t result;
+	isc_boolean_t persistent;
+	ld_string_t *path = NULL;
+
+	CHECK(setting_get_bool("persistent_cache", inst->local_settings,
+			       &persistent));
+	CHECK(ldap_cache_path(inst, &path));
+	if (persistent == ISC_FALSE || !isc_file_exists(str_buf(path))) {
+		/* old snapshot must not be used after next restart */
+		CHECK(fs_file_remove(str_buf(path)));
+		goto cleanup;
+	}
+
+	result = mldap_snapshot_load(inst->mldapdb, str_buf(path),
+				     &inst->sync_cookie);
+	if (result == ISC_R_SUCCESS) {
+		inst->zone_cache = ISC_TRUE;
+		log_info("LDAP instance '%s': loaded cache '%s', data "
+			 "synchronization will be resumed",
+			 inst->db_name, str_buf(path));
+	} else {
+		log_error_r("unable to load cache '%s', full "
+			    "synchronization will be done", str_buf(path));
+		if (inst->sync_cookie != NULL) {
+			ber_bvfree(inst->sync_cookie);
+			inst->sync_cookie = NULL;
+		}
+		mldap_destroy(&inst->mldapdb);
+		CHECK(mldap_new(inst->mctx, &inst->mldapdb));
+	}
+	CHECK(fs_file_remove(str_buf(path)));
+
+cleanup:
+	str_destroy(&path);
+	return result;
+}
+
+/**
+ * Store metaLDAP snapshot, SyncRepl cookie and zone data to disk so
+ * the data synchronization can be resumed after restart.
+ *
+ * Nothing is stored if persistent_cache is disabled, if the initial
+ * synchronization was not finished or if any error occurred
+ * which could cause inconsistency between LDAP and DNS data.
+ *
+ * @pre SyncRepl watcher thread is stopped.
+ */
+static void ATTR_NONNULLS
+ldap_cache_save(ldap_instance_t *inst) {
+	isc_result_t result;
+	sync_state_t state;
+	ld_string_t *path = NULL;
+
+	/* cookie exists only if persistent_cache is enabled */
+	if (inst->sync_cookie == NULL)
+		return;
+
+	sync_state_get(inst->sctx, &state);
+	if (state != sync_finished) {
+		log_info("LDAP instance '%s': initial synchronization was not "
+			 "finished, cache will not be saved", inst->db_name);
+		return;
+	}
+	if (ldap_instance_istained(inst) == ISC_TRUE)
+		CLEANUP_WITH(DNS_R_BADDB);
+
+	/* all changes described by the cookie have to be applied */
+	CHECK(sync_concurr_limit_drain(inst->sctx));
+	CHECK(zone_cache_save_all(inst));
+	CHECK(ldap_cache_path(inst, &path));
+	CHECK(mldap_snapshot_save(inst->mldapdb, inst->sync_cookie,
+				  str_buf(path)));
+	log_info("LDAP instance '%s': cache saved to '%s'",
+		 inst->db_name, str_buf(path));
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("LDAP instance '%s': unable to save cache, full "
+			    "synchronization will be done after restart",
+			    inst->db_name);
+		str_destroy(&path);
+		if (ldap_cache_path(inst, &path) == ISC_R_SUCCESS)
+			(void)fs_file_remove(str_buf(path));
+	}
+	str_destroy(&path);
+}
+
+/**
+ * Add tasks of all zones in ZR to the list of tasks in synchronization
+ * context, so the following barrier will wait for events sent to them.
+ * This is necessary for zones created before data synchronization started.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_zr_tasks_add(ldap_instance_t *inst) {
+	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	isc_task_t *task = NULL;
+	DECLARE_BUFFERED_NAME(name);
+
+	INIT_BUFFERED_NAME(name);
+	CHECK(zr_rbt_iter_init(inst->zone_register, &iter, &name));
+	do {
+		CHECK(zr_get_zone_ptr(inst->zone_register, &name, &raw, &secure));
+		dns_zone_gettask(raw, &task);
+		CHECK(sync_task_add(inst->sctx, task));
+		isc_task_detach(&task);
+		dns_zone_detach(&raw);
+		if (secure != NULL) {
+			dns_zone_gettask(secure, &task);
+			CHECK(sync_task_add(inst->sctx, task));
+			isc_task_detach(&task);
+			dns_zone_detach(&secure);
+		}
+
+		INIT_BUFFERED_NAME(name);
+		CHECK(rbt_iter_next(&iter, &name));
+	} while (result == ISC_R_SUCCESS);
+
+cleanup:
+	rbt_iter_stop(&iter);
+	if (task != NULL)
+		isc_task_detach(&task);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (secure != NULL)
+		dns_zone_detach(&secure);
+	if (result == ISC_R_NOTFOUND || result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
+	return result;
+}
+
+/**
+ * Unload empty zone from given view.
+ *
+ * @retval ISC_R_EXISTS   if a zone with given name is not an empty zone
+ * @retval ISC_R_SUCCESS  if name was an empty zone
+ *                        and it was unloaded successfully
+ * @retval ISC_R_NOTFOUND if name does not match any zone in given view
+ * @retval other errors
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_unload_ifempty(dns_view_t *view, dns_name_t *name) {
+	isc_result_t result;
+	dns_zone_t *zone = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	CHECK(dns_view_findzone(view, name, &zone));
+
+	if (zone_isempty(zone) == ISC_TRUE) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		result = delete_bind_zone(view->zonetable, &zone);
+		if (result != ISC_R_SUCCESS)
+			log_error_r("unable to unload automatic empty zone "
+				    "%s", zone_name);
+		else
+			log_info("automatic empty zone %s unloaded",
+				 zone_name);
+	} else {
+		result = ISC_R_EXISTS;
+	}
+
+cleanup:
+	if (zone != NULL)
+		dns_zone_detach(&zone);
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+configure_paths(isc_mem_t *mctx, ldap_instance_t *inst, dns_zone_t *zone,
+		isc_boolean_t issecure) {
+	isc_result_t result;
+	ld_string_t *file_name = NULL;
+	ld_string_t *key_dir = NULL;
+
+	CHECK(zr_get_zone_path(mctx, ldap_instance_getsettings_local(inst),
+			       dns_zone_getorigin(zone),
+			       (issecure ? "signed" : "raw"), &file_name));
+	CHECK(dns_zone_setfile(zone, str_buf(file_name)));
+	if (issecure == ISC_TRUE) {
+		CHECK(zr_get_zone_path(mctx,
+				       ldap_instance_getsettings_local(inst),
+				       dns_zone_getorigin(zone), "keys/",
+				       &key_dir));
+		dns_zone_setkeydirectory(zone, str_buf(key_dir));
+	}
+	CHECK(fs_file_remove(dns_zone_getfile(zone)));
+	CHECK(fs_file_remove(dns_zone_getjournal(zone)));
+
+cleanup:
+	str_destroy(&file_name);
+	str_destroy(&key_dir);
+	return result;
+}
+
+/*
+ * Create a new zone with origin 'name'. The zone will be added to the
+ * ldap_inst->view.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+create_zone(ldap_instance_t * const inst, const char * const dn,
+	    dns_name_t * const name, dns_db_t * const ldapdb,
+	    const isc_boolean_t want_secure, dns_zone_t ** const rawp,
+	    dns_zone_t ** const securep)
+{
+	isc_result_t result;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	const char *ldap_argv[2];
+	const char *rbt_argv[1] = { "rbt" };
+	sync_state_t sync_state;
+	isc_task_t *task = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	REQUIRE(inst != NULL);
+	REQUIRE(name != NULL);
+	REQUIRE(rawp != NULL && *rawp == NULL);
+
+	ldap_argv[0] = ldapdb_impname;
 	ldap_argv[1] = inst->db_name;
 
 	result = zone_unload_ifempty(inst->view, name);
@@ -1153,77 +2014,530 @@ cleanup:
 }
 
 /**
- * Add all active zones in zone register to DNS view specified in inst->view
- * and load zones.
+ * Shared state of zone loading started by activate_zones(). Zones are loaded
+ * by their own tasks and at most ctx->window loads run at the same time.
+ * The last finished load reports the result and destroys the context.
  */
-isc_result_t
-activate_zones(isc_task_t *task, ldap_instance_t *inst) {
-	isc_result_t result;
-	rbt_iterator_t *iter = NULL;
-	DECLARE_BUFFERED_NAME(name);
-	unsigned int published_cnt = 0;
-	unsigned int total_cnt = 0;
-	unsigned int active_cnt = 0;
-	settings_set_t *settings;
-	isc_boolean_t active;
+typedef struct zone_loadctx zone_loadctx_t;
+struct zone_loadctx {
+	isc_mem_t	*mctx;
+	/* reference keeps the instance valid, see syncrepl_event_instance() */
+	ldap_instance_t	*inst;
+	isc_mutex_t	lock;		/**< guards next, finished, failed */
+	dns_zone_t	**zones;	/**< zones to be loaded */
+	unsigned int	size;		/**< allocated size of zones array */
+	unsigned int	count;		/**< number of zones in array */
+	unsigned int	next;		/**< index of the next zone to load */
+	unsigned int	finished;
+	unsigned int	failed;		/**< loading failed */
+	unsigned int	window;
+
+	/* numbers for the final report */
+	unsigned int	total_cnt;
+	unsigned int	active_cnt;
+	unsigned int	early_cnt;	/**< activated by zone_refreshed_activate() */
+	isc_time_t	start;
+	isc_time_t	load_start;
+	isc_uint64_t	scan_time;	/**< microseconds */
+	isc_uint64_t	publish_time;	/**< microseconds */
+};
 
-	INIT_BUFFERED_NAME(name);
-	for(result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
-	    result == ISC_R_SUCCESS;
-	    dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
-		settings = NULL;
-		result = zr_get_zone_settings(inst->zone_register, &name, &settings);
-		INSIST(result == ISC_R_SUCCESS);
-		result = setting_get_bool("active", settings, &active);
-		INSIST(result == ISC_R_SUCCESS);
+typedef struct zone_loadev zone_loadev_t;
+struct zone_loadev {
+	ISC_EVENT_COMMON(zone_loadev_t);
+	zone_loadctx_t	*ctx;
+	dns_zone_t	*zone;
+};
 
-		++total_cnt;
-		if (active == ISC_TRUE) {
-			++active_cnt;
-			result = activate_zone(task, inst, &name);
-			if (result == ISC_R_SUCCESS)
-				++published_cnt;
-			result = fwd_configure_zone(settings, inst, &name);
-			if (result != ISC_R_SUCCESS)
-				log_error_r("could not configure forwarding");
+static void ATTR_NONNULLS
+zone_loadctx_destroy(zone_loadctx_t **ctxp) {
+	zone_loadctx_t *ctx = *ctxp;
+	ldap_instance_t *inst = ctx->inst;
+	unsigned int i;
+
+	for (i = 0; i < ctx->count; i++)
+		dns_zone_detach(&ctx->zones[i]);
+	if (ctx->zones != NULL)
+		isc_mem_put(ctx->mctx, ctx->zones,
+			    ctx->size * sizeof(dns_zone_t *));
+	DESTROYLOCK(&ctx->lock);
+	MEM_PUT_AND_DETACH(ctx);
+	*ctxp = NULL;
+	if (inst != NULL)
+		ldap_instance_detach(&inst);
+}
 
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_loadctx_add(zone_loadctx_t *ctx, dns_zone_t *zone) {
+	isc_result_t result;
+	dns_zone_t **zones = NULL;
+	unsigned int size;
+
+	if (ctx->count == ctx->size) {
+		size = ISC_MAX(64, ctx->size * 2);
+		CHECKED_MEM_GET(ctx->mctx, zones, size * sizeof(dns_zone_t *));
+		if (ctx->zones != NULL) {
+			memcpy(zones, ctx->zones,
+			       ctx->count * sizeof(dns_zone_t *));
+			isc_mem_put(ctx->mctx, ctx->zones,
+				    ctx->size * sizeof(dns_zone_t *));
 		}
-	};
+		ctx->zones = zones;
+		ctx->size = size;
+	}
+	dns_zone_attach(zone, &ctx->zones[ctx->count++]);
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Remove zone from the array, the last zone is moved to its place.
+ */
+static void ATTR_NONNULLS
+zone_loadctx_remove(zone_loadctx_t *ctx, unsigned int i) {
+	dns_zone_t *zone = ctx->zones[i];
+
+	ctx->zones[i] = ctx->zones[--ctx->count];
+	ctx->zones[ctx->count] = NULL;
+	dns_zone_detach(&zone);
+}
+
+static void ATTR_NONNULLS
+zone_loadctx_report(zone_loadctx_t *ctx) {
+	isc_time_t now;
+	unsigned int published_cnt;
 
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+	published_cnt = ctx->early_cnt + ctx->count - ctx->failed;
 	log_info("%u master zones from LDAP instance '%s' loaded (%u zones "
 		 "defined, %u inactive, %u failed to load)", published_cnt,
-		 inst->db_name, total_cnt, total_cnt - active_cnt,
-		 active_cnt - published_cnt);
-	if (total_cnt < 1)
+		 ctx->inst->db_name, ctx->total_cnt, ctx->total_cnt - ctx->active_cnt,
+		 ctx->active_cnt - published_cnt);
+	log_info("LDAP instance '%s': zone activation took %u ms (register "
+		 "scan %u ms, publishing %u ms, loading %u ms, %u zones "
+		 "activated earlier)", ctx->inst->db_name,
+		 (unsigned int)(isc_time_microdiff(&now, &ctx->start) / 1000),
+		 (unsigned int)(ctx->scan_time / 1000),
+		 (unsigned int)(ctx->publish_time / 1000),
+		 (unsigned int)(isc_time_microdiff(&now, &ctx->load_start)
+				/ 1000),
+		 ctx->early_cnt);
+	if (ctx->total_cnt < 1)
 		log_info("0 master zones is suspicious number, please check "
 			 "access control instructions on LDAP server");
-	return result;
 }
 
+static void ATTR_NONNULLS
+zone_load_handler(isc_task_t *task, isc_event_t *event);
 
+/**
+ * Send load event for the next zone to its task.
+ *
+ * @pre ctx->lock is locked.
+ *
+ * @retval ISC_R_NOMORE All zones were already handed out.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-configure_zone_acl(isc_mem_t *mctx, dns_zone_t *zone,
-		void (acl_setter)(dns_zone_t *zone, dns_acl_t *acl),
-		const char *aclstr, acl_type_t type) {
-	isc_result_t result;
-	isc_result_t result2;
-	dns_acl_t *acl = NULL;
-	const char *type_txt = NULL;
-
-	result = acl_from_ldap(mctx, aclstr, type, &acl);
-	if (result != ISC_R_SUCCESS) {
-		result2 = get_enum_description(acl_type_txts, type, &type_txt);
-		if (result2 != ISC_R_SUCCESS) {
-			log_bug("invalid acl type %u", type);
-			type_txt = "<unknown>";
+zone_load_next(zone_loadctx_t *ctx) {
+	zone_loadev_t *ev = NULL;
+	isc_task_t *task = NULL;
+	dns_zone_t *zone;
+
+	while (ctx->next < ctx->count) {
+		zone = ctx->zones[ctx->next++];
+		ev = (zone_loadev_t *)isc_event_allocate(ctx->mctx, ctx,
+							 LDAPDB_EVENT_ZONE_LOAD,
+							 zone_load_handler,
+							 NULL,
+							 sizeof(zone_loadev_t));
+		if (ev == NULL) {
+			dns_zone_log(zone, ISC_LOG_ERROR, "cannot load zone: "
+				     "%s", isc_result_totext(ISC_R_NOMEMORY));
+			ctx->finished++;
+			ctx->failed++;
+			continue;
 		}
+		ev->ctx = ctx;
+		ev->zone = NULL;
+		dns_zone_attach(zone, &ev->zone);
+		dns_zone_gettask(zone, &task);
+		isc_task_send(task, (isc_event_t **)&ev);
+		isc_task_detach(&task);
+		return ISC_R_SUCCESS;
+	}
 
-		dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_ERROR,
-			      "%s policy is invalid: %s; configuring most "
-			      "restrictive %s policy as possible",
-			      type_txt, isc_result_totext(result), type_txt);
-		result2 = acl_from_ldap(mctx, "", type, &acl);
-		if (result2 != ISC_R_SUCCESS) {
+	return ISC_R_NOMORE;
+}
+
+/**
+ * Load one zone in its own task and start loading of the next zone.
+ */
+static void ATTR_NONNULLS
+zone_load_handler(isc_task_t *task, isc_event_t *event) {
+	zone_loadev_t *ev = (zone_loadev_t *)event;
+	zone_loadctx_t *ctx = ev->ctx;
+	isc_result_t result;
+	ldap_instance_t *inst = ctx->inst;
+	dns_zone_t *raw = NULL;
+	settings_set_t *zone_settings = NULL;
+	isc_boolean_t last;
+
+	UNUSED(task);
+
+	if (inst->destroyed == ISC_TRUE)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	CHECK(load_zone(ev->zone, ISC_TRUE));
+	/* in-line signing: ev->zone is the secure zone */
+	dns_zone_getraw(ev->zone, &raw);
+	if (raw != NULL) {
+		CHECK(zr_get_zone_settings(inst->zone_register,
+					   dns_zone_getorigin(ev->zone),
+					   &zone_settings));
+		CHECK(zone_master_reconfigure_nsec3param(zone_settings,
+							 ev->zone));
+	}
+
+cleanup:
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	dns_zone_detach(&ev->zone);
+	isc_event_free(&event);
+
+	LOCK(&ctx->lock);
+	ctx->finished++;
+	if (result != ISC_R_SUCCESS)
+		ctx->failed++;
+	(void)zone_load_next(ctx);
+	last = ISC_TF(ctx->finished == ctx->count);
+	UNLOCK(&ctx->lock);
+
+	if (last == ISC_TRUE) {
+		zone_loadctx_report(ctx);
+		zone_loadctx_destroy(&ctx);
+	}
+}
+
+/**
+ * Add all active zones in zone register to DNS view specified in inst->view
+ * and load zones.
+ *
+ * View modifications (zone publishing and forwarding configuration) are done
+ * in a single exclusive section. Zones are loaded afterwards by their
+ * own tasks, with at most two loads per CPU running in parallel.
+ * The result is logged when the last zone is loaded.
+ */
+isc_result_t
+activate_zones(isc_task_t *task, ldap_instance_t *inst) {
+	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	DECLARE_BUFFERED_NAME(name);
+	zone_loadctx_t *ctx = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	settings_set_t *settings;
+	isc_boolean_t active;
+	isc_boolean_t activated;
+	isc_boolean_t freeze = ISC_FALSE;
+	isc_result_t lock_state = ISC_R_IGNORE;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	dns_zone_t *toview;
+	isc_time_t now;
+	isc_result_t published;
+	isc_boolean_t done;
+	unsigned int i;
+
+	CHECKED_MEM_GET_PTR(inst->mctx, ctx);
+	ZERO_PTR(ctx);
+	isc_mem_attach(inst->mctx, &ctx->mctx);
+	CHECK(isc_mutex_init(&ctx->lock));
+	lock_ready = ISC_TRUE;
+	ldap_instance_attach(inst, &ctx->inst);
+	ctx->window = ISC_MAX(2 * isc_os_ncpus(), 1);
+	RUNTIME_CHECK(isc_time_now(&ctx->start) == ISC_R_SUCCESS);
+
+	/* Phase 1: find zones which have to be activated. */
+	INIT_BUFFERED_NAME(name);
+	for(result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	    result == ISC_R_SUCCESS;
+	    dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		settings = NULL;
+		result = zr_get_zone_settings(inst->zone_register, &name, &settings);
+		INSIST(result == ISC_R_SUCCESS);
+		result = setting_get_bool("active", settings, &active);
+		INSIST(result == ISC_R_SUCCESS);
+
+		++ctx->total_cnt;
+		if (active == ISC_FALSE)
+			continue;
+
+		++ctx->active_cnt;
+		/* Load only "secure" zone if inline-signing is active,
+		 * see activate_zone(). */
+		result = zr_get_zone_ptr(inst->zone_register, &name, &raw,
+					 &secure);
+		if (result == ISC_R_SUCCESS) {
+			toview = (secure != NULL) ? secure : raw;
+			result = zone_loadctx_add(ctx, toview);
+		}
+		if (result != ISC_R_SUCCESS)
+			log_error_r("cannot activate zone");
+		if (raw != NULL)
+			dns_zone_detach(&raw);
+		if (secure != NULL)
+			dns_zone_detach(&secure);
+	}
+	/* iterator holds zone register lock */
+	rbt_iter_stop(&iter);
+
+	for (i = 0; i < ctx->count; ) {
+		result = zr_set_zone_activated(inst->zone_register,
+					       dns_zone_getorigin(ctx->zones[i]),
+					       ISC_FALSE, &activated);
+		/* already activated by zone_refreshed_activate() */
+		if (result == ISC_R_SUCCESS && activated == ISC_TRUE) {
+			++ctx->early_cnt;
+			zone_loadctx_remove(ctx, i);
+		} else {
+			++i;
+		}
+	}
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+	ctx->scan_time = isc_time_microdiff(&now, &ctx->start);
+
+	/*
+	 * Phase 2: publish zones and configure forwarding. Zone has to be
+	 * published *before* zone load, see activate_zone(). Nested
+	 * run_exclusive_enter() calls inside are no-op so the whole phase
+	 * is a single exclusive section and the view is thawed only once.
+	 */
+	run_exclusive_enter(inst, &lock_state);
+	if (inst->view->frozen) {
+		freeze = ISC_TRUE;
+		dns_view_thaw(inst->view);
+	}
+	for (i = 0; i < ctx->count; ) {
+		toview = ctx->zones[i];
+		published = publish_zone(task, inst, toview);
+		if (published != ISC_R_SUCCESS)
+			dns_zone_log(toview, ISC_LOG_ERROR,
+				     "cannot add zone to view: %s",
+				     dns_result_totext(published));
+
+		settings = NULL;
+		result = zr_get_zone_settings(inst->zone_register,
+					      dns_zone_getorigin(toview),
+					      &settings);
+		if (result == ISC_R_SUCCESS)
+			result = fwd_configure_zone(settings, inst,
+						    dns_zone_getorigin(toview));
+		if (result != ISC_R_SUCCESS)
+			log_error_r("could not configure forwarding");
+
+		/* zone which is not in the view must not be loaded */
+		if (published != ISC_R_SUCCESS)
+			zone_loadctx_remove(ctx, i);
+		else
+			++i;
+	}
+	if (freeze)
+		dns_view_freeze(inst->view);
+	run_exclusive_exit(inst, lock_state);
+	RUNTIME_CHECK(isc_time_now(&ctx->load_start) == ISC_R_SUCCESS);
+	ctx->publish_time = isc_time_microdiff(&ctx->load_start, &now);
+
+	/* Phase 3: load zones in parallel, the last one reports result. */
+	if (ctx->count == 0) {
+		zone_loadctx_report(ctx);
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	}
+	LOCK(&ctx->lock);
+	for (i = 0; i < ctx->window; i++)
+		if (zone_load_next(ctx) != ISC_R_SUCCESS)
+			break;
+	/* all events could fail to be sent */
+	done = ISC_TF(ctx->finished == ctx->count);
+	UNLOCK(&ctx->lock);
+	if (done == ISC_TRUE) {
+		zone_loadctx_report(ctx);
+		zone_loadctx_destroy(&ctx);
+	}
+	ctx = NULL;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	rbt_iter_stop(&iter);
+	if (ctx != NULL) {
+		if (lock_ready == ISC_TRUE)
+			zone_loadctx_destroy(&ctx);
+		else
+			MEM_PUT_AND_DETACH(ctx);
+	}
+	if (result != ISC_R_SUCCESS)
+		log_error_r("LDAP instance '%s': zone activation failed",
+			    inst->db_name);
+	return result;
+}
+
+
+/**
+ * Activate zone whose records were completely processed before the end
+ * of initial synchronization, so the zone does not have to wait
+ * for all other zones. Runs in inst->task, see run_exclusive_enter().
+ */
+static void ATTR_NONNULLS
+zone_refreshed_activate(isc_task_t *task, isc_event_t *event) {
+	zone_refreshev_t *ev = (zone_refreshev_t *)event;
+	isc_result_t result;
+	ldap_instance_t *inst = ev->inst;
+	settings_set_t *settings = NULL;
+	isc_boolean_t active;
+	isc_boolean_t activated;
+	sync_state_t sync_state;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	if (inst->destroyed == ISC_TRUE)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	/* activate_zones() takes care of the zone after the barrier */
+	sync_state_get(inst->sctx, &sync_state);
+	if (sync_state != sync_datainit)
+		goto cleanup;
+
+	CHECK(zr_get_zone_settings(inst->zone_register, &ev->zone_name,
+				   &settings));
+	CHECK(setting_get_bool("active", settings, &active));
+	if (active == ISC_FALSE)
+		goto cleanup;
+
+	CHECK(zr_set_zone_activated(inst->zone_register, &ev->zone_name,
+				    ISC_TRUE, &activated));
+	if (activated == ISC_TRUE)
+		goto cleanup;
+
+	result = activate_zone(task, inst, &ev->zone_name);
+	if (result != ISC_R_SUCCESS) {
+		/* let activate_zones() try again */
+		(void)zr_set_zone_activated(inst->zone_register,
+					    &ev->zone_name, ISC_FALSE, NULL);
+		goto cleanup;
+	}
+	result = fwd_configure_zone(settings, inst, &ev->zone_name);
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("could not configure forwarding");
+		result = ISC_R_SUCCESS;
+	}
+	dns_name_format(&ev->zone_name, zone_name, sizeof(zone_name));
+	log_debug(1, "zone '%s' activated before the end of initial "
+		  "synchronization", zone_name);
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND) {
+		dns_name_format(&ev->zone_name, zone_name, sizeof(zone_name));
+		log_error_r("early activation of zone '%s' failed, zone will "
+			    "be activated after initial synchronization",
+			    zone_name);
+	}
+	/* event memory belongs to the instance */
+	ev->inst = NULL;
+	isc_event_free(&event);
+	ldap_instance_detach(&inst);
+}
+
+/**
+ * All events for the zone queued before this one were processed,
+ * i.e. all records from its refresh session are in the zone database.
+ * Pass the event to inst->task which is allowed to modify the view.
+ */
+static void ATTR_NONNULLS
+zone_refreshed_handler(isc_task_t *task, isc_event_t *event) {
+	zone_refreshev_t *ev = (zone_refreshev_t *)event;
+	ldap_instance_t *inst = ev->inst;
+
+	UNUSED(task);
+
+	if (inst->destroyed == ISC_TRUE) {
+		ev->inst = NULL;
+		isc_event_free(&event);
+		ldap_instance_detach(&inst);
+		return;
+	}
+
+	ev->ev_action = zone_refreshed_activate;
+	isc_task_send(inst->task, &event);
+}
+
+/**
+ * Schedule activation of the zone after all records sent by its refresh
+ * session are processed by the zone task.
+ *
+ * @param[in] dn DN of the zone which was completely downloaded.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_refreshed_send(ldap_instance_t *inst, const char *dn) {
+	isc_result_t result;
+	zone_refreshev_t *ev = NULL;
+	dns_zone_t *raw = NULL;
+	isc_task_t *task = NULL;
+	dns_name_t name;
+
+	dns_name_init(&name, NULL);
+	CHECK(dn_cache_dnsname(inst->dncache, inst->mctx, dn, &name, NULL,
+			       NULL));
+	CHECK(zr_get_zone_ptr(inst->zone_register, &name, &raw, NULL));
+
+	ev = (zone_refreshev_t *)isc_event_allocate(inst->mctx, inst,
+						    LDAPDB_EVENT_ZONE_REFRESHED,
+						    zone_refreshed_handler,
+						    NULL,
+						    sizeof(zone_refreshev_t));
+	if (ev == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	ev->inst = NULL;
+	INIT_BUFFERED_NAME(ev->zone_name);
+	CHECK(dns_name_copy(&name, &ev->zone_name, NULL));
+	ldap_instance_attach(inst, &ev->inst);
+
+	/* records of the zone were sent to the raw zone task */
+	dns_zone_gettask(raw, &task);
+	isc_task_send(task, (isc_event_t **)&ev);
+
+cleanup:
+	if (dns_name_dynamic(&name))
+		dns_name_free(&name, inst->mctx);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (task != NULL)
+		isc_task_detach(&task);
+	if (ev != NULL)
+		isc_event_free((isc_event_t **)&ev);
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+configure_zone_acl(isc_mem_t *mctx, dns_zone_t *zone,
+		void (acl_setter)(dns_zone_t *zone, dns_acl_t *acl),
+		const char *aclstr, acl_type_t type) {
+	isc_result_t result;
+	isc_result_t result2;
+	dns_acl_t *acl = NULL;
+	const char *type_txt = NULL;
+
+	result = acl_from_ldap(mctx, aclstr, type, &acl);
+	if (result != ISC_R_SUCCESS) {
+		result2 = get_enum_description(acl_type_txts, type, &type_txt);
+		if (result2 != ISC_R_SUCCESS) {
+			log_bug("invalid acl type %u", type);
+			type_txt = "<unknown>";
+		}
+
+		dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_ERROR,
+			      "%s policy is invalid: %s; configuring most "
+			      "restrictive %s policy as possible",
+			      type_txt, isc_result_totext(result), type_txt);
+		result2 = acl_from_ldap(mctx, "", type, &acl);
+		if (result2 != ISC_R_SUCCESS) {
 			dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_CRITICAL,
 				      "cannot configure restrictive %s policy: %s",
 				      type_txt, isc_result_totext(result2));
@@ -1331,6 +2645,11 @@ ldap_delete_zone2(ldap_instance_t *inst, dns_name_t *name, isc_boolean_t lock)
 		}
 	} /* else: zone wasn't in a view */
 
+	result = zone_batch_flush_zone(inst, name);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to write changes from LDAP to journal "
+			    "of zone '%s'", zone_name_char);
+
 	if (secure != NULL)
 		CHECK(delete_bind_zone(inst->view->zonetable, &secure));
 	CHECK(delete_bind_zone(inst->view->zonetable, &raw));
@@ -1457,6 +2776,9 @@ ldap_parse_serverconfigentry(ldap_entry_t *entry, ldap_instance_t *inst)
 						inst->server_ldap_settings,
 						"idnsSubstitutionVariable;ipalocation",
 						entry);
+	if (result == ISC_R_SUCCESS)
+		result = ldap_templates_rerender(inst,
+						 "substitutionvariable_ipalocation");
 	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
 		goto cleanup;
 
@@ -1637,6 +2959,27 @@ cleanup:
 	return result;
 }
 
+/**
+ * Convert owner name to DN of the LDAP entry in given zone.
+ *
+ * @retval ISC_R_NOTFOUND Zone is not managed by this LDAP instance.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_owner_to_dn(ldap_instance_t *inst, dns_name_t *owner, dns_name_t *zone,
+		 ld_string_t *target) {
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+
+	CHECK(zr_get_zone_handle(inst->zone_register, zone, &zinfo));
+	CHECK(dn_cache_ownerdn(inst->dncache, owner, zone, zinfo_getdn(zinfo),
+			       target));
+
+cleanup:
+	if (zinfo != NULL)
+		zr_zone_handle_detach(&zinfo);
+	return result;
+}
+
 /**
  * Replace SOA serial in LDAP for given zone.
  *
@@ -1659,7 +3002,7 @@ ldap_replace_serial(ldap_instance_t *inst, dns_name_t *zone,
 	REQUIRE(inst != NULL);
 
 	CHECK(str_new(inst->mctx, &dn));
-	CHECK(dnsname_to_dn(inst->zone_register, zone, zone, dn));
+	CHECK(ldap_owner_to_dn(inst, zone, zone, dn));
 
 	change.mod_op = LDAP_MOD_REPLACE;
 	change.mod_type = "idnsSOAserial";
@@ -1683,19 +3026,22 @@ zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
 	dns_rdata_nsec3param_t nsec3p_rr;
 	dns_name_t *origin = NULL;
 	const char *nsec3p_str = NULL;
-	ldap_entry_t *fake_entry = NULL;
+	isc_consttextregion_t nsec3p_text;
+	ldap_parsectx_t *parser = NULL;
 
 	REQUIRE(secure != NULL);
 
 	mctx = dns_zone_getmctx(secure);
 	origin = dns_zone_getorigin(secure);
-	CHECK(ldap_entry_init(mctx, &fake_entry));
+	CHECK(ldap_parsectx_create(mctx, &parser));
 
 	CHECK(setting_get_str("nsec3param", zone_settings, &nsec3p_str));
 	dns_zone_log(secure, ISC_LOG_INFO,
 		     "reconfiguring NSEC3PARAM to '%s'", nsec3p_str);
-	CHECK(parse_rdata(mctx, fake_entry, dns_rdataclass_in,
-			  dns_rdatatype_nsec3param, origin, nsec3p_str,
+	nsec3p_text.base = nsec3p_str;
+	nsec3p_text.length = strlen(nsec3p_str);
+	CHECK(parse_rdata(mctx, parser, dns_rdataclass_in,
+			  dns_rdatatype_nsec3param, origin, &nsec3p_text,
 			  &nsec3p_rdata));
 	CHECK(dns_rdata_tostruct(nsec3p_rdata, &nsec3p_rr, NULL));
 	CHECK(dns_zone_setnsec3param(secure, nsec3p_rr.hash, nsec3p_rr.flags,
@@ -1708,8 +3054,7 @@ cleanup:
 		isc_mem_put(mctx, nsec3p_rdata->data, nsec3p_rdata->length);
 		SAFE_MEM_PUT_PTR(mctx, nsec3p_rdata);
 	}
-	if (fake_entry != NULL)
-		ldap_entry_destroy(&fake_entry);
+	ldap_parsectx_destroy(mctx, &parser);
 	return result;
 }
 
@@ -1900,8 +3245,8 @@ zone_sync_apex(const ldap_instance_t * const inst,
 	INIT_LIST(rdatalist);
 	*ldap_writeback = ISC_FALSE; /* GCC */
 
-	CHECK(ldap_parse_rrentry(inst->mctx, entry, &name,
-				 zone_settings, &rdatalist));
+	CHECK(ldap_parse_rrentry(inst->mctx, inst->parsepool, inst->templates,
+				 entry, &name, zone_settings, &rdatalist));
 
 	CHECK(dns_db_getoriginnode(rbtdb, &node));
 	result = dns_db_allrdatasets(rbtdb, node, version, 0,
@@ -2027,6 +3372,7 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 	isc_boolean_t configured = ISC_FALSE;
 	isc_boolean_t activity_changed;
 	isc_boolean_t isactive = ISC_FALSE;
+	isc_boolean_t activated = ISC_FALSE;
 	settings_set_t *zone_settings = NULL;
 	isc_boolean_t ldap_writeback;
 	isc_boolean_t data_changed = ISC_FALSE; /* GCC */
@@ -2087,6 +3433,13 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 	CHECK(zr_get_zone_dbs(inst->zone_register, &entry->fqdn, &ldapdb, &rbtdb));
 	CHECK(dns_db_newversion(ldapdb, &version));
 	sync_state_get(inst->sctx, &sync_state);
+	/* Zone activated by zone_refreshed_activate() is already served,
+	 * see update_record(). */
+	if (new_zone == ISC_FALSE && sync_state != sync_finished)
+		CHECK(zr_get_zone_activated(inst->zone_register, &entry->fqdn,
+					    &activated));
+	if (activated == ISC_TRUE)
+		sync_state = sync_finished;
 	CHECK(zone_sync_apex(inst, entry, entry->fqdn, sync_state, new_zone,
 			     ldapdb, rbtdb, version, zone_settings,
 			     &diff, &new_serial, &ldap_writeback,
@@ -2280,100 +3633,6 @@ free_rdatalist(isc_mem_t *mctx, dns_rdatalist_t *rdlist)
 	}
 }
 
-/**
- * Replace occurrences of \{variable_name\} with respective strings from
- * settings tree. Remaining parts of the original string are just copied
- * into the output.
- *
- * Double-escaped strings \\{ \\} do not trigger substitution.
- * Nested references will expand only innermost variable: \{\{var1\}\}
- * Non-matching parentheses and other garbage will be copied verbatim
- * without trigerring an error.
- *
- * @retval  ISC_R_SUCCESS  Output string is valid. Caller must deallocate output.
- * @retval  ISC_R_IGNORE   Some variables used in the template are not defined
- *                         in settings tree. Substitution was terminated
- *                         prematurely and output is not available.
- * @retval  others         Unexpected errors.
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_substitute_rr_template(isc_mem_t *mctx, const settings_set_t const * set,
-			    ld_string_t *orig_val, ld_string_t **output) {
-	isc_result_t result;
-	regex_t regex;
-	regmatch_t matches[3];
-	size_t processed = 0;
-	char *tmp = NULL;
-	const char *setting_name;
-	setting_t *setting;
-	ld_string_t *replaced = NULL;
-
-	/* match \{variable_name\} in the text
-	 * \{ and \} must not be double-escaped like \\{ or \\} */
-	if (regcomp(&regex,
-		    "\\(^\\|[^\\]\\)" /* character preceding \{ = matches[1] */
-		    "\\\\{"
-		    "\\([a-zA-Z0-9_-]\\+\\)" /* variable name = matches[2] */
-		    "\\\\}",
-		    0) != 0)
-		CLEANUP_WITH(ISC_R_UNEXPECTED);
-
-	CHECK(str_new(mctx, &replaced));
-	CHECKED_MEM_STRDUP(mctx, str_buf(orig_val), tmp);
-
-	while (regexec(&regex, tmp + processed,
-		       sizeof(matches)/sizeof(regmatch_t),
-		       matches, 0) == 0)
-	{
-		/* derelativize offsets to make sure they
-		 * always start from tmp instead of tmp + processed */
-		for (size_t i = 0; i < sizeof(matches)/sizeof(regmatch_t); i++) {
-			matches[i].rm_so += processed;
-			matches[i].rm_eo += processed;
-		}
-		/* copy verbatim part of the string which precedes the \{ */
-		CHECK(str_cat_char_len(replaced,
-				       tmp + processed,
-				       matches[1].rm_eo - processed));
-
-		/* find value for given variable name in settings tree */
-		setting_name = tmp + matches[2].rm_so;
-		tmp[matches[2].rm_eo] = '\0';
-		setting = NULL;
-		result = setting_find(setting_name, set, isc_boolean_true,
-				      isc_boolean_true, &setting);
-		if (result != ISC_R_SUCCESS) {
-			log_debug(3, "setting '%s' is not defined so it "
-				  "cannot be substituted into template '%s'",
-				  setting_name, str_buf(orig_val));
-			CLEANUP_WITH(ISC_R_IGNORE);
-		}
-		if (setting->type != ST_STRING) {
-			log_bug("setting '%s' it not string so it cannot be "
-				"substituted", setting_name);
-			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
-		}
-		CHECK(str_cat_char(replaced, setting->value.value_char));
-
-		/* end offset of previous match = matches[0].rm_eo */
-		processed = matches[0].rm_eo;
-	};
-
-	/* copy remaining part of the string */
-	CHECK(str_cat_char(replaced, tmp + processed));
-
-	*output = replaced;
-	replaced = NULL;
-	result = ISC_R_SUCCESS;
-
-cleanup:
-	if (tmp != NULL)
-		isc_mem_free(mctx, tmp);
-
-	str_destroy(&replaced);
-	return result;
-}
-
 /**
  * Substitute strings into idnsTemplateAttributes
  * and parse results into list of rdatas.
@@ -2384,6 +3643,9 @@ cleanup:
  * @warning Substitution currently works only for *Record attributes
  *          and cannot be used for anything else.
  *
+ * Templates compiled when the entry was added to the template index
+ * are used so they are not compiled again on each parse.
+ *
  * @retval  ISC_R_SUCCESS  A template exists in the entry and values
  *                         were successfully substituted into it.
  *                         Rdatalist contains new rdata.
@@ -2391,14 +3653,17 @@ cleanup:
  *                         do not have defined values. Ignore output.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
-			    dns_name_t *origin,
+ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_parsectx_t *parser,
+			    rr_template_index_t *templates,
+			    ldap_entry_t *entry, dns_name_t *origin,
 			    const settings_set_t * const settings,
 			    ldapdb_rdatalist_t *rdatalist)
 {
 	isc_result_t result;
 	ldap_attribute_t *attr;
-	ld_string_t *orig_val = NULL;
+	isc_consttextregion_t value;
+	isc_consttextregion_t new_text;
+	rr_template_set_t *set = NULL;
 	ld_string_t *new_val = NULL;
 	dns_rdata_t *rdata = NULL;
 	dns_rdataclass_t rdclass;
@@ -2406,39 +3671,47 @@ ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
 	dns_rdatatype_t rdtype;
 	dns_rdatalist_t *rdlist = NULL;
 	isc_boolean_t did_something = ISC_FALSE;
-	static const char prefix[] = "idnsTemplateAttribute;";
-	static const char prefix_len = sizeof(prefix) - 1;
 
-	CHECK(str_new(mctx, &orig_val));
+	CHECK(str_new(mctx, &new_val));
 	rdclass = ldap_entry_getrdclass(entry);
 	ttl = ldap_entry_getttl(entry, settings);
+	if (entry->uuid != NULL) {
+		result = rr_template_index_find(templates, entry->uuid, &set);
+		if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+			goto cleanup;
+		result = ISC_R_SUCCESS;
+	}
 
 	while ((attr = ldap_entry_nextattr(entry)) != NULL) {
-		if (strncasecmp(prefix, attr->name, prefix_len) != 0)
+		if (strncasecmp(LDAP_TEMPLATE_ATTR_PREFIX, attr->name,
+				LDAP_TEMPLATE_ATTR_PREFIX_LEN) != 0)
 			continue;
 
-		result = ldap_attribute_to_rdatatype(attr->name + prefix_len,
+		result = ldap_attribute_to_rdatatype(attr->name
+						     + LDAP_TEMPLATE_ATTR_PREFIX_LEN,
 						     &rdtype);
 		if (result != ISC_R_SUCCESS) {
 			log_bug("%s: substitution into '%s' is not supported",
 				ldap_entry_logname(entry),
-				attr->name + prefix_len);
+				attr->name + LDAP_TEMPLATE_ATTR_PREFIX_LEN);
 			continue;
 		}
 
 		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
 					      rdtype, ttl, &rdlist));
-		for (result = ldap_attr_firstvalue(attr, orig_val);
+		for (result = ldap_attr_firstvalue(attr, &value);
 		     result == ISC_R_SUCCESS;
-		     result = ldap_attr_nextvalue(attr, orig_val)) {
-			str_destroy(&new_val);
-			CHECK(ldap_substitute_rr_template(mctx, settings,
-							  orig_val, &new_val));
+		     result = ldap_attr_nextvalue(attr, &value)) {
+			CHECK(rr_template_set_render(mctx, set, rdtype,
+						     value.base, settings,
+						     new_val));
 			log_debug(10, "%s: substituted '%s' '%s' -> '%s'",
 				  ldap_entry_logname(entry), attr->name,
-				  str_buf(orig_val), str_buf(new_val));
-			CHECK(parse_rdata(mctx, entry, rdclass, rdtype, origin,
-					  str_buf(new_val), &rdata));
+				  value.base, str_buf(new_val));
+			new_text.base = str_buf(new_val);
+			new_text.length = str_len(new_val);
+			CHECK(parse_rdata(mctx, parser, rdclass, rdtype,
+					  origin, &new_text, &rdata));
 			APPEND(rdlist->rdata, rdata, link);
 			rdata = NULL;
 			did_something = ISC_TRUE;
@@ -2446,7 +3719,7 @@ ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
 	}
 
 cleanup:
-	str_destroy(&orig_val);
+	rr_template_set_detach(&set);
 	str_destroy(&new_val);
 	if (result == ISC_R_NOMORE || result == ISC_R_SUCCESS)
 		result = did_something ? ISC_R_SUCCESS : ISC_R_IGNORE;
@@ -2467,7 +3740,9 @@ cleanup:
  * @param rdatalist[in,out]
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
+ldap_parse_rrentry(isc_mem_t *mctx, ldap_parsepool_t *parsepool,
+		   rr_template_index_t *templates,
+		   ldap_entry_t *entry, dns_name_t *origin,
 		   const settings_set_t * const settings,
 		   ldapdb_rdatalist_t *rdatalist)
 {
@@ -2478,43 +3753,45 @@ ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
 	dns_rdata_t *rdata = NULL;
 	dns_rdatalist_t *rdlist = NULL;
 	ldap_attribute_t *attr;
-	const char *data_str = "<NULL data>";
-	ld_string_t *data_buf = NULL;
+	isc_consttextregion_t data = { "<NULL data>", 0 };
 	const char *fake_mname;
+	ldap_parsectx_t *parser = NULL;
 
 	REQUIRE(EMPTY(*rdatalist));
 
+	CHECK(ldap_parsepool_get(parsepool, &parser));
 	ttl = ldap_entry_getttl(entry, settings);
 	rdclass = ldap_entry_getrdclass(entry);
 	if ((entry->class & LDAP_ENTRYCLASS_MASTER) != 0) {
-		CHECK(setting_get_str("fake_mname", settings, &fake_mname));
-		CHECK(add_soa_record(mctx, origin, entry, ttl, rdatalist,
-				     fake_mname));
+		CHECK(setting_get_str_id(SETTING_fake_mname, settings,
+					 &fake_mname));
+		CHECK(add_soa_record(mctx, parser, origin, entry, ttl,
+				     rdatalist, fake_mname));
 	}
 
 	if ((entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0) {
-		result = ldap_parse_rrentry_template(mctx, entry, origin,
-						     settings, rdatalist);
-		if (result == ISC_R_SUCCESS)
+		result = ldap_parse_rrentry_template(mctx, parser, templates,
+						     entry, origin, settings,
+						     rdatalist);
+		if (result == ISC_R_SUCCESS) {
 			/* successful substitution overrides all constants */
+			ldap_parsepool_put(parsepool, &parser);
 			return result;
-		else if (result != ISC_R_IGNORE)
+		} else if (result != ISC_R_IGNORE)
 			goto cleanup;
 	}
 
-	CHECK(str_new(mctx, &data_buf));
 	for (result = ldap_entry_firstrdtype(entry, &attr, &rdtype);
 	     result == ISC_R_SUCCESS;
 	     result = ldap_entry_nextrdtype(entry, &attr, &rdtype)) {
 
 		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
 					      rdtype, ttl, &rdlist));
-		for (result = ldap_attr_firstvalue(attr, data_buf);
+		for (result = ldap_attr_firstvalue(attr, &data);
 		     result == ISC_R_SUCCESS;
-		     result = ldap_attr_nextvalue(attr, data_buf)) {
-			CHECK(parse_rdata(mctx, entry, rdclass,
-					  rdtype, origin,
-					  str_buf(data_buf), &rdata));
+		     result = ldap_attr_nextvalue(attr, &data)) {
+			CHECK(parse_rdata(mctx, parser, rdclass,
+					  rdtype, origin, &data, &rdata));
 			APPEND(rdlist->rdata, rdata, link);
 			rdata = NULL;
 		}
@@ -2525,25 +3802,25 @@ ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
 	if (result != ISC_R_NOMORE)
 		goto cleanup;
 
-	str_destroy(&data_buf);
+	ldap_parsepool_put(parsepool, &parser);
 	return ISC_R_SUCCESS;
 
 cleanup:
-	if (data_buf != NULL && str_len(data_buf) != 0)
-		data_str = str_buf(data_buf);
+	/* values are NUL-terminated */
 	log_error_r("failed to parse RR entry: %s: data '%s'",
-		    ldap_entry_logname(entry), data_str);
-	str_destroy(&data_buf);
+		    ldap_entry_logname(entry), data.base);
+	ldap_parsepool_put(parsepool, &parser);
 	return result;
 }
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
+add_soa_record(isc_mem_t *mctx, ldap_parsectx_t *parser, dns_name_t *origin,
 	       ldap_entry_t *entry, dns_ttl_t ttl, ldapdb_rdatalist_t *rdatalist,
 	       const char *fake_mname)
 {
 	isc_result_t result;
 	ld_string_t *string = NULL;
+	isc_consttextregion_t text;
 	dns_rdataclass_t rdclass;
 	dns_rdata_t *rdata = NULL;
 	dns_rdatalist_t *rdlist = NULL;
@@ -2552,8 +3829,10 @@ add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
 
 	CHECK(ldap_entry_getfakesoa(entry, fake_mname, string));
 	rdclass = ldap_entry_getrdclass(entry);
-	CHECK(parse_rdata(mctx, entry, rdclass, dns_rdatatype_soa, origin,
-			  str_buf(string), &rdata));
+	text.base = str_buf(string);
+	text.length = str_len(string);
+	CHECK(parse_rdata(mctx, parser, rdclass, dns_rdatatype_soa, origin,
+			  &text, &rdata));
 
 	CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass, dns_rdatatype_soa,
 				      ttl, &rdlist));
@@ -2569,54 +3848,58 @@ cleanup:
 }
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
+parse_rdata(isc_mem_t *mctx, ldap_parsectx_t *parser,
 	    dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
-	    dns_name_t *origin, const char *rdata_text, dns_rdata_t **rdatap)
+	    dns_name_t *origin, const isc_consttextregion_t *rdata_text,
+	    dns_rdata_t **rdatap)
 {
 	isc_result_t result;
-	isc_consttextregion_t text;
 	isc_buffer_t lex_buffer;
 	isc_region_t rdatamem;
 	dns_rdata_t *rdata;
 
-	REQUIRE(entry != NULL);
+	REQUIRE(parser != NULL);
 	REQUIRE(rdata_text != NULL);
 	REQUIRE(rdatap != NULL);
 
 	rdata = NULL;
 	rdatamem.base = NULL;
 
-	text.base = rdata_text;
-	text.length = strlen(text.base);
-
-	isc_buffer_init(&lex_buffer, (char *)text.base, text.length);
-	isc_buffer_add(&lex_buffer, text.length);
-	isc_buffer_setactive(&lex_buffer, text.length);
-
-	CHECK(isc_lex_openbuffer(entry->lex, &lex_buffer));
-
-	isc_buffer_init(&entry->rdata_target, entry->rdata_target_mem,
+	isc_buffer_init(&parser->rdata_target, parser->rdata_target_mem,
 			DNS_RDATA_MAXLENGTH);
-	CHECK(dns_rdata_fromtext(NULL, rdclass, rdtype, entry->lex, origin,
-				 0, mctx, &entry->rdata_target, NULL));
+
+	/* Common types in simple format do not need full-blown parser. */
+	result = rdata_fromtext_fast(rdclass, rdtype, origin, rdata_text,
+				     &parser->rdata_target);
+	if (result != ISC_R_SUCCESS) {
+		isc_buffer_init(&lex_buffer, (char *)rdata_text->base,
+				rdata_text->length);
+		isc_buffer_add(&lex_buffer, rdata_text->length);
+		isc_buffer_setactive(&lex_buffer, rdata_text->length);
+
+		CHECK(isc_lex_openbuffer(parser->lex, &lex_buffer));
+		CHECK(dns_rdata_fromtext(NULL, rdclass, rdtype, parser->lex,
+					 origin, 0, mctx, &parser->rdata_target,
+					 NULL));
+	}
 
 	CHECKED_MEM_GET_PTR(mctx, rdata);
 	dns_rdata_init(rdata);
 
-	rdatamem.length = isc_buffer_usedlength(&entry->rdata_target);
+	rdatamem.length = isc_buffer_usedlength(&parser->rdata_target);
 	CHECKED_MEM_GET(mctx, rdatamem.base, rdatamem.length);
 
-	memcpy(rdatamem.base, isc_buffer_base(&entry->rdata_target),
+	memcpy(rdatamem.base, isc_buffer_base(&parser->rdata_target),
 	       rdatamem.length);
 	dns_rdata_fromregion(rdata, rdclass, rdtype, &rdatamem);
 
-	isc_lex_close(entry->lex);
+	isc_lex_close(parser->lex);
 
 	*rdatap = rdata;
 	return ISC_R_SUCCESS;
 
 cleanup:
-	isc_lex_close(entry->lex);
+	isc_lex_close(parser->lex);
 	SAFE_MEM_PUT_PTR(mctx, rdata);
 	if (rdatamem.base != NULL)
 		isc_mem_put(mctx, rdatamem.base, rdatamem.length);
@@ -2687,6 +3970,26 @@ cleanup:
 	return LDAP_OTHER;
 }
 
+/*
+ * Take server used by the connection out of rotation so next connection
+ * attempts go to another server (if there is any).
+ */
+static void ATTR_NONNULLS
+ldap_server_failed(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn)
+{
+	isc_uint32_t reconnect_interval;
+
+	if (ldap_conn->server == NULL)
+		return;
+
+	if (setting_get_uint_id(SETTING_reconnect_interval,
+				ldap_inst->server_ldap_settings,
+				&reconnect_interval) != ISC_R_SUCCESS)
+		reconnect_interval = 60;
+	server_failure(ldap_inst->servers, ldap_conn->server,
+		       reconnect_interval);
+}
+
 /*
  * Initialize the LDAP handle and bind to the server. Needed authentication
  * credentials and settings are available from the ldap_inst.
@@ -2700,15 +4003,29 @@ ldap_connect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
 	int version;
 	struct timeval timeout;
 	isc_result_t result = ISC_R_FAILURE;
-	const char *uri = NULL;
 	const char *ldap_hostname = NULL;
 	isc_uint32_t timeout_sec;
+	ldap_server_t *server = NULL;
+	isc_time_t start;
+	isc_time_t end;
 
 	REQUIRE(ldap_inst != NULL);
 	REQUIRE(ldap_conn != NULL);
 
-	CHECK(setting_get_str("uri", ldap_inst->local_settings, &uri));
-	ret = ldap_initialize(&ld, uri);
+	/* Switch to another server if the current one is down. Reconnect
+	 * back-off applies to a single server so fail over immediately. */
+	if (server_list_pick(ldap_inst->servers, ldap_conn->role, &server)
+	    == ISC_TRUE && server != ldap_conn->server) {
+		if (ldap_conn->server != NULL)
+			log_debug(1, "switching LDAP connection from %s to %s",
+				  server_uri(ldap_conn->server),
+				  server_uri(server));
+		ldap_conn->tries = 0;
+	}
+	ldap_conn->server = server;
+
+	RUNTIME_CHECK(isc_time_now(&start) == ISC_R_SUCCESS);
+	ret = ldap_initialize(&ld, server_uri(server));
 	if (ret != LDAP_SUCCESS) {
 		log_error("LDAP initialization failed: %s",
 			  ldap_err2string(ret));
@@ -2719,16 +4036,17 @@ ldap_connect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
 	ret = ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version);
 	LDAP_OPT_CHECK(ret, "failed to set LDAP version");
 
-	CHECK(setting_get_uint("timeout", ldap_inst->server_ldap_settings,
-			       &timeout_sec));
+	CHECK(setting_get_uint_id(SETTING_timeout,
+				  ldap_inst->server_ldap_settings,
+				  &timeout_sec));
 	timeout.tv_sec = timeout_sec;
 	timeout.tv_usec = 0;
 
 	ret = ldap_set_option(ld, LDAP_OPT_TIMEOUT, &timeout);
 	LDAP_OPT_CHECK(ret, "failed to set timeout");
 
-	CHECK(setting_get_str("ldap_hostname", ldap_inst->local_settings,
-			      &ldap_hostname));
+	CHECK(setting_get_str_id(SETTING_ldap_hostname,
+				 ldap_inst->local_settings, &ldap_hostname));
 	if (strlen(ldap_hostname) > 0) {
 		ret = ldap_set_option(ld, LDAP_OPT_HOST_NAME, ldap_hostname);
 		LDAP_OPT_CHECK(ret, "failed to set LDAP_OPT_HOST_NAME");
@@ -2740,12 +4058,20 @@ ldap_connect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
 	ld = NULL; /* prevent double-unbind from ldap_reconnect() and cleanup: */
 
 	CHECK(ldap_reconnect(ldap_inst, ldap_conn, force));
+	RUNTIME_CHECK(isc_time_now(&end) == ISC_R_SUCCESS);
+	server_success(ldap_inst->servers, server,
+		       isc_time_microdiff(&end, &start));
 	return result;
 
 cleanup:
 	if (ld != NULL)
 		ldap_unbind_ext_s(ld, NULL, NULL);
 
+	/* ISC_R_SOFTQUOTA = reconnect interval did not elapse,
+	 * nothing was tried */
+	if (result != ISC_R_SOFTQUOTA)
+		ldap_server_failed(ldap_inst, ldap_conn);
+
 	/* Make sure handle is NULL. */
 	if (ldap_conn->handle != NULL) {
 		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
@@ -2763,7 +4089,6 @@ ldap_reconnect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
 	int ret = 0;
 	const char *bind_dn = NULL;
 	const char *password = NULL;
-	const char *uri = NULL;
 	const char *sasl_mech = NULL;
 	const char *krb5_principal = NULL;
 	const char *krb5_keytab = NULL;
@@ -2792,9 +4117,9 @@ ldap_reconnect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
 		const size_t ntimes = sizeof(intervals) / sizeof(intervals[0]);
 
 		i = ISC_MIN(ntimes - 1, ldap_conn->tries);
-		CHECK(setting_get_uint("reconnect_interval",
-				       ldap_inst->server_ldap_settings,
-				       &reconnect_interval));
+		CHECK(setting_get_uint_id(SETTING_reconnect_interval,
+					  ldap_inst->server_ldap_settings,
+					  &reconnect_interval));
 		seconds = ISC_MIN(intervals[i], reconnect_interval);
 		isc_interval_set(&delay, seconds, 0);
 		isc_time_nowplusinterval(&ldap_conn->next_reconnect, &delay);
@@ -2802,32 +4127,36 @@ ldap_reconnect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
 
 	ldap_conn->tries++;
 force_reconnect:
-	CHECK(setting_get_str("uri", ldap_inst->local_settings, &uri));
-	log_debug(2, "trying to establish LDAP connection to %s", uri);
+	log_debug(2, "trying to establish LDAP connection to %s",
+		  server_uri(ldap_conn->server));
 
-	CHECK(setting_get_uint("auth_method_enum", ldap_inst->local_settings,
-			       &auth_method_enum));
+	CHECK(setting_get_uint_id(SETTING_auth_method_enum,
+				  ldap_inst->local_settings,
+				  &auth_method_enum));
 	switch (auth_method_enum) {
 	case AUTH_NONE:
 		ret = ldap_simple_bind_s(ldap_conn->handle, NULL, NULL);
 		break;
 	case AUTH_SIMPLE:
-		CHECK(setting_get_str("bind_dn", ldap_inst->server_ldap_settings,
-				      &bind_dn));
-		CHECK(setting_get_str("password", ldap_inst->server_ldap_settings,
-				      &password));
+		CHECK(setting_get_str_id(SETTING_bind_dn,
+					 ldap_inst->server_ldap_settings,
+					 &bind_dn));
+		CHECK(setting_get_str_id(SETTING_password,
+					 ldap_inst->server_ldap_settings,
+					 &password));
 		ret = ldap_simple_bind_s(ldap_conn->handle, bind_dn, password);
 		break;
 	case AUTH_SASL:
-		CHECK(setting_get_str("sasl_mech", ldap_inst->local_settings,
-				      &sasl_mech));
+		CHECK(setting_get_str_id(SETTING_sasl_mech,
+					 ldap_inst->local_settings,
+					 &sasl_mech));
 		if (strcmp(sasl_mech, "GSSAPI") == 0) {
-			CHECK(setting_get_str("krb5_principal",
-					      ldap_inst->local_settings,
-					      &krb5_principal));
-			CHECK(setting_get_str("krb5_keytab",
-					      ldap_inst->local_settings,
-					      &krb5_keytab));
+			CHECK(setting_get_str_id(SETTING_krb5_principal,
+						 ldap_inst->local_settings,
+						 &krb5_principal));
+			CHECK(setting_get_str_id(SETTING_krb5_keytab,
+						 ldap_inst->local_settings,
+						 &krb5_keytab));
 			LOCK(&ldap_inst->kinit_lock);
 			result = get_krb5_tgt(ldap_inst->mctx,
 					      krb5_principal,
@@ -2928,6 +4257,7 @@ handle_connection_error(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn
 	default:
 		/* Try to reconnect on other errors. */
 		log_ldap_error(ldap_conn->handle, "connection error");
+		ldap_server_failed(ldap_inst, ldap_conn);
 reconnect:
 		if (ldap_conn->handle == NULL && force == ISC_FALSE)
 			log_error("connection to the LDAP server was lost");
@@ -2941,42 +4271,221 @@ reconnect:
 }
 
 /**
- * Apply LDAP modifications.
+ * Prepare LDAP write operation for ldap_modify_pipeline().
  *
- * @retval ISC_R_SUCCESS
- * @retval DNS_R_UNKNOWN = LDAP_OBJECT_CLASS_VIOLATION
- *                       or LDAP_INSUFFICIENT_ACCESS. Most likely an attribute
- *                       for a DNS RR type cannot be added because it is not
- *                       present in the LDAP schema.
+ * @param[in] dn          DN of the entry to be modified.
+ * @param[in] mods        LDAP modifications. Array has to stay valid until
+ *                        the operation is finished.
+ * @param[in] delete_node Delete whole entry instead of applying mods.
  */
-isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_modify_do(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
-		isc_boolean_t delete_node)
-{
-	int ret;
-	int err_code;
-	const char *operation_str;
-	isc_boolean_t once = ISC_FALSE;
-	isc_result_t result;
-	ldap_connection_t *ldap_conn = NULL;
-
-	REQUIRE(dn != NULL);
-	REQUIRE(mods != NULL);
-	REQUIRE(ldap_inst != NULL);
+static void ATTR_NONNULLS
+ldap_writeop_init(ldap_writeop_t *op, const char *dn, LDAPMod **mods,
+		  isc_boolean_t delete_node) {
+	ZERO_PTR(op);
+	op->dn = dn;
+	op->mods = mods;
+	op->delete_node = delete_node;
+	op->msgid = -1;
+	op->state = WRITEOP_QUEUED;
+	op->result = ISC_R_FAILURE;
 
 	/* Any mod_op can be ORed with LDAP_MOD_BVALUES. */
 	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD)
-		operation_str = "modifying(add)";
+		op->operation_str = "modifying(add)";
 	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_DELETE)
-		operation_str = "modifying(del)";
+		op->operation_str = "modifying(del)";
 	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_REPLACE)
-		operation_str = "modifying(replace)";
+		op->operation_str = "modifying(replace)";
 	else {
-		operation_str = "modifying(unknown operation)";
-		log_bug("%s: 0x%x", operation_str, mods[0]->mod_op);
-		CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+		op->operation_str = "modifying(unknown operation)";
+		log_bug("%s: 0x%x", op->operation_str, mods[0]->mod_op);
+		op->state = WRITEOP_DONE;
+		op->result = ISC_R_NOTIMPLEMENTED;
+	}
+}
+
+static void ATTR_NONNULLS
+ldap_writeop_free(isc_mem_t *mctx, ldap_writeop_t *op) {
+	if (op->add_mods != NULL)
+		isc_mem_put(mctx, op->add_mods,
+			    op->add_mods_cnt * sizeof(LDAPMod *));
+	op->add_mods = NULL;
+	op->add_mods_cnt = 0;
+}
+
+/**
+ * Convert LDAP modify operation to add operation because
+ * the entry does not exist yet.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_writeop_toadd(isc_mem_t *mctx, ldap_writeop_t *op) {
+	isc_result_t result;
+	unsigned int i;
+
+	REQUIRE(op->add_mods == NULL);
+
+	/*
+	 * Create a new array of LDAPMod structures. We will change
+	 * the mod_op member of each one to 0 (but preserve
+	 * LDAP_MOD_BVALUES. Additionally, we also need to specify
+	 * the objectClass attribute.
+	 */
+	for (i = 0; op->mods[i]; i++)
+		op->mods[i]->mod_op &= LDAP_MOD_BVALUES;
+	op->add_mods_cnt = i + 2;
+	CHECKED_MEM_GET(mctx, op->add_mods,
+			op->add_mods_cnt * sizeof(LDAPMod *));
+	memcpy(op->add_mods, op->mods, i * sizeof(LDAPMod *));
+	op->obj_str[0] = "idnsRecord";
+	op->obj_str[1] = NULL;
+	op->obj_class.mod_op = 0;
+	op->obj_class.mod_type = "objectClass";
+	op->obj_class.mod_values = op->obj_str;
+	op->add_mods[i] = &op->obj_class;
+	op->add_mods[i + 1] = NULL;
+	op->adding = ISC_TRUE;
+	op->operation_str = "adding";
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		op->add_mods_cnt = 0;
+	return result;
+}
+
+/**
+ * Mark operation as failed. Failed operation will be retried once
+ * after ldap_modify_pipeline() attempts to re-establish the connection.
+ */
+static void ATTR_NONNULLS
+ldap_writeop_fail(ldap_writeop_t *op) {
+	op->msgid = -1;
+	op->result = ISC_R_FAILURE;
+	op->state = (op->retried == ISC_TRUE) ? WRITEOP_DONE : WRITEOP_RETRY;
+}
+
+/**
+ * Send asynchronous LDAP request for operation without waiting for result.
+ */
+static void ATTR_NONNULLS
+ldap_writeop_send(ldap_connection_t *conn, ldap_writeop_t *op) {
+	int ret;
+
+	REQUIRE(op->state == WRITEOP_QUEUED);
+
+	if (op->adding == ISC_TRUE) {
+		log_debug(2, "adding entry '%s'", op->dn);
+		ret = ldap_add_ext(conn->handle, op->dn, op->add_mods,
+				   NULL, NULL, &op->msgid);
+	} else if (op->delete_node == ISC_TRUE) {
+		log_debug(2, "deleting whole node: '%s'", op->dn);
+		ret = ldap_delete_ext(conn->handle, op->dn, NULL, NULL,
+				      &op->msgid);
+	} else {
+		log_debug(2, "writing to '%s': %s", op->dn, op->operation_str);
+		ret = ldap_modify_ext(conn->handle, op->dn, op->mods,
+				      NULL, NULL, &op->msgid);
+	}
+
+	if (ret == LDAP_SUCCESS) {
+		op->state = WRITEOP_SENT;
+		RUNTIME_CHECK(isc_time_now(&op->sent) == ISC_R_SUCCESS);
+	} else {
+		log_ldap_error(conn->handle, "while %s entry '%s'",
+			       op->operation_str, op->dn);
+		ldap_writeop_fail(op);
+	}
+}
+
+/**
+ * Process result of LDAP operation. Modification of non-existing entry
+ * is converted to add operation and queued again.
+ */
+static void ATTR_NONNULLS
+ldap_writeop_done(isc_mem_t *mctx, ldap_connection_t *conn,
+		  ldap_writeop_t *op, int err_code) {
+	int mod_op = op->mods[0]->mod_op & ~LDAP_MOD_BVALUES;
+
+	op->msgid = -1;
+	if (err_code == LDAP_SUCCESS) {
+		op->state = WRITEOP_DONE;
+		op->result = ISC_R_SUCCESS;
+		return;
+	}
+
+	/* If there is no object yet, create it with an ldap add operation. */
+	if (op->adding == ISC_FALSE && op->delete_node == ISC_FALSE &&
+	    mod_op == LDAP_MOD_ADD && err_code == LDAP_NO_SUCH_OBJECT) {
+		if (ldap_writeop_toadd(mctx, op) == ISC_R_SUCCESS) {
+			op->state = WRITEOP_QUEUED;
+			return;
+		}
+	}
+
+	log_ldap_error(conn->handle, "while %s entry '%s'",
+		       op->operation_str, op->dn);
+	/* attempt to manipulate attribute failed - likely a unknown RR type */
+	if (err_code == LDAP_OBJECT_CLASS_VIOLATION
+	    || err_code == LDAP_INSUFFICIENT_ACCESS) { /* this is for 389 DS */
+		op->state = WRITEOP_DONE;
+		op->result = DNS_R_UNKNOWN;
+		return;
+	}
+
+	/* do not retry if we are trying to delete an
+	 * unexisting attribute */
+	if (mod_op == LDAP_MOD_DELETE && err_code == LDAP_NO_SUCH_ATTRIBUTE) {
+		op->state = WRITEOP_DONE;
+		op->result = ISC_R_FAILURE;
+		return;
 	}
 
+	ldap_writeop_fail(op);
+}
+
+/**
+ * Apply multiple LDAP modifications using single LDAP connection.
+ *
+ * All requests are sent to LDAP server without waiting for results
+ * so the whole batch costs one round trip instead of one round trip
+ * per operation. Results are matched to operations by message ID.
+ * Failed operations are retried once after re-establishing the connection.
+ * Operations whose results do not arrive within the timeout setting
+ * are abandoned and handled as failed.
+ *
+ * @param[in,out] ops   Array of operations initialized by
+ *                      ldap_writeop_init(). Result of each operation
+ *                      is stored in ops[i].result, see ldap_modify_do().
+ *
+ * @retval ISC_R_SUCCESS All operations were processed, individual results
+ *                       are stored in ops[i].result.
+ * @retval others        Connection to LDAP is not available,
+ *                       no operation was processed.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modify_pipeline(ldap_instance_t *ldap_inst, ldap_writeop_t *ops,
+		     unsigned int count) {
+	isc_result_t result;
+	ldap_connection_t *ldap_conn = NULL;
+	LDAPMessage *msg = NULL;
+	ldap_writeop_t *op = NULL;
+	unsigned int i;
+	unsigned int outstanding;
+	isc_boolean_t retry;
+	int ret;
+	int err_code;
+	isc_time_t sent;
+	isc_time_t now;
+	isc_uint32_t timeout_sec;
+	isc_uint64_t waited;
+	isc_uint64_t remains;
+	isc_uint64_t limit;
+	struct timeval timeout;
+
+	CHECK(setting_get_uint_id(SETTING_timeout,
+				  ldap_inst->server_ldap_settings,
+				  &timeout_sec));
+	limit = (isc_uint64_t)timeout_sec * 1000000;
 	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
 	if (ldap_conn->handle == NULL) {
 		/*
@@ -2984,84 +4493,169 @@ ldap_modify_do(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
 		 * successful
 		 * TODO: handle this case inside ldap_pool_getconnection()?
 		 */
-retry:
-		once = ISC_TRUE;
+		for (i = 0; i < count; i++)
+			ops[i].retried = ISC_TRUE;
 		CHECK(handle_connection_error(ldap_inst, ldap_conn, ISC_FALSE));
 	}
 
-	if (delete_node) {
-		log_debug(2, "deleting whole node: '%s'", dn);
-		ret = ldap_delete_ext_s(ldap_conn->handle, dn, NULL, NULL);
-	} else {
-		log_debug(2, "writing to '%s': %s", dn, operation_str);
-		ret = ldap_modify_ext_s(ldap_conn->handle, dn, mods, NULL, NULL);
-	}
-
-	result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
-	if (ret == LDAP_SUCCESS)
-		goto cleanup;
-
-	LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-			&err_code), "ldap_modify_do(%s) failed to obtain ldap error code",
-			operation_str);
+	do {
+		outstanding = 0;
+		for (i = 0; i < count; i++) {
+			if (ops[i].state != WRITEOP_QUEUED)
+				continue;
+			ldap_writeop_send(ldap_conn, &ops[i]);
+			if (ops[i].state == WRITEOP_SENT)
+				outstanding++;
+		}
 
-	/* If there is no object yet, create it with an ldap add operation. */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD &&
-	     err_code == LDAP_NO_SUCH_OBJECT) {
-		int i;
-		LDAPMod **new_mods;
-		char *obj_str[] = { "idnsRecord", NULL };
-		LDAPMod obj_class = {
-			0, "objectClass", { .modv_strvals = obj_str },
-		};
+		/* all results have to arrive within timeout, 0 = infinite */
+		RUNTIME_CHECK(isc_time_now(&sent) == ISC_R_SUCCESS);
+		while (outstanding > 0) {
+			if (limit > 0) {
+				RUNTIME_CHECK(isc_time_now(&now)
+					      == ISC_R_SUCCESS);
+				waited = isc_time_microdiff(&now, &sent);
+				remains = (waited < limit) ? limit - waited : 0;
+				timeout.tv_sec = remains / 1000000;
+				timeout.tv_usec = remains % 1000000;
+			}
+			ret = ldap_result(ldap_conn->handle, LDAP_RES_ANY,
+					  LDAP_MSG_ONE,
+					  (limit > 0) ? &timeout : NULL, &msg);
+			if (ret <= 0) {
+				/* timeout or connection error */
+				if (ret == 0)
+					log_error("%u LDAP write operations "
+						  "did not finish in %u "
+						  "seconds, abandoning them",
+						  outstanding, timeout_sec);
+				else
+					log_ldap_error(ldap_conn->handle,
+						       "unable to obtain "
+						       "result of LDAP write "
+						       "operation");
+				for (i = 0; i < count; i++) {
+					if (ops[i].state != WRITEOP_SENT)
+						continue;
+					if (ret == 0)
+						(void)ldap_abandon_ext(
+							ldap_conn->handle,
+							ops[i].msgid,
+							NULL, NULL);
+					ldap_writeop_fail(&ops[i]);
+				}
+				break;
+			}
 
-		/*
-		 * Create a new array of LDAPMod structures. We will change
-		 * the mod_op member of each one to 0 (but preserve
-		 * LDAP_MOD_BVALUES. Additionally, we also need to specify
-		 * the objectClass attribute.
-		 */
-		for (i = 0; mods[i]; i++)
-			mods[i]->mod_op &= LDAP_MOD_BVALUES;
-		new_mods = alloca((i + 2) * sizeof(LDAPMod *));
-		memcpy(new_mods, mods, i * sizeof(LDAPMod *));
-		new_mods[i] = &obj_class;
-		new_mods[i + 1] = NULL;
-
-		ret = ldap_add_ext_s(ldap_conn->handle, dn, new_mods, NULL, NULL);
-		result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
-		if (ret == LDAP_SUCCESS)
-			goto cleanup;
-		LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-				&err_code),
-				"ldap_modify_do(add) failed to obtain ldap error code");
-		operation_str = "adding";
-	}
+			op = NULL;
+			for (i = 0; i < count; i++) {
+				if (ops[i].state == WRITEOP_SENT &&
+				    ops[i].msgid == ldap_msgid(msg)) {
+					op = &ops[i];
+					break;
+				}
+			}
+			if (op == NULL) {
+				/* response to abandoned request */
+				ldap_msgfree(msg);
+				msg = NULL;
+				continue;
+			}
 
-	log_ldap_error(ldap_conn->handle, "while %s entry '%s'", operation_str, dn);
-	/* attempt to manipulate attribute failed - likely a unknown RR type */
-	if (err_code == LDAP_OBJECT_CLASS_VIOLATION
-	    || err_code == LDAP_INSUFFICIENT_ACCESS) /* this is for 389 DS */
-		CLEANUP_WITH(DNS_R_UNKNOWN);
+			outstanding--;
+			ldap_stats_observe_since(ldap_inst->stats,
+						 ldap_statshist_modify_rtt,
+						 &op->sent);
+			ret = ldap_parse_result(ldap_conn->handle, msg,
+						&err_code, NULL, NULL, NULL,
+						NULL, 1);
+			msg = NULL; /* freed by ldap_parse_result() */
+			if (ret != LDAP_SUCCESS)
+				err_code = ret;
+			ldap_writeop_done(ldap_inst->mctx, ldap_conn, op,
+					  err_code);
+			if (op->state == WRITEOP_QUEUED) {
+				ldap_writeop_send(ldap_conn, op);
+				if (op->state == WRITEOP_SENT)
+					outstanding++;
+			}
+		}
 
-	/* do not error out if we are trying to delete an
-	 * unexisting attribute */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) != LDAP_MOD_DELETE ||
-	    err_code != LDAP_NO_SUCH_ATTRIBUTE) {
-		result = ISC_R_FAILURE;
-		if (once == ISC_FALSE) {
+		retry = ISC_FALSE;
+		for (i = 0; i < count; i++) {
+			if (ops[i].state != WRITEOP_RETRY)
+				continue;
 			log_error("retrying LDAP operation (%s) on entry '%s'",
-				  operation_str, dn);
-			goto retry;
+				  ops[i].operation_str, ops[i].dn);
+			ldap_writeop_free(ldap_inst->mctx, &ops[i]);
+			ops[i].adding = ISC_FALSE;
+			ops[i].retried = ISC_TRUE;
+			ops[i].state = WRITEOP_QUEUED;
+			retry = ISC_TRUE;
 		}
-	}
+		if (retry == ISC_TRUE &&
+		    handle_connection_error(ldap_inst, ldap_conn, ISC_FALSE)
+		    != ISC_R_SUCCESS) {
+			for (i = 0; i < count; i++) {
+				if (ops[i].state == WRITEOP_QUEUED)
+					ldap_writeop_fail(&ops[i]);
+			}
+			retry = ISC_FALSE;
+		}
+	} while (retry == ISC_TRUE);
+
+	result = ISC_R_SUCCESS;
 
 cleanup:
+	if (msg != NULL)
+		ldap_msgfree(msg);
+	for (i = 0; i < count; i++) {
+		ldap_writeop_free(ldap_inst->mctx, &ops[i]);
+		if (result != ISC_R_SUCCESS && ops[i].state != WRITEOP_DONE) {
+			ops[i].state = WRITEOP_DONE;
+			ops[i].result = result;
+		}
+		ldap_stats_increment(ldap_inst->stats,
+				     (ops[i].result == ISC_R_SUCCESS)
+				     ? ldap_statscounter_modify_ok
+				     : ldap_statscounter_modify_fail);
+	}
 	ldap_pool_putconnection(ldap_inst->pool, &ldap_conn);
 
 	return result;
 }
 
+/**
+ * Apply LDAP modifications.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval DNS_R_UNKNOWN = LDAP_OBJECT_CLASS_VIOLATION
+ *                       or LDAP_INSUFFICIENT_ACCESS. Most likely an attribute
+ *                       for a DNS RR type cannot be added because it is not
+ *                       present in the LDAP schema.
+ */
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modify_do(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
+		isc_boolean_t delete_node)
+{
+	isc_result_t result;
+	ldap_writeop_t op;
+
+	REQUIRE(dn != NULL);
+	REQUIRE(mods != NULL);
+	REQUIRE(ldap_inst != NULL);
+
+	ldap_writeop_init(&op, dn, mods, delete_node);
+	if (op.state == WRITEOP_DONE)
+		return op.result;
+
+	CHECK(ldap_modify_pipeline(ldap_inst, &op, 1));
+	result = op.result;
+
+cleanup:
+	return result;
+}
+
 void ATTR_NONNULLS
 ldap_mod_free(isc_mem_t *mctx, LDAPMod **changep)
 {
@@ -3305,39 +4899,32 @@ modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_in
 	LDAPMod *change[3] = { NULL };
 	isc_boolean_t zone_sync_ptr;
 	char **vals = NULL;
-	dns_name_t zone_name;
-	char *zone_dn = NULL;
+	zone_info_t *zinfo = NULL;
+	const char *zone_dn = NULL;
 	settings_set_t *zone_settings = NULL;
 	int af; /* address family */
 	isc_boolean_t unknown_type = ISC_FALSE;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
 	/*
 	 * Find parent zone entry and check if Dynamic Update is allowed.
-	 * @todo Try the cache first and improve split: SOA records are problematic.
+	 * Zone DN and settings come from a single zone register lookup.
 	 */
-	dns_name_init(&zone_name, NULL);
-	CHECK(str_new(mctx, &owner_dn));
-
-	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, owner_dn));
-	zone_dn = strstr(str_buf(owner_dn),", ");
-
-	if (zone_dn == NULL) { /* SOA record; owner = zone => owner_dn = zone_dn */
-		zone_dn = (char *)str_buf(owner_dn);
-	} else {
-		zone_dn += 1; /* skip whitespace */
-	}
-
-	CHECK(dn_to_dnsname(mctx, zone_dn, &zone_name, NULL, NULL));
-	INSIST(dns_name_equal(zone, &zone_name) == ISC_TRUE);
-
-	result = zr_get_zone_settings(ldap_inst->zone_register, &zone_name,
-				      &zone_settings);
+	result = zr_get_zone_handle(ldap_inst->zone_register, zone, &zinfo);
 	if (result != ISC_R_SUCCESS) {
-		if (result == ISC_R_NOTFOUND)
+		if (result == ISC_R_NOTFOUND) {
+			dns_name_format(zone, zone_name, DNS_NAME_FORMATSIZE);
 			log_debug(3, "update refused: "
-				  "active zone '%s' not found", zone_dn);
+				  "active zone '%s' not found", zone_name);
+		}
 		CLEANUP_WITH(DNS_R_NOTAUTH);
 	}
+	zone_dn = zinfo_getdn(zinfo);
+	zone_settings = zinfo_getsettings(zinfo);
+
+	CHECK(str_new(mctx, &owner_dn));
+	CHECK(dn_cache_ownerdn(ldap_inst->dncache, owner, zone, zone_dn,
+			       owner_dn));
 
 	if (rdlist->type == dns_rdatatype_soa && mod_op == LDAP_MOD_DELETE)
 		CLEANUP_WITH(ISC_R_SUCCESS);
@@ -3372,7 +4959,8 @@ modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_in
 		 * use global plugin configuration: option "sync_ptr"
 		 */
 
-		CHECK(setting_get_bool("sync_ptr", zone_settings, &zone_sync_ptr));
+		CHECK(setting_get_bool_id(SETTING_sync_ptr, zone_settings,
+					  &zone_sync_ptr));
 		if (!zone_sync_ptr) {
 			log_debug(3, "sync PTR is disabled for zone '%s'", zone_dn);
 			CLEANUP_WITH(ISC_R_SUCCESS);
@@ -3399,7 +4987,8 @@ cleanup:
 	ldap_mod_free(mctx, &change[0]);
 	ldap_mod_free(mctx, &change[1]);
 	free_char_array(mctx, &vals);
-	dns_name_free(&zone_name, mctx);
+	if (zinfo != NULL)
+		zr_zone_handle_detach(&zinfo);
 
 	return result;
 }
@@ -3432,7 +5021,7 @@ remove_rdtype_from_ldap(dns_name_t *owner, dns_name_t *zone,
 	isc_boolean_t unknown_type = ISC_FALSE;
 
 	CHECK(str_new(ldap_inst->mctx, &dn));
-	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, dn));
+	CHECK(ldap_owner_to_dn(ldap_inst, owner, zone, dn));
 
 	do {
 		CHECK(ldap_mod_create(ldap_inst->mctx, &change[0]));
@@ -3463,7 +5052,7 @@ remove_entry_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *lda
 	isc_result_t result;
 
 	CHECK(str_new(ldap_inst->mctx, &dn));
-	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, dn));
+	CHECK(ldap_owner_to_dn(ldap_inst, owner, zone, dn));
 	log_debug(2, "deleting whole node: '%s'", str_buf(dn));
 
 	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
@@ -3493,137 +5082,992 @@ cleanup:
 	return result;
 }
 
+/**
+ * LDAP values added to or deleted from one attribute of one LDAP entry.
+ * Rdata are shallow copies of rdata from the diff they were created from.
+ */
+typedef struct ldap_rdchange {
+	dns_rdatalist_t		rdlist;
+	int			mod_op;	/* LDAP_MOD_ADD or LDAP_MOD_DELETE */
+	dns_rdata_t		*rdata;
+	unsigned int		count;
+} ldap_rdchange_t;
+
+/**
+ * Modifications of one LDAP entry collected from closed database version.
+ */
+typedef struct ldap_entrychange {
+	dns_name_t		*owner;
+	ld_string_t		*dn;
+	dns_diff_t		diff;
+	ldap_rdchange_t		*rdchanges;
+	unsigned int		rdchanges_cnt;
+	isc_boolean_t		delete_node;
+	LDAPMod			**mods;
+	unsigned int		mods_cnt;
+	ldap_writeop_t		op;
+} ldap_entrychange_t;
 
+/**
+ * Build LDAP modifications which replace SOA attributes of zone entry.
+ *
+ * @param[out] changes Array of 5 LDAPMod pointers.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_create(isc_mem_t *mctx, unsigned int connections, ldap_pool_t **poolp)
+ldap_soa_to_ldapmods(isc_mem_t *mctx, dns_rdata_t *rdata, LDAPMod **changes)
 {
-	ldap_pool_t *pool;
 	isc_result_t result;
+	dns_rdata_soa_t soa;
+	isc_uint32_t values[5];
+	const char *attrs[5] = {
+		"idnsSOAserial", "idnsSOArefresh", "idnsSOAretry",
+		"idnsSOAexpire", "idnsSOAminimum"
+	};
+	unsigned int i;
 
-	REQUIRE(poolp != NULL && *poolp == NULL);
-
-	CHECKED_MEM_GET(mctx, pool, sizeof(*pool));
-	ZERO_PTR(pool);
-	isc_mem_attach(mctx, &pool->mctx);
-	
-	CHECK(semaphore_init(&pool->conn_semaphore, connections));
-	CHECKED_MEM_GET(mctx, pool->conns,
-			connections * sizeof(ldap_connection_t *));
-	memset(pool->conns, 0, connections * sizeof(ldap_connection_t *));
-	pool->connections = connections;
+/* all values in SOA record are isc_uint32_t, i.e. max. 2^32-1 */
+#define MAX_SOANUM_LENGTH (10 + 1)
+	CHECK(dns_rdata_tostruct(rdata, (void *)&soa, NULL));
+	values[0] = soa.serial;
+	values[1] = soa.refresh;
+	values[2] = soa.retry;
+	values[3] = soa.expire;
+	values[4] = soa.minimum;
+	dns_rdata_freestruct((void *)&soa);
 
-	*poolp = pool;
+	for (i = 0; i < 5; i++) {
+		CHECK(ldap_mod_create(mctx, &changes[i]));
+		changes[i]->mod_op = LDAP_MOD_REPLACE;
+		CHECK(isc_string_copy(changes[i]->mod_type,
+				      LDAP_ATTR_FORMATSIZE, attrs[i]));
+		CHECKED_MEM_ALLOCATE(mctx, changes[i]->mod_values,
+				     2 * sizeof(char *));
+		memset(changes[i]->mod_values, 0, 2 * sizeof(char *));
+		CHECKED_MEM_ALLOCATE(mctx, changes[i]->mod_values[0],
+				     MAX_SOANUM_LENGTH);
+		CHECK(isc_string_printf(changes[i]->mod_values[0],
+					MAX_SOANUM_LENGTH, "%u", values[i]));
+	}
 
 	return ISC_R_SUCCESS;
 
 cleanup:
-	ldap_pool_destroy(&pool);
+	for (i = 0; i < 5; i++)
+		ldap_mod_free(mctx, &changes[i]);
 	return result;
+#undef MAX_SOANUM_LENGTH
 }
 
 static void ATTR_NONNULLS
-ldap_pool_destroy(ldap_pool_t **poolp)
-{
-	ldap_pool_t *pool;
-	ldap_connection_t *ldap_conn;
+ldap_entrychange_free(isc_mem_t *mctx, ldap_entrychange_t *change) {
 	unsigned int i;
 
-	REQUIRE(poolp != NULL);
-
-	pool = *poolp;
-	if (pool == NULL)
-		return;
-
-	if (pool->conns != NULL) {
-		for (i = 0; i < pool->connections; i++) {
-			ldap_conn = pool->conns[i];
-			if (ldap_conn != NULL)
-				destroy_ldap_connection(&ldap_conn);
+	if (change->mods != NULL) {
+		for (i = 0; change->mods[i] != NULL; i++)
+			ldap_mod_free(mctx, &change->mods[i]);
+		isc_mem_put(mctx, change->mods,
+			    change->mods_cnt * sizeof(LDAPMod *));
+	}
+	if (change->rdchanges != NULL) {
+		for (i = 0; i < change->rdchanges_cnt; i++) {
+			if (change->rdchanges[i].rdata != NULL)
+				isc_mem_put(mctx, change->rdchanges[i].rdata,
+					    change->rdchanges[i].count
+					    * sizeof(dns_rdata_t));
 		}
-
-		SAFE_MEM_PUT(pool->mctx, pool->conns,
-			     pool->connections * sizeof(ldap_connection_t *));
+		isc_mem_put(mctx, change->rdchanges,
+			    change->rdchanges_cnt * sizeof(ldap_rdchange_t));
 	}
-
-	semaphore_destroy(&pool->conn_semaphore);
-
-	MEM_PUT_AND_DETACH(pool);
-	*poolp = NULL;
+	dns_diff_clear(&change->diff);
+	str_destroy(&change->dn);
 }
 
+/**
+ * Add all RRsets from given database version to the diff.
+ *
+ * @param[out] emptyp ISC_TRUE if the node does not have any RRset
+ *                    in given version.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_getconnection(ldap_pool_t *pool, ldap_connection_t ** conn)
-{
-	ldap_connection_t *ldap_conn = NULL;
-	unsigned int i;
+node_to_diff(isc_mem_t *mctx, dns_db_t *rbtdb, dns_dbnode_t *node,
+	     dns_dbversion_t *version, dns_name_t *owner, dns_diffop_t op,
+	     dns_diff_t *diff, isc_boolean_t *emptyp) {
 	isc_result_t result;
+	dns_rdatasetiter_t *iter = NULL;
+	dns_rdataset_t rdataset;
 
-	REQUIRE(pool != NULL);
-	REQUIRE(conn != NULL && *conn == NULL);
-	ldap_conn = *conn;
-
-	CHECK(semaphore_wait_timed(&pool->conn_semaphore, &conn_wait_timeout));
-	/* Following assertion is necessary to convince clang static analyzer
-	 * that the loop is always entered. */
-	REQUIRE(pool->connections > 0);
-	for (i = 0; i < pool->connections; i++) {
-		ldap_conn = pool->conns[i];
-		if (isc_mutex_trylock(&ldap_conn->lock) == ISC_R_SUCCESS)
-			break;
-	}
+	dns_rdataset_init(&rdataset);
+	*emptyp = ISC_TRUE;
 
-	RUNTIME_CHECK(ldap_conn != NULL);
+	result = dns_db_allrdatasets(rbtdb, node, version, 0, &iter);
+	if (result == ISC_R_NOTFOUND)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
 
-	*conn = ldap_conn;
+	for (result = dns_rdatasetiter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdatasetiter_next(iter)) {
+		dns_rdatasetiter_current(iter, &rdataset);
+		*emptyp = ISC_FALSE;
+		CHECK(rdataset_to_diff(mctx, op, owner, &rdataset, diff));
+		dns_rdataset_disassociate(&rdataset);
+	}
+	if (result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
 
 cleanup:
-	if (result != ISC_R_SUCCESS) {
-		log_error("timeout in ldap_pool_getconnection(): try to raise "
-				"'connections' parameter; potential deadlock?");
-	}
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (iter != NULL)
+		dns_rdatasetiter_destroy(&iter);
 	return result;
 }
 
-static void ATTR_NONNULLS
-ldap_pool_putconnection(ldap_pool_t *pool, ldap_connection_t **conn)
-{
-	REQUIRE(conn != NULL);
-	ldap_connection_t *ldap_conn = *conn;
-
-	if (ldap_conn == NULL)
-		return;
-
-	UNLOCK(&ldap_conn->lock);
-	semaphore_signal(&pool->conn_semaphore);
-
-	*conn = NULL;
-}
-
+/**
+ * Split diff into lists of values added to or deleted from
+ * individual RR types.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_connect(ldap_pool_t *pool, ldap_instance_t *ldap_inst)
-{
+diff_to_rdchanges(isc_mem_t *mctx, ldap_entrychange_t *change) {
 	isc_result_t result;
-	ldap_connection_t *ldap_conn;
+	dns_difftuple_t *t;
+	ldap_rdchange_t *rdc = NULL;
+	unsigned int tuples = 0;
 	unsigned int i;
+	int mod_op;
 
-	for (i = 0; i < pool->connections; i++) {
-		ldap_conn = NULL;
-		CHECK(new_ldap_connection(pool, &ldap_conn));
-		result = ldap_connect(ldap_inst, ldap_conn, ISC_FALSE);
-		/* Continue even if LDAP server is down */
-		if (result != ISC_R_NOTCONNECTED && result != ISC_R_TIMEDOUT &&
-		    result != ISC_R_SUCCESS) {
-			goto cleanup;
+	for (t = HEAD(change->diff.tuples); t != NULL; t = NEXT(t, link))
+		tuples++;
+	if (tuples == 0)
+		return ISC_R_SUCCESS;
+
+	/* each tuple can create new combination of RR type and operation */
+	CHECKED_MEM_GET(mctx, change->rdchanges,
+			tuples * sizeof(ldap_rdchange_t));
+	memset(change->rdchanges, 0, tuples * sizeof(ldap_rdchange_t));
+	change->rdchanges_cnt = tuples;
+
+	for (t = HEAD(change->diff.tuples); t != NULL; t = NEXT(t, link)) {
+		mod_op = (t->op == DNS_DIFFOP_DEL) ? LDAP_MOD_DELETE
+						   : LDAP_MOD_ADD;
+		for (i = 0, rdc = change->rdchanges;
+		     rdc->count > 0;
+		     i++, rdc = &change->rdchanges[i]) {
+			if (rdc->rdlist.type == t->rdata.type &&
+			    rdc->mod_op == mod_op)
+				break;
+		}
+		if (rdc->count == 0) {
+			dns_rdatalist_init(&rdc->rdlist);
+			rdc->rdlist.rdclass = t->rdata.rdclass;
+			rdc->rdlist.type = t->rdata.type;
+			rdc->mod_op = mod_op;
 		}
-		pool->conns[i] = ldap_conn;
+		rdc->rdlist.ttl = t->ttl;
+		rdc->count++;
 	}
 
-	return ISC_R_SUCCESS;
+	for (i = 0; i < change->rdchanges_cnt; i++) {
+		rdc = &change->rdchanges[i];
+		if (rdc->count == 0)
+			break;
+		CHECKED_MEM_GET(mctx, rdc->rdata,
+				rdc->count * sizeof(dns_rdata_t));
+		rdc->count = 0;
+		for (t = HEAD(change->diff.tuples); t != NULL;
+		     t = NEXT(t, link)) {
+			mod_op = (t->op == DNS_DIFFOP_DEL) ? LDAP_MOD_DELETE
+							   : LDAP_MOD_ADD;
+			if (t->rdata.type != rdc->rdlist.type ||
+			    mod_op != rdc->mod_op)
+				continue;
+			dns_rdata_init(&rdc->rdata[rdc->count]);
+			dns_rdata_clone(&t->rdata, &rdc->rdata[rdc->count]);
+			APPEND(rdc->rdlist.rdata, &rdc->rdata[rdc->count],
+			       link);
+			rdc->count++;
+		}
+	}
+	result = ISC_R_SUCCESS;
 
 cleanup:
-	log_error_r("couldn't establish connection in LDAP connection pool");
-	for (i = 0; i < pool->connections; i++) {
-		destroy_ldap_connection(&pool->conns[i]);
+	return result;
+}
+
+/**
+ * Convert all changes in one LDAP entry to single array of LDAP
+ * modifications. Deletions are placed first so values can be re-added
+ * with a different TTL in the same LDAP operation.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+rdchanges_to_ldapmods(isc_mem_t *mctx, ldap_entrychange_t *change) {
+	isc_result_t result;
+	ldap_rdchange_t *rdc;
+	dns_rdatalist_t *ttl_rdlist = NULL;
+	unsigned int i;
+	unsigned int pass;
+	unsigned int next = 0;
+	int mod_op;
+
+	/* all changes + SOA attributes + TTL + terminating NULL */
+	change->mods_cnt = change->rdchanges_cnt + 5 + 1 + 1;
+	CHECKED_MEM_GET(mctx, change->mods,
+			change->mods_cnt * sizeof(LDAPMod *));
+	memset(change->mods, 0, change->mods_cnt * sizeof(LDAPMod *));
+
+	for (pass = 0; pass < 2; pass++) {
+		mod_op = (pass == 0) ? LDAP_MOD_DELETE : LDAP_MOD_ADD;
+		for (i = 0; i < change->rdchanges_cnt; i++) {
+			rdc = &change->rdchanges[i];
+			if (rdc->count == 0 || rdc->mod_op != mod_op)
+				continue;
+			if (rdc->rdlist.type == dns_rdatatype_soa) {
+				/* SOA is stored in special attributes and
+				 * it cannot be deleted from zone entry */
+				if (mod_op == LDAP_MOD_ADD) {
+					CHECK(ldap_soa_to_ldapmods(mctx,
+						HEAD(rdc->rdlist.rdata),
+						&change->mods[next]));
+					next += 5;
+				}
+				continue;
+			}
+			CHECK(ldap_rdatalist_to_ldapmod(mctx, &rdc->rdlist,
+							&change->mods[next],
+							mod_op, ISC_FALSE));
+			next++;
+			if (mod_op == LDAP_MOD_ADD)
+				ttl_rdlist = &rdc->rdlist;
+		}
+	}
+	/* for now always replace the ttl on add */
+	if (ttl_rdlist != NULL)
+		CHECK(ldap_rdttl_to_ldapmod(mctx, ttl_rdlist,
+					    &change->mods[next]));
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Compute changes of one DNS name between two database versions
+ * and prepare LDAP modifications for the corresponding LDAP entry.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_entrychange_prepare(ldap_instance_t *ldap_inst, dns_name_t *zone,
+			 dns_db_t *rbtdb, dns_dbversion_t *oldver,
+			 dns_dbversion_t *newver, ldap_entrychange_t *change) {
+	isc_result_t result;
+	isc_mem_t *mctx = ldap_inst->mctx;
+	dns_dbnode_t *node = NULL;
+	isc_boolean_t old_empty = ISC_TRUE;
+	isc_boolean_t new_empty = ISC_TRUE;
+
+	result = dns_db_findnode(rbtdb, change->owner, ISC_FALSE, &node);
+	if (result == ISC_R_NOTFOUND)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	/* deletion and subsequent addition of the same RR cancel out */
+	CHECK(node_to_diff(mctx, rbtdb, node, oldver, change->owner,
+			   DNS_DIFFOP_DEL, &change->diff, &old_empty));
+	CHECK(node_to_diff(mctx, rbtdb, node, newver, change->owner,
+			   DNS_DIFFOP_ADD, &change->diff, &new_empty));
+	if (EMPTY(change->diff.tuples))
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	change->delete_node = ISC_TF(old_empty == ISC_FALSE &&
+				     new_empty == ISC_TRUE);
+
+	CHECK(str_new(mctx, &change->dn));
+	CHECK(ldap_owner_to_dn(ldap_inst, change->owner, zone, change->dn));
+	CHECK(diff_to_rdchanges(mctx, change));
+	CHECK(rdchanges_to_ldapmods(mctx, change));
+	if (change->mods[0] != NULL)
+		ldap_writeop_init(&change->op, str_buf(change->dn),
+				  change->mods, change->delete_node);
+
+cleanup:
+	if (node != NULL)
+		dns_db_detachnode(rbtdb, &node);
+	return result;
+}
+
+/**
+ * Keep PTR records synchronized with A/AAAA records in one LDAP entry.
+ */
+static void ATTR_NONNULLS
+ldap_entrychange_syncptr(ldap_instance_t *ldap_inst,
+			 settings_set_t *zone_settings,
+			 ldap_entrychange_t *change) {
+	isc_result_t result;
+	isc_boolean_t zone_sync_ptr;
+	ldap_rdchange_t *rdc;
+	dns_rdata_t *rdata;
+	unsigned int i;
+	int af;
+	char ip_str[INET6_ADDRSTRLEN + 1];
+	DECLARE_BUFFER(buffer, INET6_ADDRSTRLEN + 1);
+
+	CHECK(setting_get_bool_id(SETTING_sync_ptr, zone_settings,
+				  &zone_sync_ptr));
+	if (!zone_sync_ptr)
+		return;
+
+	for (i = 0; i < change->rdchanges_cnt; i++) {
+		rdc = &change->rdchanges[i];
+		if (rdc->rdlist.type != dns_rdatatype_a &&
+		    rdc->rdlist.type != dns_rdatatype_aaaa)
+			continue;
+		af = (rdc->rdlist.type == dns_rdatatype_a) ? AF_INET : AF_INET6;
+		for (rdata = HEAD(rdc->rdlist.rdata);
+		     rdata != NULL;
+		     rdata = NEXT(rdata, link)) {
+			INIT_BUFFER(buffer);
+			CHECK(dns_rdata_totext(rdata, NULL, &buffer));
+			isc_buffer_putuint8(&buffer, '\0');
+			strncpy(ip_str, isc_buffer_base(&buffer),
+				sizeof(ip_str));
+			result = sync_ptr_init(ldap_inst->mctx,
+					       ldap_inst->view->zonetable,
+					       ldap_inst->zone_register,
+					       change->owner, af, ip_str,
+					       rdc->rdlist.ttl, rdc->mod_op);
+			/* Silently ignore cases where the reverse zone does
+			 * not exist, does not accept dynamic updates, or is
+			 * not managed by this driver instance. */
+			if (result != ISC_R_SUCCESS &&
+			    result != ISC_R_NOTFOUND &&
+			    result != ISC_R_NOPERM &&
+			    result != DNS_R_NOTAUTHORITATIVE)
+				goto cleanup;
+		}
+	}
+	return;
+
+cleanup:
+	log_error_r("PTR record synchronization failed for '%s'",
+		    str_buf(change->dn));
+}
+
+/**
+ * Write changes in one LDAP entry RRset by RRset. This is used when
+ * the combined modification failed, e.g. because some RR type is not
+ * present in LDAP schema and has to be stored as UnknownRecord.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_entrychange_write_rrsets(ldap_instance_t *ldap_inst, dns_name_t *zone,
+			      ldap_entrychange_t *change) {
+	isc_result_t result = ISC_R_SUCCESS;
+	ldap_rdchange_t *rdc;
+	unsigned int pass;
+	unsigned int i;
+	int mod_op;
+
+	for (pass = 0; pass < 2; pass++) {
+		mod_op = (pass == 0) ? LDAP_MOD_DELETE : LDAP_MOD_ADD;
+		for (i = 0; i < change->rdchanges_cnt; i++) {
+			rdc = &change->rdchanges[i];
+			if (rdc->count == 0 || rdc->mod_op != mod_op)
+				continue;
+			CHECK(modify_ldap_common(change->owner, zone, ldap_inst,
+						 &rdc->rdlist, mod_op,
+						 ISC_FALSE));
+		}
+	}
+	if (change->delete_node == ISC_TRUE)
+		CHECK(remove_entry_from_ldap(change->owner, zone, ldap_inst));
+
+cleanup:
+	return result;
+}
+
+/**
+ * Write all changes made in database version to LDAP. All modifications
+ * of one DNS name are written to the corresponding LDAP entry using one
+ * LDAP operation and operations for all names are pipelined,
+ * see ldap_modify_pipeline().
+ *
+ * @param[in] rbtdb   Database with the changes.
+ * @param[in] oldver  Latest committed version.
+ * @param[in] newver  New version which is going to be committed.
+ * @param[in] owners  Array of DNS names modified in newver.
+ */
+isc_result_t
+write_version_to_ldap(ldap_instance_t *ldap_inst, dns_name_t *zone,
+		      dns_db_t *rbtdb, dns_dbversion_t *oldver,
+		      dns_dbversion_t *newver, dns_name_t **owners,
+		      unsigned int count) {
+	isc_result_t result;
+	isc_result_t write_result = ISC_R_SUCCESS;
+	isc_mem_t *mctx = ldap_inst->mctx;
+	settings_set_t *zone_settings = NULL;
+	ldap_entrychange_t *changes = NULL;
+	ldap_writeop_t *ops = NULL;
+	unsigned int i;
+	unsigned int ops_cnt = 0;
+
+	if (count == 0)
+		return ISC_R_SUCCESS;
+
+	result = zr_get_zone_settings(ldap_inst->zone_register, zone,
+				      &zone_settings);
+	if (result != ISC_R_SUCCESS) {
+		if (result == ISC_R_NOTFOUND)
+			log_debug(3, "update refused: active zone not found");
+		CLEANUP_WITH(DNS_R_NOTAUTH);
+	}
+
+	CHECKED_MEM_GET(mctx, changes, count * sizeof(ldap_entrychange_t));
+	memset(changes, 0, count * sizeof(ldap_entrychange_t));
+	for (i = 0; i < count; i++) {
+		changes[i].owner = owners[i];
+		dns_diff_init(mctx, &changes[i].diff);
+		changes[i].op.state = WRITEOP_DONE;
+		changes[i].op.result = ISC_R_SUCCESS;
+	}
+	CHECKED_MEM_GET(mctx, ops, count * sizeof(ldap_writeop_t));
+
+	for (i = 0; i < count; i++) {
+		CHECK(ldap_entrychange_prepare(ldap_inst, zone, rbtdb, oldver,
+					       newver, &changes[i]));
+		if (changes[i].op.state == WRITEOP_QUEUED)
+			ops[ops_cnt++] = changes[i].op;
+	}
+
+	CHECK(ldap_modify_pipeline(ldap_inst, ops, ops_cnt));
+
+	for (i = 0, ops_cnt = 0; i < count; i++) {
+		if (changes[i].op.state != WRITEOP_QUEUED)
+			continue;
+		changes[i].op = ops[ops_cnt++];
+		if (changes[i].op.result == ISC_R_SUCCESS) {
+			ldap_entrychange_syncptr(ldap_inst, zone_settings,
+						 &changes[i]);
+			continue;
+		}
+		log_debug(1, "combined modification of entry '%s' failed, "
+			  "writing RRsets one by one", str_buf(changes[i].dn));
+		result = ldap_entrychange_write_rrsets(ldap_inst, zone,
+						       &changes[i]);
+		if (result != ISC_R_SUCCESS)
+			write_result = result;
+	}
+	result = write_result;
+
+cleanup:
+	if (changes != NULL) {
+		for (i = 0; i < count; i++)
+			ldap_entrychange_free(mctx, &changes[i]);
+		isc_mem_put(mctx, changes, count * sizeof(ldap_entrychange_t));
+	}
+	if (ops != NULL)
+		isc_mem_put(mctx, ops, count * sizeof(ldap_writeop_t));
+	return result;
+}
+
+
+/* Idle connections above conn_min are closed after this many seconds. */
+#define LDAP_POOL_IDLE_TIMEOUT		60
+/* Period of maintenance thread in seconds. */
+#define LDAP_POOL_MAINT_INTERVAL	1
+
+#define IDLE_SLOT(head)		((unsigned int)((head) & 0xffffffffU))
+#define IDLE_TAG(head)		((head) >> 32)
+#define IDLE_HEAD(tag, slot)	(((tag) << 32) | (isc_uint64_t)(slot))
+
+/**
+ * Push connection to the lock-free stack of idle connections.
+ */
+static void ATTR_NONNULLS
+ldap_pool_idle_push(ldap_pool_t *pool, ldap_connection_t *ldap_conn)
+{
+	isc_uint64_t old_head;
+	isc_uint64_t new_head;
+
+	do {
+		old_head = pool->idle_head;
+		pool->idle_next[ldap_conn->slot] = IDLE_SLOT(old_head);
+		new_head = IDLE_HEAD(IDLE_TAG(old_head) + 1,
+				     ldap_conn->slot + 1);
+	} while (!__sync_bool_compare_and_swap(&pool->idle_head,
+					       old_head, new_head));
+}
+
+/**
+ * Pop the most recently used connection from the stack of idle connections.
+ *
+ * @returns Idle connection or NULL if the stack is empty.
+ */
+static ldap_connection_t * ATTR_NONNULLS
+ldap_pool_idle_pop(ldap_pool_t *pool)
+{
+	isc_uint64_t old_head;
+	isc_uint64_t new_head;
+	unsigned int slot;
+
+	do {
+		old_head = pool->idle_head;
+		slot = IDLE_SLOT(old_head);
+		if (slot == 0)
+			return NULL;
+		/* idle_next array is never freed before the pool so the read
+		 * is safe even if the slot was popped in the meantime;
+		 * the tag makes sure that CAS fails in that case */
+		new_head = IDLE_HEAD(IDLE_TAG(old_head) + 1,
+				     pool->idle_next[slot - 1]);
+	} while (!__sync_bool_compare_and_swap(&pool->idle_head,
+					       old_head, new_head));
+
+	return pool->conns[slot - 1];
+}
+
+/**
+ * Wake up threads waiting for an idle connection (if there are any).
+ */
+static void ATTR_NONNULLS
+ldap_pool_wakeup(ldap_pool_t *pool)
+{
+	/* CAS in ldap_pool_idle_push() is a full barrier and waiters
+	 * increment the counter before they try to pop a connection,
+	 * so either they see the pushed connection or we see them. */
+	if (pool->waiters == 0)
+		return;
+
+	LOCK(&pool->lock);
+	BROADCAST(&pool->idle_cond);
+	UNLOCK(&pool->lock);
+}
+
+/**
+ * Allocate new connection in a free slot.
+ *
+ * @pre pool->lock is locked.
+ *
+ * @retval ISC_R_QUOTA Pool already has conn_max connections.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_grow(ldap_pool_t *pool, ldap_connection_t **ldap_connp)
+{
+	isc_result_t result;
+	ldap_connection_t *ldap_conn = NULL;
+	unsigned int i;
+
+	if (pool->conn_size >= pool->conn_max)
+		return ISC_R_QUOTA;
+
+	for (i = 0; i < pool->conn_max; i++)
+		if (pool->conns[i] == NULL)
+			break;
+	INSIST(i < pool->conn_max);
+
+	CHECK(new_ldap_connection(pool, &ldap_conn));
+	ldap_conn->slot = i;
+	pool->conns[i] = ldap_conn;
+	pool->conn_size++;
+
+	*ldap_connp = ldap_conn;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Release slot of the connection. The caller has to destroy the connection
+ * after unlocking the pool because ldap_unbind_ext_s() can block.
+ *
+ * @pre pool->lock is locked.
+ */
+static void ATTR_NONNULLS
+ldap_pool_shrink(ldap_pool_t *pool, ldap_connection_t *ldap_conn)
+{
+	INSIST(pool->conns[ldap_conn->slot] == ldap_conn);
+	pool->conns[ldap_conn->slot] = NULL;
+	pool->conn_size--;
+}
+
+/**
+ * Try to reconnect broken connections and close connections above conn_min
+ * which were not used for LDAP_POOL_IDLE_TIMEOUT seconds.
+ */
+static void ATTR_NONNULLS
+ldap_pool_maintain(ldap_pool_t *pool)
+{
+	ISC_LIST(ldap_connection_t) broken;
+	ldap_connection_t *ldap_conn = NULL;
+	ldap_connection_t **idle = pool->maint_conns;
+	unsigned int idle_cnt = 0;
+	unsigned int kept_cnt;
+	unsigned int closed_cnt;
+	unsigned int conn_size;
+	unsigned int reconnected = 0;
+	isc_time_t now;
+
+	/* Reconnect outside of the lock, ldap_connect() can block. */
+	ISC_LIST_INIT(broken);
+	LOCK(&pool->lock);
+	ISC_LIST_APPENDLIST(broken, pool->broken, link);
+	UNLOCK(&pool->lock);
+
+	while ((ldap_conn = HEAD(broken)) != NULL) {
+		ISC_LIST_UNLINK(broken, ldap_conn, link);
+		/* ISC_R_SOFTQUOTA means that reconnect interval
+		 * did not elapse yet */
+		if (ldap_connect(pool->inst, ldap_conn, ISC_FALSE)
+		    == ISC_R_SUCCESS) {
+			log_debug(1, "connection in LDAP connection pool "
+				  "was reconnected");
+			RUNTIME_CHECK(isc_time_now(&ldap_conn->last_used)
+				      == ISC_R_SUCCESS);
+			ldap_pool_idle_push(pool, ldap_conn);
+			reconnected++;
+		} else {
+			LOCK(&pool->lock);
+			APPEND(pool->broken, ldap_conn, link);
+			UNLOCK(&pool->lock);
+		}
+	}
+	if (reconnected > 0)
+		ldap_pool_wakeup(pool);
+
+	/* Stack is ordered from the most recently used connection
+	 * so the stale ones are at the bottom. Whole stack is borrowed
+	 * under the lock so ldap_pool_getconnection() does not grow the pool
+	 * just because the stack looks empty for a moment. */
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+	LOCK(&pool->lock);
+	if (pool->conn_size <= pool->conn_min) {
+		UNLOCK(&pool->lock);
+		return;
+	}
+	while (idle_cnt < pool->conn_max
+	       && (ldap_conn = ldap_pool_idle_pop(pool)) != NULL)
+		idle[idle_cnt++] = ldap_conn;
+
+	/* Closed connections stay in idle[idle_cnt..closed_cnt - 1]. */
+	closed_cnt = idle_cnt;
+	while (idle_cnt > 0 && pool->conn_size > pool->conn_min) {
+		ldap_conn = idle[idle_cnt - 1];
+		if (isc_time_microdiff(&now, &ldap_conn->last_used)
+		    < LDAP_POOL_IDLE_TIMEOUT * 1000000ULL)
+			break;
+		idle_cnt--;
+		ldap_pool_shrink(pool, ldap_conn);
+	}
+	conn_size = pool->conn_size;
+
+	kept_cnt = idle_cnt;
+	while (idle_cnt > 0)
+		ldap_pool_idle_push(pool, idle[--idle_cnt]);
+	BROADCAST(&pool->idle_cond);
+	UNLOCK(&pool->lock);
+
+	/* Unbind outside of the lock, it waits for the LDAP server. */
+	while (closed_cnt > kept_cnt) {
+		ldap_conn = idle[--closed_cnt];
+		destroy_ldap_connection(&ldap_conn);
+	}
+	log_debug(5, "LDAP connection pool has %u connections", conn_size);
+}
+
+static isc_threadresult_t
+ldap_pool_maintainer(isc_threadarg_t arg)
+{
+	ldap_pool_t *pool = (ldap_pool_t *)arg;
+	isc_interval_t interval;
+	isc_time_t abs_timeout;
+
+	isc_interval_set(&interval, LDAP_POOL_MAINT_INTERVAL, 0);
+
+	LOCK(&pool->lock);
+	while (pool->exiting == ISC_FALSE) {
+		UNLOCK(&pool->lock);
+		ldap_pool_maintain(pool);
+		LOCK(&pool->lock);
+
+		if (pool->exiting == ISC_TRUE)
+			break;
+		RUNTIME_CHECK(isc_time_nowplusinterval(&abs_timeout, &interval)
+			      == ISC_R_SUCCESS);
+		(void)WAITUNTIL(&pool->maint_cond, &pool->lock, &abs_timeout);
+	}
+	UNLOCK(&pool->lock);
+
+	return (isc_threadresult_t)0;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_create(isc_mem_t *mctx, unsigned int conn_min,
+		 unsigned int conn_max, ldap_pool_t **poolp)
+{
+	ldap_pool_t *pool;
+	isc_result_t result;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	isc_boolean_t idle_cond_ready = ISC_FALSE;
+	isc_boolean_t maint_cond_ready = ISC_FALSE;
+
+	REQUIRE(poolp != NULL && *poolp == NULL);
+	REQUIRE(conn_min > 0 && conn_min <= conn_max);
+
+	CHECKED_MEM_GET(mctx, pool, sizeof(*pool));
+	ZERO_PTR(pool);
+	isc_mem_attach(mctx, &pool->mctx);
+	ISC_LIST_INIT(pool->broken);
+	pool->conn_min = conn_min;
+	pool->conn_max = conn_max;
+
+	CHECK(isc_mutex_init(&pool->lock));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_condition_init(&pool->idle_cond));
+	idle_cond_ready = ISC_TRUE;
+	CHECK(isc_condition_init(&pool->maint_cond));
+	maint_cond_ready = ISC_TRUE;
+
+	CHECKED_MEM_GET(mctx, pool->conns,
+			conn_max * sizeof(ldap_connection_t *));
+	memset(pool->conns, 0, conn_max * sizeof(ldap_connection_t *));
+	CHECKED_MEM_GET(mctx, pool->idle_next,
+			conn_max * sizeof(*pool->idle_next));
+	memset(pool->idle_next, 0, conn_max * sizeof(*pool->idle_next));
+	CHECKED_MEM_GET(mctx, pool->maint_conns,
+			conn_max * sizeof(ldap_connection_t *));
+
+	*poolp = pool;
+
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (pool != NULL) {
+		if (pool->conns != NULL)
+			SAFE_MEM_PUT(mctx, pool->conns,
+				     conn_max * sizeof(ldap_connection_t *));
+		SAFE_MEM_PUT(mctx, pool->idle_next,
+			     conn_max * sizeof(*pool->idle_next));
+		if (maint_cond_ready == ISC_TRUE)
+			RUNTIME_CHECK(isc_condition_destroy(&pool->maint_cond)
+				      == ISC_R_SUCCESS);
+		if (idle_cond_ready == ISC_TRUE)
+			RUNTIME_CHECK(isc_condition_destroy(&pool->idle_cond)
+				      == ISC_R_SUCCESS);
+		if (lock_ready == ISC_TRUE)
+			DESTROYLOCK(&pool->lock);
+		MEM_PUT_AND_DETACH(pool);
+	}
+	return result;
+}
+
+static void ATTR_NONNULLS
+ldap_pool_destroy(ldap_pool_t **poolp)
+{
+	ldap_pool_t *pool;
+	ldap_connection_t *ldap_conn;
+	unsigned int i;
+
+	REQUIRE(poolp != NULL);
+
+	pool = *poolp;
+	if (pool == NULL)
+		return;
+
+	if (pool->maintainer_running == ISC_TRUE) {
+		LOCK(&pool->lock);
+		pool->exiting = ISC_TRUE;
+		BROADCAST(&pool->maint_cond);
+		UNLOCK(&pool->lock);
+		RUNTIME_CHECK(isc_thread_join(pool->maintainer, NULL)
+			      == ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < pool->conn_max; i++) {
+		ldap_conn = pool->conns[i];
+		if (ldap_conn != NULL)
+			destroy_ldap_connection(&ldap_conn);
+	}
+
+	SAFE_MEM_PUT(pool->mctx, pool->conns,
+		     pool->conn_max * sizeof(ldap_connection_t *));
+	SAFE_MEM_PUT(pool->mctx, pool->idle_next,
+		     pool->conn_max * sizeof(*pool->idle_next));
+	SAFE_MEM_PUT(pool->mctx, pool->maint_conns,
+		     pool->conn_max * sizeof(ldap_connection_t *));
+	RUNTIME_CHECK(isc_condition_destroy(&pool->maint_cond)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_condition_destroy(&pool->idle_cond)
+		      == ISC_R_SUCCESS);
+	DESTROYLOCK(&pool->lock);
+
+	MEM_PUT_AND_DETACH(pool);
+	*poolp = NULL;
+}
+
+/**
+ * Get connection from the pool. Healthy idle connections are preferred.
+ * If there is no idle connection, the pool grows up to conn_max connections.
+ * Broken connection is handed out only if the pool cannot grow, so the caller
+ * can try to reconnect it (and fail fast if reconnect interval did not
+ * elapse yet). Otherwise wait until some connection is returned.
+ */
+static isc_result_t ATTR_NONNULL(2) ATTR_CHECKRESULT
+ldap_pool_getconnection(ldap_pool_t *pool, ldap_connection_t ** conn)
+{
+	ldap_connection_t *ldap_conn = NULL;
+	isc_boolean_t grown = ISC_FALSE;
+	isc_time_t start;
+	isc_time_t abs_timeout;
+	isc_result_t result;
+
+	REQUIRE(conn != NULL && *conn == NULL);
+
+	/* there is no pool in replay mode, see sync_replay_file */
+	if (pool == NULL)
+		return ISC_R_NOTCONNECTED;
+
+	ldap_conn = ldap_pool_idle_pop(pool);
+	if (ldap_conn != NULL) {
+		ldap_stats_observe(pool->inst->stats,
+				   ldap_statshist_conn_wait, 0);
+		*conn = ldap_conn;
+		return ISC_R_SUCCESS;
+	}
+
+	RUNTIME_CHECK(isc_time_now(&start) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_nowplusinterval(&abs_timeout,
+					       &conn_wait_timeout)
+		      == ISC_R_SUCCESS);
+	LOCK(&pool->lock);
+	__sync_fetch_and_add(&pool->waiters, 1);
+	while (ISC_TRUE) {
+		ldap_conn = ldap_pool_idle_pop(pool);
+		if (ldap_conn != NULL)
+			break;
+
+		result = ldap_pool_grow(pool, &ldap_conn);
+		if (result == ISC_R_SUCCESS) {
+			grown = ISC_TRUE;
+			break;
+		} else if (result != ISC_R_QUOTA) {
+			goto cleanup;
+		}
+
+		ldap_conn = HEAD(pool->broken);
+		if (ldap_conn != NULL) {
+			UNLINK(pool->broken, ldap_conn, link);
+			break;
+		}
+
+		CHECK(WAITUNTIL(&pool->idle_cond, &pool->lock, &abs_timeout));
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	__sync_fetch_and_sub(&pool->waiters, 1);
+	if (grown == ISC_TRUE)
+		log_debug(1, "LDAP connection pool grew to %u connections",
+			  pool->conn_size);
+	UNLOCK(&pool->lock);
+
+	ldap_stats_observe_since(pool->inst->stats, ldap_statshist_conn_wait,
+				 &start);
+	if (result == ISC_R_TIMEDOUT) {
+		ldap_stats_increment(pool->inst->stats,
+				     ldap_statscounter_conn_timeout);
+		log_error("timeout in ldap_pool_getconnection(): try to raise "
+				"'connections_max' parameter; potential deadlock?");
+	}
+	if (result != ISC_R_SUCCESS)
+		return result;
+
+	/* Connection failures are handled by the caller
+	 * in the same way as for broken connections. */
+	if (grown == ISC_TRUE)
+		(void)ldap_connect(pool->inst, ldap_conn, ISC_FALSE);
+
+	*conn = ldap_conn;
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Return connection to the pool. Connection without LDAP handle is taken
+ * out of rotation and the maintenance thread will reconnect it.
+ */
+static void ATTR_NONNULL(2)
+ldap_pool_putconnection(ldap_pool_t *pool, ldap_connection_t **conn)
+{
+	REQUIRE(conn != NULL);
+	ldap_connection_t *ldap_conn = *conn;
+
+	if (ldap_conn == NULL)
+		return;
+
+	if (ldap_conn->handle != NULL) {
+		RUNTIME_CHECK(isc_time_now(&ldap_conn->last_used)
+			      == ISC_R_SUCCESS);
+		ldap_pool_idle_push(pool, ldap_conn);
+		ldap_pool_wakeup(pool);
+	} else {
+		LOCK(&pool->lock);
+		APPEND(pool->broken, ldap_conn, link);
+		SIGNAL(&pool->maint_cond);
+		/* broken connection can be handed out to a waiter */
+		BROADCAST(&pool->idle_cond);
+		UNLOCK(&pool->lock);
+	}
+
+	*conn = NULL;
+}
+
+/**
+ * Open conn_min connections and start the maintenance thread.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_connect(ldap_pool_t *pool, ldap_instance_t *ldap_inst)
+{
+	isc_result_t result;
+	ldap_connection_t *ldap_conn;
+	unsigned int i;
+
+	pool->inst = ldap_inst;
+	for (i = 0; i < pool->conn_min; i++) {
+		ldap_conn = NULL;
+		LOCK(&pool->lock);
+		result = ldap_pool_grow(pool, &ldap_conn);
+		UNLOCK(&pool->lock);
+		CHECK(result);
+		result = ldap_connect(ldap_inst, ldap_conn, ISC_FALSE);
+		/* Continue even if LDAP server is down */
+		if (result != ISC_R_NOTCONNECTED && result != ISC_R_TIMEDOUT &&
+		    result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		ldap_pool_putconnection(pool, &ldap_conn);
+	}
+
+	result = isc_thread_create(ldap_pool_maintainer, pool,
+				   &pool->maintainer);
+	if (result != ISC_R_SUCCESS) {
+		log_error("Failed to create LDAP connection pool "
+			  "maintenance thread");
+		goto cleanup;
+	}
+	pool->maintainer_running = ISC_TRUE;
+
+	return ISC_R_SUCCESS;
+
+cleanup:
+	log_error_r("couldn't establish connection in LDAP connection pool");
+	LOCK(&pool->lock);
+	pool->idle_head = 0;
+	ISC_LIST_INIT(pool->broken);
+	UNLOCK(&pool->lock);
+	for (i = 0; i < pool->conn_max; i++) {
+		LOCK(&pool->lock);
+		ldap_conn = pool->conns[i];
+		if (ldap_conn != NULL)
+			ldap_pool_shrink(pool, ldap_conn);
+		UNLOCK(&pool->lock);
+		destroy_ldap_connection(&ldap_conn);
 	}
 	return result;
 }
@@ -3641,12 +6085,32 @@ cleanup:
 #define SYNCREPL_ANY(chgtype) ((chgtype & LDAP_ENTRYCHANGE_ALL) != 0)
  */
 
+/**
+ * Get LDAP instance which sent the syncrepl event.
+ *
+ * Event handlers are processed asynchronously so the instance could have
+ * been destroyed due server reload in the meantime. Event holds reference
+ * to the instance so the pointer stays valid but nothing else can be
+ * used in that case.
+ *
+ * @retval ISC_R_NOTFOUND Instance was destroyed, the event has to be
+ *                        dropped without any processing.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+syncrepl_event_instance(ldap_syncreplevent_t *pevent, ldap_instance_t **instp)
+{
+	if (pevent->inst->destroyed == ISC_TRUE)
+		return ISC_R_NOTFOUND;
+
+	*instp = pevent->inst;
+	return ISC_R_SUCCESS;
+}
+
 /*
  * update_zone routine is processed asynchronously so it cannot assume
- * anything about state of ldap_inst from where it was sent. The ldap_inst
- * could have been already destroyed due server reload. The safest
- * way how to handle zone update is to refetch ldap_inst,
- * perform query to LDAP and delete&add the zone. This is expensive
+ * anything about state of ldap_inst from where it was sent.
+ * See syncrepl_event_instance(). The safest way how to handle zone update
+ * is to perform query to LDAP and delete&add the zone. This is expensive
  * operation but zones don't change often.
  */
 static void ATTR_NONNULLS
@@ -3658,40 +6122,49 @@ update_zone(isc_task_t *task, isc_event_t *event)
 	isc_mem_t *mctx;
 	dns_name_t prevname;
 	ldap_entry_t *entry = pevent->entry;
+	dns_db_t *cachedb = NULL;
+	isc_time_t start;
 
-	mctx = pevent->mctx;
+	mctx = pevent->inst->mctx;
 	dns_name_init(&prevname, NULL);
+	RUNTIME_CHECK(isc_time_now(&start) == ISC_R_SUCCESS);
 
-	CHECK(manager_get_ldap_instance(pevent->dbname, &inst));
+	CHECK(syncrepl_event_instance(pevent, &inst));
 	INSIST(task == inst->task); /* For task-exclusive mode */
 
 	if (SYNCREPL_DEL(pevent->chgtype)) {
 		CHECK(ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE));
 	} else {
-		if (entry->class & LDAP_ENTRYCLASS_MASTER)
-			CHECK(ldap_parse_master_zoneentry(entry, NULL, inst,
+		if (entry->class & LDAP_ENTRYCLASS_MASTER) {
+			/* zone known from previous run can re-use cached data */
+			if (SYNCREPL_MOD(pevent->chgtype))
+				CHECK(zone_cache_load(inst, &entry->fqdn,
+						      &cachedb));
+			CHECK(ldap_parse_master_zoneentry(entry, cachedb, inst,
 							  task));
-		else if (entry->class & LDAP_ENTRYCLASS_FORWARD)
+		} else if (entry->class & LDAP_ENTRYCLASS_FORWARD)
 			CHECK(ldap_parse_fwd_zoneentry(entry, inst));
 	}
 
 cleanup:
 	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
+		ldap_stats_observe_since(inst->stats,
+					 ldap_statshist_update_zone, &start);
+		sync_concurr_limit_signal(inst->sctx, pevent);
 		sync_event_signal(inst->sctx, pevent);
 		if (dns_name_dynamic(&prevname))
 			dns_name_free(&prevname, inst->mctx);
 	}
+	if (cachedb != NULL)
+		dns_db_detach(&cachedb);
 	if (result != ISC_R_SUCCESS)
 		log_error_r("update_zone (syncrepl) failed for %s. "
 			    "Zones can be outdated, run `rndc reload`",
 			    ldap_entry_logname(entry));
 
-	isc_mem_free(mctx, pevent->dbname);
 	if (pevent->prevdn != NULL)
 		isc_mem_free(mctx, pevent->prevdn);
 	ldap_entry_destroy(&entry);
-	isc_mem_detach(&mctx);
 	isc_event_free(&event);
 	isc_task_detach(&task);
 }
@@ -3703,61 +6176,323 @@ update_config(isc_task_t * task, isc_event_t *event)
 	isc_result_t result;
 	ldap_instance_t *inst = NULL;
 	ldap_entry_t *entry = pevent->entry;
-	isc_mem_t *mctx;
 
-	mctx = pevent->mctx;
+	CHECK(syncrepl_event_instance(pevent, &inst));
+	INSIST(task == inst->task); /* For task-exclusive mode */
+	CHECK(ldap_parse_configentry(entry, inst));
+
+cleanup:
+	if (inst != NULL) {
+		sync_concurr_limit_signal(inst->sctx, pevent);
+		sync_event_signal(inst->sctx, pevent);
+	}
+	if (result != ISC_R_SUCCESS)
+		log_error_r("update_config (syncrepl) failed for %s. "
+			    "Configuration can be outdated, run `rndc reload`",
+			    ldap_entry_logname(entry));
+
+	ldap_entry_destroy(&entry);
+	isc_event_free(&event);
+	isc_task_detach(&task);
+}
+
+static void ATTR_NONNULLS
+update_serverconfig(isc_task_t * task, isc_event_t *event)
+{
+	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
+	isc_result_t result;
+	ldap_instance_t *inst = NULL;
+	ldap_entry_t *entry = pevent->entry;
+
+	CHECK(syncrepl_event_instance(pevent, &inst));
+	INSIST(task == inst->task); /* For task-exclusive mode */
+	CHECK(ldap_parse_serverconfigentry(entry, inst));
+
+cleanup:
+	if (inst != NULL) {
+		sync_concurr_limit_signal(inst->sctx, pevent);
+		sync_event_signal(inst->sctx, pevent);
+	}
+	if (result != ISC_R_SUCCESS)
+		log_error_r("update_serverconfig (syncrepl) failed for %s. "
+			    "Configuration can be outdated, run `rndc reload`",
+			    ldap_entry_logname(entry));
+
+	ldap_entry_destroy(&entry);
+	isc_event_free(&event);
+	isc_task_detach(&task);
+}
+
+/**
+ * Apply all changes accumulated in zone batch to RBTDB in one version
+ * together with SOA serial increment, write them to zone journal as one
+ * transaction and write the new serial back to LDAP.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_batch_flush(ldap_instance_t *inst, dns_zone_t *raw, dns_db_t *ldapdb) {
+	isc_result_t result;
+	isc_mem_t *mctx = inst->mctx;
+	dns_diff_t diff;
+	dns_dbversion_t *version = NULL;
+	isc_uint32_t serial;
+
+	dns_diff_init(mctx, &diff);
+
+	zone_batch_take(ldapdb_get_batch(ldapdb), &diff);
+	if (HEAD(diff.tuples) == NULL)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	CHECK(dns_db_newversion(ldapdb, &version));
+	CHECK(zone_soaserial_addtuple(mctx, ldapdb, version, &diff, &serial));
+
+	dns_zone_log(raw, ISC_LOG_DEBUG(5),
+		     "writing new zone serial %u to LDAP", serial);
+	result = ldap_replace_serial(inst, dns_zone_getorigin(raw), serial);
+	if (result != ISC_R_SUCCESS)
+		dns_zone_log(raw, ISC_LOG_ERROR,
+			     "serial (%u) write back to LDAP failed",
+			     serial);
+
+#if RBTDB_DEBUG >= 2
+	dns_diff_print(&diff, stdout);
+#else
+	dns_diff_print(&diff, NULL);
+#endif
+	/* write the transaction to journal */
+	CHECK(zone_journal_adddiff(mctx, raw, &diff));
+	/* commit */
+	CHECK(dns_diff_apply(&diff, ldapdb_get_rbtdb(ldapdb), version));
+	dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+	dns_zone_markdirty(raw);
+
+cleanup:
+	/* rollback */
+	if (version != NULL)
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+	dns_diff_clear(&diff);
+	return result;
+}
+
+/**
+ * Flush zone batch of the zone if it contains any changes.
+ * It has to be called before the zone is destroyed.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_batch_flush_zone(ldap_instance_t *inst, dns_name_t *name) {
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+	dns_db_t *ldapdb;
+
+	CHECK(zr_get_zone_handle(inst->zone_register, name, &zinfo));
+	ldapdb = zinfo_getldapdb(zinfo);
+	if (zone_batch_changes(ldapdb_get_batch(ldapdb)) != 0)
+		CHECK(zone_batch_flush(inst, zinfo_getraw(zinfo), ldapdb));
+
+cleanup:
+	if (zinfo != NULL)
+		zr_zone_handle_detach(&zinfo);
+	return result;
+}
+
+/**
+ * Flush zone batches of all zones in zone register. Zone names are
+ * collected first so the zone register lock held by the iterator is
+ * released before zones are flushed.
+ */
+static void ATTR_NONNULLS
+zone_batch_flush_all(ldap_instance_t *inst) {
+	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	dns_name_t *names = NULL;
+	dns_name_t *bigger = NULL;
+	unsigned int size = 0;
+	unsigned int count = 0;
+	unsigned int i;
+	char zone_name[DNS_NAME_FORMATSIZE];
+	DECLARE_BUFFERED_NAME(name);
+
+	INIT_BUFFERED_NAME(name);
+	for (result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		if (count == size) {
+			size = ISC_MAX(64, size * 2);
+			CHECKED_MEM_GET(inst->mctx, bigger,
+					size * sizeof(dns_name_t));
+			if (names != NULL) {
+				memcpy(bigger, names,
+				       count * sizeof(dns_name_t));
+				isc_mem_put(inst->mctx, names,
+					    count * sizeof(dns_name_t));
+			}
+			names = bigger;
+			bigger = NULL;
+		}
+		dns_name_init(&names[count], NULL);
+		CHECK(dns_name_dup(&name, inst->mctx, &names[count]));
+		count++;
+	}
+	rbt_iter_stop(&iter);
+
+	for (i = 0; i < count; i++) {
+		result = zone_batch_flush_zone(inst, &names[i]);
+		if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND) {
+			dns_name_format(&names[i], zone_name,
+					sizeof(zone_name));
+			log_error_r("unable to write changes from LDAP to "
+				    "journal of zone '%s'", zone_name);
+		}
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	rbt_iter_stop(&iter);
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE
+	    && result != ISC_R_NOTFOUND)
+		log_error_r("LDAP instance '%s': unable to flush changes "
+			    "to zone journals", inst->db_name);
+	for (i = 0; i < count; i++)
+		dns_name_free(&names[i], inst->mctx);
+	if (names != NULL)
+		isc_mem_put(inst->mctx, names, size * sizeof(dns_name_t));
+}
+
+/**
+ * Send event which will flush zone batch after all events queued
+ * in the zone task are processed.
+ *
+ * @param[in] changes Number of changes in the batch at the moment.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_batch_send(ldap_instance_t *inst, dns_zone_t *raw, unsigned int changes) {
+	isc_result_t result;
+	zone_batchev_t *ev = NULL;
+	isc_task_t *task = NULL;
+
+	ev = (zone_batchev_t *)isc_event_allocate(inst->mctx, inst,
+						  LDAPDB_EVENT_ZONE_BATCH,
+						  zone_batch_handler, NULL,
+						  sizeof(zone_batchev_t));
+	if (ev == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	ev->inst = NULL;
+	INIT_BUFFERED_NAME(ev->zone_name);
+	CHECK(dns_name_copy(dns_zone_getorigin(raw), &ev->zone_name, NULL));
+	ev->changes = changes;
+	ldap_instance_attach(inst, &ev->inst);
+
+	dns_zone_gettask(raw, &task);
+	isc_task_send(task, (isc_event_t **)&ev);
+
+cleanup:
+	if (task != NULL)
+		isc_task_detach(&task);
+	if (ev != NULL)
+		isc_event_free((isc_event_t **)&ev);
+	return result;
+}
+
+/**
+ * Decide if changes accumulated in zone batch have to be flushed now
+ * or if flushing can be postponed to merge more changes together.
+ *
+ * Batch is flushed immediately if it reached serial_batch_size changes
+ * or if the oldest change is waiting for serial_batch_delay milliseconds.
+ * Otherwise a flush event is sent to the zone task so the batch
+ * will be flushed when the current burst of events is processed.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_batch_update(ldap_instance_t *inst, dns_zone_t *raw, dns_db_t *ldapdb,
+		  unsigned int changes) {
+	isc_result_t result;
+	zone_batch_t *batch = ldapdb_get_batch(ldapdb);
+	isc_uint32_t max_changes;
+	isc_uint32_t max_delay;
+
+	CHECK(setting_get_uint_id(SETTING_serial_batch_size,
+				  inst->local_settings, &max_changes));
+	CHECK(setting_get_uint_id(SETTING_serial_batch_delay,
+				  inst->local_settings, &max_delay));
 
-	CHECK(manager_get_ldap_instance(pevent->dbname, &inst));
-	INSIST(task == inst->task); /* For task-exclusive mode */
-	CHECK(ldap_parse_configentry(entry, inst));
+	if (changes >= max_changes || zone_batch_expired(batch, max_delay)) {
+		result = zone_batch_flush(inst, raw, ldapdb);
+		goto cleanup;
+	}
 
-cleanup:
-	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
-		sync_event_signal(inst->sctx, pevent);
+	/* flush event was already sent */
+	if (zone_batch_setpending(batch, ISC_TRUE) == ISC_TRUE)
+		goto cleanup;
+
+	result = zone_batch_send(inst, raw, changes);
+	if (result != ISC_R_SUCCESS) {
+		/* nobody would flush the batch later */
+		(void)zone_batch_setpending(batch, ISC_FALSE);
+		CHECK(zone_batch_flush(inst, raw, ldapdb));
 	}
-	if (result != ISC_R_SUCCESS)
-		log_error_r("update_config (syncrepl) failed for %s. "
-			    "Configuration can be outdated, run `rndc reload`",
-			    ldap_entry_logname(entry));
 
-	ldap_entry_destroy(&entry);
-	isc_mem_free(mctx, pevent->dbname);
-	isc_mem_detach(&mctx);
-	isc_event_free(&event);
-	isc_task_detach(&task);
+cleanup:
+	return result;
 }
 
+/**
+ * Flush changes accumulated in zone batch. The flush is postponed again
+ * if more changes arrived since the event was sent, i.e. the burst
+ * of changes continues, and serial_batch_delay was not reached yet.
+ */
 static void ATTR_NONNULLS
-update_serverconfig(isc_task_t * task, isc_event_t *event)
-{
-	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
+zone_batch_handler(isc_task_t *task, isc_event_t *event) {
+	zone_batchev_t *ev = (zone_batchev_t *)event;
 	isc_result_t result;
-	ldap_instance_t *inst = NULL;
-	ldap_entry_t *entry = pevent->entry;
-	isc_mem_t *mctx;
+	ldap_instance_t *inst = ev->inst;
+	dns_zone_t *raw = NULL;
+	dns_db_t *ldapdb = NULL;
+	zone_batch_t *batch = NULL;
+	isc_uint32_t max_delay;
+	unsigned int changes;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	mctx = pevent->mctx;
+	UNUSED(task);
 
-	CHECK(manager_get_ldap_instance(pevent->dbname, &inst));
-	INSIST(task == inst->task); /* For task-exclusive mode */
-	CHECK(ldap_parse_serverconfigentry(entry, inst));
+	/* the batch was flushed by destroy_ldap_instance() */
+	if (inst->destroyed == ISC_TRUE)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	CHECK(zr_get_zone_ptr(inst->zone_register, &ev->zone_name, &raw, NULL));
+	CHECK(zr_get_zone_dbs(inst->zone_register, &ev->zone_name, &ldapdb,
+			      NULL));
+	batch = ldapdb_get_batch(ldapdb);
+	(void)zone_batch_setpending(batch, ISC_FALSE);
 
-cleanup:
-	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
-		sync_event_signal(inst->sctx, pevent);
+	changes = zone_batch_changes(batch);
+	if (changes == 0)
+		goto cleanup;
+
+	CHECK(setting_get_uint_id(SETTING_serial_batch_delay,
+				  inst->local_settings, &max_delay));
+	if (changes != ev->changes && !zone_batch_expired(batch, max_delay)) {
+		(void)zone_batch_setpending(batch, ISC_TRUE);
+		result = zone_batch_send(inst, raw, changes);
+		if (result == ISC_R_SUCCESS)
+			goto cleanup;
+		(void)zone_batch_setpending(batch, ISC_FALSE);
 	}
-	if (result != ISC_R_SUCCESS)
-		log_error_r("update_serverconfig (syncrepl) failed for %s. "
-			    "Configuration can be outdated, run `rndc reload`",
-			    ldap_entry_logname(entry));
+	CHECK(zone_batch_flush(inst, raw, ldapdb));
 
-	ldap_entry_destroy(&entry);
-	isc_mem_free(mctx, pevent->dbname);
-	isc_mem_detach(&mctx);
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND) {
+		dns_name_format(&ev->zone_name, zone_name, sizeof(zone_name));
+		log_error_r("unable to write changes from LDAP to journal of "
+			    "zone '%s'. Zone transfers can be outdated, run "
+			    "`rndc reload`", zone_name);
+	}
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	/* event memory belongs to the instance */
+	ev->inst = NULL;
 	isc_event_free(&event);
-	isc_task_detach(&task);
+	ldap_instance_detach(&inst);
 }
 
 /**
@@ -3776,12 +6511,13 @@ update_record(isc_task_t *task, isc_event_t *event)
 	isc_result_t result;
 	ldap_instance_t *inst = NULL;
 	isc_mem_t *mctx;
-	settings_set_t *zone_settings = NULL;
+	zone_info_t *zinfo = NULL;
 	dns_zone_t *raw = NULL;
 	dns_zone_t *secure = NULL;
 	isc_boolean_t zone_found = ISC_FALSE;
 	isc_boolean_t zone_reloaded = ISC_FALSE;
 	isc_uint32_t serial;
+	unsigned int changes;
 	ldap_entry_t *entry = pevent->entry;
 
 	dns_db_t *rbtdb = NULL;
@@ -3793,9 +6529,12 @@ update_record(isc_task_t *task, isc_event_t *event)
 	dns_rdatasetiter_t *rbt_rds_iterator = NULL;
 
 	sync_state_t sync_state;
+	isc_boolean_t activated = ISC_FALSE;
+	isc_time_t start;
 
-	mctx = pevent->mctx;
+	mctx = pevent->inst->mctx;
 	dns_diff_init(mctx, &diff);
+	RUNTIME_CHECK(isc_time_now(&start) == ISC_R_SUCCESS);
 
 #ifdef RBTDB_DEBUG
 	static unsigned int count = 0;
@@ -3811,16 +6550,24 @@ update_record(isc_task_t *task, isc_event_t *event)
 	dns_name_init(&prevname, NULL);
 	dns_name_init(&prevorigin, NULL);
 
-	CHECK(manager_get_ldap_instance(pevent->dbname, &inst));
-	CHECK(zr_get_zone_ptr(inst->zone_register, &entry->zone_name, &raw, &secure));
+	CHECK(syncrepl_event_instance(pevent, &inst));
+	/* Zones, databases and settings are valid while the handle is held. */
+	CHECK(zr_get_zone_handle(inst->zone_register, &entry->zone_name,
+				 &zinfo));
+	raw = zinfo_getraw(zinfo);
+	secure = zinfo_getsecure(zinfo);
 	zone_found = ISC_TRUE;
 
 update_restart:
 	rbtdb = NULL;
 	ldapdb = NULL;
-	zone_settings = NULL;
 	ldapdb_rdatalist_destroy(mctx, &rdatalist);
-	CHECK(zr_get_zone_dbs(inst->zone_register, &entry->zone_name, &ldapdb, &rbtdb));
+	dns_db_attach(zinfo_getldapdb(zinfo), &ldapdb);
+	dns_db_attach(zinfo_getrbtdb(zinfo), &rbtdb);
+	/* Changes in zone batch are not in RBTDB yet
+	 * but the diff below has to be computed against them. */
+	if (zone_batch_hasname(ldapdb_get_batch(ldapdb), &entry->fqdn))
+		CHECK(zone_batch_flush(inst, raw, ldapdb));
 	CHECK(dns_db_newversion(ldapdb, &version));
 
 	CHECK(dns_db_findnode(rbtdb, &entry->fqdn, ISC_TRUE, &node));
@@ -3871,10 +6618,10 @@ update_restart:
 		/* Parse new data from LDAP. */
 		log_debug(5, "syncrepl_update: updating name in rbtdb, "
 			  "%s", ldap_entry_logname(entry));
-		CHECK(zr_get_zone_settings(inst->zone_register,
-					   &entry->zone_name, &zone_settings));
-		CHECK(ldap_parse_rrentry(mctx, entry, &entry->zone_name,
-					 zone_settings, &rdatalist));
+		CHECK(ldap_parse_rrentry(mctx, inst->parsepool,
+					 inst->templates, entry,
+					 &entry->zone_name,
+					 zinfo_getsettings(zinfo), &rdatalist));
 	}
 
 	if (rbt_rds_iterator != NULL) {
@@ -3884,34 +6631,30 @@ update_restart:
 	}
 
 	sync_state_get(inst->sctx, &sync_state);
+	/* Zone activated by zone_refreshed_activate() is already served
+	 * so its changes need SOA serial increment and journal as well.
+	 * finish() changes the state before the flags are reset. */
+	if (sync_state != sync_finished)
+		CHECK(zr_get_zone_activated(inst->zone_register,
+					    &entry->zone_name, &activated));
+	if (activated == ISC_TRUE)
+		sync_state = sync_finished;
+
 	/* No real change in RR data -> do not increment SOA serial. */
 	if (HEAD(diff.tuples) != NULL) {
 		if (sync_state == sync_finished) {
-			CHECK(zone_soaserial_addtuple(mctx, ldapdb, version,
-						      &diff, &serial));
-			dns_zone_log(raw, ISC_LOG_DEBUG(5),
-				     "writing new zone serial %u to LDAP",
-				     serial);
-			result = ldap_replace_serial(inst, &entry->zone_name, serial);
-			if (result != ISC_R_SUCCESS)
-				dns_zone_log(raw, ISC_LOG_ERROR,
-					     "serial (%u) write back to LDAP failed",
-					     serial);
-		}
-
-#if RBTDB_DEBUG >= 2
-		dns_diff_print(&diff, stdout);
-#else
-		dns_diff_print(&diff, NULL);
-#endif
-		if (sync_state == sync_finished) {
-			/* write the transaction to journal */
-			CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
+			/* Changes are applied together with SOA serial
+			 * increment when the zone batch is flushed. */
+			dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+			zone_batch_add(ldapdb_get_batch(ldapdb), &diff,
+				       &changes);
+			CHECK(zone_batch_update(inst, raw, ldapdb, changes));
+		} else {
+			/* commit */
+			CHECK(dns_diff_apply(&diff, rbtdb, version));
+			dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+			dns_zone_markdirty(raw);
 		}
-		/* commit */
-		CHECK(dns_diff_apply(&diff, rbtdb, version));
-		dns_db_closeversion(ldapdb, &version, ISC_TRUE);
-		dns_zone_markdirty(raw);
 	}
 
 	/* Check if the zone is loaded or not.
@@ -3973,22 +6716,20 @@ cleanup:
 	}
 
 	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
+		ldap_stats_observe_since(inst->stats,
+					 ldap_statshist_update_record, &start);
+		sync_concurr_limit_signal(inst->sctx, pevent);
 		if (dns_name_dynamic(&prevname))
 			dns_name_free(&prevname, inst->mctx);
 		if (dns_name_dynamic(&prevorigin))
 			dns_name_free(&prevorigin, inst->mctx);
 	}
-	if (raw != NULL)
-		dns_zone_detach(&raw);
-	if (secure != NULL)
-		dns_zone_detach(&secure);
+	if (zinfo != NULL)
+		zr_zone_handle_detach(&zinfo);
 	ldapdb_rdatalist_destroy(mctx, &rdatalist);
-	isc_mem_free(mctx, pevent->dbname);
 	if (pevent->prevdn != NULL)
 		isc_mem_free(mctx, pevent->prevdn);
 	ldap_entry_destroy(&entry);
-	isc_mem_detach(&mctx);
 	isc_event_free(&event);
 	isc_task_detach(&task);
 }
@@ -4035,19 +6776,196 @@ cleanup:
 	return result;
 }
 
+/**
+ * Free syncrepl event which was not sent, including the LDAP entry.
+ */
+static void ATTR_NONNULLS
+syncrepl_event_discard(ldap_syncreplevent_t **peventp, isc_task_t **taskp) {
+	ldap_entry_destroy(&(*peventp)->entry);
+	isc_event_free((isc_event_t **)peventp);
+	isc_task_detach(taskp);
+}
+
+/**
+ * Queue syncrepl event in the open sync group. The event will be sent
+ * when the group is flushed.
+ *
+ * @pre inst->sync_group.lock is locked and the group is open.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_group_add(ldap_instance_t *inst, isc_task_t **taskp,
+	       ldap_syncreplevent_t **peventp, isc_boolean_t synchronous) {
+	isc_result_t result;
+	sync_group_t *group = &inst->sync_group;
+	sync_group_item_t *item = NULL;
+
+	INSIST(group->open == ISC_TRUE);
+
+	CHECKED_MEM_GET_PTR(inst->mctx, item);
+	ZERO_PTR(item);
+	ISC_LINK_INIT(item, link);
+	item->pevent = *peventp;
+	item->task = *taskp;
+	item->synchronous = synchronous;
+	APPEND(group->events, item, link);
+	group->items++;
+	*peventp = NULL;
+	*taskp = NULL;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Commit open metaLDAP version and send all events queued in the group
+ * in the original order.
+ *
+ * @pre inst->sync_group.lock is locked.
+ */
+static void ATTR_NONNULLS
+sync_group_flush_locked(ldap_instance_t *inst) {
+	isc_result_t result = ISC_R_SUCCESS;
+	sync_group_t *group = &inst->sync_group;
+	sync_group_item_t *item;
+	isc_result_t send_result;
+
+	if (group->open == ISC_FALSE)
+		return;
+
+	mldap_closeversion(inst->mldapdb, ISC_TRUE);
+	group->open = ISC_FALSE;
+	log_debug(20, "sync group: %u entries and %u events committed",
+		  group->entries, group->items);
+	group->entries = 0;
+
+	/* sync_event_send() consumes the event even if it fails */
+	while ((item = HEAD(group->events)) != NULL) {
+		UNLINK(group->events, item, link);
+		group->items--;
+		send_result = sync_event_send(inst->sctx, item->task,
+					      &item->pevent,
+					      item->synchronous);
+		if (result == ISC_R_SUCCESS)
+			result = send_result;
+		SAFE_MEM_PUT_PTR(inst->mctx, item);
+	}
+	INSIST(group->items == 0);
+
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN)
+		log_error_r("unable to send SyncRepl events");
+}
+
+/**
+ * Make all changes done so far visible to zone tasks.
+ */
+static void
+sync_group_flush(ldap_instance_t *inst) {
+	LOCK(&inst->sync_group.lock);
+	sync_group_flush_locked(inst);
+	UNLOCK(&inst->sync_group.lock);
+}
+
+/**
+ * Lock sync group and open metaLDAP version if it is not open already.
+ * Changes done until sync_group_end() form one unit which is rolled
+ * back as a whole if it fails.
+ *
+ * @post inst->sync_group.lock is locked if ISC_R_SUCCESS is returned.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_group_begin(ldap_instance_t *inst) {
+	isc_result_t result = ISC_R_SUCCESS;
+	sync_group_t *group = &inst->sync_group;
+
+	LOCK(&group->lock);
+	if (group->open == ISC_FALSE) {
+		CHECK(mldap_newversion(inst->mldapdb));
+		group->open = ISC_TRUE;
+		RUNTIME_CHECK(isc_time_now(&group->start) == ISC_R_SUCCESS);
+	}
+	group->savepoint = mldap_savepoint(inst->mldapdb);
+	group->mark = group->items;
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		UNLOCK(&group->lock);
+	return result;
+}
+
+/**
+ * Finish changes started by sync_group_begin() and unlock the group.
+ * Failed changes are rolled back and their events are dropped.
+ *
+ * Group is flushed if sync_commit_size or sync_commit_delay was reached
+ * or if the caller requested that.
+ *
+ * @param[in] result Result of changes done since sync_group_begin().
+ * @param[in] flush  Flush the group regardless of the limits.
+ */
+static void ATTR_NONNULLS
+sync_group_end(ldap_instance_t *inst, isc_result_t result,
+	       isc_boolean_t flush) {
+	sync_group_t *group = &inst->sync_group;
+	sync_group_item_t *item;
+	isc_time_t now;
+
+	if (result != ISC_R_SUCCESS) {
+		mldap_rollback(inst->mldapdb, group->savepoint);
+		while (group->items > group->mark) {
+			item = TAIL(group->events);
+			UNLINK(group->events, item, link);
+			group->items--;
+			syncrepl_event_discard(&item->pevent, &item->task);
+			SAFE_MEM_PUT_PTR(inst->mctx, item);
+		}
+	} else {
+		group->entries++;
+	}
+
+	if (flush == ISC_FALSE && group->entries < group->max_entries
+	    && isc_time_now(&now) == ISC_R_SUCCESS
+	    && isc_time_microdiff(&now, &group->start)
+	       < (isc_uint64_t)group->max_delay * 1000)
+		goto unlock;
+
+	sync_group_flush_locked(inst);
+
+unlock:
+	UNLOCK(&group->lock);
+}
+
+/**
+ * Wait for a free slot in syncrepl concurrency limit. Events held back
+ * in sync group occupy slots, too, so the group is flushed before waiting.
+ * Otherwise the wait could never end.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_group_limit_wait(ldap_instance_t *inst) {
+	if (sync_concurr_limit_trywait(inst->sctx) == ISC_R_SUCCESS)
+		return ISC_R_SUCCESS;
+
+	sync_group_flush(inst);
+	return sync_concurr_limit_wait(inst->sctx);
+}
+
 /**
  * Create asynchronous ISC event to execute update_config()/zone()/record()
  * in a task associated with affected DNS zone.
  *
  * @param[in,out] entryp  (Possibly fake) LDAP entry to parse.
  * @param[in]     chgtype One of LDAP_SYNC_CAPI_ADD/MODIFY/DELETE.
+ * @param[in]     defer   Queue the event in sync group instead of sending it.
  *
  * @pre entryp is valid LDAP entry with class, DNS names, DN, etc.
+ * @pre inst->sync_group.lock is locked and the group is open if defer
+ *      is ISC_TRUE.
  *
  * @post entryp is NULL.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
+syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype,
+		isc_boolean_t defer)
 {
 	isc_result_t result = ISC_R_SUCCESS;
 	ldap_syncreplevent_t *pevent = NULL;
@@ -4055,8 +6973,6 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 	dns_name_t *zone_name = NULL;
 	dns_zone_t *zone_ptr = NULL;
 	char *dn = NULL;
-	char *dbname = NULL;
-	isc_mem_t *mctx = NULL;
 	isc_taskaction_t action = NULL;
 	isc_task_t *task = NULL;
 	isc_boolean_t synchronous;
@@ -4069,10 +6985,6 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 		  SYNCREPL_ADD(chgtype), SYNCREPL_DEL(chgtype),
 		  SYNCREPL_MOD(chgtype));
 
-	isc_mem_attach(inst->mctx, &mctx);
-
-	CHECKED_MEM_STRDUP(mctx, inst->db_name, dbname);
-
 	if (entry->class & LDAP_ENTRYCLASS_MASTER)
 		zone_name = &entry->fqdn;
 	else
@@ -4118,25 +7030,39 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 		goto cleanup;
 	}
 
-	pevent = (ldap_syncreplevent_t *)isc_event_allocate(inst->mctx,
-				inst, LDAPDB_EVENT_SYNCREPL_UPDATE,
-				action, NULL,
-				sizeof(ldap_syncreplevent_t));
-
-	if (pevent == NULL) {
-		result = ISC_R_NOMEMORY;
-		goto cleanup;
+	/* Remember compiled templates and which records depend
+	 * on substitution variables so they can be re-rendered when
+	 * a variable changes. Deleted entries are reconstructed from metaLDAP
+	 * so their class tells if they ever had a template; removal
+	 * of templates from a modified entry is handled by the caller. */
+	if (action == update_record && entry->uuid != NULL
+	    && (entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0) {
+		if (SYNCREPL_DEL(chgtype)) {
+			rr_template_index_remove(inst->templates, entry->uuid);
+		} else {
+			result = rr_template_index_update(inst->templates,
+							  entry);
+			if (result != ISC_R_SUCCESS)
+				log_error_r("%s: template index update failed; "
+					    "record will not be re-rendered "
+					    "when substitution variables "
+					    "change",
+					    ldap_entry_logname(entry));
+			result = ISC_R_SUCCESS;
+		}
 	}
 
-	pevent->mctx = mctx;
-	pevent->dbname = dbname;
+	CHECK(sync_event_create(inst->sctx, action, &pevent));
 	pevent->prevdn = NULL;
 	pevent->chgtype = chgtype;
 	pevent->entry = entry;
 
 	/* Lock syncrepl queue to prevent zone, config and resource records
 	 * from racing with each other. */
-	CHECK(sync_event_send(inst->sctx, task, &pevent, synchronous));
+	if (defer == ISC_TRUE)
+		CHECK(sync_group_add(inst, &task, &pevent, synchronous));
+	else
+		CHECK(sync_event_send(inst->sctx, task, &pevent, synchronous));
 	*entryp = NULL; /* event handler will deallocate the LDAP entry */
 
 cleanup:
@@ -4147,19 +7073,64 @@ cleanup:
 			    ldap_entry_logname(entry));
 	if (pevent != NULL) {
 		/* Event was not sent */
-		sync_concurr_limit_signal(inst->sctx);
+		sync_concurr_limit_signal(inst->sctx, NULL);
 
-		if (dbname != NULL)
-			isc_mem_free(mctx, dbname);
-		if (mctx != NULL)
-			isc_mem_detach(&mctx);
 		ldap_entry_destroy(entryp);
+		isc_event_free((isc_event_t **)&pevent);
 		if (task != NULL)
 			isc_task_detach(&task);
 	}
 	return result;
 }
 
+/**
+ * Re-render all template records which reference given substitution
+ * variable. Stored copies of the entries are sent as modifications
+ * so update_record() replaces only RRs which actually changed.
+ *
+ * This runs in inst->task so it must not wait for free slots
+ * in the concurrency limit. The copies are in memory already and their
+ * number is bounded by the template index so slots are taken
+ * even if the limit is exceeded.
+ *
+ * @param[in] variable Name of the setting which was changed.
+ */
+static isc_result_t
+ldap_templates_rerender(ldap_instance_t *inst, const char *variable)
+{
+	isc_result_t result;
+	ldap_entrylist_t entries;
+	ldap_entry_t *entry = NULL;
+
+	INIT_LIST(entries);
+	CHECK(rr_template_index_dependents(inst->templates, variable,
+					   &entries));
+	if (!EMPTY(entries))
+		log_debug(1, "re-rendering template records depending "
+			  "on '%s'", variable);
+
+	while ((entry = HEAD(entries)) != NULL) {
+		UNLINK(entries, entry, link);
+		sync_concurr_limit_take(inst->sctx);
+		result = syncrepl_update(inst, &entry, LDAP_SYNC_CAPI_MODIFY,
+					 ISC_FALSE);
+		if (result != ISC_R_SUCCESS && entry != NULL) {
+			/* Event was not created: entry and slot are ours. */
+			sync_concurr_limit_signal(inst->sctx, NULL);
+			ldap_entry_destroy(&entry);
+		}
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	ldap_entry_destroy(&entry);
+	while ((entry = HEAD(entries)) != NULL) {
+		UNLINK(entries, entry, link);
+		ldap_entry_destroy(&entry);
+	}
+	return result;
+}
+
 #define CHECK_EXIT \
 	do { \
 		if (inst->exiting) \
@@ -4230,39 +7201,122 @@ ldap_sync_search_reference (
 	return LDAP_SUCCESS;
 }
 
-/*
- * Called when an entry is returned by ldap_sync_init()/ldap_sync_poll().
- * If phase is LDAP_SYNC_CAPI_ADD or LDAP_SYNC_CAPI_MODIFY,
- * the entry has been either added or modified, and thus
- * the complete view of the entry should be in the LDAPMessage.
- * If phase is LDAP_SYNC_CAPI_PRESENT or LDAP_SYNC_CAPI_DELETE,
- * only the DN should be in the LDAPMessage.
+/**
+ * Test if entry with given UUID is already present in metaLDAP.
  */
-int ldap_sync_search_entry (
-	ldap_sync_t			*ls,
-	LDAPMessage			*msg,
-	struct berval			*entryUUID,
-	ldap_sync_refresh_t		phase ) {
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_isknown(ldap_instance_t *inst, struct berval *entryUUID) {
+	mldap_node_t *node = NULL;
+	ldap_entryclass_t class;
+	isc_boolean_t known;
+
+	if (mldap_entry_read(inst->mldapdb, entryUUID, &node) != ISC_R_SUCCESS)
+		return ISC_FALSE;
+	/* node of deleted entry can exist but it does not have any data */
+	known = ISC_TF(mldap_class_get(node, &class) == ISC_R_SUCCESS);
+	mldap_node_close(&node);
+
+	return known;
+}
+
+/**
+ * Mark entry reported as unchanged during incremental refresh as alive
+ * so it will not be removed as stale entry at the end of refresh phase.
+ */
+static void ATTR_NONNULLS
+ldap_sync_present(ldap_instance_t *inst, struct berval *entryUUID) {
+	isc_result_t result;
+
+	inst->sync_refresh_presents = ISC_TRUE;
+	CHECK(sync_group_begin(inst));
+	result = mldap_entry_touch(inst->mldapdb, entryUUID);
+	sync_group_end(inst, result, ISC_FALSE);
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to mark LDAP entry as present: "
+			    "rndc reload might be necessary");
+}
+
+/**
+ * Count entry received from LDAP. Statistics are written to the log
+ * by stats timer, see ldap_stats_start().
+ */
+static void ATTR_NONNULLS
+ldap_sync_stats_update(ldap_instance_t *inst, ldap_sync_refresh_t phase) {
+	switch (phase) {
+	case LDAP_SYNC_CAPI_ADD:
+		ldap_stats_increment(inst->stats, ldap_statscounter_sync_add);
+		break;
+	case LDAP_SYNC_CAPI_MODIFY:
+		ldap_stats_increment(inst->stats,
+				     ldap_statscounter_sync_modify);
+		break;
+	case LDAP_SYNC_CAPI_DELETE:
+		ldap_stats_increment(inst->stats,
+				     ldap_statscounter_sync_delete);
+		break;
+	case LDAP_SYNC_CAPI_PRESENT:
+		ldap_stats_increment(inst->stats,
+				     ldap_statscounter_sync_present);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Stop recording of SyncRepl callbacks if the last write failed
+ * so the record file is not left with a gap in the middle.
+ */
+static void ATTR_NONNULLS
+ldap_sync_record_check(ldap_instance_t *inst, isc_result_t result) {
+	if (result == ISC_R_SUCCESS)
+		return;
 
+	log_error("recording of SyncRepl session for instance '%s' "
+		  "stopped", inst->db_name);
+	sync_record_destroy(&inst->sync_record);
+}
+
+/**
+ * Apply one entry from SyncRepl session to metaLDAP and DNS.
+ *
+ * @param[in,out] new_entryp Entry parsed from LDAP for ADD and MODIFY
+ *                           phases, NULL otherwise. The entry is consumed.
+ */
+static void ATTR_NONNULLS
+ldap_sync_entry(ldap_sync_t *ls, ldap_entry_t **new_entryp,
+		struct berval *entryUUID, ldap_sync_refresh_t phase) {
 	ldap_instance_t *inst = ls->ls_private;
 	ldap_entry_t *old_entry = NULL;
-	ldap_entry_t *new_entry = NULL;
+	ldap_entry_t *new_entry = *new_entryp;
 	isc_result_t result;
-	metadb_node_t *node = NULL;
-	isc_boolean_t mldap_open = ISC_FALSE;
+	mldap_node_t *node = NULL;
+	isc_boolean_t group_open = ISC_FALSE;
+	isc_boolean_t flush;
 	isc_boolean_t modrdn = ISC_FALSE;
+	ldap_entryclass_t class;
 
 #ifdef RBTDB_DEBUG
 	static unsigned int count = 0;
 #endif
 
-	if (inst->exiting)
-		return LDAP_SUCCESS;
+	*new_entryp = NULL;
+	ldap_sync_stats_update(inst, phase);
+	if (phase == LDAP_SYNC_CAPI_PRESENT) {
+		ldap_sync_present(inst, entryUUID);
+		return;
+	}
 
-	CHECK(mldap_newversion(inst->mldapdb));
-	mldap_open = ISC_TRUE;
+	/* Entries already known from previous synchronization are reported
+	 * as new during refresh phase. Treat them as modified so renames
+	 * are detected and old data are removed. */
+	if (phase == LDAP_SYNC_CAPI_ADD
+	    && ldap_sync_isknown(inst, entryUUID) == ISC_TRUE)
+		phase = LDAP_SYNC_CAPI_MODIFY;
 
-	CHECK(sync_concurr_limit_wait(inst->sctx));
+	CHECK(sync_group_limit_wait(inst));
 	log_debug(20, "ldap_sync_search_entry phase: %x", phase);
 
 	/* MODIFY can be rename: get old name from metaDB */
@@ -4270,10 +7324,6 @@ int ldap_sync_search_entry (
 		CHECK(ldap_entry_reconstruct(inst->mctx, inst->mldapdb,
 					     entryUUID, &old_entry));
 	}
-	if (phase == LDAP_SYNC_CAPI_ADD || phase == LDAP_SYNC_CAPI_MODIFY) {
-		CHECK(ldap_entry_parse(inst->mctx, ls->ls_ld, msg, entryUUID,
-				       &new_entry));
-	}
 	/* detect type of modification */
 	if (phase == LDAP_SYNC_CAPI_MODIFY) {
 		if (old_entry->class != new_entry->class)
@@ -4281,6 +7331,9 @@ int ldap_sync_search_entry (
 				  "object class in %s changed: "
 				  "rndc reload might be necessary",
 				  ldap_entry_logname(new_entry));
+		if ((old_entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0
+		    && (new_entry->class & LDAP_ENTRYCLASS_TEMPLATE) == 0)
+			rr_template_index_remove(inst->templates, entryUUID);
 		if ((old_entry->class
 		    & (LDAP_ENTRYCLASS_CONFIG | LDAP_ENTRYCLASS_SERVERCONFIG))
 		    == 0)
@@ -4299,9 +7352,28 @@ int ldap_sync_search_entry (
 					ldap_entry_logname(new_entry));
 		}
 	}
+	/* Records are grouped only during refresh. Zone and config objects
+	 * have to be processed before subsequent entries are parsed because
+	 * records are routed to tasks of their zones. */
+	if (new_entry != NULL)
+		class = new_entry->class;
+	else if (old_entry != NULL)
+		class = old_entry->class;
+	else
+		class = LDAP_ENTRYCLASS_NONE;
+	flush = ISC_TF(ls->ls_refreshPhase == LDAP_SYNC_CAPI_DONE
+		       || (class & LDAP_ENTRYCLASS_RR) == 0
+		       || (class & LDAP_ENTRYCLASS_MASTER) != 0);
+
+	/* Entry is parsed before metaDB is locked so parallel refresh
+	 * sessions can decode entries concurrently. */
+	CHECK(sync_group_begin(inst));
+	group_open = ISC_TRUE;
+
 	if (phase == LDAP_SYNC_CAPI_DELETE || modrdn == ISC_TRUE) {
 		/* delete old entry from zone and metaDB */
-		CHECK(syncrepl_update(inst, &old_entry, LDAP_SYNC_CAPI_DELETE));
+		CHECK(syncrepl_update(inst, &old_entry, LDAP_SYNC_CAPI_DELETE,
+				      ISC_TRUE));
 		CHECK(mldap_entry_delete(inst->mldapdb, entryUUID));
 	}
 	if (phase == LDAP_SYNC_CAPI_ADD || phase == LDAP_SYNC_CAPI_MODIFY) {
@@ -4312,14 +7384,13 @@ int ldap_sync_search_entry (
 		    == 0)
 			CHECK(mldap_dnsname_store(&new_entry->fqdn,
 						  &new_entry->zone_name, node));
-		/* commit new entry into metaLDAP DB before something breaks */
-		metadb_node_close(&node);
-		mldap_closeversion(inst->mldapdb, ISC_TRUE);
-		mldap_open = ISC_FALSE;
-		/* re-add entry under new DN, if necessary */
+		mldap_node_close(&node);
+		/* re-add entry under new DN, if necessary; event is sent
+		 * when the new entry is committed into metaLDAP DB */
 		CHECK(syncrepl_update(inst, &new_entry,
 		                      (modrdn == ISC_TRUE)
-					      ? LDAP_SYNC_CAPI_ADD : phase));
+					      ? LDAP_SYNC_CAPI_ADD : phase,
+				      ISC_TRUE));
 	}
 	if (phase != LDAP_SYNC_CAPI_ADD && phase != LDAP_SYNC_CAPI_MODIFY &&
 	    phase != LDAP_SYNC_CAPI_DELETE) {
@@ -4333,18 +7404,54 @@ int ldap_sync_search_entry (
 			 count, isc_mem_inuse(inst->mctx));
 #endif
 
-cleanup:
-	metadb_node_close(&node);
-	if (mldap_open == ISC_TRUE)
-		/* commit metaDB changes if the syncrepl event was sent */
-		mldap_closeversion(inst->mldapdb, ISC_TF(result == ISC_R_SUCCESS));
-	if (result != ISC_R_SUCCESS) {
-		log_error_r("ldap_sync_search_entry failed");
-		sync_concurr_limit_signal(inst->sctx);
-		/* TODO: Add 'tainted' flag to the LDAP instance. */
+cleanup:
+	mldap_node_close(&node);
+	if (group_open == ISC_TRUE)
+		/* roll back metaDB changes and drop events if something failed */
+		sync_group_end(inst, result, flush);
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("ldap_sync_search_entry failed");
+		sync_concurr_limit_signal(inst->sctx, NULL);
+		/* TODO: Add 'tainted' flag to the LDAP instance. */
+	}
+	ldap_entry_destroy(&old_entry);
+	ldap_entry_destroy(&new_entry);
+}
+
+/*
+ * Called when an entry is returned by ldap_sync_init()/ldap_sync_poll().
+ * If phase is LDAP_SYNC_CAPI_ADD or LDAP_SYNC_CAPI_MODIFY,
+ * the entry has been either added or modified, and thus
+ * the complete view of the entry should be in the LDAPMessage.
+ * If phase is LDAP_SYNC_CAPI_PRESENT or LDAP_SYNC_CAPI_DELETE,
+ * only the DN should be in the LDAPMessage.
+ */
+int ldap_sync_search_entry (
+	ldap_sync_t			*ls,
+	LDAPMessage			*msg,
+	struct berval			*entryUUID,
+	ldap_sync_refresh_t		phase ) {
+
+	ldap_instance_t *inst = ls->ls_private;
+	ldap_entry_t *entry = NULL;
+	isc_result_t result;
+
+	if (inst->exiting)
+		return LDAP_SUCCESS;
+
+	if (phase == LDAP_SYNC_CAPI_ADD || phase == LDAP_SYNC_CAPI_MODIFY) {
+		result = ldap_entry_parse(inst->mctx, inst->dncache, ls->ls_ld,
+					  msg, entryUUID, &entry);
+		if (result != ISC_R_SUCCESS) {
+			log_error_r("ldap_sync_search_entry failed");
+			return LDAP_SUCCESS;
+		}
 	}
-	ldap_entry_destroy(&old_entry);
-	ldap_entry_destroy(&new_entry);
+	if (inst->sync_record != NULL)
+		ldap_sync_record_check(inst, sync_record_write_entry(
+					inst->sync_record, entry, entryUUID,
+					phase, ls->ls_refreshPhase));
+	ldap_sync_entry(ls, &entry, entryUUID, phase);
 
 	/* Following return code will never reach upper layers.
 	 * It is limitation in ldap_sync_init() and ldap_sync_poll()
@@ -4352,6 +7459,98 @@ cleanup:
 	return LDAP_SUCCESS;
 }
 
+/**
+ * Remove one dead entry from DNS and metaLDAP. Removals are done through
+ * sync group so events are sent only after the removal is committed
+ * to metaLDAP. Group is flushed when the zone changes so all removals
+ * from one zone are committed together.
+ *
+ * @param[in,out] zone Zone of the previous entry, empty name
+ *                     if the previous entry did not belong to a zone.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_sweep_entry(ldap_instance_t *inst, struct berval *entryUUID,
+		      dns_name_t *zone) {
+	isc_result_t result;
+	ldap_entry_t *entry = NULL;
+	isc_boolean_t waited = ISC_FALSE;
+	isc_boolean_t group_open = ISC_FALSE;
+	isc_boolean_t has_zone;
+
+	CHECK(sync_group_limit_wait(inst));
+	waited = ISC_TRUE;
+	CHECK(ldap_entry_reconstruct(inst->mctx, inst->mldapdb, entryUUID,
+				     &entry));
+	has_zone = ISC_TF((entry->class & (LDAP_ENTRYCLASS_CONFIG
+					   | LDAP_ENTRYCLASS_SERVERCONFIG))
+			  == 0);
+
+	if (has_zone == ISC_FALSE
+	    || dns_name_countlabels(zone) == 0
+	    || dns_name_equal(zone, &entry->zone_name) == ISC_FALSE)
+		sync_group_flush(inst);
+	dns_name_reset(zone);
+	if (has_zone == ISC_TRUE)
+		CHECK(dns_name_copy(&entry->zone_name, zone, NULL));
+
+	CHECK(sync_group_begin(inst));
+	group_open = ISC_TRUE;
+	CHECK(syncrepl_update(inst, &entry, LDAP_SYNC_CAPI_DELETE, ISC_TRUE));
+	CHECK(mldap_entry_delete(inst->mldapdb, entryUUID));
+
+cleanup:
+	if (group_open == ISC_TRUE)
+		/* roll back metaLDAP changes and drop the event if failed */
+		sync_group_end(inst, result, ISC_FALSE);
+	if (result != ISC_R_SUCCESS && waited == ISC_TRUE)
+		sync_concurr_limit_signal(inst->sctx, NULL);
+	ldap_entry_destroy(&entry);
+	return result;
+}
+
+/**
+ * Remove entries which were not reported as present during refresh
+ * from DNS and metaLDAP (RFC 4533 section 3.3.1).
+ *
+ * Only entries from old generations are visited. Dead entries are
+ * processed zone by zone so all removals from one zone are committed
+ * to metaLDAP at once and consecutive events for the zone are merged
+ * into one zone batch.
+ */
+static void ATTR_NONNULLS
+ldap_sync_sweep(ldap_instance_t *inst) {
+	isc_result_t result;
+	mldap_iter_t *mldap_iter = NULL;
+	char entryUUID_buf[16];
+	struct berval entryUUID = { .bv_len = sizeof(entryUUID_buf),
+				    .bv_val = entryUUID_buf };
+	unsigned int removed = 0;
+	unsigned int failed = 0;
+	DECLARE_BUFFERED_NAME(zone);
+
+	INIT_BUFFERED_NAME(zone);
+
+	for (result = mldap_iter_deadnodes_start(inst->mldapdb, &mldap_iter,
+						 &entryUUID);
+	     result == ISC_R_SUCCESS;
+	     result = mldap_iter_deadnodes_next(inst->mldapdb, &mldap_iter,
+					        &entryUUID)) {
+		if (ldap_sync_sweep_entry(inst, &entryUUID, &zone)
+		    == ISC_R_SUCCESS)
+			removed++;
+		else
+			failed++;
+	}
+	sync_group_flush(inst);
+
+	if (result != ISC_R_NOMORE)
+		log_error_r("mldap_iter_deadnodes_* failed, run rndc reload");
+	if (failed > 0 && !inst->exiting)
+		log_error("unable to remove %u stale LDAP entries: "
+			  "rndc reload might be necessary", failed);
+	log_debug(1, "%u stale LDAP entries removed", removed);
+}
+
 /**
  * Called when specific intermediate/final messages are returned
  * by ldap_sync_init()/ldap_sync_poll().
@@ -4376,21 +7575,54 @@ int ldap_sync_intermediate (
 
 	isc_result_t	result;
 	ldap_instance_t *inst = ls->ls_private;
-	metadb_iter_t *mldap_iter = NULL;
-	char entryUUID_buf[16];
-	struct berval entryUUID = { .bv_len = sizeof(entryUUID_buf),
-				    .bv_val = entryUUID_buf };
+	ldap_entry_t *entry = NULL;
 	sync_state_t state;
+	int i;
 
 	UNUSED(msg);
-	UNUSED(syncUUIDs);
 
 	if (inst->exiting)
 		goto cleanup;
 
 	log_debug(1, "ldap_sync_intermediate 0x%x", phase);
-	if (phase != LDAP_SYNC_CAPI_DONE)
+	if (inst->sync_record != NULL)
+		ldap_sync_record_check(inst, sync_record_write_intermediate(
+					inst->sync_record, syncUUIDs, phase));
+	switch (phase) {
+	case LDAP_SYNC_CAPI_PRESENTS:
+		inst->sync_refresh_presents = ISC_TRUE;
+		goto cleanup;
+
+	case LDAP_SYNC_CAPI_PRESENTS_IDSET:
+		for (i = 0; syncUUIDs != NULL && syncUUIDs[i].bv_val != NULL;
+		     i++)
+			ldap_sync_present(inst, &syncUUIDs[i]);
+		goto cleanup;
+
+	case LDAP_SYNC_CAPI_DELETES:
+		/* only deleted entries will be reported */
+		inst->sync_refresh_presents = ISC_FALSE;
+		goto cleanup;
+
+	case LDAP_SYNC_CAPI_DELETES_IDSET:
+		inst->sync_refresh_presents = ISC_FALSE;
+		for (i = 0; syncUUIDs != NULL && syncUUIDs[i].bv_val != NULL;
+		     i++) {
+			if (ldap_sync_isknown(inst, &syncUUIDs[i]) == ISC_TRUE)
+				ldap_sync_entry(ls, &entry, &syncUUIDs[i],
+						LDAP_SYNC_CAPI_DELETE);
+		}
+		goto cleanup;
+
+	case LDAP_SYNC_CAPI_DONE:
+		break;
+
+	default:
 		goto cleanup;
+	}
+
+	/* refresh is done, make all changes visible */
+	sync_group_flush(inst);
 
 	sync_state_get(inst->sctx, &state);
 	if (state == sync_datainit) {
@@ -4402,17 +7634,12 @@ int ldap_sync_intermediate (
 		}
 	}
 
-	for (result = mldap_iter_deadnodes_start(inst->mldapdb, &mldap_iter,
-						 &entryUUID);
-	     result == ISC_R_SUCCESS;
-	     result = mldap_iter_deadnodes_next(inst->mldapdb, &mldap_iter,
-					        &entryUUID)) {
-		ldap_sync_search_entry(ls, NULL, &entryUUID,
-				       LDAP_SYNC_CAPI_DELETE);
+	/* Incremental refresh in 'delete' mode reports deleted entries
+	 * explicitly, unchanged entries have old generation number. */
+	if (inst->sync_refresh_presents == ISC_FALSE)
+		goto cleanup;
 
-	}
-	if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE)
-		log_error_r("mldap_iter_deadnodes_* failed, run rndc reload");
+	ldap_sync_sweep(inst);
 
 cleanup:
 	return LDAP_SUCCESS;
@@ -4424,7 +7651,7 @@ cleanup:
  * In refreshAndPersist, this can only occur if the search for any reason
  * is being terminated by the server.
  */
-int ATTR_NONNULLS ATTR_CHECKRESULT ldap_sync_search_result (
+int ATTR_NONNULL(1) ATTR_CHECKRESULT ldap_sync_search_result (
 	ldap_sync_t			*ls,
 	LDAPMessage			*msg,
 	int				refreshDeletes ) {
@@ -4433,19 +7660,24 @@ int ATTR_NONNULLS ATTR_CHECKRESULT ldap_sync_search_result (
 	sync_state_t state;
 
 	UNUSED(msg);
-	UNUSED(refreshDeletes);
 
 	log_debug(1, "ldap_sync_search_result");
 
 	if (inst->exiting)
 		goto cleanup;
 
+	if (inst->sync_record != NULL)
+		ldap_sync_record_check(inst, sync_record_write_result(
+					inst->sync_record, refreshDeletes));
+
 	/* This place can be reached only if:
 	 * a) initial config synchronization is done
 	 * b) config is re-synchronized after reconnect to LDAP */
 	sync_state_get(inst->sctx, &state);
 	INSIST(state == sync_configinit || state == sync_finished);
 
+	sync_group_flush(inst);
+
 	if (state == sync_configinit) {
 		result = sync_barrier_wait(inst->sctx, inst->db_name);
 		if (result != ISC_R_SUCCESS) {
@@ -4481,22 +7713,19 @@ ldap_sync_cleanup(ldap_sync_t **ldap_syncp) {
  * In case of failure, the conn parameter may be invalid and LDAP connection
  * needs to be re-established.
  *
+ * @param[in]  base    Search base or NULL to use base from settings.
  * @param[in]  filter  LDAP filter to be used in SyncRepl session
  */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+static isc_result_t ATTR_NONNULL(1,2,4,5,6) ATTR_CHECKRESULT
 ldap_sync_prepare(ldap_instance_t *inst, settings_set_t *settings,
-		  const char *filter, ldap_connection_t *conn,
-		  ldap_sync_t **ldap_syncp) {
+		  const char *base, const char *filter,
+		  ldap_connection_t *conn, ldap_sync_t **ldap_syncp) {
 	isc_result_t result;
-	const char *base = NULL;
 	ldap_sync_t *ldap_sync = NULL;
 
 	REQUIRE(inst != NULL);
 	REQUIRE(ldap_syncp != NULL && *ldap_syncp == NULL);
 
-	/* Remove stale zone & journal files. */
-	CHECK(cleanup_files(inst));
-
 	if(conn->handle == NULL)
 		CLEANUP_WITH(ISC_R_NOTCONNECTED);
 
@@ -4507,7 +7736,8 @@ ldap_sync_prepare(ldap_instance_t *inst, settings_set_t *settings,
 	}
 	ZERO_PTR(ldap_sync);
 
-	CHECK(setting_get_str("base", settings, &base));
+	if (base == NULL)
+		CHECK(setting_get_str("base", settings, &base));
 	ldap_sync->ls_base = ldap_strdup(base);
 	if (ldap_sync->ls_base == NULL)
 		CLEANUP_WITH(ISC_R_NOMEMORY);
@@ -4554,6 +7784,8 @@ cleanup:
  * @retval ISC_R_SUCCESS      LDAP_SYNC_REFRESH_ONLY mode finished,
  *                            all events were sent (not necessarily processed)
  * @retval ISC_R_NOTCONNECTED Unable to start SyncRepl session.
+ * @retval ISC_R_RELOAD       LDAP server rejected SyncRepl cookie,
+ *                            full synchronization has to be done.
  * @retval others             Errors, some events might or might not be sent.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
@@ -4571,6 +7803,10 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 		"%s"
 		")";
 	const char *server_id = NULL;
+	isc_boolean_t persistent = ISC_FALSE;
+
+	CHECK(setting_get_bool("persistent_cache", inst->local_settings,
+			       &persistent));
 
 	/* request idnsServerConfig object only if server_id is specified */
 	CHECK(setting_get_str("server_id", inst->server_ldap_settings, &server_id));
@@ -4583,8 +7819,11 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 				        "    (idnsServerId=", server_id, "))",
 					filter_objcs));
 
-	result = ldap_sync_prepare(inst, inst->server_ldap_settings,
-				   filter, conn, &ldap_sync);
+	/* Remove stale zone & journal files. */
+	result = cleanup_files(inst);
+	if (result == ISC_R_SUCCESS)
+		result = ldap_sync_prepare(inst, inst->server_ldap_settings,
+					   NULL, filter, conn, &ldap_sync);
 	if (result != ISC_R_SUCCESS) {
 		log_error_r("ldap_sync_prepare() failed, retrying "
 			    "in 1 second");
@@ -4592,7 +7831,17 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 		goto cleanup;
 	}
 
+	/* resume data synchronization from the last known state */
+	inst->sync_refresh_presents = ISC_TRUE;
+	if (mode == LDAP_SYNC_REFRESH_AND_PERSIST && inst->sync_cookie != NULL) {
+		if (ber_dupbv(&ldap_sync->ls_cookie, inst->sync_cookie) == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+		inst->sync_refresh_presents = ISC_FALSE;
+	}
+
 	ret = ldap_sync_init(ldap_sync, mode);
+	if (ret == LDAP_SYNC_REFRESH_REQUIRED)
+		goto refresh_required;
 	/* TODO: error handling, set tainted flag & do full reload? */
 	if (ret != LDAP_SUCCESS) {
 		if (ret == LDAP_UNAVAILABLE_CRITICAL_EXTENSION)
@@ -4609,6 +7858,8 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 	while (!inst->exiting && ret == LDAP_SUCCESS
 	       && mode == LDAP_SYNC_REFRESH_AND_PERSIST) {
 		ret = ldap_sync_poll(ldap_sync);
+		if (ret == LDAP_SYNC_REFRESH_REQUIRED)
+			goto refresh_required;
 		if (!inst->exiting && ret != LDAP_SUCCESS) {
 			log_ldap_error(ldap_sync->ls_ld,
 				       "ldap_sync_poll() failed");
@@ -4618,10 +7869,474 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 	}
 
 cleanup:
+	/* Cookie is valid only after the refresh phase is complete.
+	 * It will be used after reconnect and stored on shutdown. */
+	if (ldap_sync != NULL && persistent == ISC_TRUE
+	    && mode == LDAP_SYNC_REFRESH_AND_PERSIST
+	    && ldap_sync->ls_refreshPhase == LDAP_SYNC_CAPI_DONE
+	    && ldap_sync->ls_cookie.bv_val != NULL) {
+		if (inst->sync_cookie != NULL)
+			ber_bvfree(inst->sync_cookie);
+		inst->sync_cookie = ber_dupbv(NULL, &ldap_sync->ls_cookie);
+		if (inst->sync_cookie == NULL)
+			log_error("unable to store SyncRepl cookie, full "
+				  "synchronization will be done after "
+				  "reconnect");
+	} else if (persistent == ISC_FALSE
+		   && mode == LDAP_SYNC_REFRESH_AND_PERSIST
+		   && inst->sync_cookie != NULL) {
+		/* cookie from parallel refresh is used only once */
+		ber_bvfree(inst->sync_cookie);
+		inst->sync_cookie = NULL;
+	}
+	sync_group_flush(inst);
+	ldap_sync_cleanup(&ldap_sync);
+	return result;
+
+refresh_required:
+	log_info("LDAP server rejected SyncRepl cookie, "
+		 "full synchronization will be done");
+	sync_group_flush(inst);
+	if (inst->sync_cookie != NULL) {
+		ber_bvfree(inst->sync_cookie);
+		inst->sync_cookie = NULL;
+	}
+	ldap_sync_cleanup(&ldap_sync);
+	/* ldap_sync_cleanup() unbound the handle, start over immediately */
+	conn->handle = NULL;
+	if (ldap_connect(inst, conn, ISC_TRUE) != ISC_R_SUCCESS)
+		log_error("reconnection to LDAP failed");
+	return ISC_R_RELOAD;
+}
+
+/**
+ * Shared state of parallel initial refresh. Zones are handed out to worker
+ * threads one by one so a single large zone does not delay the others.
+ */
+typedef struct ldap_refresh ldap_refresh_t;
+struct ldap_refresh {
+	ldap_instance_t		*inst;
+	isc_mutex_t		lock;	/**< guards next and result */
+	char			**dns;	/**< DNs of zones to be refreshed */
+	unsigned int		count;
+	unsigned int		next;	/**< index of the next zone */
+	isc_result_t		result;	/**< first error from any worker */
+};
+
+/*
+ * Intermediate and result messages do not carry any information
+ * for refresh-only sessions without cookie.
+ */
+static int ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_refresh_intermediate(ldap_sync_t *ls, LDAPMessage *msg,
+			  BerVarray syncUUIDs, ldap_sync_refresh_t phase) {
+	UNUSED(ls);
+	UNUSED(msg);
+	UNUSED(syncUUIDs);
+
+	log_debug(1, "ldap_refresh_intermediate 0x%x", phase);
+	return LDAP_SUCCESS;
+}
+
+static int ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_refresh_result(ldap_sync_t *ls, LDAPMessage *msg, int refreshDeletes) {
+	UNUSED(msg);
+	UNUSED(refreshDeletes);
+
+	log_debug(1, "ldap_refresh_result: base '%s' done", ls->ls_base);
+	return LDAP_SUCCESS;
+}
+
+/**
+ * Run one SyncRepl session in LDAP_SYNC_REFRESH_ONLY mode and process all
+ * entries returned by it. LDAP connection stays bound after successful
+ * session so it can be re-used for the next one.
+ *
+ * @param[in]  base     Search base or NULL to use base from settings.
+ * @param[out] cookiep  Cookie returned by LDAP server or NULL if the server
+ *                      did not return any. Can be NULL if the cookie is not
+ *                      needed.
+ */
+static isc_result_t ATTR_NONNULL(1,2,4) ATTR_CHECKRESULT
+ldap_refresh_session(ldap_instance_t *inst, ldap_connection_t *conn,
+		     const char *base, const char *filter,
+		     struct berval **cookiep) {
+	isc_result_t result;
+	ldap_sync_t *ldap_sync = NULL;
+	int ret;
+
+	if (conn->handle == NULL)
+		CHECK(ldap_connect(inst, conn, ISC_TRUE));
+	CHECK(ldap_sync_prepare(inst, inst->server_ldap_settings, base,
+				filter, conn, &ldap_sync));
+	ldap_sync->ls_intermediate = ldap_refresh_intermediate;
+	ldap_sync->ls_search_result = ldap_refresh_result;
+
+	ret = ldap_sync_init(ldap_sync, LDAP_SYNC_REFRESH_ONLY);
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ldap_sync->ls_ld, "SyncRepl refresh of '%s' "
+			       "failed", ldap_sync->ls_base);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	if (cookiep != NULL && ldap_sync->ls_cookie.bv_val != NULL) {
+		*cookiep = ber_dupbv(NULL, &ldap_sync->ls_cookie);
+		if (*cookiep == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+	}
+
+	/* search is finished, take the handle back from ldap_sync */
+	conn->handle = ldap_sync->ls_ld;
+	ldap_sync->ls_ld = NULL;
+
+cleanup:
+	/* the caller can announce that the zone is complete */
+	sync_group_flush(inst);
 	ldap_sync_cleanup(&ldap_sync);
 	return result;
 }
 
+/**
+ * Worker thread for parallel refresh. It refreshes zones from shared queue
+ * until the queue is empty or until some worker fails.
+ */
+static isc_threadresult_t
+ldap_refresh_worker(isc_threadarg_t arg) {
+	ldap_refresh_t *refresh = (ldap_refresh_t *)arg;
+	ldap_instance_t *inst = refresh->inst;
+	ldap_connection_t *conn = NULL;
+	isc_result_t result;
+	unsigned int i;
+
+	CHECK(ldap_pool_getconnection(inst->pool, &conn));
+	while (inst->exiting == ISC_FALSE) {
+		LOCK(&refresh->lock);
+		i = refresh->next;
+		if (refresh->result != ISC_R_SUCCESS)
+			i = refresh->count;
+		else if (i < refresh->count)
+			refresh->next++;
+		UNLOCK(&refresh->lock);
+		if (i >= refresh->count)
+			break;
+
+		log_debug(1, "parallel refresh of zone '%s' started",
+			  refresh->dns[i]);
+		CHECK(ldap_refresh_session(inst, conn, refresh->dns[i],
+					   "(objectClass=idnsRecord)", NULL));
+		/* zone is complete, there is no need to wait for others */
+		if (zone_refreshed_send(inst, refresh->dns[i])
+		    != ISC_R_SUCCESS)
+			log_error("unable to schedule early activation of "
+				  "zone '%s'", refresh->dns[i]);
+	}
+	if (inst->exiting == ISC_TRUE)
+		result = ISC_R_SHUTTINGDOWN;
+
+cleanup:
+	ldap_pool_putconnection(inst->pool, &conn);
+	if (result != ISC_R_SUCCESS) {
+		LOCK(&refresh->lock);
+		if (refresh->result == ISC_R_SUCCESS)
+			refresh->result = result;
+		UNLOCK(&refresh->lock);
+	}
+	return (isc_threadresult_t)0;
+}
+
+/**
+ * Fill refresh->dns with DNs of all zones in zone register.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_refresh_zones(ldap_instance_t *inst, ldap_refresh_t *refresh) {
+	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	unsigned int count = 0;
+	unsigned int pass;
+	const char *dn;
+	DECLARE_BUFFERED_NAME(name);
+
+	/* first pass counts zones, second pass copies their DNs */
+	for (pass = 0; pass < 2; pass++) {
+		INIT_BUFFERED_NAME(name);
+		result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+		while (result == ISC_R_SUCCESS) {
+			if (pass == 0) {
+				count++;
+			} else if (refresh->count < count) {
+				dn = NULL;
+				CHECK(zr_get_zone_dn(inst->zone_register,
+						     &name, &dn));
+				CHECKED_MEM_STRDUP(inst->mctx, dn,
+					refresh->dns[refresh->count]);
+				refresh->count++;
+			}
+			INIT_BUFFERED_NAME(name);
+			result = rbt_iter_next(&iter, &name);
+		}
+		if (result != ISC_R_NOTFOUND && result != ISC_R_NOMORE)
+			goto cleanup;
+		rbt_iter_stop(&iter);
+
+		if (pass == 0) {
+			if (count == 0)
+				break;
+			CHECKED_MEM_GET(inst->mctx, refresh->dns,
+					count * sizeof(char *));
+			memset(refresh->dns, 0, count * sizeof(char *));
+		}
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	rbt_iter_stop(&iter);
+	/* refresh->count DNs are valid but the array has count slots */
+	if (result != ISC_R_SUCCESS || count != refresh->count) {
+		while (refresh->count > 0)
+			isc_mem_free(inst->mctx,
+				     refresh->dns[--refresh->count]);
+		if (refresh->dns != NULL)
+			isc_mem_put(inst->mctx, refresh->dns,
+				    count * sizeof(char *));
+		refresh->dns = NULL;
+	}
+	return result;
+}
+
+/**
+ * Download records from all zones known to zone register using multiple
+ * SyncRepl sessions in parallel. Each session uses its own LDAP connection
+ * from the connection pool and covers one zone at a time.
+ *
+ * The persistent session started after the parallel refresh resumes from
+ * the cookie stored to inst->sync_cookie. The cookie is obtained from an
+ * empty refresh done before any worker is started so changes made during
+ * the parallel refresh are sent again by the persistent session.
+ *
+ * @pre Zone objects were already processed.
+ *
+ * @retval ISC_R_SUCCESS  Refresh finished and inst->sync_cookie was set.
+ * @retval ISC_R_NOTFOUND Parallel refresh is not possible because LDAP server
+ *                        did not return any cookie or there are no zones.
+ * @retval others         Refresh failed, data have to be downloaded again.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_parallel_refresh(ldap_instance_t *inst, ldap_connection_t *conn,
+			   unsigned int sessions) {
+	isc_result_t result;
+	ldap_refresh_t refresh;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	struct berval *cookie = NULL;
+	isc_thread_t *threads = NULL;
+	unsigned int started = 0;
+	unsigned int i;
+	isc_time_t start;
+	isc_time_t end;
+
+	ZERO_PTR(&refresh);
+	refresh.inst = inst;
+	refresh.result = ISC_R_SUCCESS;
+	CHECK(isc_mutex_init(&refresh.lock));
+	lock_ready = ISC_TRUE;
+
+	CHECK(ldap_refresh_zones(inst, &refresh));
+	if (refresh.count == 0)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+
+	CHECK(ldap_refresh_session(inst, conn, NULL, "(!(objectClass=*))",
+				   &cookie));
+	if (cookie == NULL) {
+		log_info("LDAP server did not return SyncRepl cookie, "
+			 "parallel refresh is not possible");
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	}
+
+	sessions = ISC_MIN(sessions, refresh.count);
+	log_info("LDAP instance '%s': refreshing %u zones using %u "
+		 "parallel sessions", inst->db_name, refresh.count, sessions);
+	RUNTIME_CHECK(isc_time_now(&start) == ISC_R_SUCCESS);
+
+	CHECKED_MEM_GET(inst->mctx, threads, sessions * sizeof(isc_thread_t));
+	for (started = 0; started < sessions; started++) {
+		result = isc_thread_create(ldap_refresh_worker, &refresh,
+					   &threads[started]);
+		if (result != ISC_R_SUCCESS) {
+			log_error_r("unable to create parallel refresh thread");
+			LOCK(&refresh.lock);
+			refresh.result = result;
+			UNLOCK(&refresh.lock);
+			break;
+		}
+	}
+	for (i = 0; i < started; i++)
+		RUNTIME_CHECK(isc_thread_join(threads[i], NULL)
+			      == ISC_R_SUCCESS);
+	CHECK(refresh.result);
+
+	RUNTIME_CHECK(isc_time_now(&end) == ISC_R_SUCCESS);
+	log_info("LDAP instance '%s': parallel refresh finished in %u ms",
+		 inst->db_name,
+		 (unsigned int)(isc_time_microdiff(&end, &start) / 1000));
+
+	if (inst->sync_cookie != NULL)
+		ber_bvfree(inst->sync_cookie);
+	inst->sync_cookie = cookie;
+	cookie = NULL;
+
+cleanup:
+	if (threads != NULL)
+		isc_mem_put(inst->mctx, threads,
+			    sessions * sizeof(isc_thread_t));
+	if (cookie != NULL)
+		ber_bvfree(cookie);
+	for (i = 0; i < refresh.count; i++)
+		isc_mem_free(inst->mctx, refresh.dns[i]);
+	if (refresh.dns != NULL)
+		isc_mem_put(inst->mctx, refresh.dns,
+			    refresh.count * sizeof(char *));
+	if (lock_ready == ISC_TRUE)
+		DESTROYLOCK(&refresh.lock);
+	return result;
+}
+
+/**
+ * Phases of recorded SyncRepl session measured by ldap_sync_replay().
+ */
+typedef enum {
+	ldap_replay_config = 0,	/**< configuration session */
+	ldap_replay_refresh,	/**< data session up to refreshDone */
+	ldap_replay_persist,	/**< persistent search */
+	ldap_replay_max
+} ldap_replay_phase_t;
+
+static const char * const ldap_replay_phase_names[ldap_replay_max] = {
+	"configuration", "refresh", "persist"
+};
+
+/**
+ * Finish measurement of the current replay phase and start the next one.
+ */
+static void ATTR_NONNULLS
+ldap_sync_replay_next(ldap_replay_phase_t *phase, isc_time_t *phase_start,
+		      isc_uint64_t *usec) {
+	isc_time_t now;
+
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+	usec[*phase] += isc_time_microdiff(&now, phase_start);
+	*phase_start = now;
+	if (*phase < ldap_replay_persist)
+		(*phase)++;
+}
+
+/**
+ * Process SyncRepl callbacks stored by sync_record_file instead of
+ * talking to LDAP server and log throughput of each phase.
+ * Callbacks are fed to the same code as callbacks from libldap
+ * so the whole processing pipeline up to zone updates is exercised.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_replay(ldap_instance_t *inst, const char *filename) {
+	isc_result_t result;
+	sync_record_t *rec = NULL;
+	sync_record_msg_t msg;
+	ldap_sync_t ls;
+	sync_state_t state;
+	ldap_replay_phase_t phase = ldap_replay_config;
+	isc_time_t phase_start;
+	isc_uint64_t usec[ldap_replay_max];
+	unsigned int entries[ldap_replay_max];
+	isc_uint64_t total_usec = 0;
+	unsigned int total = 0;
+	int ret;
+	unsigned int i;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(usec, 0, sizeof(usec));
+	memset(entries, 0, sizeof(entries));
+	ZERO_PTR(&ls);
+	ls.ls_private = inst;
+
+	CHECK(sync_record_create(inst->mctx, filename, ISC_FALSE, &rec));
+	log_info("LDAP instance '%s': replaying SyncRepl session from '%s'",
+		 inst->db_name, filename);
+	sync_state_reset(inst->sctx);
+	CHECK(sync_task_add(inst->sctx, inst->task));
+	RUNTIME_CHECK(isc_time_now(&phase_start) == ISC_R_SUCCESS);
+
+	while (!inst->exiting) {
+		result = sync_record_read(rec, inst->dncache, &msg);
+		if (result == ISC_R_NOMORE)
+			break;
+		else if (result != ISC_R_SUCCESS)
+			goto cleanup;
+
+		switch (msg.type) {
+		case sync_record_entry:
+			if ((msg.phase == LDAP_SYNC_CAPI_ADD
+			     || msg.phase == LDAP_SYNC_CAPI_MODIFY)
+			    && msg.entry == NULL)
+				CLEANUP_WITH(ISC_R_UNEXPECTEDEND);
+			entries[phase]++;
+			ls.ls_refreshPhase = msg.refresh_phase;
+			ldap_sync_entry(&ls, &msg.entry, &msg.uuid, msg.phase);
+			break;
+
+		case sync_record_intermediate:
+			ret = ldap_sync_intermediate(&ls, NULL, msg.uuids,
+						     msg.phase);
+			if (ret != LDAP_SUCCESS)
+				CLEANUP_WITH(ISC_R_FAILURE);
+			if (msg.phase == LDAP_SYNC_CAPI_DONE
+			    && phase == ldap_replay_refresh)
+				ldap_sync_replay_next(&phase, &phase_start,
+						      usec);
+			break;
+
+		case sync_record_result:
+			ret = ldap_sync_search_result(&ls, NULL, msg.phase);
+			if (ret != LDAP_SUCCESS)
+				CLEANUP_WITH(ISC_R_FAILURE);
+			/* data session follows, see ldap_syncrepl_watcher() */
+			sync_state_get(inst->sctx, &state);
+			if (state != sync_finished)
+				CHECK(sync_task_add(inst->sctx, inst->task));
+			mldap_cur_generation_bump(inst->mldapdb);
+			if (phase == ldap_replay_config)
+				ldap_sync_replay_next(&phase, &phase_start,
+						      usec);
+			break;
+		}
+	}
+	if (inst->exiting)
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+
+	/* include processing of events still waiting in task queues */
+	sync_group_flush(inst);
+	CHECK(sync_concurr_limit_drain(inst->sctx));
+	ldap_sync_replay_next(&phase, &phase_start, usec);
+
+	for (i = 0; i < ldap_replay_max; i++) {
+		log_info("LDAP instance '%s': replay phase %s: %u entries "
+			 "in %llu ms (%llu entries/s)", inst->db_name,
+			 ldap_replay_phase_names[i], entries[i],
+			 (unsigned long long)(usec[i] / 1000),
+			 (unsigned long long)(entries[i] * 1000000ULL
+					      / ISC_MAX(usec[i], 1)));
+		total += entries[i];
+		total_usec += usec[i];
+	}
+	log_info("LDAP instance '%s': replay finished: %u entries "
+		 "in %llu ms (%llu entries/s), peak memory %zu bytes",
+		 inst->db_name, total, (unsigned long long)(total_usec / 1000),
+		 (unsigned long long)(total * 1000000ULL
+				      / ISC_MAX(total_usec, 1)),
+		 isc_mem_maxinuse(inst->mctx));
+
+cleanup:
+	ldap_entry_destroy(&msg.entry);
+	sync_record_destroy(&rec);
+	return result;
+}
+
 /*
  * NOTE:
  * Every blocking call in syncrepl_watcher thread must be preemptible.
@@ -4635,7 +8350,12 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 	isc_result_t result;
 	sigset_t sigset;
 	isc_uint32_t reconnect_interval;
+	isc_uint32_t refresh_sessions;
+	isc_uint32_t connections;
+	isc_boolean_t parallel;
+	isc_boolean_t parallel_cookie = ISC_FALSE;
 	sync_state_t state;
+	const char *replay_file = NULL;
 
 	log_debug(1, "Entering ldap_syncrepl_watcher");
 
@@ -4653,8 +8373,44 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 	/* pthread_sigmask fails only due invalid args */
 	RUNTIME_CHECK(ret == 0);
 
+	CHECK(setting_get_str("sync_replay_file", inst->local_settings,
+			      &replay_file));
+	if (strlen(replay_file) != 0) {
+		result = ldap_sync_replay(inst, replay_file);
+		if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN)
+			log_error_r("replay of SyncRepl session from '%s' "
+				    "failed", replay_file);
+		/* LDAP is not used in replay mode, wait for shutdown */
+		while (sane_sleep(inst, 3600) == ISC_TRUE)
+			;
+		goto cleanup;
+	}
+
+	/* Parallel refresh sessions share the pool with the watcher
+	 * and at least one connection is left for updates from DNS. */
+	CHECK(setting_get_uint("sync_refresh_sessions", inst->local_settings,
+			       &refresh_sessions));
+	CHECK(setting_get_uint("connections", inst->local_settings,
+			       &connections));
+	if (refresh_sessions > connections - 2) {
+		if (refresh_sessions > 1)
+			log_info("sync_refresh_sessions %u is limited to %u "
+				 "by connections %u", refresh_sessions,
+				 connections - 2, connections);
+		refresh_sessions = connections - 2;
+	}
+	/* record file cannot interleave callbacks from parallel sessions */
+	if (inst->sync_record != NULL && refresh_sessions > 1) {
+		log_info("sync_refresh_sessions is ignored while "
+			 "sync_record_file is used");
+		refresh_sessions = 1;
+	}
+
 	/* Pick connection, one is reserved purely for this thread */
 	CHECK(ldap_pool_getconnection(inst->pool, &conn));
+	/* SyncRepl session can use read-only replicas, the connection
+	 * is moved to the fastest server at the first reconnect below */
+	conn->role = SERVER_SYNC;
 
 	while (!inst->exiting) {
 		sync_state_get(inst->sctx, &state);
@@ -4662,9 +8418,22 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 			sync_state_reset(inst->sctx);
 			CHECK(sync_task_add(inst->sctx, inst->task));
 		}
+		/* parallel refresh is used only for full synchronization */
+		parallel = ISC_TF(refresh_sessions > 1
+				  && state != sync_finished
+				  && inst->sync_cookie == NULL);
+		parallel_cookie = ISC_FALSE;
 		/* synchronize configuration first so configuration variables
-		 * are already available during data processing */
-		result = ldap_sync_doit(inst, conn, "", LDAP_SYNC_REFRESH_ONLY);
+		 * are already available during data processing;
+		 * data session resumed from cookie will not send unchanged
+		 * zones so they have to be fetched together with config */
+		result = ldap_sync_doit(inst, conn,
+					(inst->sync_cookie != NULL
+					 || parallel == ISC_TRUE)
+					? "(objectClass=idnsZone)"
+					  "(objectClass=idnsForwardZone)"
+					: "",
+					LDAP_SYNC_REFRESH_ONLY);
 		if (result != ISC_R_SUCCESS) {
 			log_error_r("LDAP configuration synchronization failed");
 			goto retry;
@@ -4676,20 +8445,59 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 			goto retry;
 		}
 
+		/* zone caches can be used only during the first session */
+		if (inst->zone_cache_failed == ISC_TRUE
+		    && inst->sync_cookie != NULL) {
+			ber_bvfree(inst->sync_cookie);
+			inst->sync_cookie = NULL;
+		}
+		inst->zone_cache = ISC_FALSE;
+
 		/* finally synchronize the data */
 		sync_state_get(inst->sctx, &state);
-		if (state != sync_finished)
+		if (state != sync_finished) {
 			CHECK(sync_task_add(inst->sctx, inst->task));
+			if (inst->sync_cookie != NULL || parallel == ISC_TRUE)
+				CHECK(sync_zr_tasks_add(inst));
+		}
 		mldap_cur_generation_bump(inst->mldapdb);
 		log_info("LDAP data for instance '%s' are being synchronized, "
 			 "please ignore message 'all zones loaded'",
 			 inst->db_name);
+		if (parallel == ISC_TRUE) {
+			result = ldap_sync_parallel_refresh(inst, conn,
+							    refresh_sessions);
+			CHECK_EXIT;
+			if (result == ISC_R_SUCCESS) {
+				parallel_cookie = ISC_TRUE;
+			} else if (result != ISC_R_NOTFOUND) {
+				log_error_r("parallel refresh failed, "
+					    "falling back to single session");
+			}
+			if (conn->handle == NULL) {
+				result = ldap_connect(inst, conn, ISC_TRUE);
+				if (result != ISC_R_SUCCESS) {
+					log_error_r("reconnection to LDAP "
+						    "failed");
+					goto retry;
+				}
+			}
+		}
 		result = ldap_sync_doit(inst, conn,
 				        "(|(objectClass=idnsZone)"
 					"  (objectClass=idnsForwardZone)"
 					"  (objectClass=idnsRecord))",
 					LDAP_SYNC_REFRESH_AND_PERSIST);
-		if (result != ISC_R_SUCCESS) {
+		if (result == ISC_R_RELOAD) {
+			/* cookie was rejected, start over with full sync */
+			if (parallel_cookie == ISC_TRUE) {
+				log_error("LDAP server does not accept cookie "
+					  "from parallel refresh, "
+					  "sync_refresh_sessions is ignored");
+				refresh_sessions = 1;
+			}
+			goto retry;
+		} else if (result != ISC_R_SUCCESS) {
 			log_error_r("LDAP data synchronization failed");
 			goto retry;
 		}
@@ -4700,6 +8508,15 @@ retry:
 		/* Try to connect. */
 		while (conn->handle == NULL) {
 			CHECK_EXIT;
+			/* Failed server is in back-off state so reconnect
+			 * goes to another server, no need to wait. */
+			if (server_list_available(inst->servers, SERVER_SYNC)
+			    == ISC_TRUE) {
+				log_info("ldap_syncrepl is failing over to "
+					 "another LDAP server");
+				handle_connection_error(inst, conn, ISC_TRUE);
+				continue;
+			}
 			CHECK(setting_get_uint("reconnect_interval",
 					       inst->server_ldap_settings,
 					       &reconnect_interval));
@@ -4716,6 +8533,16 @@ retry:
 
 cleanup:
 	log_debug(1, "Ending ldap_syncrepl_watcher");
+	if (conn != NULL) {
+		/* read-only replica cannot be used for updates */
+		if (conn->server != NULL
+		    && server_writable(conn->server) == ISC_FALSE
+		    && conn->handle != NULL) {
+			ldap_unbind_ext_s(conn->handle, NULL, NULL);
+			conn->handle = NULL;
+		}
+		conn->role = SERVER_WRITE;
+	}
 	ldap_pool_putconnection(inst->pool, &conn);
 
 	return (isc_threadresult_t)0;
@@ -65,6 +65,12 @@ remove_rdtype_from_ldap(dns_name_t *owner, dns_name_t *zone,
 isc_result_t
 remove_entry_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst) ATTR_NONNULLS;
 
+isc_result_t
+write_version_to_ldap(ldap_instance_t *ldap_inst, dns_name_t *zone,
+		      dns_db_t *rbtdb, dns_dbversion_t *oldver,
+		      dns_dbversion_t *newver, dns_name_t **owners,
+		      unsigned int count) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 ldap_mod_create(isc_mem_t *mctx, LDAPMod **changep);
 
@@ -87,10 +93,16 @@ isc_result_t activate_zones(isc_task_t *task, ldap_instance_t *inst) ATTR_NONNUL
 
 isc_task_t * ldap_instance_gettask(ldap_instance_t *ldap_inst);
 
+void ldap_instance_attach(ldap_instance_t *source, ldap_instance_t **targetp) ATTR_NONNULLS;
+
+void ldap_instance_detach(ldap_instance_t **ldap_instp) ATTR_NONNULLS;
+
 isc_boolean_t ldap_instance_isexiting(ldap_instance_t *ldap_inst) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 void ldap_instance_taint(ldap_instance_t *ldap_inst) ATTR_NONNULLS;
 
+isc_boolean_t ldap_instance_istained(ldap_instance_t *ldap_inst) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 unsigned int
 ldap_instance_untaint_start(ldap_instance_t *ldap_inst);
 
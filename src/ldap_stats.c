@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#include <isc/mem.h>
+#include <isc/stats.h>
+#include <isc/util.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ldap_stats.h"
+#include "log.h"
+
+/**
+ * Runtime statistics of LDAP instance.
+ *
+ * Counters and histogram buckets are kept in one isc_stats_t so updates
+ * from parallel tasks are lock-free. Each histogram has buckets with
+ * decimal upper bounds from 100 microseconds to one second and one bucket
+ * for everything slower.
+ */
+
+#define LDAP_STATS_BUCKETS	6
+
+static const char * const counter_names[ldap_statscounter_max] = {
+	"entries added",
+	"entries modified",
+	"entries deleted",
+	"entries present",
+	"LDAP modifications",
+	"LDAP modification failures",
+	"connection wait timeouts"
+};
+
+static const char * const hist_names[ldap_statshist_max] = {
+	"update_record",
+	"update_zone",
+	"LDAP modify RTT",
+	"connection wait"
+};
+
+static const char * const bucket_names[LDAP_STATS_BUCKETS] = {
+	"<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s"
+};
+
+#define LDAP_STATS_NCOUNTERS \
+	(ldap_statscounter_max + ldap_statshist_max * LDAP_STATS_BUCKETS)
+
+struct ldap_stats {
+	isc_mem_t	*mctx;
+	isc_stats_t	*counters;
+};
+
+isc_result_t
+ldap_stats_create(isc_mem_t *mctx, ldap_stats_t **statsp) {
+	isc_result_t result;
+	ldap_stats_t *stats = NULL;
+
+	REQUIRE(statsp != NULL && *statsp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, stats);
+	ZERO_PTR(stats);
+	isc_mem_attach(mctx, &stats->mctx);
+	CHECK(isc_stats_create(mctx, &stats->counters,
+			       LDAP_STATS_NCOUNTERS));
+
+	*statsp = stats;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (stats != NULL)
+		MEM_PUT_AND_DETACH(stats);
+	return result;
+}
+
+void
+ldap_stats_destroy(ldap_stats_t **statsp) {
+	ldap_stats_t *stats;
+
+	REQUIRE(statsp != NULL);
+
+	stats = *statsp;
+	if (stats == NULL)
+		return;
+
+	isc_stats_detach(&stats->counters);
+	MEM_PUT_AND_DETACH(stats);
+	*statsp = NULL;
+}
+
+void
+ldap_stats_increment(ldap_stats_t *stats, ldap_statscounter_t counter) {
+	REQUIRE(counter < ldap_statscounter_max);
+
+	isc_stats_increment(stats->counters, counter);
+}
+
+/**
+ * Add one observation of given duration to the histogram.
+ */
+void
+ldap_stats_observe(ldap_stats_t *stats, ldap_statshist_t hist,
+		   isc_uint64_t usec) {
+	isc_uint64_t limit = 100;
+	unsigned int bucket = 0;
+
+	REQUIRE(hist < ldap_statshist_max);
+
+	while (bucket < LDAP_STATS_BUCKETS - 1 && usec >= limit) {
+		limit *= 10;
+		bucket++;
+	}
+	isc_stats_increment(stats->counters, ldap_statscounter_max
+			    + hist * LDAP_STATS_BUCKETS + bucket);
+}
+
+void
+ldap_stats_observe_since(ldap_stats_t *stats, ldap_statshist_t hist,
+			 const isc_time_t *start) {
+	isc_time_t now;
+
+	if (isc_time_now(&now) != ISC_R_SUCCESS)
+		return;
+	ldap_stats_observe(stats, hist, isc_time_microdiff(&now, start));
+}
+
+static void
+ldap_stats_collect(isc_statscounter_t counter, isc_uint64_t value,
+		   void *arg) {
+	isc_uint64_t *values = arg;
+
+	values[counter] = value;
+}
+
+/**
+ * Write all counters and histograms to the log.
+ */
+void
+ldap_stats_log(ldap_stats_t *stats, const char *db_name) {
+	isc_uint64_t values[LDAP_STATS_NCOUNTERS];
+	isc_uint64_t *buckets;
+	char line[256];
+	size_t len;
+	unsigned int i;
+	unsigned int j;
+
+	memset(values, 0, sizeof(values));
+	isc_stats_dump(stats->counters, ldap_stats_collect, values,
+		       ISC_STATSDUMP_VERBOSE);
+
+	for (i = 0; i < ldap_statscounter_max; i++)
+		log_info("LDAP instance '%s' statistics: %s: %llu",
+			 db_name, counter_names[i],
+			 (unsigned long long)values[i]);
+
+	for (i = 0; i < ldap_statshist_max; i++) {
+		buckets = &values[ldap_statscounter_max
+				  + i * LDAP_STATS_BUCKETS];
+		line[0] = '\0';
+		len = 0;
+		for (j = 0; j < LDAP_STATS_BUCKETS && len < sizeof(line); j++)
+			len += snprintf(line + len, sizeof(line) - len,
+					" %s %llu", bucket_names[j],
+					(unsigned long long)buckets[j]);
+		log_info("LDAP instance '%s' statistics: %s:%s",
+			 db_name, hist_names[i], line);
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_LDAP_STATS_H_
+#define SRC_LDAP_STATS_H_
+
+#include <isc/time.h>
+#include <isc/types.h>
+
+#include "util.h"
+
+typedef struct ldap_stats ldap_stats_t;
+
+/** Monotonic event counters. */
+typedef enum {
+	ldap_statscounter_sync_add = 0,
+	ldap_statscounter_sync_modify,
+	ldap_statscounter_sync_delete,
+	ldap_statscounter_sync_present,
+	ldap_statscounter_modify_ok,
+	ldap_statscounter_modify_fail,
+	ldap_statscounter_conn_timeout,
+	ldap_statscounter_max
+} ldap_statscounter_t;
+
+/** Latency histograms. */
+typedef enum {
+	ldap_statshist_update_record = 0,
+	ldap_statshist_update_zone,
+	ldap_statshist_modify_rtt,
+	ldap_statshist_conn_wait,
+	ldap_statshist_max
+} ldap_statshist_t;
+
+isc_result_t
+ldap_stats_create(isc_mem_t *mctx, ldap_stats_t **statsp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_stats_destroy(ldap_stats_t **statsp) ATTR_NONNULLS;
+
+void
+ldap_stats_increment(ldap_stats_t *stats,
+		     ldap_statscounter_t counter) ATTR_NONNULLS;
+
+void
+ldap_stats_observe(ldap_stats_t *stats, ldap_statshist_t hist,
+		   isc_uint64_t usec) ATTR_NONNULLS;
+
+void
+ldap_stats_observe_since(ldap_stats_t *stats, ldap_statshist_t hist,
+			 const isc_time_t *start) ATTR_NONNULLS;
+
+void
+ldap_stats_log(ldap_stats_t *stats, const char *db_name) ATTR_NONNULLS;
+
+#endif /* SRC_LDAP_STATS_H_ */
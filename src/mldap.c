@@ -6,56 +6,512 @@
  */
 
 #include <ldap.h>
+#include <limits.h>
 #include <stddef.h>
-#include <uuid/uuid.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <isc/boolean.h>
-#include <isc/net.h>
+#include <isc/condition.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/refcount.h>
 #include <isc/result.h>
-#include <isc/util.h>
+#include <isc/rwlock.h>
 #include <isc/serial.h>
+#include <isc/stdio.h>
+#include <isc/util.h>
 
-#include <dns/db.h>
-#include <dns/dbiterator.h>
-#include <dns/enumclass.h>
 #include <dns/name.h>
+#include <dns/result.h>
 #include <dns/types.h>
-#include <dns/update.h>
 
 #include "ldap_entry.h"
-#include "metadb.h"
 #include "mldap.h"
 #include "util.h"
 
-/* name "ldap.uuid." */
-static unsigned char uuid_rootname_ndata[]
-	= { 4, 'u', 'u', 'i', 'd', 4, 'l', 'd', 'a', 'p', 0 };
-static unsigned char uuid_rootname_offsets[] = { 0, 5, 10 };
-static dns_name_t uuid_rootname =
-{
-	DNS_NAME_MAGIC,
-	uuid_rootname_ndata,
-	sizeof(uuid_rootname_ndata),
-	sizeof(uuid_rootname_offsets),
-	DNS_NAMEATTR_READONLY | DNS_NAMEATTR_ABSOLUTE,
-	uuid_rootname_offsets,
-	NULL,
-	{ (void *)-1, (void *)-1 },
-	{ NULL, NULL }
-};
+/**
+ * MetaLDAP is an in-memory index of LDAP entries keyed by raw entryUUID.
+ *
+ * Records are stored in a dense array so record indices are stable
+ * and every record occupies the same small amount of memory.
+ * Lookups go through an open-addressing hash table with linear probing.
+ * Each slot holds only the full UUID hash and the record index so probing
+ * touches a single cache line in the common case and the table can be
+ * resized without touching the records.
+ *
+ * DNS names associated with an entry are stored in one blob in uncompressed
+ * wire format: the FQDN is followed by the zone name unless the zone name
+ * is a suffix of the FQDN, which is the usual case.
+ *
+ * Modifications are done inside a version, only one version can be open
+ * at any time. Changes are applied to the index immediately and an undo log
+ * records previous state of each modified record, so the version can be
+ * rolled back as a whole or up to a savepoint. Names and records released
+ * by a version are freed only when the version is committed.
+ *
+ * Records in use are linked into one of two lists according to their
+ * generation number: records from the current generation and records from
+ * all older generations. Generation bump moves all records to the second
+ * list so entries which were not seen since the last bump can be found
+ * without scanning the whole index.
+ */
+
+#define MLDAP_UUID_LEN		16
+
+/* Record is in use. */
+#define MLDAP_REC_USED		0x01
+/* Record has FQDN and zone name. */
+#define MLDAP_REC_NAMES		0x02
+/* Zone name is a suffix of the FQDN and is not stored separately. */
+#define MLDAP_REC_ZONE_SUFFIX	0x04
+#define MLDAP_REC_ALLFLAGS	(MLDAP_REC_USED | MLDAP_REC_NAMES \
+				 | MLDAP_REC_ZONE_SUFFIX)
+
+typedef struct mldap_rec {
+	unsigned char		uuid[MLDAP_UUID_LEN];
+	/* Generation number, link to next free record for unused records. */
+	isc_uint32_t		generation;
+	ldap_entryclass_t	class;
+	unsigned char		flags;
+	unsigned char		fqdn_len;
+	unsigned char		zone_len;
+	/* Members above this line are stored in snapshot files. */
+	unsigned char		*names;
+	/* Links in generation list, record index + 1, 0 = none. */
+	isc_uint32_t		prev;
+	isc_uint32_t		next;
+} mldap_rec_t;
+
+#define MLDAP_REC_DISKSIZE	offsetof(mldap_rec_t, names)
+
+typedef struct mldap_list {
+	/* Record index + 1, 0 = empty list. */
+	isc_uint32_t		head;
+	isc_uint32_t		tail;
+	unsigned int		count;
+} mldap_list_t;
+
+typedef struct mldap_slot {
+	isc_uint32_t		hash;
+	/* Record index + 1, 0 = empty slot. */
+	isc_uint32_t		rec;
+} mldap_slot_t;
+
+/**
+ * Undo log entry: state of the record before modification.
+ */
+typedef struct mldap_undo {
+	unsigned int		rec;
+	/* Names in the previous state are not referenced anymore. */
+	isc_boolean_t		retired;
+	/* Modification removed the record from the index. */
+	isc_boolean_t		deleted;
+	mldap_rec_t		before;
+} mldap_undo_t;
 
 struct mldapdb {
-	isc_mem_t	*mctx;
-	metadb_t	*mdb;
-	isc_refcount_t	generation;
+	isc_mem_t		*mctx;
+	isc_refcount_t		generation;
+
+	/**
+	 * Guard for slots and records. Readers copy data out while holding
+	 * the read lock, modifications and resizing need the write lock.
+	 */
+	isc_rwlock_t		rwlock;
+	mldap_slot_t		*slots;
+	/* Power of two. */
+	unsigned int		slots_size;
+	mldap_rec_t		*recs;
+	unsigned int		recs_size;
+	/* Records [0, recs_used) were handed out at least once. */
+	unsigned int		recs_used;
+	/* First free record + 1, 0 = no free record. */
+	unsigned int		free_head;
+	/* Number of records in the index. */
+	unsigned int		count;
+	/* Records from the current generation. */
+	mldap_list_t		fresh;
+	/* Records from older generations, i.e. candidates for removal. */
+	mldap_list_t		stale;
+
+	/**
+	 * Only one version can be open for writing at any time.
+	 * See functions newversion and closeversion. Version can be closed
+	 * by a different thread than the one which opened it.
+	 */
+	isc_mutex_t		version_lock;
+	isc_condition_t		version_cond;
+	isc_boolean_t		version_open;
+	mldap_undo_t		*undo;
+	unsigned int		undo_size;
+	unsigned int		undo_count;
 };
 
+/**
+ * Handle for metaLDAP entry. Nodes opened for reading hold a private copy
+ * of the record so they are not affected by subsequent modifications.
+ * Nodes opened for writing refer to the record in the index and can be used
+ * only inside the version which opened them.
+ */
+struct mldap_node {
+	mldapdb_t		*mldap;
+	size_t			size;
+	isc_boolean_t		writable;
+	/* Index of record, valid only for nodes opened for writing. */
+	unsigned int		idx;
+	/* Copy of record, valid only for nodes opened for reading. */
+	mldap_rec_t		rec;
+};
+
+/**
+ * Dead entry found by mldap_iter_deadnodes_start().
+ */
+typedef struct mldap_dead {
+	unsigned char		uuid[MLDAP_UUID_LEN];
+	/* Zone name in wire format, valid only during sorting. */
+	const unsigned char	*zone;
+	unsigned char		zone_len;
+	/* Entry is a zone object, i.e. it has to be removed after records. */
+	unsigned char		zone_obj;
+} mldap_dead_t;
+
+struct mldap_iter {
+	mldap_dead_t		*dead;
+	unsigned int		count;
+	/* Next dead entry to return. */
+	unsigned int		next;
+	/* Generation number when the iteration started. */
+	isc_uint32_t		generation;
+};
+
+#define MLDAP_SLOTS_MIN		64
+#define MLDAP_RECS_MIN		32
+
+#define MLDAP_SNAPSHOT_MAGIC	0x4d4c4431	/* "MLD1" */
+
+typedef struct mldap_snapshot_hdr {
+	isc_uint32_t		magic;
+	isc_uint32_t		generation;
+	isc_uint32_t		count;
+	isc_uint32_t		cookie_len;
+} mldap_snapshot_hdr_t;
+
+static isc_uint32_t
+mldap_hash(const unsigned char *uuid) {
+	isc_uint64_t a, b;
+
+	/* time-based UUIDs have most entropy in the first octets
+	 * so both halves are mixed together */
+	memcpy(&a, uuid, sizeof(a));
+	memcpy(&b, uuid + sizeof(a), sizeof(b));
+	a ^= b * 0x9E3779B97F4A7C15ULL;
+	a ^= a >> 29;
+	a *= 0xBF58476D1CE4E5B9ULL;
+	a ^= a >> 32;
+
+	return (isc_uint32_t)a;
+}
+
+/**
+ * Find slot with given UUID or empty slot where the UUID belongs.
+ *
+ * @pre rwlock is locked or version is open by the caller.
+ */
+static unsigned int ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_slot_find(mldapdb_t *mldap, const unsigned char *uuid,
+		isc_uint32_t hash, isc_boolean_t *foundp) {
+	unsigned int mask = mldap->slots_size - 1;
+	unsigned int pos = hash & mask;
+	mldap_slot_t *slot;
+
+	while (ISC_TRUE) {
+		slot = &mldap->slots[pos];
+		if (slot->rec == 0) {
+			*foundp = ISC_FALSE;
+			return pos;
+		}
+		if (slot->hash == hash
+		    && memcmp(mldap->recs[slot->rec - 1].uuid, uuid,
+			      MLDAP_UUID_LEN) == 0) {
+			*foundp = ISC_TRUE;
+			return pos;
+		}
+		pos = (pos + 1) & mask;
+	}
+}
+
+/**
+ * Remove slot and shift following slots back so no tombstones are needed.
+ *
+ * @pre rwlock is write-locked.
+ */
+static void ATTR_NONNULLS
+mldap_slot_remove(mldapdb_t *mldap, unsigned int pos) {
+	unsigned int mask = mldap->slots_size - 1;
+	unsigned int next;
+	unsigned int home;
+
+	while (ISC_TRUE) {
+		mldap->slots[pos].rec = 0;
+		next = pos;
+		do {
+			next = (next + 1) & mask;
+			if (mldap->slots[next].rec == 0)
+				return;
+			home = mldap->slots[next].hash & mask;
+			/* slot can be moved only if pos is between its home
+			 * position and its current position */
+		} while (((next - home) & mask) < ((next - pos) & mask));
+		mldap->slots[pos] = mldap->slots[next];
+		pos = next;
+	}
+}
+
+/**
+ * @pre rwlock is write-locked.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_slots_resize(mldapdb_t *mldap, unsigned int size) {
+	isc_result_t result;
+	mldap_slot_t *slots = NULL;
+	unsigned int mask = size - 1;
+	unsigned int i;
+	unsigned int pos;
+
+	REQUIRE((size & mask) == 0);
+	REQUIRE(size > mldap->count);
+
+	CHECKED_MEM_GET(mldap->mctx, slots, size * sizeof(*slots));
+	memset(slots, 0, size * sizeof(*slots));
+	for (i = 0; i < mldap->slots_size; i++) {
+		if (mldap->slots[i].rec == 0)
+			continue;
+		pos = mldap->slots[i].hash & mask;
+		while (slots[pos].rec != 0)
+			pos = (pos + 1) & mask;
+		slots[pos] = mldap->slots[i];
+	}
+	SAFE_MEM_PUT(mldap->mctx, mldap->slots,
+		     mldap->slots_size * sizeof(*slots));
+	mldap->slots = slots;
+	mldap->slots_size = size;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Make sure that count records can be stored without further allocation.
+ *
+ * @pre rwlock is write-locked.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_reserve(mldapdb_t *mldap, unsigned int count) {
+	isc_result_t result = ISC_R_SUCCESS;
+	mldap_rec_t *recs = NULL;
+	unsigned int size;
+
+	if (count > (UINT_MAX / 2) / sizeof(mldap_slot_t))
+		CLEANUP_WITH(ISC_R_NOSPACE);
+
+	/* load factor is kept at or below 1/2 */
+	for (size = mldap->slots_size; size / 2 < count; size *= 2)
+		if (size > UINT_MAX / 2)
+			CLEANUP_WITH(ISC_R_NOSPACE);
+	if (size != mldap->slots_size)
+		CHECK(mldap_slots_resize(mldap, size));
+
+	if (count > mldap->recs_size) {
+		CHECKED_MEM_GET(mldap->mctx, recs, count * sizeof(*recs));
+		memcpy(recs, mldap->recs, mldap->recs_size * sizeof(*recs));
+		memset(recs + mldap->recs_size, 0,
+		       (count - mldap->recs_size) * sizeof(*recs));
+		SAFE_MEM_PUT(mldap->mctx, mldap->recs,
+			     mldap->recs_size * sizeof(*recs));
+		mldap->recs = recs;
+		mldap->recs_size = count;
+	}
+
+cleanup:
+	return result;
+}
+
+/**
+ * Allocate unused record and insert it into the index at position pos
+ * returned by mldap_slot_find().
+ *
+ * @pre rwlock is write-locked.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_rec_insert(mldapdb_t *mldap, const unsigned char *uuid,
+		 isc_uint32_t hash, unsigned int pos, unsigned int *idxp) {
+	isc_result_t result;
+	isc_boolean_t found;
+	unsigned int idx;
+	mldap_rec_t *rec;
+
+	if ((mldap->count + 1) > mldap->slots_size / 2) {
+		CHECK(mldap_reserve(mldap, mldap->count + 1));
+		pos = mldap_slot_find(mldap, uuid, hash, &found);
+		INSIST(found == ISC_FALSE);
+	}
+	if (mldap->free_head == 0 && mldap->recs_used == mldap->recs_size)
+		CHECK(mldap_reserve(mldap, ISC_MAX(mldap->recs_size * 2,
+						   MLDAP_RECS_MIN)));
+
+	if (mldap->free_head != 0) {
+		idx = mldap->free_head - 1;
+		mldap->free_head = mldap->recs[idx].generation;
+	} else {
+		idx = mldap->recs_used++;
+	}
+	rec = &mldap->recs[idx];
+	memset(rec, 0, sizeof(*rec));
+	memcpy(rec->uuid, uuid, MLDAP_UUID_LEN);
+	rec->flags = MLDAP_REC_USED;
+
+	mldap->slots[pos].hash = hash;
+	mldap->slots[pos].rec = idx + 1;
+	mldap->count++;
+	*idxp = idx;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Return unused record to the free list.
+ *
+ * @pre rwlock is write-locked.
+ */
+static void ATTR_NONNULLS
+mldap_rec_free(mldapdb_t *mldap, unsigned int idx) {
+	mldap_rec_t *rec = &mldap->recs[idx];
+
+	INSIST((rec->flags & MLDAP_REC_USED) == 0);
+	rec->names = NULL;
+	rec->generation = mldap->free_head;
+	mldap->free_head = idx + 1;
+}
+
+/**
+ * @returns Generation list which contains the record.
+ *
+ * @pre rwlock is locked.
+ */
+static mldap_list_t * ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_rec_list(mldapdb_t *mldap, const mldap_rec_t *rec) {
+	if (rec->generation == mldap_cur_generation_get(mldap))
+		return &mldap->fresh;
+	return &mldap->stale;
+}
+
+/**
+ * Append record to the list corresponding to its generation number.
+ *
+ * @pre rwlock is write-locked.
+ */
+static void ATTR_NONNULLS
+mldap_rec_link(mldapdb_t *mldap, unsigned int idx) {
+	mldap_rec_t *rec = &mldap->recs[idx];
+	mldap_list_t *list = mldap_rec_list(mldap, rec);
+
+	INSIST((rec->flags & MLDAP_REC_USED) != 0);
+
+	rec->prev = list->tail;
+	rec->next = 0;
+	if (list->tail != 0)
+		mldap->recs[list->tail - 1].next = idx + 1;
+	else
+		list->head = idx + 1;
+	list->tail = idx + 1;
+	list->count++;
+}
+
+/**
+ * Remove record from its generation list.
+ *
+ * @pre rwlock is write-locked.
+ */
+static void ATTR_NONNULLS
+mldap_rec_unlink(mldapdb_t *mldap, unsigned int idx) {
+	mldap_rec_t *rec = &mldap->recs[idx];
+	mldap_list_t *list = mldap_rec_list(mldap, rec);
+
+	INSIST((rec->flags & MLDAP_REC_USED) != 0);
+	INSIST(list->count > 0);
+
+	if (rec->prev != 0)
+		mldap->recs[rec->prev - 1].next = rec->next;
+	else
+		list->head = rec->next;
+	if (rec->next != 0)
+		mldap->recs[rec->next - 1].prev = rec->prev;
+	else
+		list->tail = rec->prev;
+	rec->prev = 0;
+	rec->next = 0;
+	list->count--;
+}
+
+/**
+ * Mark record as alive in the current generation.
+ *
+ * @pre rwlock is write-locked.
+ */
+static void ATTR_NONNULLS
+mldap_rec_refresh(mldapdb_t *mldap, unsigned int idx) {
+	mldap_rec_t *rec = &mldap->recs[idx];
+
+	mldap_rec_unlink(mldap, idx);
+	rec->generation = mldap_cur_generation_get(mldap);
+	mldap_rec_link(mldap, idx);
+}
+
+/**
+ * Record state of a record before modification.
+ *
+ * @pre Version is open and rwlock is write-locked.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_undo_push(mldapdb_t *mldap, unsigned int idx, isc_boolean_t retired,
+		isc_boolean_t deleted) {
+	isc_result_t result;
+	mldap_undo_t *undo = NULL;
+	unsigned int size;
+	mldap_undo_t *entry;
+
+	INSIST(mldap->version_open == ISC_TRUE);
+
+	if (mldap->undo_count == mldap->undo_size) {
+		size = ISC_MAX(mldap->undo_size * 2, 8);
+		CHECKED_MEM_GET(mldap->mctx, undo, size * sizeof(*undo));
+		memcpy(undo, mldap->undo, mldap->undo_count * sizeof(*undo));
+		SAFE_MEM_PUT(mldap->mctx, mldap->undo,
+			     mldap->undo_size * sizeof(*undo));
+		mldap->undo = undo;
+		mldap->undo_size = size;
+	}
+	entry = &mldap->undo[mldap->undo_count++];
+	entry->rec = idx;
+	entry->retired = retired;
+	entry->deleted = deleted;
+	entry->before = mldap->recs[idx];
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
 
 isc_result_t
 mldap_new(isc_mem_t *mctx, mldapdb_t **mldapp) {
 	isc_result_t result;
 	mldapdb_t *mldap = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	isc_boolean_t cond_ready = ISC_FALSE;
+	isc_boolean_t rwlock_ready = ISC_FALSE;
 
 	REQUIRE(mldapp != NULL && *mldapp == NULL);
 
@@ -64,20 +520,42 @@ mldap_new(isc_mem_t *mctx, mldapdb_t **mldapp) {
 	isc_mem_attach(mctx, &mldap->mctx);
 
 	CHECK(isc_refcount_init(&mldap->generation, 0));
-	CHECK(metadb_new(mctx, &mldap->mdb));
+	CHECK(isc_mutex_init(&mldap->version_lock));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_condition_init(&mldap->version_cond));
+	cond_ready = ISC_TRUE;
+	CHECK(isc_rwlock_init(&mldap->rwlock, 0, 0));
+	rwlock_ready = ISC_TRUE;
+	CHECKED_MEM_GET(mctx, mldap->slots,
+			MLDAP_SLOTS_MIN * sizeof(*mldap->slots));
+	memset(mldap->slots, 0, MLDAP_SLOTS_MIN * sizeof(*mldap->slots));
+	mldap->slots_size = MLDAP_SLOTS_MIN;
 
 	*mldapp = mldap;
-	return result;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	metadb_destroy(&mldap->mdb);
-	MEM_PUT_AND_DETACH(mldap);
+	if (mldap != NULL) {
+		if (rwlock_ready == ISC_TRUE)
+			isc_rwlock_destroy(&mldap->rwlock);
+		if (cond_ready == ISC_TRUE)
+			RUNTIME_CHECK(isc_condition_destroy(&mldap->version_cond)
+				      == ISC_R_SUCCESS);
+		if (lock_ready == ISC_TRUE)
+			DESTROYLOCK(&mldap->version_lock);
+		MEM_PUT_AND_DETACH(mldap);
+	}
 	return result;
 }
 
+/**
+ * Destroy metaLDAP.
+ * All write-able versions have to be closed before calling destroy().
+ */
 void
 mldap_destroy(mldapdb_t **mldapp) {
 	mldapdb_t *mldap;
+	unsigned int i;
 
 	REQUIRE(mldapp != NULL);
 
@@ -85,29 +563,178 @@ mldap_destroy(mldapdb_t **mldapp) {
 	if (mldap == NULL)
 		return;
 
-	metadb_destroy(&mldap->mdb);
+	INSIST(mldap->version_open == ISC_FALSE);
+
+	for (i = 0; i < mldap->recs_used; i++) {
+		if ((mldap->recs[i].flags & MLDAP_REC_USED) != 0
+		    && mldap->recs[i].names != NULL)
+			isc_mem_free(mldap->mctx, mldap->recs[i].names);
+	}
+	SAFE_MEM_PUT(mldap->mctx, mldap->recs,
+		     mldap->recs_size * sizeof(*mldap->recs));
+	SAFE_MEM_PUT(mldap->mctx, mldap->slots,
+		     mldap->slots_size * sizeof(*mldap->slots));
+	SAFE_MEM_PUT(mldap->mctx, mldap->undo,
+		     mldap->undo_size * sizeof(*mldap->undo));
+	isc_rwlock_destroy(&mldap->rwlock);
+	RUNTIME_CHECK(isc_condition_destroy(&mldap->version_cond)
+		      == ISC_R_SUCCESS);
+	DESTROYLOCK(&mldap->version_lock);
 	MEM_PUT_AND_DETACH(mldap);
 
 	*mldapp = NULL;
 }
 
+/**
+ * Open new version for writing. Only one version can be open at any time,
+ * this call blocks until the previous version is closed.
+ */
 isc_result_t
 mldap_newversion(mldapdb_t *mldap) {
-	return metadb_newversion(mldap->mdb);
+	LOCK(&mldap->version_lock);
+	while (mldap->version_open == ISC_TRUE)
+		WAIT(&mldap->version_cond, &mldap->version_lock);
+	INSIST(mldap->undo_count == 0);
+	mldap->version_open = ISC_TRUE;
+	UNLOCK(&mldap->version_lock);
+
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Undo modifications recorded in undo log above given savepoint.
+ *
+ * @pre Version is open and rwlock is write-locked.
+ */
+static void ATTR_NONNULLS
+mldap_undo_rollback(mldapdb_t *mldap, unsigned int savepoint) {
+	mldap_undo_t *undo;
+	mldap_rec_t *rec;
+	isc_uint32_t hash;
+	isc_boolean_t found;
+	unsigned int pos;
+
+	INSIST(savepoint <= mldap->undo_count);
+
+	for (; mldap->undo_count > savepoint; mldap->undo_count--) {
+		undo = &mldap->undo[mldap->undo_count - 1];
+		rec = &mldap->recs[undo->rec];
+		/* names installed by the modification */
+		if (rec->names != undo->before.names && rec->names != NULL)
+			isc_mem_free(mldap->mctx, rec->names);
+		if ((rec->flags & MLDAP_REC_USED) !=
+		    (undo->before.flags & MLDAP_REC_USED)) {
+			hash = mldap_hash(undo->before.uuid);
+			pos = mldap_slot_find(mldap, undo->before.uuid, hash,
+					      &found);
+			if (undo->deleted == ISC_TRUE) {
+				INSIST(found == ISC_FALSE);
+				mldap->slots[pos].hash = hash;
+				mldap->slots[pos].rec = undo->rec + 1;
+				mldap->count++;
+			} else {
+				INSIST(found == ISC_TRUE);
+				mldap_slot_remove(mldap, pos);
+				mldap->count--;
+			}
+		}
+		if ((rec->flags & MLDAP_REC_USED) != 0)
+			mldap_rec_unlink(mldap, undo->rec);
+		*rec = undo->before;
+		rec->prev = 0;
+		rec->next = 0;
+		if ((rec->flags & MLDAP_REC_USED) != 0)
+			mldap_rec_link(mldap, undo->rec);
+		else
+			mldap_rec_free(mldap, undo->rec);
+	}
 }
 
+/**
+ * Commit or roll back all changes done in the current version.
+ */
 void
 mldap_closeversion(mldapdb_t *mldap, isc_boolean_t commit) {
-	return metadb_closeversion(mldap->mdb, commit);
+	mldap_undo_t *undo;
+	unsigned int i;
+
+	INSIST(mldap->version_open == ISC_TRUE);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	if (commit == ISC_TRUE) {
+		for (i = 0; i < mldap->undo_count; i++) {
+			undo = &mldap->undo[i];
+			if (undo->deleted == ISC_TRUE)
+				mldap_rec_free(mldap, undo->rec);
+		}
+	} else {
+		mldap_undo_rollback(mldap, 0);
+	}
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
+
+	/* readers cannot see retired names anymore */
+	if (commit == ISC_TRUE) {
+		for (i = 0; i < mldap->undo_count; i++) {
+			undo = &mldap->undo[i];
+			if (undo->retired == ISC_TRUE)
+				isc_mem_free(mldap->mctx, undo->before.names);
+		}
+	}
+	mldap->undo_count = 0;
+
+	LOCK(&mldap->version_lock);
+	mldap->version_open = ISC_FALSE;
+	SIGNAL(&mldap->version_cond);
+	UNLOCK(&mldap->version_lock);
+}
+
+/**
+ * @returns Savepoint which allows to roll back changes done after this call
+ *          without closing the current version.
+ */
+unsigned int
+mldap_savepoint(mldapdb_t *mldap) {
+	INSIST(mldap->version_open == ISC_TRUE);
+
+	return mldap->undo_count;
+}
+
+/**
+ * Roll back changes done in the current version after the savepoint
+ * was taken. The version stays open.
+ */
+void
+mldap_rollback(mldapdb_t *mldap, unsigned int savepoint) {
+	INSIST(mldap->version_open == ISC_TRUE);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	mldap_undo_rollback(mldap, savepoint);
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
 }
 
 /**
- * Atomically increment MetaLDAP generation number.
+ * Atomically increment MetaLDAP generation number. All records become
+ * members of the old generation.
  */
 void mldap_cur_generation_bump(mldapdb_t *mldap) {
 	REQUIRE(mldap != NULL);
 
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
 	isc_refcount_increment0(&mldap->generation, NULL);
+	if (mldap->fresh.head != 0) {
+		if (mldap->stale.tail != 0) {
+			mldap->recs[mldap->stale.tail - 1].next =
+				mldap->fresh.head;
+			mldap->recs[mldap->fresh.head - 1].prev =
+				mldap->stale.tail;
+		} else {
+			mldap->stale.head = mldap->fresh.head;
+		}
+		mldap->stale.tail = mldap->fresh.tail;
+		mldap->stale.count += mldap->fresh.count;
+		memset(&mldap->fresh, 0, sizeof(mldap->fresh));
+	}
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
 }
 
 /*
@@ -141,280 +768,624 @@ mldap_cur_generation_get(mldapdb_t *mldap) {
 }
 
 /**
- * Convert UUID to "01234567-89ab-cdef-0123-456789abcdef.uuid.ldap." DNS name.
- *
- * @param[in]  beruuid
- * @param[out] nameuuid
+ * @returns Number of entries in MetaLDAP.
  */
-void
-ldap_uuid_to_mname(struct berval *beruuid, dns_name_t *nameuuid) {
-	/* UUID string representation according to RFC 4122 section 3 */
-	char label_buf[sizeof("01234567-89ab-cdef-0123-456789abcdef") + 1];
-	/* uncompressed label format, length 36 octets; RFC 1034 section 3.1 */
-	label_buf[0] = 36;
-
-	isc_region_t label_reg;
-	label_reg.base = (unsigned char *)label_buf;
-	label_reg.length = sizeof(label_buf) - 1; /* omit final \0 */
+unsigned int
+mldap_count(mldapdb_t *mldap) {
+	unsigned int count;
 
-	dns_name_t relative_name;
-	DNS_NAME_INIT(&relative_name, NULL);
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_read);
+	count = mldap->count;
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_read);
 
-	/* RFC 4530 section 2.1 format = 16 octets is required */
-	REQUIRE(beruuid != NULL && beruuid->bv_len == 16);
+	return count;
+}
 
-	/* fill-in string representation into label buffer */
-	uuid_unparse((*(const uuid_t *) beruuid->bv_val), label_buf + 1);
-	dns_name_fromregion(&relative_name, &label_reg);
+/**
+ * @returns Length of names blob of the record.
+ */
+static unsigned int ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_rec_nameslen(const mldap_rec_t *rec) {
+	if ((rec->flags & MLDAP_REC_NAMES) == 0)
+		return 0;
+	if ((rec->flags & MLDAP_REC_ZONE_SUFFIX) != 0)
+		return rec->fqdn_len;
+	return rec->fqdn_len + rec->zone_len;
+}
 
-	INSIST(dns_name_concatenate(&relative_name, &uuid_rootname,
-				    nameuuid, NULL) == ISC_R_SUCCESS);
+/**
+ * @returns Record for the node. Records of nodes opened for writing
+ *          can be accessed without lock because only the version owner
+ *          can modify them.
+ */
+static const mldap_rec_t * ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_node_rec(const mldap_node_t *node) {
+	if (node->writable == ISC_TRUE)
+		return &node->mldap->recs[node->idx];
+	return &node->rec;
+}
 
-	return;
+/**
+ * Check that data are a single name in uncompressed wire format.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_wirename_valid(const unsigned char *data, unsigned int length) {
+	unsigned int pos = 0;
+
+	while (pos < length) {
+		if (data[pos] == 0)
+			return ISC_TF(pos + 1 == length);
+		if (data[pos] > 63)
+			return ISC_FALSE;
+		pos += data[pos] + 1;
+	}
+	return ISC_FALSE;
 }
 
-STATIC_ASSERT((sizeof(ldap_entryclass_t) <= sizeof(struct in6_addr)), \
-		"ldap_entryclass_t is too big for AAAA rdata type");
 /**
- * ldap_entryclass_t is stored inside AAAA record type
+ * Close node returned by mldap_entry_read() or mldap_entry_create().
  */
-static isc_result_t
-mldap_class_store(ldap_entryclass_t class, metadb_node_t *node) {
-	unsigned char buff[sizeof(struct in6_addr)];
-	isc_region_t region = { .base = buff, .length = sizeof(buff) };
-	dns_rdata_t rdata;
+void
+mldap_node_close(mldap_node_t **nodep) {
+	mldap_node_t *node;
 
-	dns_rdata_init(&rdata);
-	memset(buff, 0, sizeof(buff));
+	REQUIRE(nodep != NULL);
 
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally.  2) Class is unsigned char. */
-	memcpy(buff, &class, sizeof(class));
-	dns_rdata_fromregion(&rdata, dns_rdataclass_in, dns_rdatatype_aaaa,
-			     &region);
+	node = *nodep;
+	if (node == NULL)
+		return;
 
-	return metadb_rdata_store(&rdata, node);
+	isc_mem_put(node->mldap->mctx, node, node->size);
+	*nodep = NULL;
 }
 
 isc_result_t
-mldap_class_get(metadb_node_t *node, ldap_entryclass_t *classp) {
-	isc_result_t result;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
-	isc_region_t region;
+mldap_class_get(mldap_node_t *node, ldap_entryclass_t *classp) {
+	const mldap_rec_t *rec;
 
 	REQUIRE(classp != NULL);
 
-	dns_rdata_init(&rdata);
-	dns_rdataset_init(&rdataset);
+	rec = mldap_node_rec(node);
+	if ((rec->flags & MLDAP_REC_USED) == 0)
+		return ISC_R_NOTFOUND;
 
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_aaaa, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	dns_rdata_toregion(&rdata, &region);
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally.  2) Class is unsigned char. */
-	memcpy(classp, region.base, sizeof(*classp));
-
-cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
-	return result;
+	*classp = rec->class;
+	return ISC_R_SUCCESS;
 }
 
 /**
- * mldapdb_t->generation is stored inside A record type
+ * Store FQDN and zone name into metaLDAP entry opened for writing.
  */
-static isc_result_t
-mldap_generation_store(mldapdb_t *mldap, metadb_node_t *node) {
+isc_result_t
+mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, mldap_node_t *node) {
 	isc_result_t result;
-	unsigned char buff[sizeof(mldap->generation)];
-	isc_region_t region = { .base = buff, .length = sizeof(buff) };
-	dns_rdata_t rdata;
-	isc_uint32_t generation;
-
-	STATIC_ASSERT(sizeof(mldap_cur_generation_get(mldap)) == sizeof(struct in_addr), \
-		      "mldapdb_t->generation value is too big for A rdata type");
-	STATIC_ASSERT(sizeof(mldap_cur_generation_get(mldap)) == sizeof(generation), \
-		      "mldapdb_t->generation and local generation sizes do not match");
-
-	dns_rdata_init(&rdata);
+	mldapdb_t *mldap;
+	mldap_rec_t *rec;
+	isc_region_t fqdn_reg;
+	isc_region_t zone_reg;
+	isc_boolean_t suffix;
+	unsigned char *names = NULL;
+	unsigned int length;
 
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally and always compared on this machine. */
-	generation = mldap_cur_generation_get(mldap);
-	memcpy(buff, &generation, sizeof(generation));
-	dns_rdata_fromregion(&rdata, dns_rdataclass_in, dns_rdatatype_a, &region);
-	CHECK(metadb_rdata_store(&rdata, node));
+	REQUIRE(fqdn != NULL);
+	REQUIRE(zone != NULL);
+	REQUIRE(node->writable == ISC_TRUE);
+	REQUIRE(dns_name_isabsolute(fqdn) && dns_name_isabsolute(zone));
+
+	mldap = node->mldap;
+	dns_name_toregion(fqdn, &fqdn_reg);
+	dns_name_toregion(zone, &zone_reg);
+	suffix = ISC_TF(zone_reg.length <= fqdn_reg.length
+			&& memcmp(fqdn_reg.base + fqdn_reg.length
+				  - zone_reg.length,
+				  zone_reg.base, zone_reg.length) == 0);
+	length = fqdn_reg.length + (suffix == ISC_TRUE ? 0 : zone_reg.length);
+	CHECKED_MEM_ALLOCATE(mldap->mctx, names, length);
+	memcpy(names, fqdn_reg.base, fqdn_reg.length);
+	if (suffix == ISC_FALSE)
+		memcpy(names + fqdn_reg.length, zone_reg.base, zone_reg.length);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	rec = &mldap->recs[node->idx];
+	result = mldap_undo_push(mldap, node->idx,
+				 ISC_TF(rec->names != NULL), ISC_FALSE);
+	if (result == ISC_R_SUCCESS) {
+		rec->names = names;
+		rec->fqdn_len = fqdn_reg.length;
+		rec->zone_len = zone_reg.length;
+		rec->flags |= MLDAP_REC_NAMES;
+		if (suffix == ISC_TRUE)
+			rec->flags |= MLDAP_REC_ZONE_SUFFIX;
+		else
+			rec->flags &= ~MLDAP_REC_ZONE_SUFFIX;
+		names = NULL;
+	}
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
 
 cleanup:
+	if (names != NULL)
+		isc_mem_free(mldap->mctx, names);
 	return result;
 }
 
-static isc_result_t
-mldap_generation_get(metadb_node_t *node, isc_uint32_t *generationp) {
+/**
+ * Retrieve FQDN and zone name from metaLDAP entry.
+ * @param[in]  node
+ * @param[out] fqdn
+ * @param[out] zone
+ *
+ * @pre DNS names fqdn and zone have dedicated buffer.
+ */
+isc_result_t
+mldap_dnsname_get(mldap_node_t *node, dns_name_t *fqdn, dns_name_t *zone) {
 	isc_result_t result;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
+	const mldap_rec_t *rec;
 	isc_region_t region;
+	dns_name_t name;
 
-	REQUIRE(generationp != NULL);
-
-	dns_rdata_init(&rdata);
-	dns_rdataset_init(&rdataset);
+	REQUIRE(fqdn != NULL);
+	REQUIRE(zone != NULL);
 
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_a, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	dns_rdata_toregion(&rdata, &region);
-	memcpy(generationp, region.base, sizeof(*generationp));
+	rec = mldap_node_rec(node);
+	if ((rec->flags & MLDAP_REC_NAMES) == 0)
+		return ISC_R_NOTFOUND;
+
+	dns_name_init(&name, NULL);
+	region.base = rec->names;
+	region.length = rec->fqdn_len;
+	dns_name_fromregion(&name, &region);
+	CHECK(dns_name_copy(&name, fqdn, NULL));
+
+	dns_name_init(&name, NULL);
+	if ((rec->flags & MLDAP_REC_ZONE_SUFFIX) != 0)
+		region.base = rec->names + rec->fqdn_len - rec->zone_len;
+	else
+		region.base = rec->names + rec->fqdn_len;
+	region.length = rec->zone_len;
+	dns_name_fromregion(&name, &region);
+	CHECK(dns_name_copy(&name, zone, NULL));
 
 cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
 	return result;
 }
 
 /**
- * FQDN and zone name are stored inside RP record type
+ * Store information from LDAP entry into metaLDAP. Previous content
+ * of the entry with the same UUID is replaced.
+ *
+ * @param[out] nodep Node opened for writing. It can be used only
+ *                   until the current version is closed.
  */
 isc_result_t
-mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, metadb_node_t *node) {
+mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, mldap_node_t **nodep) {
 	isc_result_t result;
-	dns_rdata_rp_t rp;
-	dns_rdata_t rdata;
-	unsigned char wirebuf[2 * DNS_NAME_MAXWIRE];
-	isc_buffer_t rdatabuf;
+	mldap_node_t *node = NULL;
+	const unsigned char *uuid;
+	isc_uint32_t hash;
+	isc_boolean_t found;
+	unsigned int pos;
+	unsigned int idx = 0;
+	mldap_rec_t *rec;
 
-	REQUIRE(fqdn != NULL);
-	REQUIRE(zone != NULL);
-
-	dns_rdata_init(&rdata);
-	DNS_RDATACOMMON_INIT(&rp, dns_rdatatype_rp, dns_rdataclass_in);
-	isc_buffer_init(&rdatabuf, wirebuf, sizeof(wirebuf));
+	REQUIRE(nodep != NULL && *nodep == NULL);
+	REQUIRE(entry->uuid != NULL && entry->uuid->bv_len == MLDAP_UUID_LEN);
+
+	CHECKED_MEM_GET_PTR(mldap->mctx, node);
+	ZERO_PTR(node);
+	node->mldap = mldap;
+	node->size = sizeof(*node);
+	node->writable = ISC_TRUE;
+
+	uuid = (const unsigned char *)entry->uuid->bv_val;
+	hash = mldap_hash(uuid);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	pos = mldap_slot_find(mldap, uuid, hash, &found);
+	if (found == ISC_TRUE) {
+		idx = mldap->slots[pos].rec - 1;
+		rec = &mldap->recs[idx];
+		result = mldap_undo_push(mldap, idx, ISC_TF(rec->names != NULL),
+					 ISC_FALSE);
+		if (result == ISC_R_SUCCESS) {
+			mldap_rec_unlink(mldap, idx);
+			rec->names = NULL;
+			rec->flags = MLDAP_REC_USED;
+		}
+	} else {
+		result = mldap_rec_insert(mldap, uuid, hash, pos, &idx);
+		if (result == ISC_R_SUCCESS) {
+			/* previous state is an unused record */
+			mldap->recs[idx].flags = 0;
+			result = mldap_undo_push(mldap, idx, ISC_FALSE,
+						 ISC_FALSE);
+			mldap->recs[idx].flags = MLDAP_REC_USED;
+			if (result != ISC_R_SUCCESS) {
+				pos = mldap_slot_find(mldap, uuid, hash,
+						      &found);
+				mldap_slot_remove(mldap, pos);
+				mldap->count--;
+				mldap->recs[idx].flags = 0;
+				mldap_rec_free(mldap, idx);
+			}
+		}
+	}
+	if (result == ISC_R_SUCCESS) {
+		rec = &mldap->recs[idx];
+		rec->class = entry->class;
+		rec->generation = mldap_cur_generation_get(mldap);
+		mldap_rec_link(mldap, idx);
+		node->idx = idx;
+	}
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	CHECK(result);
 
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally and always compared on this machine. */
-	rp.mail = *fqdn;
-	rp.text = *zone;
-	CHECK(dns_rdata_fromstruct(&rdata, dns_rdataclass_in, dns_rdatatype_rp,
-				   &rp, &rdatabuf));
-	CHECK(metadb_rdata_store(&rdata, node));
+	*nodep = node;
+	return ISC_R_SUCCESS;
 
 cleanup:
+	SAFE_MEM_PUT_PTR(mldap->mctx, node);
 	return result;
 }
 
 /**
- * Retrieve FQDN and zone name from RP record in metaDB.
- * @param[in]  node
- * @param[out] fqdn
- * @param[out] zone
+ * Open metaLDAP entry for reading. The node holds a copy of the entry
+ * so it is not affected by subsequent modifications.
  *
- * @pre DNS names fqdn and zone have dedicated buffer.
+ * @retval ISC_R_NOTFOUND Entry with given UUID does not exist in metaLDAP.
  */
 isc_result_t
-mldap_dnsname_get(metadb_node_t *node, dns_name_t *fqdn, dns_name_t *zone) {
+mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, mldap_node_t **nodep) {
 	isc_result_t result;
-	dns_rdata_rp_t rp;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
+	mldap_node_t *node = NULL;
+	const mldap_rec_t *rec;
+	isc_boolean_t found;
+	unsigned int pos;
+	unsigned int nameslen;
+	size_t size;
 
-	REQUIRE(fqdn != NULL);
-	REQUIRE(zone != NULL);
+	REQUIRE(nodep != NULL && *nodep == NULL);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_read);
+	pos = mldap_slot_find(mldap, (const unsigned char *)uuid->bv_val,
+			      mldap_hash((const unsigned char *)uuid->bv_val),
+			      &found);
+	if (found == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+
+	rec = &mldap->recs[mldap->slots[pos].rec - 1];
+	nameslen = mldap_rec_nameslen(rec);
+	size = sizeof(*node) + nameslen;
+	CHECKED_MEM_GET(mldap->mctx, node, size);
+	ZERO_PTR(node);
+	node->mldap = mldap;
+	node->size = size;
+	node->writable = ISC_FALSE;
+	node->rec = *rec;
+	if (nameslen > 0) {
+		node->rec.names = (unsigned char *)(node + 1);
+		memcpy(node->rec.names, rec->names, nameslen);
+	} else {
+		node->rec.names = NULL;
+	}
+	*nodep = node;
+	result = ISC_R_SUCCESS;
 
-	dns_rdataset_init(&rdataset);
-	dns_rdata_init(&rdata);
+cleanup:
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_read);
+	return result;
+}
 
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_rp, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	CHECK(dns_rdata_tostruct(&rdata, &rp, NULL));
-	CHECK(dns_name_copy(&rp.mail, fqdn, NULL));
-	CHECK(dns_name_copy(&rp.text, zone, NULL));
+/**
+ * Delete metaLDAP entry.
+ *
+ * @retval ISC_R_NOTFOUND Entry with given UUID does not exist in metaLDAP.
+ */
+isc_result_t
+mldap_entry_delete(mldapdb_t *mldap, struct berval *uuid) {
+	isc_result_t result;
+	isc_boolean_t found;
+	unsigned int pos;
+	unsigned int idx;
+	mldap_rec_t *rec;
+
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	pos = mldap_slot_find(mldap, (const unsigned char *)uuid->bv_val,
+			      mldap_hash((const unsigned char *)uuid->bv_val),
+			      &found);
+	if (found == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+
+	idx = mldap->slots[pos].rec - 1;
+	rec = &mldap->recs[idx];
+	CHECK(mldap_undo_push(mldap, idx, ISC_TF(rec->names != NULL),
+			      ISC_TRUE));
+	mldap_slot_remove(mldap, pos);
+	mldap->count--;
+	mldap_rec_unlink(mldap, idx);
+	/* record is returned to the free list when the version is committed */
+	rec->names = NULL;
+	rec->flags = 0;
 
 cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
 	return result;
 }
 
 /**
- * Store information from LDAP entry into meta-database.
+ * Mark existing metaLDAP entry as alive in current generation.
+ * This is used for entries reported as 'present' by LDAP server
+ * during incremental refresh (RFC 4533 section 3.3.1).
+ *
+ * @retval ISC_R_NOTFOUND Entry with given UUID does not exist in metaLDAP.
  */
 isc_result_t
-mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, metadb_node_t **nodep) {
+mldap_entry_touch(mldapdb_t *mldap, struct berval *uuid) {
 	isc_result_t result;
-	metadb_node_t *node = NULL;
-	DECLARE_BUFFERED_NAME(mname);
+	isc_boolean_t found;
+	unsigned int pos;
+	unsigned int idx;
 
-	REQUIRE(nodep != NULL && *nodep == NULL);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN);
 
-	INIT_BUFFERED_NAME(mname);
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	pos = mldap_slot_find(mldap, (const unsigned char *)uuid->bv_val,
+			      mldap_hash((const unsigned char *)uuid->bv_val),
+			      &found);
+	if (found == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
 
-	ldap_uuid_to_mname(entry->uuid, &mname);
-	CHECK(metadb_writenode_create(mldap->mdb, &mname, &node));
+	idx = mldap->slots[pos].rec - 1;
+	if (mldap->recs[idx].generation == mldap_cur_generation_get(mldap))
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	CHECK(mldap_undo_push(mldap, idx, ISC_FALSE, ISC_FALSE));
+	mldap_rec_refresh(mldap, idx);
 
-	CHECK(mldap_class_store(entry->class, node));
-	CHECK(mldap_generation_store(mldap, node));
+cleanup:
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	return result;
+}
 
-	*nodep = node;
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_file_read(FILE *fp, void *buf, size_t length) {
+	isc_result_t result;
 
-cleanup:
-	if (result != ISC_R_SUCCESS)
-		metadb_node_close(&node);
+	if (length == 0)
+		return ISC_R_SUCCESS;
+	result = isc_stdio_read(buf, 1, length, fp, NULL);
+	if (result == ISC_R_EOF)
+		result = ISC_R_UNEXPECTEDEND;
 	return result;
 }
 
 /**
- * Open metaLDAP entry for reading.
- * All notes about metadb_readnode_open() apply equally here.
+ * Dump SyncRepl cookie, current generation number and whole metaLDAP
+ * into a file.
+ *
+ * The cookie and metaLDAP content have to be written together,
+ * otherwise the cookie would not describe the state stored in the file.
+ * The file can be read only by the same build on the same machine.
  */
 isc_result_t
-mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, metadb_node_t **nodep) {
-	DECLARE_BUFFERED_NAME(mname);
-
-	INIT_BUFFERED_NAME(mname);
-
-	ldap_uuid_to_mname(uuid, &mname);
+mldap_snapshot_save(mldapdb_t *mldap, struct berval *cookie,
+		    const char *filename) {
+	isc_result_t result;
+	isc_boolean_t mldap_open = ISC_FALSE;
+	FILE *fp = NULL;
+	mldap_snapshot_hdr_t hdr;
+	const mldap_rec_t *rec;
+	unsigned int i;
+
+	REQUIRE(cookie->bv_val != NULL);
+	REQUIRE(cookie->bv_len <= 65535);
+
+	/* no modification can happen while the version is open */
+	CHECK(mldap_newversion(mldap));
+	mldap_open = ISC_TRUE;
+
+	hdr.magic = MLDAP_SNAPSHOT_MAGIC;
+	hdr.generation = mldap_cur_generation_get(mldap);
+	hdr.count = mldap->count;
+	hdr.cookie_len = cookie->bv_len;
+
+	CHECK(isc_stdio_open(filename, "w", &fp));
+	CHECK(isc_stdio_write(&hdr, sizeof(hdr), 1, fp, NULL));
+	CHECK(isc_stdio_write(cookie->bv_val, 1, cookie->bv_len, fp, NULL));
+	for (i = 0; i < mldap->recs_used; i++) {
+		rec = &mldap->recs[i];
+		if ((rec->flags & MLDAP_REC_USED) == 0)
+			continue;
+		CHECK(isc_stdio_write(rec, MLDAP_REC_DISKSIZE, 1, fp, NULL));
+		if ((rec->flags & MLDAP_REC_NAMES) != 0)
+			CHECK(isc_stdio_write(rec->names, 1,
+					      mldap_rec_nameslen(rec),
+					      fp, NULL));
+	}
+	CHECK(isc_stdio_flush(fp));
+	CHECK(isc_stdio_sync(fp));
 
-	return metadb_readnode_open(mldap->mdb, &mname, nodep);
+cleanup:
+	if (fp != NULL && isc_stdio_close(fp) != ISC_R_SUCCESS
+	    && result == ISC_R_SUCCESS)
+		result = ISC_R_IOERROR;
+	if (mldap_open == ISC_TRUE)
+		mldap_closeversion(mldap, ISC_FALSE);
+	return result;
 }
 
 /**
- * Delete metaLDAP entry.
- * All notes about metadb_writenode_open() apply equally here.
+ * Load metaLDAP content from file created by mldap_snapshot_save()
+ * and restore generation number and SyncRepl cookie stored in it.
+ * The index is pre-sized according to number of entries in the snapshot.
+ *
+ * @param[out] cookiep Newly allocated SyncRepl cookie. Caller is responsible
+ *                     for deallocation using ber_bvfree().
+ *
+ * @pre MetaLDAP is empty, i.e. it was just created by mldap_new().
+ *      MetaLDAP content is undefined if this function fails.
  */
 isc_result_t
-mldap_entry_delete(mldapdb_t *mldap, struct berval *uuid) {
+mldap_snapshot_load(mldapdb_t *mldap, const char *filename,
+		    struct berval **cookiep) {
 	isc_result_t result;
-	metadb_node_t *node = NULL;
-	DECLARE_BUFFERED_NAME(mname);
-
-	INIT_BUFFERED_NAME(mname);
-
-	ldap_uuid_to_mname(uuid, &mname);
+	FILE *fp = NULL;
+	mldap_snapshot_hdr_t hdr;
+	struct berval cookie = { .bv_len = 0, .bv_val = NULL };
+	mldap_rec_t disk_rec;
+	mldap_rec_t *rec;
+	unsigned char *names = NULL;
+	unsigned int nameslen = 0;
+	isc_uint32_t hash;
+	isc_boolean_t found;
+	unsigned int pos;
+	unsigned int idx;
+	unsigned int i;
+
+	REQUIRE(cookiep != NULL && *cookiep == NULL);
+	REQUIRE(mldap_cur_generation_get(mldap) == 0);
+	REQUIRE(mldap->count == 0);
+
+	CHECK(isc_stdio_open(filename, "r", &fp));
+	CHECK(mldap_file_read(fp, &hdr, sizeof(hdr)));
+	if (hdr.magic != MLDAP_SNAPSHOT_MAGIC || hdr.cookie_len > 65535)
+		CLEANUP_WITH(DNS_R_BADDB);
+
+	/* generation counter was not used yet so it can be re-initialized,
+	 * it has to be set before records are linked into generation lists */
+	isc_refcount_destroy(&mldap->generation);
+	CHECK(isc_refcount_init(&mldap->generation, hdr.generation));
+
+	CHECKED_MEM_ALLOCATE(mldap->mctx, cookie.bv_val, hdr.cookie_len + 1);
+	cookie.bv_len = hdr.cookie_len;
+	CHECK(mldap_file_read(fp, cookie.bv_val, cookie.bv_len));
+
+	/* concurrent access is not possible yet, lock is taken for
+	 * consistency with other functions */
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	result = mldap_reserve(mldap, hdr.count);
+	for (i = 0; result == ISC_R_SUCCESS && i < hdr.count; i++) {
+		memset(&disk_rec, 0, sizeof(disk_rec));
+		result = mldap_file_read(fp, &disk_rec, MLDAP_REC_DISKSIZE);
+		if (result != ISC_R_SUCCESS)
+			break;
+		nameslen = mldap_rec_nameslen(&disk_rec);
+		if ((disk_rec.flags & ~MLDAP_REC_ALLFLAGS) != 0
+		    || (disk_rec.flags & MLDAP_REC_USED) == 0
+		    || ((disk_rec.flags & MLDAP_REC_NAMES) == 0
+			&& (disk_rec.flags & MLDAP_REC_ZONE_SUFFIX) != 0)
+		    || ((disk_rec.flags & MLDAP_REC_NAMES) != 0
+			&& (disk_rec.fqdn_len == 0 || disk_rec.zone_len == 0))
+		    || ((disk_rec.flags & MLDAP_REC_ZONE_SUFFIX) != 0
+			&& disk_rec.zone_len > disk_rec.fqdn_len)) {
+			result = DNS_R_BADDB;
+			break;
+		}
+		if (nameslen > 0) {
+			names = isc_mem_allocate(mldap->mctx, nameslen);
+			if (names == NULL) {
+				result = ISC_R_NOMEMORY;
+				break;
+			}
+			result = mldap_file_read(fp, names, nameslen);
+			if (result != ISC_R_SUCCESS)
+				break;
+			disk_rec.names = names;
+			if (mldap_wirename_valid(names, disk_rec.fqdn_len)
+			    == ISC_FALSE
+			    || mldap_wirename_valid(names + nameslen
+						    - disk_rec.zone_len,
+						    disk_rec.zone_len)
+			    == ISC_FALSE) {
+				result = DNS_R_BADDB;
+				break;
+			}
+		}
+
+		hash = mldap_hash(disk_rec.uuid);
+		pos = mldap_slot_find(mldap, disk_rec.uuid, hash, &found);
+		if (found == ISC_TRUE) {
+			result = DNS_R_BADDB;
+			break;
+		}
+		result = mldap_rec_insert(mldap, disk_rec.uuid, hash, pos,
+					  &idx);
+		if (result != ISC_R_SUCCESS)
+			break;
+		rec = &mldap->recs[idx];
+		*rec = disk_rec;
+		mldap_rec_link(mldap, idx);
+		names = NULL;
+	}
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_write);
+	CHECK(result);
 
-	CHECK(metadb_writenode_open(mldap->mdb, &mname, &node));
-	CHECK(metadb_node_delete(&node));
+	*cookiep = ber_dupbv(NULL, &cookie);
+	if (*cookiep == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
 
 cleanup:
+	if (result == ISC_R_UNEXPECTEDEND)
+		result = DNS_R_BADDB;
+	if (names != NULL)
+		isc_mem_free(mldap->mctx, names);
+	if (cookie.bv_val != NULL)
+		isc_mem_free(mldap->mctx, cookie.bv_val);
+	if (fp != NULL)
+		(void)isc_stdio_close(fp);
 	return result;
 }
 
 /**
- * Start iteration over UUID's of dead nodes stored in uuid.ldap. sub-tree
- * of metaLDAP.
+ * Order dead entries by zone and put zone objects after records
+ * so all entries from one zone are removed together.
+ */
+static int
+mldap_dead_cmp(const void *a, const void *b) {
+	const mldap_dead_t *da = a;
+	const mldap_dead_t *db = b;
+	int cmp;
+
+	if (da->zone_len != db->zone_len)
+		return (da->zone_len < db->zone_len) ? -1 : 1;
+	if (da->zone_len > 0) {
+		cmp = memcmp(da->zone, db->zone, da->zone_len);
+		if (cmp != 0)
+			return cmp;
+	}
+	return (int)da->zone_obj - (int)db->zone_obj;
+}
+
+static void ATTR_NONNULLS
+mldap_iter_destroy(mldapdb_t *mldap, mldap_iter_t **iterp) {
+	mldap_iter_t *iter = *iterp;
+
+	SAFE_MEM_PUT(mldap->mctx, iter->dead, iter->count * sizeof(*iter->dead));
+	SAFE_MEM_PUT_PTR(mldap->mctx, iter);
+	*iterp = NULL;
+}
+
+/**
+ * Start iteration over UUID's of dead entries in metaLDAP.
  *
- * Dead node is a node with generation number lower than global generation
- * number in in metaLDAP.
+ * Dead entry is an entry with generation number lower than global generation
+ * number in in metaLDAP. Only the list of entries from old generations
+ * is examined, i.e. the cost is proportional to number of dead entries.
+ *
+ * Entries are returned grouped by zone. Entries without DNS name
+ * (configuration objects) go first and zone objects follow records
+ * from the same zone.
  *
  * @param[in]  mldap
  * @param[out] iterp
  * @param[out] uuid  Pre-allocated struct berval of size == 16 bytes.
- *                   LDAP entry UUID of the first dead node will be filled in.
+ *                   LDAP entry UUID of the first dead entry will be filled in.
  *
- * @retval ISC_R_SUCCESS LDAP entry UUID of the first dead node in database
+ * @retval ISC_R_SUCCESS LDAP entry UUID of the first dead entry in database
  *                       is in uuid variable. Resulting iterp can be used for
  *                       subsequent mldap_iter_deadnodes_next() calls.
- * @retval ISC_R_NOMORE  There is no dead node in metaLDAP.
+ * @retval ISC_R_NOMORE  There is no dead entry in metaLDAP.
  *                       Iterp and uuid are invalid.
  * @retval other         Various errors.
  *
@@ -422,48 +1393,76 @@ cleanup:
  *          This is safety check to prevent hard-to-debug inconsistencies.
  */
 isc_result_t
-mldap_iter_deadnodes_start(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_start(mldapdb_t *mldap, mldap_iter_t **iterp,
 			   struct berval *uuid) {
 	isc_result_t result;
-	metadb_iter_t *iter = NULL;
+	mldap_iter_t *iter = NULL;
+	const mldap_rec_t *rec;
+	mldap_dead_t *dead;
+	isc_uint32_t idx;
+	isc_boolean_t locked = ISC_FALSE;
 
 	REQUIRE(iterp != NULL && *iterp == NULL);
 
-	CHECK(metadb_iterator_create(mldap->mdb, &iter));
-	CHECKED_MEM_GET(mldap->mctx, iter->state, sizeof(isc_uint32_t));
-	result = dns_dbiterator_seek(iter->iter, &uuid_rootname);
-	if (result == ISC_R_NOTFOUND) /* metaLDAP is empty */
-		CLEANUP_WITH(ISC_R_NOMORE);
-	else if (result != ISC_R_SUCCESS)
-		goto cleanup;
+	CHECKED_MEM_GET_PTR(mldap->mctx, iter);
+	ZERO_PTR(iter);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_read);
+	locked = ISC_TRUE;
 	/* store current generation value for sanity checking */
-	*(isc_uint32_t *)iter->state = mldap_cur_generation_get(mldap);
+	iter->generation = mldap_cur_generation_get(mldap);
+	if (mldap->stale.count == 0)
+		CLEANUP_WITH(ISC_R_NOMORE);
 
-	CHECK(mldap_iter_deadnodes_next(mldap, &iter, uuid));
+	CHECKED_MEM_GET(mldap->mctx, iter->dead,
+			mldap->stale.count * sizeof(*iter->dead));
+	iter->count = mldap->stale.count;
+	for (idx = mldap->stale.head, dead = iter->dead;
+	     idx != 0;
+	     idx = rec->next, dead++) {
+		rec = &mldap->recs[idx - 1];
+		INSIST(isc_serial_lt(rec->generation, iter->generation));
+		memcpy(dead->uuid, rec->uuid, MLDAP_UUID_LEN);
+		if ((rec->flags & MLDAP_REC_NAMES) != 0) {
+			dead->zone_len = rec->zone_len;
+			dead->zone = rec->names + mldap_rec_nameslen(rec)
+				     - rec->zone_len;
+		} else {
+			dead->zone_len = 0;
+			dead->zone = NULL;
+		}
+		dead->zone_obj = ISC_TF((rec->class & (LDAP_ENTRYCLASS_MASTER
+						       | LDAP_ENTRYCLASS_FORWARD))
+					!= 0);
+	}
+	INSIST(dead == iter->dead + iter->count);
+	/* zone names are referenced only while the lock is held */
+	qsort(iter->dead, iter->count, sizeof(*iter->dead), mldap_dead_cmp);
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_read);
+	locked = ISC_FALSE;
 
 	*iterp = iter;
-	return result;
+	return mldap_iter_deadnodes_next(mldap, iterp, uuid);
 
 cleanup:
-	if (iter != NULL) {
-		SAFE_MEM_PUT(mldap->mctx, iter->state, sizeof(isc_uint32_t));
-		iter->state = NULL;
-		metadb_iterator_destroy(&iter);
-	}
-
+	if (locked == ISC_TRUE)
+		RWUNLOCK(&mldap->rwlock, isc_rwlocktype_read);
+	if (iter != NULL)
+		mldap_iter_destroy(mldap, &iter);
 	return result;
 }
 
 /**
- * Continue iteration over UUID's of dead nodes stored in uuid.ldap. sub-tree
- * of metaLDAP.
+ * Continue iteration over UUID's of dead entries in metaLDAP.
+ * Entries can be deleted during iteration. Entries which were deleted
+ * or marked as alive since the iteration started are skipped.
  *
  * @param[in]     mldap
  * @param[in,out] iterp
  * @param[out]    uuid  Pre-allocated struct berval of size == 16 bytes.
- *                      LDAP entry UUID of the next dead node will be filled in.
+ *                      LDAP entry UUID of the next dead entry will be filled in.
  *
- * @retval ISC_R_SUCCESS LDAP entry UUID of the next dead node in database
+ * @retval ISC_R_SUCCESS LDAP entry UUID of the next dead entry in database
  *                       is in uuid variable. Resulting iterp can be used for
  *                       subsequent mldap_iter_deadnodes_next() calls.
  * @retval ISC_R_NOMORE  End of iteration. Iterp and uuid are no longer valid.
@@ -473,67 +1472,42 @@ cleanup:
  *          This is safety check to prevent hard-to-debug inconsistencies.
  */
 isc_result_t
-mldap_iter_deadnodes_next(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_next(mldapdb_t *mldap, mldap_iter_t **iterp,
 		   struct berval *uuid) {
-	isc_result_t result;
-	dns_dbnode_t *rbt_node = NULL;
-	metadb_iter_t *iter = NULL;
-	isc_uint32_t node_generation;
+	isc_result_t result = ISC_R_NOMORE;
+	mldap_iter_t *iter;
+	const mldap_dead_t *dead;
+	const mldap_rec_t *rec;
 	isc_uint32_t cur_generation;
-	metadb_node_t metadb_node;
-	DECLARE_BUFFERED_NAME(name);
-	isc_region_t name_region;
+	isc_boolean_t found;
+	unsigned int pos;
 
-	REQUIRE(uuid != NULL);
-	REQUIRE(uuid->bv_len == 16 && uuid->bv_val != NULL);
+	REQUIRE(iterp != NULL && *iterp != NULL);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN && uuid->bv_val != NULL);
 
-	INIT_BUFFERED_NAME(name);
 	iter = *iterp;
-
-	/* create fake metaDB node for use with metaDB interface */
-	metadb_node.mctx = iter->mctx;
-	metadb_node.version = iter->version;
-	metadb_node.rbtdb = iter->rbtdb;
-
-	/* skip nodes which do not belong to UUID sub-tree or are 'fresh' */
-	while (ISC_TRUE) {
-		if (rbt_node != NULL)
-			dns_db_detachnode(iter->rbtdb, &rbt_node);
-		dns_name_reset(&name);
-
-		CHECK(dns_dbiterator_next(iter->iter));
-		CHECK(dns_dbiterator_current(iter->iter, &rbt_node, &name));
-		if (dns_name_issubdomain(&name, &uuid_rootname) == ISC_FALSE)
+	cur_generation = mldap_cur_generation_get(mldap);
+	/* sanity check: generation number cannot change during iteration */
+	INSIST(iter->generation == cur_generation);
+
+	RWLOCK(&mldap->rwlock, isc_rwlocktype_read);
+	while (iter->next < iter->count) {
+		dead = &iter->dead[iter->next++];
+		pos = mldap_slot_find(mldap, dead->uuid,
+				      mldap_hash(dead->uuid), &found);
+		if (found == ISC_FALSE)
 			continue;
-		metadb_node.dbnode = rbt_node;
-
-		INSIST(mldap_generation_get(&metadb_node, &node_generation)
-		       == ISC_R_SUCCESS);
-		cur_generation = mldap_cur_generation_get(mldap);
-		/* sanity check: generation number cannot change during iteration */
-		INSIST(*(isc_uint32_t *)(*iterp)->state == cur_generation);
-
-		if (isc_serial_lt(node_generation, cur_generation))
-			break; /* this node is from previous mLDAP generation */
+		rec = &mldap->recs[mldap->slots[pos].rec - 1];
+		if (isc_serial_lt(rec->generation, cur_generation)) {
+			/* this entry is from previous mLDAP generation */
+			memcpy(uuid->bv_val, dead->uuid, MLDAP_UUID_LEN);
+			result = ISC_R_SUCCESS;
+			break;
+		}
 	}
-	DNS_NAME_TOREGION(&name, &name_region);
-	/* parse UUID from DNS name
-	 * "$e4113e03-03b4-11e5-b478-c78116fa7f8b\004uuid\004ldap"
-	 * - first byte of any label is length
-	 * - names derived from UUID has to have constant length */
-	INSIST(name_region.length == 37 + sizeof(uuid_rootname_ndata));
-	INSIST(name_region.base[0] == 36);
-	name_region.base[37] = '\0';
-	INSIST(uuid_parse((const char *)name_region.base + 1,
-			  *(uuid_t *)(uuid->bv_val)) == 0);
+	RWUNLOCK(&mldap->rwlock, isc_rwlocktype_read);
 
-cleanup:
-	if (rbt_node != NULL)
-		dns_db_detachnode(iter->rbtdb, &rbt_node);
-	if (result != ISC_R_SUCCESS) {
-		SAFE_MEM_PUT(iter->mctx, iter->state, sizeof(isc_uint32_t));
-		iter->state = NULL;
-		metadb_iterator_destroy(iterp);
-	}
+	if (result != ISC_R_SUCCESS)
+		mldap_iter_destroy(mldap, iterp);
 	return result;
 }
@@ -7,10 +7,11 @@
 
 #include <ldap.h>
 
-#include "metadb.h"
 #include "types.h"
 #include "util.h"
 
+typedef struct mldap_node mldap_node_t;
+typedef struct mldap_iter mldap_iter_t;
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
 mldap_new(isc_mem_t *mctx, mldapdb_t **dbp);
@@ -24,23 +25,35 @@ mldap_newversion(mldapdb_t *mldap);
 void ATTR_NONNULLS
 mldap_closeversion(mldapdb_t *mldap, isc_boolean_t commit);
 
+unsigned int ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_savepoint(mldapdb_t *mldap);
+
+void ATTR_NONNULLS
+mldap_rollback(mldapdb_t *mldap, unsigned int savepoint);
+
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, metadb_node_t **nodep);
+mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, mldap_node_t **nodep);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, metadb_node_t **nodep);
+mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, mldap_node_t **nodep);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
 mldap_entry_delete(mldapdb_t *mldap, struct berval *uuid);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_class_get(metadb_node_t *node, ldap_entryclass_t *class);
+mldap_entry_touch(mldapdb_t *mldap, struct berval *uuid);
+
+void ATTR_NONNULLS
+mldap_node_close(mldap_node_t **nodep);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_class_get(mldap_node_t *node, ldap_entryclass_t *class);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_dnsname_get(metadb_node_t *node, dns_name_t *fqdn, dns_name_t *zone);
+mldap_dnsname_get(mldap_node_t *node, dns_name_t *fqdn, dns_name_t *zone);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, metadb_node_t *node);
+mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, mldap_node_t *node);
 
 void ATTR_NONNULLS
 mldap_cur_generation_bump(mldapdb_t *mldap);
@@ -48,12 +61,23 @@ mldap_cur_generation_bump(mldapdb_t *mldap);
 isc_uint32_t ATTR_CHECKRESULT ATTR_NONNULLS
 mldap_cur_generation_get(mldapdb_t *mldap);
 
+unsigned int ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_count(mldapdb_t *mldap);
+
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_iter_deadnodes_start(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_start(mldapdb_t *mldap, mldap_iter_t **iterp,
 			   struct berval *uuid);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_iter_deadnodes_next(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_next(mldapdb_t *mldap, mldap_iter_t **iterp,
 		   struct berval *uuid);
 
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_snapshot_save(mldapdb_t *mldap, struct berval *cookie,
+		    const char *filename);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_snapshot_load(mldapdb_t *mldap, const char *filename,
+		    struct berval **cookiep);
+
 #endif /* SRC_MLDAP_H_ */
@@ -0,0 +1,763 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/refcount.h>
+#include <isc/util.h>
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ldap_convert.h"
+#include "log.h"
+#include "rr_template.h"
+
+/**
+ * Record templates from idnsTemplateAttribute values.
+ *
+ * Template is compiled into a list of tokens: literal text copied verbatim
+ * and references \{variable_name\} to settings. The rules are the same
+ * as for the original regular expression:
+ * - Double-escaped strings \\{ \\} do not trigger substitution.
+ * - Nested references will expand only innermost variable: \{\{var1\}\}
+ * - Non-matching parentheses and other garbage are copied verbatim.
+ *
+ * The template index keeps compiled templates of each LDAP entry keyed
+ * by entryUUID so templates are not compiled again each time the entry
+ * is parsed. Entries which reference variables are also copied and
+ * a reverse index from variable names to the entries is maintained
+ * so entries which depend on a changed variable can be re-rendered
+ * without reloading whole zones.
+ */
+
+typedef struct rr_template_token {
+	/* offset into rr_template_t text */
+	unsigned int	offset;
+	unsigned int	length;
+	/* variable name is NUL-terminated at offset + length */
+	isc_boolean_t	variable;
+} rr_template_token_t;
+
+struct rr_template {
+	isc_mem_t		*mctx;
+	size_t			size;
+	char			*text;
+	/* original template text for comparison with LDAP values */
+	char			*source;
+	unsigned int		count;
+	rr_template_token_t	tokens[];
+};
+
+typedef struct rr_template_item {
+	dns_rdatatype_t		rdtype;
+	rr_template_t		*tmpl;
+} rr_template_item_t;
+
+/* Compiled templates of one entry shared by the index and parsers. */
+struct rr_template_set {
+	isc_mem_t		*mctx;
+	size_t			size;
+	isc_refcount_t		references;
+	unsigned int		count;
+	rr_template_item_t	items[];
+};
+
+typedef struct rr_template_var rr_template_var_t;
+typedef struct rr_template_dep rr_template_dep_t;
+typedef struct rr_template_entry rr_template_entry_t;
+
+/* Variable name and all entries which use it. */
+struct rr_template_var {
+	char				*name;
+	ISC_LIST(rr_template_dep_t)	deps;
+	ISC_LINK(rr_template_var_t)	link;
+};
+
+/* Entry uses variable. */
+struct rr_template_dep {
+	rr_template_var_t		*var;
+	rr_template_entry_t		*entry;
+	ISC_LINK(rr_template_dep_t)	var_link;
+	ISC_LINK(rr_template_dep_t)	entry_link;
+};
+
+struct rr_template_entry {
+	struct berval			uuid;
+	isc_uint32_t			hash;
+	rr_template_set_t		*set;
+	/* copy of the entry, only if its templates reference variables */
+	ldap_entry_t			*entry;
+	ISC_LIST(rr_template_dep_t)	deps;
+	ISC_LINK(rr_template_entry_t)	link;
+};
+
+typedef ISC_LIST(rr_template_entry_t) rr_template_bucket_t;
+
+#define RR_TEMPLATE_INDEX_INITSIZE	64
+
+/**
+ * Entries are kept in a chained hash table keyed by entryUUID which grows
+ * when the number of entries exceeds the number of buckets.
+ * Variables are few and they are looked up only on change of server
+ * configuration so they are kept in a list.
+ */
+struct rr_template_index {
+	isc_mem_t			*mctx;
+	isc_mutex_t			lock;
+	rr_template_bucket_t		*buckets;
+	unsigned int			nbuckets; /* power of 2 */
+	unsigned int			count;
+	ISC_LIST(rr_template_var_t)	vars;
+};
+
+/**
+ * FNV-1a hash of entryUUID.
+ */
+static isc_uint32_t
+rr_template_hash(const struct berval *uuid) {
+	isc_uint32_t hash = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < uuid->bv_len; i++) {
+		hash ^= (unsigned char)uuid->bv_val[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static inline isc_boolean_t
+rr_template_isvarchar(char c) {
+	return ISC_TF(isalnum((unsigned char)c) || c == '_' || c == '-');
+}
+
+static inline void
+rr_template_addtoken(rr_template_t *tmpl, unsigned int offset,
+		     unsigned int length, isc_boolean_t variable) {
+	rr_template_token_t *token = &tmpl->tokens[tmpl->count++];
+
+	token->offset = offset;
+	token->length = length;
+	token->variable = variable;
+}
+
+/**
+ * Split template into literal text and variable references.
+ */
+isc_result_t
+rr_template_compile(isc_mem_t *mctx, const char *text, rr_template_t **tmplp)
+{
+	isc_result_t result;
+	rr_template_t *tmpl = NULL;
+	size_t len;
+	size_t size;
+	size_t max_tokens;
+	size_t literal = 0; /* start of current literal part */
+	size_t search = 0; /* start of text after the last variable */
+	size_t i;
+	size_t j;
+	char *buf;
+
+	REQUIRE(tmplp != NULL && *tmplp == NULL);
+
+	len = strlen(text);
+	/* each reference has at least 5 characters: \{x\} */
+	max_tokens = 2 * (len / 5) + 1;
+	size = sizeof(*tmpl) + max_tokens * sizeof(rr_template_token_t)
+	       + 2 * (len + 1);
+	tmpl = isc_mem_get(mctx, size);
+	if (tmpl == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+	tmpl->mctx = NULL;
+	isc_mem_attach(mctx, &tmpl->mctx);
+	tmpl->size = size;
+	tmpl->count = 0;
+	tmpl->text = buf = (char *)&tmpl->tokens[max_tokens];
+	memcpy(buf, text, len + 1);
+	tmpl->source = buf + len + 1;
+	memcpy(tmpl->source, text, len + 1);
+
+	for (i = 0; i + 1 < len; i++) {
+		if (buf[i] != '\\' || buf[i + 1] != '{')
+			continue;
+		/* \{ must not be double-escaped like \\{ */
+		if (i != search && buf[i - 1] == '\\')
+			continue;
+		for (j = i + 2; j < len && rr_template_isvarchar(buf[j]); j++)
+			;
+		if (j == i + 2 || j + 1 >= len
+		    || buf[j] != '\\' || buf[j + 1] != '}')
+			continue;
+
+		if (i > literal)
+			rr_template_addtoken(tmpl, literal, i - literal,
+					     ISC_FALSE);
+		rr_template_addtoken(tmpl, i + 2, j - (i + 2), ISC_TRUE);
+		buf[j] = '\0';
+		literal = search = j + 2;
+		i = j + 1;
+	}
+	if (len > literal)
+		rr_template_addtoken(tmpl, literal, len - literal, ISC_FALSE);
+	INSIST(tmpl->count <= max_tokens);
+
+	*tmplp = tmpl;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+void
+rr_template_destroy(rr_template_t **tmplp)
+{
+	rr_template_t *tmpl;
+
+	REQUIRE(tmplp != NULL);
+
+	tmpl = *tmplp;
+	if (tmpl == NULL)
+		return;
+
+	isc_mem_putanddetach(&tmpl->mctx, tmpl, tmpl->size);
+	*tmplp = NULL;
+}
+
+/**
+ * Replace variable references with respective strings from settings tree.
+ *
+ * @retval  ISC_R_SUCCESS  Output string is valid.
+ * @retval  ISC_R_IGNORE   Some variables used in the template are not defined
+ *                         in settings tree. Output is not valid.
+ * @retval  others         Unexpected errors.
+ */
+isc_result_t
+rr_template_render(const rr_template_t *tmpl, const settings_set_t *set,
+		   ld_string_t *output)
+{
+	isc_result_t result;
+	const rr_template_token_t *token;
+	const char *text;
+	setting_t *setting;
+	unsigned int i;
+
+	str_clear(output);
+	for (i = 0; i < tmpl->count; i++) {
+		token = &tmpl->tokens[i];
+		text = tmpl->text + token->offset;
+		if (token->variable == ISC_FALSE) {
+			CHECK(str_cat_char_len(output, text, token->length));
+			continue;
+		}
+
+		setting = NULL;
+		result = setting_find(text, set, isc_boolean_true,
+				      isc_boolean_true, &setting);
+		if (result != ISC_R_SUCCESS) {
+			log_debug(3, "setting '%s' is not defined so it "
+				  "cannot be substituted into template", text);
+			CLEANUP_WITH(ISC_R_IGNORE);
+		}
+		if (setting->type != ST_STRING) {
+			log_bug("setting '%s' it not string so it cannot be "
+				"substituted", text);
+			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+		}
+		CHECK(str_cat_char(output, setting->value.value_char));
+	}
+
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Compile all idnsTemplateAttribute values from the entry.
+ * Values with unsupported target types are skipped.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+rr_template_set_create(isc_mem_t *mctx, ldap_entry_t *entry,
+		       rr_template_set_t **setp) {
+	isc_result_t result;
+	rr_template_set_t *set = NULL;
+	rr_template_item_t *item;
+	ldap_attribute_t *attr;
+	ldap_value_t *val;
+	dns_rdatatype_t rdtype;
+	unsigned int values = 0;
+	size_t size;
+
+	REQUIRE(setp != NULL && *setp == NULL);
+
+	for (attr = HEAD(entry->attrs); attr != NULL; attr = NEXT(attr, link)) {
+		if (strncasecmp(LDAP_TEMPLATE_ATTR_PREFIX, attr->name,
+				LDAP_TEMPLATE_ATTR_PREFIX_LEN) != 0)
+			continue;
+		for (val = HEAD(attr->values); val != NULL;
+		     val = NEXT(val, link))
+			values++;
+	}
+
+	size = sizeof(*set) + values * sizeof(rr_template_item_t);
+	CHECKED_MEM_GET(mctx, set, size);
+	set->mctx = NULL;
+	isc_mem_attach(mctx, &set->mctx);
+	set->size = size;
+	set->count = 0;
+	result = isc_refcount_init(&set->references, 1);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_putanddetach(&set->mctx, set, size);
+		set = NULL;
+		goto cleanup;
+	}
+
+	for (attr = HEAD(entry->attrs); attr != NULL; attr = NEXT(attr, link)) {
+		if (strncasecmp(LDAP_TEMPLATE_ATTR_PREFIX, attr->name,
+				LDAP_TEMPLATE_ATTR_PREFIX_LEN) != 0)
+			continue;
+		if (ldap_attribute_to_rdatatype(attr->name
+						+ LDAP_TEMPLATE_ATTR_PREFIX_LEN,
+						&rdtype) != ISC_R_SUCCESS)
+			continue;
+		for (val = HEAD(attr->values); val != NULL;
+		     val = NEXT(val, link)) {
+			item = &set->items[set->count];
+			item->rdtype = rdtype;
+			item->tmpl = NULL;
+			CHECK(rr_template_compile(mctx, val->value,
+						  &item->tmpl));
+			set->count++;
+		}
+	}
+
+	*setp = set;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	rr_template_set_detach(&set);
+	return result;
+}
+
+void
+rr_template_set_detach(rr_template_set_t **setp)
+{
+	rr_template_set_t *set;
+	unsigned int refs;
+	unsigned int i;
+
+	REQUIRE(setp != NULL);
+
+	set = *setp;
+	if (set == NULL)
+		return;
+	*setp = NULL;
+
+	isc_refcount_decrement(&set->references, &refs);
+	if (refs > 0)
+		return;
+
+	for (i = 0; i < set->count; i++)
+		rr_template_destroy(&set->items[i].tmpl);
+	isc_refcount_destroy(&set->references);
+	isc_mem_putanddetach(&set->mctx, set, set->size);
+}
+
+/**
+ * Render template with given target type and text. Compiled template
+ * from the set is used if there is one, otherwise the text is compiled
+ * on the fly, e.g. when the entry changed after it was indexed.
+ *
+ * @param[in] set Compiled templates of the entry or NULL.
+ *
+ * @retval  ISC_R_SUCCESS  Output string is valid.
+ * @retval  ISC_R_IGNORE   Some variables used in the template are not defined
+ *                         in settings tree. Output is not valid.
+ * @retval  others         Unexpected errors.
+ */
+isc_result_t
+rr_template_set_render(isc_mem_t *mctx, const rr_template_set_t *set,
+		       dns_rdatatype_t rdtype, const char *text,
+		       const settings_set_t *settings, ld_string_t *output)
+{
+	isc_result_t result;
+	rr_template_t *tmpl = NULL;
+	unsigned int i;
+
+	for (i = 0; set != NULL && i < set->count; i++) {
+		if (set->items[i].rdtype == rdtype
+		    && strcmp(set->items[i].tmpl->source, text) == 0)
+			return rr_template_render(set->items[i].tmpl,
+						  settings, output);
+	}
+
+	CHECK(rr_template_compile(mctx, text, &tmpl));
+	result = rr_template_render(tmpl, settings, output);
+
+cleanup:
+	rr_template_destroy(&tmpl);
+	return result;
+}
+
+isc_result_t
+rr_template_index_create(isc_mem_t *mctx, rr_template_index_t **indexp)
+{
+	isc_result_t result;
+	rr_template_index_t *index = NULL;
+	unsigned int i;
+
+	REQUIRE(indexp != NULL && *indexp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, index);
+	ZERO_PTR(index);
+	isc_mem_attach(mctx, &index->mctx);
+	ISC_LIST_INIT(index->vars);
+	index->nbuckets = RR_TEMPLATE_INDEX_INITSIZE;
+	CHECKED_MEM_GET(mctx, index->buckets,
+			index->nbuckets * sizeof(rr_template_bucket_t));
+	for (i = 0; i < index->nbuckets; i++)
+		ISC_LIST_INIT(index->buckets[i]);
+	CHECK(isc_mutex_init(&index->lock));
+
+	*indexp = index;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (index != NULL) {
+		SAFE_MEM_PUT(mctx, index->buckets,
+			     index->nbuckets * sizeof(rr_template_bucket_t));
+		MEM_PUT_AND_DETACH(index);
+	}
+	return result;
+}
+
+/**
+ * @pre index->lock is locked if the entry was linked to the index.
+ */
+static void ATTR_NONNULLS
+rr_template_entry_free(rr_template_index_t *index,
+		       rr_template_entry_t **tentryp) {
+	rr_template_entry_t *tentry = *tentryp;
+	rr_template_dep_t *dep;
+	rr_template_var_t *var;
+
+	while ((dep = HEAD(tentry->deps)) != NULL) {
+		UNLINK(tentry->deps, dep, entry_link);
+		var = dep->var;
+		UNLINK(var->deps, dep, var_link);
+		SAFE_MEM_PUT_PTR(index->mctx, dep);
+		if (EMPTY(var->deps)) {
+			UNLINK(index->vars, var, link);
+			isc_mem_free(index->mctx, var->name);
+			SAFE_MEM_PUT_PTR(index->mctx, var);
+		}
+	}
+	ldap_entry_destroy(&tentry->entry);
+	rr_template_set_detach(&tentry->set);
+	SAFE_MEM_PUT(index->mctx, tentry->uuid.bv_val, tentry->uuid.bv_len);
+	SAFE_MEM_PUT_PTR(index->mctx, tentry);
+	*tentryp = NULL;
+}
+
+void
+rr_template_index_destroy(rr_template_index_t **indexp)
+{
+	rr_template_index_t *index;
+	rr_template_entry_t *tentry;
+	unsigned int i;
+
+	REQUIRE(indexp != NULL);
+
+	index = *indexp;
+	if (index == NULL)
+		return;
+
+	for (i = 0; i < index->nbuckets; i++) {
+		while ((tentry = HEAD(index->buckets[i])) != NULL) {
+			UNLINK(index->buckets[i], tentry, link);
+			rr_template_entry_free(index, &tentry);
+		}
+	}
+	INSIST(EMPTY(index->vars));
+	isc_mem_put(index->mctx, index->buckets,
+		    index->nbuckets * sizeof(rr_template_bucket_t));
+	DESTROYLOCK(&index->lock);
+	MEM_PUT_AND_DETACH(index);
+	*indexp = NULL;
+}
+
+/**
+ * @pre index->lock is locked.
+ */
+static rr_template_entry_t * ATTR_NONNULLS
+rr_template_entry_find(rr_template_index_t *index, const struct berval *uuid,
+		       isc_uint32_t hash) {
+	rr_template_entry_t *tentry;
+
+	for (tentry = HEAD(index->buckets[hash & (index->nbuckets - 1)]);
+	     tentry != NULL;
+	     tentry = NEXT(tentry, link)) {
+		if (tentry->hash == hash
+		    && tentry->uuid.bv_len == uuid->bv_len
+		    && memcmp(tentry->uuid.bv_val, uuid->bv_val,
+			      uuid->bv_len) == 0)
+			return tentry;
+	}
+	return NULL;
+}
+
+/**
+ * Double number of buckets. Failure is not fatal, chains just get longer.
+ *
+ * @pre index->lock is locked.
+ */
+static void ATTR_NONNULLS
+rr_template_index_grow(rr_template_index_t *index) {
+	rr_template_bucket_t *buckets;
+	rr_template_entry_t *tentry;
+	unsigned int nbuckets = 2 * index->nbuckets;
+	unsigned int i;
+
+	buckets = isc_mem_get(index->mctx,
+			      nbuckets * sizeof(rr_template_bucket_t));
+	if (buckets == NULL)
+		return;
+	for (i = 0; i < nbuckets; i++)
+		ISC_LIST_INIT(buckets[i]);
+
+	for (i = 0; i < index->nbuckets; i++) {
+		while ((tentry = HEAD(index->buckets[i])) != NULL) {
+			UNLINK(index->buckets[i], tentry, link);
+			APPEND(buckets[tentry->hash & (nbuckets - 1)], tentry,
+			       link);
+		}
+	}
+	isc_mem_put(index->mctx, index->buckets,
+		    index->nbuckets * sizeof(rr_template_bucket_t));
+	index->buckets = buckets;
+	index->nbuckets = nbuckets;
+}
+
+/**
+ * Record that the entry uses given variable.
+ *
+ * @pre index->lock is locked.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+rr_template_dep_add(rr_template_index_t *index, rr_template_entry_t *tentry,
+		    const char *name) {
+	isc_result_t result;
+	rr_template_var_t *var;
+	rr_template_var_t *new_var = NULL;
+	rr_template_dep_t *dep;
+
+	for (dep = HEAD(tentry->deps); dep != NULL; dep = NEXT(dep, entry_link))
+		if (strcmp(dep->var->name, name) == 0)
+			return ISC_R_SUCCESS;
+
+	for (var = HEAD(index->vars); var != NULL; var = NEXT(var, link))
+		if (strcmp(var->name, name) == 0)
+			break;
+	if (var == NULL) {
+		CHECKED_MEM_GET_PTR(index->mctx, new_var);
+		ZERO_PTR(new_var);
+		CHECKED_MEM_STRDUP(index->mctx, name, new_var->name);
+		ISC_LIST_INIT(new_var->deps);
+		ISC_LINK_INIT(new_var, link);
+		var = new_var;
+	}
+
+	dep = NULL;
+	CHECKED_MEM_GET_PTR(index->mctx, dep);
+	dep->var = var;
+	dep->entry = tentry;
+	ISC_LINK_INIT(dep, var_link);
+	ISC_LINK_INIT(dep, entry_link);
+	APPEND(var->deps, dep, var_link);
+	APPEND(tentry->deps, dep, entry_link);
+	if (new_var != NULL)
+		APPEND(index->vars, new_var, link);
+
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (new_var != NULL) {
+		if (new_var->name != NULL)
+			isc_mem_free(index->mctx, new_var->name);
+		SAFE_MEM_PUT_PTR(index->mctx, new_var);
+	}
+	return result;
+}
+
+/**
+ * @pre index->lock is locked.
+ */
+static void ATTR_NONNULLS
+rr_template_index_remove_locked(rr_template_index_t *index,
+				const struct berval *uuid, isc_uint32_t hash) {
+	rr_template_entry_t *tentry;
+
+	tentry = rr_template_entry_find(index, uuid, hash);
+	if (tentry != NULL) {
+		UNLINK(index->buckets[hash & (index->nbuckets - 1)], tentry,
+		       link);
+		index->count--;
+		rr_template_entry_free(index, &tentry);
+	}
+}
+
+static isc_boolean_t ATTR_NONNULLS
+rr_template_set_hasvars(const rr_template_set_t *set) {
+	const rr_template_t *tmpl;
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; i < set->count; i++) {
+		tmpl = set->items[i].tmpl;
+		for (j = 0; j < tmpl->count; j++)
+			if (tmpl->tokens[j].variable == ISC_TRUE)
+				return ISC_TRUE;
+	}
+	return ISC_FALSE;
+}
+
+/**
+ * Compile templates from the entry and store them in the index.
+ * Copy of the entry is stored too if the templates reference variables.
+ * Previous version of the entry with the same UUID is replaced.
+ *
+ * Templates are compiled and the entry is copied before the index
+ * is locked.
+ */
+isc_result_t
+rr_template_index_update(rr_template_index_t *index, ldap_entry_t *entry)
+{
+	isc_result_t result;
+	rr_template_entry_t *tentry = NULL;
+	const rr_template_t *tmpl;
+	isc_boolean_t locked = ISC_FALSE;
+	unsigned int i;
+	unsigned int j;
+
+	REQUIRE(entry->uuid != NULL);
+
+	CHECKED_MEM_GET_PTR(index->mctx, tentry);
+	ZERO_PTR(tentry);
+	ISC_LIST_INIT(tentry->deps);
+	ISC_LINK_INIT(tentry, link);
+	CHECKED_MEM_GET(index->mctx, tentry->uuid.bv_val, entry->uuid->bv_len);
+	memcpy(tentry->uuid.bv_val, entry->uuid->bv_val, entry->uuid->bv_len);
+	tentry->uuid.bv_len = entry->uuid->bv_len;
+	tentry->hash = rr_template_hash(entry->uuid);
+	CHECK(rr_template_set_create(index->mctx, entry, &tentry->set));
+	if (rr_template_set_hasvars(tentry->set) == ISC_TRUE)
+		CHECK(ldap_entry_clone(index->mctx, entry, &tentry->entry));
+
+	LOCK(&index->lock);
+	locked = ISC_TRUE;
+	rr_template_index_remove_locked(index, entry->uuid, tentry->hash);
+
+	for (i = 0; i < tentry->set->count; i++) {
+		tmpl = tentry->set->items[i].tmpl;
+		for (j = 0; j < tmpl->count; j++) {
+			if (tmpl->tokens[j].variable == ISC_FALSE)
+				continue;
+			CHECK(rr_template_dep_add(index, tentry,
+				tmpl->text + tmpl->tokens[j].offset));
+		}
+	}
+
+	if (index->count >= index->nbuckets)
+		rr_template_index_grow(index);
+	APPEND(index->buckets[tentry->hash & (index->nbuckets - 1)], tentry,
+	       link);
+	index->count++;
+	tentry = NULL;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (tentry != NULL)
+		rr_template_entry_free(index, &tentry);
+	if (locked == ISC_TRUE)
+		UNLOCK(&index->lock);
+	return result;
+}
+
+void
+rr_template_index_remove(rr_template_index_t *index, const struct berval *uuid)
+{
+	isc_uint32_t hash = rr_template_hash(uuid);
+
+	LOCK(&index->lock);
+	rr_template_index_remove_locked(index, uuid, hash);
+	UNLOCK(&index->lock);
+}
+
+/**
+ * Get compiled templates of the entry with given UUID.
+ *
+ * @param[out] setp Reference to the templates, release it using
+ *                  rr_template_set_detach().
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOTFOUND The entry has no templates in the index.
+ */
+isc_result_t
+rr_template_index_find(rr_template_index_t *index, const struct berval *uuid,
+		       rr_template_set_t **setp)
+{
+	isc_result_t result;
+	rr_template_entry_t *tentry;
+	isc_uint32_t hash = rr_template_hash(uuid);
+
+	REQUIRE(setp != NULL && *setp == NULL);
+
+	LOCK(&index->lock);
+	tentry = rr_template_entry_find(index, uuid, hash);
+	if (tentry != NULL) {
+		isc_refcount_increment(&tentry->set->references, NULL);
+		*setp = tentry->set;
+		result = ISC_R_SUCCESS;
+	} else {
+		result = ISC_R_NOTFOUND;
+	}
+	UNLOCK(&index->lock);
+
+	return result;
+}
+
+/**
+ * Get copies of all entries which use given variable in their templates.
+ *
+ * @param[out] entries Copies are appended to the list, caller has to
+ *                     destroy them even if the function fails.
+ */
+isc_result_t
+rr_template_index_dependents(rr_template_index_t *index, const char *variable,
+			     ldap_entrylist_t *entries)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	rr_template_var_t *var;
+	rr_template_dep_t *dep;
+	ldap_entry_t *entry = NULL;
+
+	LOCK(&index->lock);
+	for (var = HEAD(index->vars); var != NULL; var = NEXT(var, link))
+		if (strcmp(var->name, variable) == 0)
+			break;
+	if (var == NULL)
+		goto cleanup;
+
+	for (dep = HEAD(var->deps); dep != NULL; dep = NEXT(dep, var_link)) {
+		CHECK(ldap_entry_clone(index->mctx, dep->entry->entry,
+				       &entry));
+		APPEND(*entries, entry, link);
+		entry = NULL;
+	}
+
+cleanup:
+	UNLOCK(&index->lock);
+	return result;
+}
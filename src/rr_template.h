@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_RR_TEMPLATE_H_
+#define SRC_RR_TEMPLATE_H_
+
+#include <isc/types.h>
+#include <dns/types.h>
+
+#include "ldap_entry.h"
+#include "settings.h"
+#include "str.h"
+#include "util.h"
+
+#define LDAP_TEMPLATE_ATTR_PREFIX	"idnsTemplateAttribute;"
+#define LDAP_TEMPLATE_ATTR_PREFIX_LEN	(sizeof(LDAP_TEMPLATE_ATTR_PREFIX) - 1)
+
+typedef struct rr_template rr_template_t;
+typedef struct rr_template_set rr_template_set_t;
+typedef struct rr_template_index rr_template_index_t;
+
+isc_result_t
+rr_template_compile(isc_mem_t *mctx, const char *text,
+		    rr_template_t **tmplp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_destroy(rr_template_t **tmplp) ATTR_NONNULLS;
+
+isc_result_t
+rr_template_render(const rr_template_t *tmpl, const settings_set_t *set,
+		   ld_string_t *output) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_set_detach(rr_template_set_t **setp) ATTR_NONNULLS;
+
+isc_result_t
+rr_template_set_render(isc_mem_t *mctx, const rr_template_set_t *set,
+		       dns_rdatatype_t rdtype, const char *text,
+		       const settings_set_t *settings, ld_string_t *output)
+		       ATTR_NONNULL(1, 4, 5, 6) ATTR_CHECKRESULT;
+
+isc_result_t
+rr_template_index_create(isc_mem_t *mctx,
+			 rr_template_index_t **indexp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_index_destroy(rr_template_index_t **indexp) ATTR_NONNULLS;
+
+isc_result_t
+rr_template_index_update(rr_template_index_t *index,
+			 ldap_entry_t *entry) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_index_remove(rr_template_index_t *index,
+			 const struct berval *uuid) ATTR_NONNULLS;
+
+isc_result_t
+rr_template_index_find(rr_template_index_t *index, const struct berval *uuid,
+		       rr_template_set_t **setp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+rr_template_index_dependents(rr_template_index_t *index, const char *variable,
+			     ldap_entrylist_t *entries) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+#endif /* SRC_RR_TEMPLATE_H_ */
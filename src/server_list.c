@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <string.h>
+
+#include "log.h"
+#include "server_list.h"
+#include "util.h"
+
+/**
+ * List of LDAP servers configured in options "uri" (writable masters)
+ * and "replica_uri" (read-only replicas). Each server has smoothed
+ * round-trip time measured during connection establishment and a back-off
+ * state which takes the server out of rotation after a failure.
+ *
+ * Connections for updates are spread among healthy masters in round-robin
+ * fashion. SyncRepl session uses the healthy server with the lowest
+ * round-trip time. Servers which were not measured yet are preferred
+ * so each server gets a chance to be measured.
+ */
+struct ldap_server {
+	char			*uri;
+	isc_boolean_t		writable;
+	/* Smoothed round-trip time in microseconds, 0 = not measured yet. */
+	isc_uint64_t		rtt;
+	/* Number of consecutive failures. */
+	unsigned int		failures;
+	/* Server is not used before this time unless all servers are down. */
+	isc_time_t		retry_time;
+	ISC_LINK(ldap_server_t)	link;
+};
+
+struct server_list {
+	isc_mem_t		*mctx;
+	isc_mutex_t		lock;
+	ISC_LIST(ldap_server_t)	servers;
+	/* Master which got the last write connection. */
+	ldap_server_t		*last_write;
+};
+
+/* Longest back-off interval is 2^MAX_BACKOFF_SHIFT seconds. */
+#define MAX_BACKOFF_SHIFT	10
+
+/**
+ * Append all URIs from whitespace or comma separated list.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+server_list_add(server_list_t *list, const char *uris, isc_boolean_t writable)
+{
+	isc_result_t result;
+	ldap_server_t *server = NULL;
+	const char *delim = " \t\n,";
+	size_t len;
+
+	while (*uris != '\0') {
+		uris += strspn(uris, delim);
+		len = strcspn(uris, delim);
+		if (len == 0)
+			break;
+
+		CHECKED_MEM_GET_PTR(list->mctx, server);
+		ZERO_PTR(server);
+		ISC_LINK_INIT(server, link);
+		server->writable = writable;
+		CHECKED_MEM_ALLOCATE(list->mctx, server->uri, len + 1);
+		memcpy(server->uri, uris, len);
+		server->uri[len] = '\0';
+		APPEND(list->servers, server, link);
+		server = NULL;
+
+		uris += len;
+	}
+
+	return ISC_R_SUCCESS;
+
+cleanup:
+	SAFE_MEM_PUT_PTR(list->mctx, server);
+	return result;
+}
+
+/**
+ * @param[in] masters  Whitespace or comma separated list of LDAP URIs.
+ *                     At least one URI is required.
+ * @param[in] replicas Read-only servers usable for SyncRepl session,
+ *                     can be empty.
+ */
+isc_result_t
+server_list_create(isc_mem_t *mctx, const char *masters, const char *replicas,
+		   server_list_t **listp)
+{
+	isc_result_t result;
+	server_list_t *list = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+
+	REQUIRE(listp != NULL && *listp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, list);
+	ZERO_PTR(list);
+	isc_mem_attach(mctx, &list->mctx);
+	ISC_LIST_INIT(list->servers);
+	CHECK(isc_mutex_init(&list->lock));
+	lock_ready = ISC_TRUE;
+
+	CHECK(server_list_add(list, masters, ISC_TRUE));
+	if (EMPTY(list->servers)) {
+		log_error("option 'uri' does not contain any LDAP URI");
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	CHECK(server_list_add(list, replicas, ISC_FALSE));
+
+	*listp = list;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (lock_ready == ISC_FALSE && list != NULL)
+		MEM_PUT_AND_DETACH(list);
+	else
+		server_list_destroy(&list);
+	return result;
+}
+
+void
+server_list_destroy(server_list_t **listp)
+{
+	server_list_t *list;
+	ldap_server_t *server;
+
+	REQUIRE(listp != NULL);
+
+	list = *listp;
+	if (list == NULL)
+		return;
+
+	while ((server = HEAD(list->servers)) != NULL) {
+		UNLINK(list->servers, server, link);
+		isc_mem_free(list->mctx, server->uri);
+		SAFE_MEM_PUT_PTR(list->mctx, server);
+	}
+	DESTROYLOCK(&list->lock);
+	MEM_PUT_AND_DETACH(list);
+	*listp = NULL;
+}
+
+/**
+ * @pre list->lock is locked.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+server_healthy(const ldap_server_t *server, const isc_time_t *now)
+{
+	return ISC_TF(server->failures == 0
+		      || isc_time_compare(now, &server->retry_time) >= 0);
+}
+
+/**
+ * Select server for a new connection.
+ *
+ * SERVER_WRITE role rotates among healthy writable masters,
+ * SERVER_SYNC role selects the healthy server with the lowest round-trip
+ * time. If no suitable server is healthy, the server which leaves
+ * back-off state first is returned.
+ *
+ * @returns ISC_TRUE if the selected server is healthy.
+ */
+isc_boolean_t
+server_list_pick(server_list_t *list, server_role_t role,
+		 ldap_server_t **serverp)
+{
+	ldap_server_t *server;
+	ldap_server_t *start;
+	ldap_server_t *best = NULL;
+	ldap_server_t *fallback = NULL;
+	isc_time_t now;
+
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+
+	LOCK(&list->lock);
+	if (role == SERVER_WRITE) {
+		start = (list->last_write != NULL)
+			? NEXT(list->last_write, link) : NULL;
+		if (start == NULL)
+			start = HEAD(list->servers);
+		server = start;
+		do {
+			if (server->writable == ISC_TRUE) {
+				if (server_healthy(server, &now) == ISC_TRUE) {
+					best = server;
+					break;
+				}
+				if (fallback == NULL
+				    || isc_time_compare(&server->retry_time,
+							&fallback->retry_time) < 0)
+					fallback = server;
+			}
+			server = NEXT(server, link);
+			if (server == NULL)
+				server = HEAD(list->servers);
+		} while (server != start);
+		if (best != NULL)
+			list->last_write = best;
+	} else {
+		for (server = HEAD(list->servers);
+		     server != NULL;
+		     server = NEXT(server, link)) {
+			if (server_healthy(server, &now) == ISC_TRUE) {
+				if (best == NULL || server->rtt < best->rtt)
+					best = server;
+			} else if (fallback == NULL
+				   || isc_time_compare(&server->retry_time,
+						       &fallback->retry_time) < 0) {
+				fallback = server;
+			}
+		}
+	}
+	UNLOCK(&list->lock);
+
+	INSIST(best != NULL || fallback != NULL);
+	*serverp = (best != NULL) ? best : fallback;
+	return ISC_TF(best != NULL);
+}
+
+/**
+ * @returns ISC_TRUE if at least one server usable for given role
+ *          is not in back-off state.
+ */
+isc_boolean_t
+server_list_available(server_list_t *list, server_role_t role)
+{
+	ldap_server_t *server;
+	isc_boolean_t available = ISC_FALSE;
+	isc_time_t now;
+
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+
+	LOCK(&list->lock);
+	for (server = HEAD(list->servers);
+	     server != NULL && available == ISC_FALSE;
+	     server = NEXT(server, link)) {
+		if (role == SERVER_WRITE && server->writable == ISC_FALSE)
+			continue;
+		available = server_healthy(server, &now);
+	}
+	UNLOCK(&list->lock);
+
+	return available;
+}
+
+/**
+ * Record successful connection to the server.
+ *
+ * @param[in] rtt Time in microseconds needed to connect and bind.
+ */
+void
+server_success(server_list_t *list, ldap_server_t *server, isc_uint64_t rtt)
+{
+	LOCK(&list->lock);
+	if (server->failures > 0)
+		log_info("LDAP server %s is available again", server->uri);
+	server->failures = 0;
+	/* avoid 0 which means 'not measured' */
+	rtt = ISC_MAX(rtt, 1);
+	if (server->rtt == 0)
+		server->rtt = rtt;
+	else
+		server->rtt = (server->rtt * 7 + rtt) / 8;
+	log_debug(2, "LDAP server %s round-trip time %lu us",
+		  server->uri, (unsigned long)server->rtt);
+	UNLOCK(&list->lock);
+}
+
+/**
+ * Take the server out of rotation. Back-off interval doubles with each
+ * consecutive failure up to max_delay seconds.
+ */
+void
+server_failure(server_list_t *list, ldap_server_t *server,
+	       isc_uint32_t max_delay)
+{
+	isc_interval_t interval;
+	unsigned int delay;
+
+	LOCK(&list->lock);
+	server->failures++;
+	delay = 1U << ISC_MIN(server->failures, MAX_BACKOFF_SHIFT);
+	delay = ISC_MIN(delay, ISC_MAX(max_delay, 1));
+	isc_interval_set(&interval, delay, 0);
+	if (isc_time_nowplusinterval(&server->retry_time, &interval)
+	    != ISC_R_SUCCESS)
+		isc_time_settoepoch(&server->retry_time);
+	log_debug(1, "LDAP server %s failed %u time%s, next try in %u s",
+		  server->uri, server->failures,
+		  server->failures == 1 ? "" : "s", delay);
+	UNLOCK(&list->lock);
+}
+
+const char *
+server_uri(const ldap_server_t *server)
+{
+	return server->uri;
+}
+
+isc_boolean_t
+server_writable(const ldap_server_t *server)
+{
+	return server->writable;
+}
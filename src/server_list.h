@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_SERVER_LIST_H_
+#define SRC_SERVER_LIST_H_
+
+#include <isc/types.h>
+
+#include "util.h"
+
+typedef struct ldap_server ldap_server_t;
+typedef struct server_list server_list_t;
+
+/* Purpose of connection to LDAP server. */
+typedef enum server_role {
+	SERVER_WRITE = 0,	/* updates from DNS, any writable master */
+	SERVER_SYNC,		/* SyncRepl session, any server incl. replicas */
+} server_role_t;
+
+isc_result_t
+server_list_create(isc_mem_t *mctx, const char *masters, const char *replicas,
+		   server_list_t **listp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+server_list_destroy(server_list_t **listp) ATTR_NONNULLS;
+
+isc_boolean_t
+server_list_pick(server_list_t *list, server_role_t role,
+		 ldap_server_t **serverp) ATTR_NONNULLS;
+
+isc_boolean_t
+server_list_available(server_list_t *list, server_role_t role) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+server_success(server_list_t *list, ldap_server_t *server,
+	       isc_uint64_t rtt) ATTR_NONNULLS;
+
+void
+server_failure(server_list_t *list, ldap_server_t *server,
+	       isc_uint32_t max_delay) ATTR_NONNULLS;
+
+const char *
+server_uri(const ldap_server_t *server) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_boolean_t
+server_writable(const ldap_server_t *server) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+#endif /* SRC_SERVER_LIST_H_ */
@@ -8,6 +8,8 @@
 #include <isc/result.h>
 #include <isc/string.h>
 #include <isc/int.h>
+#include <isc/mutex.h>
+#include <isc/once.h>
 #include <isc/parseint.h>
 #include <dns/name.h>
 
@@ -30,7 +32,9 @@ isc_boolean_t verbose_checks = ISC_FALSE; /* log each failure in CHECK() macro *
 static const setting_t settings_default[] = {
 	{ "default_ttl",		default_uint(86400)		}, /* Seconds */
 	{ "uri",			no_default_string		}, /* User have to set this */
+	{ "replica_uri",		default_string("")		},
 	{ "connections",		default_uint(2)			},
+	{ "connections_max",		default_uint(0)			},
 	{ "reconnect_interval",		default_uint(60)		},
 	{ "zone_refresh",		default_string("")		}, /* No longer supported */
 	{ "timeout",			default_uint(10)		},
@@ -63,18 +67,220 @@ static const setting_t settings_default[] = {
 	{ "verbose_checks",		default_boolean(ISC_FALSE)	},
 	{ "directory",			default_string("")		},
 	{ "server_id",			default_string("")		},
+	{ "persistent_cache",		default_boolean(ISC_FALSE)	},
+	{ "stats_interval",		default_uint(0)			}, /* Seconds */
+	{ "serial_batch_size",		default_uint(100)		},
+	{ "serial_batch_delay",		default_uint(1000)		}, /* Milliseconds */
+	{ "sync_concurrency_limit",	default_uint(100)		},
+	{ "sync_concurrency_max",	default_uint(10000)		},
+	{ "sync_concurrency_adaptive",	default_boolean(ISC_FALSE)	},
+	{ "sync_concurrency_latency",	default_uint(100)		}, /* Milliseconds */
+	{ "sync_concurrency_memory",	default_uint(0)			}, /* MiB */
+	{ "sync_commit_size",		default_uint(50)		},
+	{ "sync_commit_delay",		default_uint(100)		}, /* Milliseconds */
+	{ "sync_refresh_sessions",	default_uint(1)			},
+	{ "sync_record_file",		default_string("")		},
+	{ "sync_replay_file",		default_string("")		},
 	end_of_settings
 };
 
+/** Index for built-in defaults, filled by settings_init(). */
+static setting_t *settings_default_index[SETTING_COUNT];
+
 /** Settings set for built-in defaults. */
 const settings_set_t settings_default_set = {
 	NULL,
 	"built-in defaults",
 	NULL,
 	NULL,
-	(setting_t *) &settings_default[0]
+	(setting_t *) &settings_default[0],
+	settings_default_index,
+	NULL
+};
+
+#define SETTING_NAME_STR(name)	#name,
+static const char * const setting_names[SETTING_COUNT] = {
+	SETTING_NAMES(SETTING_NAME_STR)
+};
+#undef SETTING_NAME_STR
+
+/** Hash table for setting name -> setting_id_t conversion.
+ * Slots contain setting_id_t + 1, zero denotes empty slot. */
+#define SETTING_HASH_SIZE	256
+static unsigned int setting_hash[SETTING_HASH_SIZE];
+
+/**
+ * Values resolved through chain of parent sets. Any change which could
+ * resolve a setting to a different set (i.e. set or unset of a value
+ * in any set) increments settings_generation and invalidates all caches.
+ * Changes of values which are already set do not need invalidation because
+ * the cache contains pointers to setting_t structures.
+ */
+struct settings_cache {
+	isc_uint32_t	generation;
+	setting_t	*resolved[SETTING_COUNT];
 };
 
+static isc_once_t settings_once = ISC_ONCE_INIT;
+static isc_mutex_t settings_generation_lock;
+static isc_uint32_t settings_generation = 1;
+
+static inline unsigned int
+setting_hash_name(const char *name) {
+	unsigned int h = 2166136261U; /* FNV-1a */
+
+	while (*name != '\0') {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void
+settings_init(void) {
+	unsigned int slot;
+
+	RUNTIME_CHECK(isc_mutex_init(&settings_generation_lock)
+		      == ISC_R_SUCCESS);
+
+	INSIST(SETTING_COUNT < SETTING_HASH_SIZE / 2);
+	for (unsigned int id = 0; id < SETTING_COUNT; id++) {
+		slot = setting_hash_name(setting_names[id]);
+		while (setting_hash[slot % SETTING_HASH_SIZE] != 0)
+			slot++;
+		setting_hash[slot % SETTING_HASH_SIZE] = id + 1;
+	}
+
+	/* First definition wins, same as in linear search. */
+	for (setting_t *setting = (setting_t *)settings_default;
+	     setting->name != NULL;
+	     setting++) {
+		for (unsigned int id = 0; id < SETTING_COUNT; id++) {
+			if (strcmp(setting->name, setting_names[id]) == 0) {
+				if (settings_default_index[id] == NULL)
+					settings_default_index[id] = setting;
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Convert setting name to its compile-time identifier.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOTFOUND Setting with given name is not listed
+ *                        in SETTING_NAMES().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+setting_name_to_id(const char *name, setting_id_t *idp) {
+	unsigned int slot;
+	unsigned int id;
+
+	RUNTIME_CHECK(isc_once_do(&settings_once, settings_init)
+		      == ISC_R_SUCCESS);
+
+	for (slot = setting_hash_name(name);
+	     (id = setting_hash[slot % SETTING_HASH_SIZE]) != 0;
+	     slot++) {
+		if (strcmp(name, setting_names[id - 1]) == 0) {
+			*idp = id - 1;
+			return ISC_R_SUCCESS;
+		}
+	}
+	return ISC_R_NOTFOUND;
+}
+
+/**
+ * Invalidate cached results of recursive lookups in all sets of settings.
+ */
+static void
+settings_invalidate(void) {
+	LOCK(&settings_generation_lock);
+	settings_generation++;
+	UNLOCK(&settings_generation_lock);
+}
+
+static isc_uint32_t
+settings_generation_get(void) {
+	isc_uint32_t generation;
+
+	LOCK(&settings_generation_lock);
+	generation = settings_generation;
+	UNLOCK(&settings_generation_lock);
+
+	return generation;
+}
+
+/**
+ * Find setting in given set of settings, parent sets are not searched.
+ * Sets created without index (i.e. statically initialized ones)
+ * are searched linearly.
+ */
+static inline setting_t * ATTR_NONNULLS
+setting_lookup(const setting_id_t id, const settings_set_t *set) {
+	if (set->index != NULL)
+		return set->index[id];
+
+	for (setting_t *setting = set->first_setting;
+	     setting->name != NULL;
+	     setting++) {
+		if (strcmp(setting_names[id], setting->name) == 0)
+			return setting;
+	}
+	return NULL;
+}
+
+static isc_result_t ATTR_NONNULL(2) ATTR_CHECKRESULT
+setting_find_id(const setting_id_t id, const settings_set_t *set,
+		isc_boolean_t recursive, isc_boolean_t filled_only,
+		setting_t **found) {
+	setting_t *setting;
+	settings_cache_t *cache = set->cache;
+	isc_uint32_t generation = 0;
+
+	REQUIRE(id < SETTING_COUNT);
+	REQUIRE(found == NULL || *found == NULL);
+
+	if (cache != NULL && recursive && filled_only) {
+		/* Generation has to be read before the lookup: result found
+		 * in parent sets is cached only if no set was modified
+		 * in the meantime. */
+		generation = settings_generation_get();
+		LOCK(set->lock);
+		if (cache->generation != generation) {
+			memset(cache->resolved, 0, sizeof(cache->resolved));
+			cache->generation = generation;
+		}
+		setting = cache->resolved[id];
+		UNLOCK(set->lock);
+		if (setting != NULL)
+			goto found;
+	}
+
+	for (const settings_set_t *s = set; s != NULL; s = s->parent_set) {
+		setting = setting_lookup(id, s);
+		if (setting != NULL && (setting->filled || !filled_only)) {
+			if (cache != NULL && recursive && filled_only) {
+				LOCK(set->lock);
+				if (cache->generation == generation)
+					cache->resolved[id] = setting;
+				UNLOCK(set->lock);
+			}
+			goto found;
+		}
+		/* continue with parent set */
+		if (!recursive)
+			break;
+	}
+	return ISC_R_NOTFOUND;
+
+found:
+	if (found != NULL)
+		*found = setting;
+	return ISC_R_SUCCESS;
+}
+
 /**
  * @param[in] name Setting name.
  * @param[in] set Set of settings to start search in.
@@ -92,36 +298,15 @@ isc_result_t
 setting_find(const char *name, const settings_set_t *set,
 	     isc_boolean_t recursive, isc_boolean_t filled_only,
 	     setting_t **found) {
+	setting_id_t id;
 
 	REQUIRE(name != NULL);
 	REQUIRE(found == NULL || *found == NULL);
 
-	while (set != NULL) {
-		log_debug(20, "examining set of settings '%s'", set->name);
-		for (setting_t *setting = set->first_setting;
-				setting->name;
-				setting++) {
-
-			if (strcmp(name, setting->name) == 0) {
-				if (setting->filled || !filled_only) {
-					if (found != NULL)
-						*found = setting;
-					log_debug(20, "setting '%s' was found "
-						      "in set '%s'", name,
-						      set->name);
-					return ISC_R_SUCCESS;
-				} else {
-					break; /* continue with parent set */
-				}
-			}
+	if (set == NULL || setting_name_to_id(name, &id) != ISC_R_SUCCESS)
+		return ISC_R_NOTFOUND;
 
-		}
-		if (recursive)
-			set = set->parent_set;
-		else
-			break;
-	}
-	return ISC_R_NOTFOUND;
+	return setting_find_id(id, set, recursive, filled_only, found);
 }
 
 /**
@@ -144,16 +329,17 @@ setting_find(const char *name, const settings_set_t *set,
  *                          error.)
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-setting_get(const char *const name, const setting_type_t type,
+setting_get(const setting_id_t id, const setting_type_t type,
 	    const settings_set_t *const set, void *target)
 {
 	isc_result_t result;
 	setting_t *setting = NULL;
+	const char *name = setting_names[id];
 
-	REQUIRE(name != NULL);
 	REQUIRE(target != NULL);
 
-	CHECK(setting_find(name, set, isc_boolean_true, isc_boolean_true, &setting));
+	CHECK(setting_find_id(id, set, isc_boolean_true, isc_boolean_true,
+			      &setting));
 
 	if (setting->type != type) {
 		log_bug("incompatible setting data type requested "
@@ -184,25 +370,62 @@ cleanup:
 	return result;
 }
 
+/**
+ * Convert name to identifier for setting_get().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+setting_get_byname(const char *const name, const setting_type_t type,
+		   const settings_set_t *const set, void *target)
+{
+	setting_id_t id;
+
+	if (setting_name_to_id(name, &id) != ISC_R_SUCCESS) {
+		log_bug("setting '%s' is not known", name);
+		return ISC_R_NOTFOUND;
+	}
+	return setting_get(id, type, set, target);
+}
+
 isc_result_t
 setting_get_uint(const char *const name, const settings_set_t *const set,
 		 isc_uint32_t *target)
 {
-	return setting_get(name, ST_UNSIGNED_INTEGER, set, target);
+	return setting_get_byname(name, ST_UNSIGNED_INTEGER, set, target);
 }
 
 isc_result_t
 setting_get_str(const char *const name, const settings_set_t *const set,
 		const char **target)
 {
-	return setting_get(name, ST_STRING, set, target);
+	return setting_get_byname(name, ST_STRING, set, target);
 }
 
 isc_result_t
 setting_get_bool(const char *const name, const settings_set_t *const set,
 		 isc_boolean_t *target)
 {
-	return setting_get(name, ST_BOOLEAN, set, target);
+	return setting_get_byname(name, ST_BOOLEAN, set, target);
+}
+
+isc_result_t
+setting_get_uint_id(const setting_id_t id, const settings_set_t *const set,
+		    isc_uint32_t *target)
+{
+	return setting_get(id, ST_UNSIGNED_INTEGER, set, target);
+}
+
+isc_result_t
+setting_get_str_id(const setting_id_t id, const settings_set_t *const set,
+		   const char **target)
+{
+	return setting_get(id, ST_STRING, set, target);
+}
+
+isc_result_t
+setting_get_bool_id(const setting_id_t id, const settings_set_t *const set,
+		    isc_boolean_t *target)
+{
+	return setting_get(id, ST_BOOLEAN, set, target);
 }
 
 /**
@@ -299,7 +522,10 @@ set_value(isc_mem_t *mctx, const settings_set_t *set, setting_t *setting,
 				 "invalid setting_type_t value %u", setting->type);
 		break;
 	}
-	setting->filled = 1;
+	if (!setting->filled) {
+		setting->filled = 1;
+		settings_invalidate();
+	}
 	result = ISC_R_SUCCESS;
 
 cleanup:
@@ -385,6 +611,7 @@ setting_unset(const char *const name, const settings_set_t *set)
 		break;
 	}
 	setting->filled = 0;
+	settings_invalidate();
 
 cleanup:
 	UNLOCK(set->lock);
@@ -486,12 +713,16 @@ settings_set_create(isc_mem_t *mctx, const setting_t default_settings[],
 		    settings_set_t **target) {
 	isc_result_t result = ISC_R_FAILURE;
 	settings_set_t *new_set = NULL;
+	setting_id_t id;
 
 	REQUIRE(target != NULL && *target == NULL);
 	REQUIRE(default_settings != NULL);
 	REQUIRE(default_set_length > 0);
 
-	CHECKED_MEM_ALLOCATE(mctx, new_set, default_set_length);
+	RUNTIME_CHECK(isc_once_do(&settings_once, settings_init)
+		      == ISC_R_SUCCESS);
+
+	CHECKED_MEM_ALLOCATE(mctx, new_set, sizeof(*new_set));
 	ZERO_PTR(new_set);
 	isc_mem_attach(mctx, &new_set->mctx);
 
@@ -507,6 +738,25 @@ settings_set_create(isc_mem_t *mctx, const setting_t default_settings[],
 	CHECKED_MEM_ALLOCATE(mctx, new_set->name, strlen(set_name) + 1);
 	strcpy(new_set->name, set_name);
 
+	CHECKED_MEM_GET(mctx, new_set->index,
+			SETTING_COUNT * sizeof(*new_set->index));
+	memset(new_set->index, 0, SETTING_COUNT * sizeof(*new_set->index));
+	for (setting_t *setting = new_set->first_setting;
+	     setting->name != NULL;
+	     setting++) {
+		if (setting_name_to_id(setting->name, &id) != ISC_R_SUCCESS) {
+			log_bug("setting '%s' in set of settings '%s' is not "
+				"listed in SETTING_NAMES()", setting->name,
+				set_name);
+			CLEANUP_WITH(ISC_R_UNEXPECTED);
+		}
+		if (new_set->index[id] == NULL)
+			new_set->index[id] = setting;
+	}
+
+	CHECKED_MEM_GET_PTR(mctx, new_set->cache);
+	ZERO_PTR(new_set->cache);
+
 	*target = new_set;
 	result = ISC_R_SUCCESS;
 
@@ -538,13 +788,20 @@ settings_set_free(settings_set_t **set) {
 			SAFE_MEM_PUT_PTR(mctx, (*set)->lock);
 		}
 
-		for (s = (*set)->first_setting; s->name != NULL; s++) {
-			if (s->is_dynamic)
-				isc_mem_free(mctx, s->value.value_char);
-		}
-		if ((*set)->first_setting != NULL)
+		if ((*set)->first_setting != NULL) {
+			for (s = (*set)->first_setting; s->name != NULL; s++) {
+				if (s->is_dynamic)
+					isc_mem_free(mctx,
+						     s->value.value_char);
+			}
 			isc_mem_free(mctx, (*set)->first_setting);
-		isc_mem_free(mctx, (*set)->name);
+		}
+		if ((*set)->index != NULL)
+			isc_mem_put(mctx, (*set)->index,
+				    SETTING_COUNT * sizeof(*(*set)->index));
+		SAFE_MEM_PUT_PTR(mctx, (*set)->cache);
+		if ((*set)->name != NULL)
+			isc_mem_free(mctx, (*set)->name);
 		isc_mem_free(mctx, *set);
 		isc_mem_detach(&mctx);
 	}
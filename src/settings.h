@@ -18,6 +18,73 @@
 #define SETTING_SET_NAME_ZONE   "LDAP idnsZone object"
 
 typedef struct setting	setting_t;
+typedef struct settings_cache	settings_cache_t;
+
+/*
+ * Names of all settings known to the plugin. Each setting gets compile-time
+ * identifier SETTING_<name> which allows lookups without string comparison.
+ * Settings used in any setting_t table have to be listed here.
+ */
+#define SETTING_NAMES(X)			\
+	X(active)				\
+	X(allow_query)				\
+	X(allow_transfer)			\
+	X(auth_method)				\
+	X(auth_method_enum)			\
+	X(base)					\
+	X(bind_dn)				\
+	X(cache_ttl)				\
+	X(connections)				\
+	X(connections_max)			\
+	X(default_ttl)				\
+	X(directory)				\
+	X(dyn_update)				\
+	X(fake_mname)				\
+	X(forward_policy)			\
+	X(forwarders)				\
+	X(krb5_keytab)				\
+	X(krb5_principal)			\
+	X(ldap_hostname)			\
+	X(nsec3param)				\
+	X(password)				\
+	X(persistent_cache)			\
+	X(psearch)				\
+	X(reconnect_interval)			\
+	X(replica_uri)				\
+	X(sasl_auth_name)			\
+	X(sasl_mech)				\
+	X(sasl_password)			\
+	X(sasl_realm)				\
+	X(sasl_user)				\
+	X(serial_autoincrement)			\
+	X(serial_batch_delay)			\
+	X(serial_batch_size)			\
+	X(server_id)				\
+	X(stats_interval)			\
+	X(substitutionvariable_ipalocation)	\
+	X(sync_commit_delay)			\
+	X(sync_commit_size)			\
+	X(sync_concurrency_adaptive)		\
+	X(sync_concurrency_latency)		\
+	X(sync_concurrency_limit)		\
+	X(sync_concurrency_max)			\
+	X(sync_concurrency_memory)		\
+	X(sync_ptr)				\
+	X(sync_record_file)			\
+	X(sync_refresh_sessions)		\
+	X(sync_replay_file)			\
+	X(timeout)				\
+	X(update_policy)			\
+	X(uri)					\
+	X(verbose_checks)			\
+	X(zone_refresh)
+
+#define SETTING_ID_ENUM(name)	SETTING_##name,
+typedef enum {
+	SETTING_NAMES(SETTING_ID_ENUM)
+	SETTING_COUNT
+} setting_id_t;
+#undef SETTING_ID_ENUM
 
 /* Make sure that cases in get_value_ptr() are synchronized */
 typedef enum {
@@ -44,6 +111,8 @@ struct settings_set {
 	const settings_set_t	*parent_set;
 	isc_mutex_t		*lock;  /**< locks only values */
 	setting_t		*first_setting;
+	setting_t		**index; /**< setting_id_t -> setting or NULL */
+	settings_cache_t	*cache;  /**< settings resolved via parents */
 };
 
 /*
@@ -105,6 +174,18 @@ isc_result_t
 setting_get_bool(const char * const name, const settings_set_t * const set,
 		 isc_boolean_t * target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+setting_get_uint_id(const setting_id_t id, const settings_set_t * const set,
+		    isc_uint32_t * target) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+setting_get_str_id(const setting_id_t id, const settings_set_t * const set,
+		   const char ** target) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+setting_get_bool_id(const setting_id_t id, const settings_set_t * const set,
+		    isc_boolean_t * target) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 setting_set(const char *const name, const settings_set_t *set,
 	    const char *const value) ATTR_NONNULLS ATTR_CHECKRESULT;
@@ -0,0 +1,480 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/region.h>
+#include <isc/util.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "sync_record.h"
+
+/**
+ * Record of RFC 4533 callbacks received from LDAP.
+ *
+ * The file allows to replay a SyncRepl session without LDAP server,
+ * see sync_replay_file option. It starts with header SYNC_RECORD_MAGIC
+ * followed by records:
+ *   u32 type, u32 payload length, payload.
+ * All integers are in network byte order, strings and binary values
+ * are stored as u32 length followed by data.
+ *
+ * Payload for ldap_sync_search_entry() callback:
+ *   u32 phase, u32 ls_refreshPhase, string entryUUID,
+ *   u32 has_entry, [string DN, u32 attribute count,
+ *   [string name, u32 value count, [string value]...]...]
+ * Entries are stored already decoded from LDAPMessage so the replay
+ * does not depend on libldap internals.
+ *
+ * Payload for ldap_sync_intermediate() callback:
+ *   u32 phase, u32 UUID count, [string UUID]...
+ *
+ * Payload for ldap_sync_search_result() callback:
+ *   u32 refreshDeletes
+ */
+
+#define SYNC_RECORD_MAGIC	"BDLSYNC1"
+#define SYNC_RECORD_MAGIC_LEN	(sizeof(SYNC_RECORD_MAGIC) - 1)
+
+struct sync_record {
+	isc_mem_t		*mctx;
+	isc_mutex_t		lock;	/**< serializes writers */
+	char			*filename;
+	FILE			*fp;
+	isc_boolean_t		write;
+
+	/* Reader scratch space. Data returned by sync_record_read()
+	 * point here and are valid until the next call. */
+	unsigned char		*buf;
+	size_t			buf_size;
+	struct berval		*bvs;
+	size_t			bvs_size;
+};
+
+/**
+ * Open record file for writing (the file is truncated) or reading.
+ */
+isc_result_t
+sync_record_create(isc_mem_t *mctx, const char *filename, isc_boolean_t write,
+		   sync_record_t **recp) {
+	isc_result_t result;
+	sync_record_t *rec = NULL;
+	char magic[SYNC_RECORD_MAGIC_LEN];
+
+	REQUIRE(recp != NULL && *recp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, rec);
+	ZERO_PTR(rec);
+	isc_mem_attach(mctx, &rec->mctx);
+	result = isc_mutex_init(&rec->lock);
+	if (result != ISC_R_SUCCESS) {
+		MEM_PUT_AND_DETACH(rec);
+		return result;
+	}
+	rec->write = write;
+	CHECKED_MEM_STRDUP(mctx, filename, rec->filename);
+
+	rec->fp = fopen(filename, (write == ISC_TRUE) ? "wb" : "rb");
+	if (rec->fp == NULL) {
+		log_error("unable to open SyncRepl record file '%s': %s",
+			  filename, strerror(errno));
+		CLEANUP_WITH(ISC_R_FILENOTFOUND);
+	}
+	if (write == ISC_TRUE) {
+		if (fwrite(SYNC_RECORD_MAGIC, SYNC_RECORD_MAGIC_LEN, 1,
+			   rec->fp) != 1)
+			CLEANUP_WITH(ISC_R_FAILURE);
+	} else if (fread(magic, sizeof(magic), 1, rec->fp) != 1
+		   || memcmp(magic, SYNC_RECORD_MAGIC, sizeof(magic)) != 0) {
+		log_error("'%s' is not a SyncRepl record file", filename);
+		CLEANUP_WITH(ISC_R_BADHEADER);
+	}
+
+	*recp = rec;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	sync_record_destroy(&rec);
+	return result;
+}
+
+void
+sync_record_destroy(sync_record_t **recp) {
+	sync_record_t *rec;
+
+	REQUIRE(recp != NULL);
+
+	rec = *recp;
+	if (rec == NULL)
+		return;
+
+	if (rec->fp != NULL && fclose(rec->fp) != 0)
+		log_error("unable to close SyncRepl record file '%s': %s",
+			  rec->filename, strerror(errno));
+	if (rec->filename != NULL)
+		isc_mem_free(rec->mctx, rec->filename);
+	if (rec->buf != NULL)
+		isc_mem_put(rec->mctx, rec->buf, rec->buf_size);
+	if (rec->bvs != NULL)
+		isc_mem_put(rec->mctx, rec->bvs,
+			    rec->bvs_size * sizeof(*rec->bvs));
+	DESTROYLOCK(&rec->lock);
+	MEM_PUT_AND_DETACH(rec);
+	*recp = NULL;
+}
+
+static inline size_t
+sync_record_bvlen(size_t len) {
+	return sizeof(isc_uint32_t) + len;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_record_put32(sync_record_t *rec, isc_uint32_t value) {
+	value = htonl(value);
+	if (fwrite(&value, sizeof(value), 1, rec->fp) != 1)
+		return ISC_R_FAILURE;
+	return ISC_R_SUCCESS;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_record_putbv(sync_record_t *rec, const void *data, size_t len) {
+	isc_result_t result;
+
+	CHECK(sync_record_put32(rec, len));
+	if (len > 0 && fwrite(data, len, 1, rec->fp) != 1)
+		CLEANUP_WITH(ISC_R_FAILURE);
+
+cleanup:
+	return result;
+}
+
+/**
+ * @returns Length of serialized attributes of the entry.
+ */
+static size_t ATTR_NONNULLS
+sync_record_entrylen(ldap_entry_t *entry) {
+	ldap_attribute_t *attr;
+	ldap_value_t *val;
+	size_t len;
+
+	len = sync_record_bvlen(strlen(entry->dn)) + sizeof(isc_uint32_t);
+	for (attr = HEAD(entry->attrs); attr != NULL; attr = NEXT(attr, link)) {
+		len += sync_record_bvlen(strlen(attr->name))
+		       + sizeof(isc_uint32_t);
+		for (val = HEAD(attr->values);
+		     val != NULL;
+		     val = NEXT(val, link))
+			len += sync_record_bvlen(val->length);
+	}
+
+	return len;
+}
+
+/**
+ * Append ldap_sync_search_entry() callback to the record.
+ *
+ * @param[in] entry Entry parsed from LDAP for ADD and MODIFY phases,
+ *                  NULL otherwise.
+ */
+isc_result_t
+sync_record_write_entry(sync_record_t *rec, ldap_entry_t *entry,
+			struct berval *uuid, int phase, int refresh_phase) {
+	isc_result_t result;
+	ldap_attribute_t *attr;
+	ldap_value_t *val;
+	unsigned int count;
+	size_t len;
+
+	REQUIRE(rec->write == ISC_TRUE);
+
+	len = 3 * sizeof(isc_uint32_t) + sync_record_bvlen(uuid->bv_len);
+	if (entry != NULL)
+		len += sync_record_entrylen(entry);
+
+	LOCK(&rec->lock);
+	CHECK(sync_record_put32(rec, sync_record_entry));
+	CHECK(sync_record_put32(rec, len));
+	CHECK(sync_record_put32(rec, phase));
+	CHECK(sync_record_put32(rec, refresh_phase));
+	CHECK(sync_record_putbv(rec, uuid->bv_val, uuid->bv_len));
+	CHECK(sync_record_put32(rec, entry != NULL));
+	if (entry == NULL)
+		goto cleanup;
+
+	CHECK(sync_record_putbv(rec, entry->dn, strlen(entry->dn)));
+	count = 0;
+	for (attr = HEAD(entry->attrs); attr != NULL; attr = NEXT(attr, link))
+		count++;
+	CHECK(sync_record_put32(rec, count));
+	for (attr = HEAD(entry->attrs); attr != NULL; attr = NEXT(attr, link)) {
+		CHECK(sync_record_putbv(rec, attr->name, strlen(attr->name)));
+		count = 0;
+		for (val = HEAD(attr->values);
+		     val != NULL;
+		     val = NEXT(val, link))
+			count++;
+		CHECK(sync_record_put32(rec, count));
+		for (val = HEAD(attr->values);
+		     val != NULL;
+		     val = NEXT(val, link))
+			CHECK(sync_record_putbv(rec, val->value, val->length));
+	}
+
+cleanup:
+	UNLOCK(&rec->lock);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to write SyncRepl record file '%s'",
+			    rec->filename);
+	return result;
+}
+
+/**
+ * Append ldap_sync_intermediate() callback to the record.
+ * Intermediate messages delimit phases of the session so buffered
+ * data are flushed to the file.
+ */
+isc_result_t
+sync_record_write_intermediate(sync_record_t *rec, BerVarray uuids,
+			       int phase) {
+	isc_result_t result;
+	unsigned int count = 0;
+	unsigned int i;
+	size_t len;
+
+	REQUIRE(rec->write == ISC_TRUE);
+
+	len = 2 * sizeof(isc_uint32_t);
+	for (i = 0; uuids != NULL && uuids[i].bv_val != NULL; i++) {
+		len += sync_record_bvlen(uuids[i].bv_len);
+		count++;
+	}
+
+	LOCK(&rec->lock);
+	CHECK(sync_record_put32(rec, sync_record_intermediate));
+	CHECK(sync_record_put32(rec, len));
+	CHECK(sync_record_put32(rec, phase));
+	CHECK(sync_record_put32(rec, count));
+	for (i = 0; i < count; i++)
+		CHECK(sync_record_putbv(rec, uuids[i].bv_val,
+					uuids[i].bv_len));
+	if (fflush(rec->fp) != 0)
+		CLEANUP_WITH(ISC_R_FAILURE);
+
+cleanup:
+	UNLOCK(&rec->lock);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to write SyncRepl record file '%s'",
+			    rec->filename);
+	return result;
+}
+
+/**
+ * Append ldap_sync_search_result() callback to the record.
+ */
+isc_result_t
+sync_record_write_result(sync_record_t *rec, int refresh_deletes) {
+	isc_result_t result;
+
+	REQUIRE(rec->write == ISC_TRUE);
+
+	LOCK(&rec->lock);
+	CHECK(sync_record_put32(rec, sync_record_result));
+	CHECK(sync_record_put32(rec, sizeof(isc_uint32_t)));
+	CHECK(sync_record_put32(rec, refresh_deletes));
+	if (fflush(rec->fp) != 0)
+		CLEANUP_WITH(ISC_R_FAILURE);
+
+cleanup:
+	UNLOCK(&rec->lock);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to write SyncRepl record file '%s'",
+			    rec->filename);
+	return result;
+}
+
+/**
+ * Make sure that scratch buffer has at least size bytes.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_record_reserve(sync_record_t *rec, void **bufp, size_t *sizep,
+		    size_t size, size_t item_size) {
+	isc_result_t result;
+	void *buf = NULL;
+	size_t new_size;
+
+	if (size <= *sizep)
+		return ISC_R_SUCCESS;
+
+	new_size = ISC_MAX(size, 2 * *sizep);
+	CHECKED_MEM_GET(rec->mctx, buf, new_size * item_size);
+	if (*bufp != NULL)
+		isc_mem_put(rec->mctx, *bufp, *sizep * item_size);
+	*bufp = buf;
+	*sizep = new_size;
+
+cleanup:
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_record_get32(isc_region_t *region, isc_uint32_t *valuep) {
+	isc_uint32_t value;
+
+	if (region->length < sizeof(value))
+		return ISC_R_UNEXPECTEDEND;
+	memcpy(&value, region->base, sizeof(value));
+	isc_region_consume(region, sizeof(value));
+	*valuep = ntohl(value);
+	return ISC_R_SUCCESS;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_record_getbv(isc_region_t *region, struct berval *bv) {
+	isc_result_t result;
+	isc_uint32_t len;
+
+	CHECK(sync_record_get32(region, &len));
+	if (region->length < len)
+		CLEANUP_WITH(ISC_R_UNEXPECTEDEND);
+	bv->bv_val = (char *)region->base;
+	bv->bv_len = len;
+	isc_region_consume(region, len);
+
+cleanup:
+	return result;
+}
+
+/**
+ * Decode attributes of an entry and create ldap_entry_t from them.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_record_getentry(sync_record_t *rec, dn_cache_t *dncache,
+		     isc_region_t *region, struct berval *uuid,
+		     ldap_entry_t **entryp) {
+	isc_result_t result;
+	ldap_entry_t *entry = NULL;
+	struct berval bv;
+	struct berval name;
+	isc_uint32_t attrs;
+	isc_uint32_t values;
+	isc_uint32_t i;
+	isc_uint32_t j;
+
+	CHECK(ldap_entry_init(rec->mctx, &entry));
+	CHECK(sync_record_getbv(region, &bv));
+	CHECK(ldap_entry_setdn(entry, &bv));
+	CHECK(sync_record_get32(region, &attrs));
+	for (i = 0; i < attrs; i++) {
+		CHECK(sync_record_getbv(region, &name));
+		CHECK(sync_record_get32(region, &values));
+		if (values > region->length / sizeof(isc_uint32_t))
+			CLEANUP_WITH(ISC_R_UNEXPECTEDEND);
+		CHECK(sync_record_reserve(rec, (void **)&rec->bvs,
+					  &rec->bvs_size, values + 1,
+					  sizeof(*rec->bvs)));
+		for (j = 0; j < values; j++)
+			CHECK(sync_record_getbv(region, &rec->bvs[j]));
+		rec->bvs[values].bv_val = NULL;
+		rec->bvs[values].bv_len = 0;
+		CHECK(ldap_entry_addattr(entry, &name, rec->bvs));
+	}
+	CHECK(ldap_entry_complete(entry, dncache, uuid));
+
+	*entryp = entry;
+	entry = NULL;
+
+cleanup:
+	ldap_entry_destroy(&entry);
+	return result;
+}
+
+/**
+ * Read next callback from the record.
+ *
+ * @param[out] msg Callback parameters. UUIDs point to internal buffer
+ *                 and are valid until the next call. Entry has to be
+ *                 destroyed by the caller.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOMORE        End of the record.
+ * @retval ISC_R_UNEXPECTEDEND The record is truncated or corrupted.
+ */
+isc_result_t
+sync_record_read(sync_record_t *rec, dn_cache_t *dncache,
+		 sync_record_msg_t *msg) {
+	isc_result_t result;
+	isc_uint32_t header[2];
+	isc_uint32_t value;
+	isc_uint32_t count;
+	isc_uint32_t i;
+	isc_region_t region;
+
+	REQUIRE(rec->write == ISC_FALSE);
+
+	memset(msg, 0, sizeof(*msg));
+	if (fread(header, sizeof(header), 1, rec->fp) != 1) {
+		if (feof(rec->fp))
+			CLEANUP_WITH(ISC_R_NOMORE);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	msg->type = ntohl(header[0]);
+	region.length = ntohl(header[1]);
+	CHECK(sync_record_reserve(rec, (void **)&rec->buf, &rec->buf_size,
+				  region.length, 1));
+	region.base = rec->buf;
+	if (region.length > 0 && fread(region.base, region.length, 1,
+				       rec->fp) != 1)
+		CLEANUP_WITH(ISC_R_UNEXPECTEDEND);
+
+	CHECK(sync_record_get32(&region, &value));
+	msg->phase = value;
+	switch (msg->type) {
+	case sync_record_entry:
+		CHECK(sync_record_get32(&region, &value));
+		msg->refresh_phase = value;
+		CHECK(sync_record_getbv(&region, &msg->uuid));
+		CHECK(sync_record_get32(&region, &value));
+		if (value != 0)
+			CHECK(sync_record_getentry(rec, dncache, &region,
+						   &msg->uuid, &msg->entry));
+		break;
+
+	case sync_record_intermediate:
+		CHECK(sync_record_get32(&region, &count));
+		if (count == 0)
+			break;
+		if (count > region.length / sizeof(isc_uint32_t))
+			CLEANUP_WITH(ISC_R_UNEXPECTEDEND);
+		CHECK(sync_record_reserve(rec, (void **)&rec->bvs,
+					  &rec->bvs_size, count + 1,
+					  sizeof(*rec->bvs)));
+		for (i = 0; i < count; i++)
+			CHECK(sync_record_getbv(&region, &rec->bvs[i]));
+		rec->bvs[count].bv_val = NULL;
+		rec->bvs[count].bv_len = 0;
+		msg->uuids = rec->bvs;
+		break;
+
+	case sync_record_result:
+		break;
+
+	default:
+		log_error("unknown callback type %u in SyncRepl record "
+			  "file '%s'", msg->type, rec->filename);
+		CLEANUP_WITH(ISC_R_UNEXPECTEDEND);
+	}
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE) {
+		log_error_r("unable to read SyncRepl record file '%s'",
+			    rec->filename);
+		ldap_entry_destroy(&msg->entry);
+	}
+	return result;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_SYNC_RECORD_H_
+#define SRC_SYNC_RECORD_H_
+
+#include <isc/types.h>
+
+#include "ldap_entry.h"
+#include "util.h"
+
+#define LDAP_DEPRECATED 1
+#include <ldap.h>
+
+typedef struct sync_record sync_record_t;
+
+/** Type of callback from RFC 4533 session stored in the record file. */
+typedef enum {
+	sync_record_entry = 1,		/**< ldap_sync_search_entry() */
+	sync_record_intermediate,	/**< ldap_sync_intermediate() */
+	sync_record_result		/**< ldap_sync_search_result() */
+} sync_record_type_t;
+
+/** One callback read from the record file by sync_record_read(). */
+typedef struct sync_record_msg {
+	sync_record_type_t	type;
+	/** ldap_sync_refresh_t phase or refreshDeletes for results */
+	int			phase;
+	/** ls_refreshPhase at the time of the callback (entries only) */
+	int			refresh_phase;
+	/** entryUUID (entries only) */
+	struct berval		uuid;
+	/** Parsed entry for ADD/MODIFY, NULL otherwise.
+	 *  Caller has to destroy it. */
+	ldap_entry_t		*entry;
+	/** syncUUIDs terminated by NULL bv_val (intermediate only) */
+	BerVarray		uuids;
+} sync_record_msg_t;
+
+isc_result_t
+sync_record_create(isc_mem_t *mctx, const char *filename,
+		   isc_boolean_t write, sync_record_t **recp)
+		   ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+sync_record_destroy(sync_record_t **recp) ATTR_NONNULLS;
+
+isc_result_t
+sync_record_write_entry(sync_record_t *rec, ldap_entry_t *entry,
+			struct berval *uuid, int phase, int refresh_phase)
+			ATTR_NONNULL(1,3) ATTR_CHECKRESULT;
+
+isc_result_t
+sync_record_write_intermediate(sync_record_t *rec, BerVarray uuids,
+			       int phase) ATTR_NONNULL(1) ATTR_CHECKRESULT;
+
+isc_result_t
+sync_record_write_result(sync_record_t *rec,
+			 int refresh_deletes) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+sync_record_read(sync_record_t *rec, dn_cache_t *dncache,
+		 sync_record_msg_t *msg) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+#endif /* SRC_SYNC_RECORD_H_ */
@@ -85,7 +85,8 @@ append_trailing_dot(char *str, unsigned int size) {
  * @param[in]  af        Address family
  * @param[in]  ip_str    IP address as a string (IPv4 or IPv6)
  * @param[out] ptr_name  Full DNS domain of the reverse record
- * @param[out] zsettings Set of settings for the DNS zone
+ * @param[out] zinfop    Handle for the zone in zone register,
+ *                       caller has to detach it.
  * @param[out] zone      DNS zone containing the reverse record
  *
  * @retval ISC_R_SUCCESS DNS name derived from given IP address belongs to an
@@ -96,7 +97,7 @@ append_trailing_dot(char *str, unsigned int size) {
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 sync_ptr_find(dns_zt_t *zonetable, zone_register_t *zone_register, const int af,
 	      const char *ip_str, dns_name_t *ptr_name,
-	      settings_set_t **zsettings, dns_zone_t **zone) {
+	      zone_info_t **zinfop, dns_zone_t **zone) {
 	isc_result_t result;
 
 	REQUIRE(ip_str != NULL);
@@ -141,11 +142,11 @@ sync_ptr_find(dns_zt_t *zonetable, zone_register_t *zone_register, const int af,
 	if (result != ISC_R_SUCCESS && result != DNS_R_PARTIALMATCH)
 		goto cleanup;
 
-	/* Get LDAP zone settings.
+	/* Get handle with LDAP zone settings.
 	 * As a side-effect it checks that the zone is present in zone register,
 	 * i.e. the zone is managed by this LDAP instance. */
-	result = zr_get_zone_settings(zone_register, dns_zone_getorigin(*zone),
-				      zsettings);
+	result = zr_get_zone_handle(zone_register, dns_zone_getorigin(*zone),
+				    zinfop);
 	if (result != ISC_R_SUCCESS) {
 		dns_zone_log(*zone, ISC_LOG_ERROR, SYNCPTR_PREF "refused: "
 			     "reverse zone for IP address '%s' "
@@ -379,7 +380,7 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 	      const char *ip_str, dns_ttl_t ttl, const int mod_op) {
 	isc_result_t result;
 
-	settings_set_t *zone_settings = NULL;
+	zone_info_t *zinfo = NULL;
 	isc_boolean_t zone_dyn_update;
 	char *a_name_str = NULL;
 
@@ -417,14 +418,15 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 	a_name_str = ev->a_name_str;
 
 	result = sync_ptr_find(zonetable, zone_register, af, ip_str,
-			       &ev->ptr_name, &zone_settings, &ev->ptr_zone);
+			       &ev->ptr_name, &zinfo, &ev->ptr_zone);
 	if (result != ISC_R_SUCCESS) {
 		log_error_r(SYNCPTR_FMTPRE "refused: unable to find "
 			    "active reverse zone", SYNCPTR_FMTPOST);
 		goto cleanup;
 	}
 
-	CHECK(setting_get_bool("dyn_update", zone_settings, &zone_dyn_update));
+	CHECK(setting_get_bool("dyn_update", zinfo_getsettings(zinfo),
+			       &zone_dyn_update));
 	if (!zone_dyn_update) {
 		dns_zone_log(ev->ptr_zone, ISC_LOG_ERROR,
 			     SYNCPTR_FMTPRE "refused: dynamic updates are not "
@@ -437,6 +439,8 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 	isc_task_sendanddetach(&task, (isc_event_t **)&ev);
 
 cleanup:
+	if (zinfo != NULL)
+		zr_zone_handle_detach(&zinfo);
 	sync_ptr_destroyev(&ev);
 	return result;
 }
@@ -6,25 +6,31 @@
 
 #include <isc/condition.h>
 #include <isc/event.h>
+#include <isc/mem.h>
 #include <isc/mutex.h>
 #include <isc/task.h>
 #include <isc/time.h>
 #include <isc/util.h>
 
 #include "ldap_helper.h"
+#include "log.h"
+#include "settings.h"
 #include "util.h"
-#include "semaphore.h"
 #include "syncrepl.h"
 #include "zone_manager.h"
 
 #define LDAPDB_EVENT_SYNCREPL_BARRIER	(LDAPDB_EVENTCLASS + 2)
 #define LDAPDB_EVENT_SYNCREPL_FINISH	(LDAPDB_EVENTCLASS + 3)
 
-/** How many unprocessed LDAP events from syncrepl can be in event queue.
+/** How many unprocessed LDAP events from syncrepl can be in event queue
+ *  before the instance configuration is loaded.
  *  Adding new events into the queue is blocked until some events
- *  are processed. */
+ *  are processed. See sync_concurr_limit_configure(). */
 #define LDAP_CONCURRENCY_LIMIT 100
 
+/** Adaptive mode never shrinks the window below this size. */
+#define LDAP_CONCURRENCY_MIN 10
+
 typedef struct task_element task_element_t;
 struct task_element {
 	isc_task_t			*task;
@@ -85,7 +91,28 @@ struct sync_ctx {
 	isc_mem_t			*mctx;
 	/** limit number of unprocessed LDAP events in queue
 	 *  (memory consumption is one of problems) */
-	semaphore_t			concurr_limit;
+	isc_mutex_t			limit_lock; /**< guards limit_* fields */
+	isc_condition_t			limit_cond; /**< signal free slot */
+	unsigned int			limit;	/**< current window size */
+	unsigned int			limit_used; /**< events in queue */
+	unsigned int			limit_peak; /**< max. limit_used */
+	unsigned int			limit_min;
+	unsigned int			limit_max;
+	isc_boolean_t			limit_adaptive;
+	isc_uint64_t			limit_latency; /**< target queue latency
+							    in microseconds */
+	size_t				limit_memory; /**< max. memory in use
+							   in bytes, 0 = no
+							   limit */
+	isc_uint64_t			latency_sum; /**< microseconds */
+	unsigned int			latency_cnt;
+
+	/** syncrepl events are recycled so the steady state does not need
+	 *  any allocation per LDAP entry */
+	isc_mutex_t			pool_lock; /**< guards pool_* fields */
+	ISC_LIST(ldap_syncreplevent_t)	pool;	/**< free events */
+	unsigned int			pool_free; /**< events in pool */
+	unsigned int			pool_size; /**< max. events kept */
 
 	isc_mutex_t			mutex;	/**< guards rest of the structure */
 	isc_condition_t			cond;	/**< for signal when task_cnt == 0 */
@@ -104,8 +131,8 @@ struct sync_ctx {
  *
  * This is an auxiliary event supporting sync_barrier_wait().
  *
- * @todo Solution with inst_name is not very clever. Reference counting would
- *       be much better, but ldap_instance_t doesn't support reference counting.
+ * @todo Solution with inst_name is not very clever. The event could hold
+ *       reference to ldap_instance_t like ldap_syncreplevent_t does.
  */
 struct sync_barrierev {
 	ISC_EVENT_COMMON(sync_barrierev_t);
@@ -274,6 +301,9 @@ sync_ctx_init(isc_mem_t *mctx, ldap_instance_t *inst, sync_ctx_t **sctxp) {
 	isc_boolean_t lock_ready = ISC_FALSE;
 	isc_boolean_t cond_ready = ISC_FALSE;
 	isc_boolean_t refcount_ready = ISC_FALSE;
+	isc_boolean_t limit_lock_ready = ISC_FALSE;
+	isc_boolean_t limit_cond_ready = ISC_FALSE;
+	isc_boolean_t pool_lock_ready = ISC_FALSE;
 
 	REQUIRE(sctxp != NULL && *sctxp == NULL);
 
@@ -297,17 +327,36 @@ sync_ctx_init(isc_mem_t *mctx, ldap_instance_t *inst, sync_ctx_t **sctxp) {
 	sctx->state = sync_configinit;
 	CHECK(sync_task_add(sctx, ldap_instance_gettask(sctx->inst)));
 
-	CHECK(semaphore_init(&sctx->concurr_limit, LDAP_CONCURRENCY_LIMIT));
+	CHECK(isc_mutex_init(&sctx->limit_lock));
+	limit_lock_ready = ISC_TRUE;
+	CHECK(isc_condition_init(&sctx->limit_cond));
+	limit_cond_ready = ISC_TRUE;
+	sctx->limit = LDAP_CONCURRENCY_LIMIT;
+	sctx->limit_min = LDAP_CONCURRENCY_LIMIT;
+	sctx->limit_max = LDAP_CONCURRENCY_LIMIT;
+	sctx->limit_adaptive = ISC_FALSE;
+
+	CHECK(isc_mutex_init(&sctx->pool_lock));
+	pool_lock_ready = ISC_TRUE;
+	ISC_LIST_INIT(sctx->pool);
+	sctx->pool_size = LDAP_CONCURRENCY_LIMIT;
 
 	*sctxp = sctx;
 	return ISC_R_SUCCESS;
 
 cleanup:
+	if (pool_lock_ready == ISC_TRUE)
+		DESTROYLOCK(&sctx->pool_lock);
 	if (lock_ready == ISC_TRUE)
 		DESTROYLOCK(&sctx->mutex);
 	if (cond_ready == ISC_TRUE)
 		RUNTIME_CHECK(isc_condition_destroy(&sctx->cond)
 			      == ISC_R_SUCCESS);
+	if (limit_lock_ready == ISC_TRUE)
+		DESTROYLOCK(&sctx->limit_lock);
+	if (limit_cond_ready == ISC_TRUE)
+		RUNTIME_CHECK(isc_condition_destroy(&sctx->limit_cond)
+			      == ISC_R_SUCCESS);
 	if (refcount_ready == ISC_TRUE)
 		isc_refcount_destroy(&sctx->task_cnt);
 	MEM_PUT_AND_DETACH(sctx);
@@ -319,6 +368,7 @@ sync_ctx_free(sync_ctx_t **sctxp) {
 	sync_ctx_t *sctx = NULL;
 	task_element_t *taskel = NULL;
 	task_element_t *next_taskel = NULL;
+	ldap_syncreplevent_t *ev = NULL;
 
 	REQUIRE(sctxp != NULL);
 
@@ -343,6 +393,16 @@ sync_ctx_free(sync_ctx_t **sctxp) {
 	isc_refcount_destroy(&sctx->task_cnt);
 	UNLOCK(&sctx->mutex);
 
+	RUNTIME_CHECK(isc_condition_destroy(&sctx->limit_cond)
+		      == ISC_R_SUCCESS);
+	DESTROYLOCK(&sctx->limit_lock);
+
+	/* all events hold reference to LDAP instance so they are back */
+	while ((ev = HEAD(sctx->pool)) != NULL) {
+		UNLINK(sctx->pool, ev, ev_link);
+		SAFE_MEM_PUT_PTR(sctx->mctx, ev);
+	}
+	DESTROYLOCK(&sctx->pool_lock);
 	DESTROYLOCK(&(*sctxp)->mutex);
 	MEM_PUT_AND_DETACH(*sctxp);
 }
@@ -545,9 +605,134 @@ cleanup:
 	return result;
 }
 
+/**
+ * Return syncrepl event to the pool. It is called by isc_event_free().
+ * Events over pool size are freed.
+ */
+static void
+sync_event_destroy(isc_event_t *event) {
+	ldap_syncreplevent_t *ev = (ldap_syncreplevent_t *)event;
+	sync_ctx_t *sctx = event->ev_destroy_arg;
+	ldap_instance_t *inst = ev->inst;
+	isc_boolean_t pooled = ISC_FALSE;
+
+	ev->inst = NULL;
+	LOCK(&sctx->pool_lock);
+	if (sctx->pool_free < sctx->pool_size) {
+		ISC_LINK_INIT(ev, ev_link);
+		APPEND(sctx->pool, ev, ev_link);
+		sctx->pool_free++;
+		pooled = ISC_TRUE;
+	}
+	UNLOCK(&sctx->pool_lock);
+	if (pooled == ISC_FALSE)
+		SAFE_MEM_PUT_PTR(sctx->mctx, ev);
+
+	/* the last reference frees sctx, too */
+	ldap_instance_detach(&inst);
+}
+
+/**
+ * Preallocate syncrepl events so the pool contains at least fill events.
+ * Events are preallocated for the whole concurrency window so no event
+ * has to be allocated during synchronization unless the window grows.
+ *
+ * @param[in] size Maximal number of events kept in pool.
+ * @param[in] fill Number of events to preallocate.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_event_pool_fill(sync_ctx_t *sctx, unsigned int size, unsigned int fill) {
+	isc_result_t result = ISC_R_SUCCESS;
+	ldap_syncreplevent_t *ev = NULL;
+
+	fill = ISC_MIN(size, fill);
+	LOCK(&sctx->pool_lock);
+	sctx->pool_size = size;
+	while (sctx->pool_free < fill) {
+		CHECKED_MEM_GET_PTR(sctx->mctx, ev);
+		ZERO_PTR(ev);
+		ISC_LINK_INIT(ev, ev_link);
+		APPEND(sctx->pool, ev, ev_link);
+		sctx->pool_free++;
+	}
+	/* the window was made smaller */
+	while (sctx->pool_free > size) {
+		ev = HEAD(sctx->pool);
+		UNLINK(sctx->pool, ev, ev_link);
+		sctx->pool_free--;
+		SAFE_MEM_PUT_PTR(sctx->mctx, ev);
+	}
+
+cleanup:
+	UNLOCK(&sctx->pool_lock);
+	return result;
+}
+
+/**
+ * Load concurrency limit settings from LDAP instance configuration.
+ *
+ * In fixed mode the window has sync_concurrency_limit slots. In adaptive
+ * mode the window starts at sync_concurrency_limit and it is adjusted
+ * after each round of processed events by sync_concurr_limit_adapt().
+ */
+isc_result_t
+sync_concurr_limit_configure(sync_ctx_t *sctx, settings_set_t *set) {
+	isc_result_t result;
+	isc_uint32_t limit;
+	isc_uint32_t limit_max;
+	isc_uint32_t latency;
+	isc_uint32_t memory;
+	isc_boolean_t adaptive;
+
+	REQUIRE(sctx != NULL);
+
+	CHECK(setting_get_uint("sync_concurrency_limit", set, &limit));
+	CHECK(setting_get_uint("sync_concurrency_max", set, &limit_max));
+	CHECK(setting_get_bool("sync_concurrency_adaptive", set, &adaptive));
+	CHECK(setting_get_uint("sync_concurrency_latency", set, &latency));
+	CHECK(setting_get_uint("sync_concurrency_memory", set, &memory));
+
+	if (limit == 0) {
+		log_error("sync_concurrency_limit has to be greater than 0");
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+	if (adaptive == ISC_TRUE && limit_max < limit) {
+		log_error("sync_concurrency_max (%u) has to be greater than "
+			  "or equal to sync_concurrency_limit (%u)",
+			  limit_max, limit);
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+
+	LOCK(&sctx->limit_lock);
+	sctx->limit = limit;
+	sctx->limit_adaptive = adaptive;
+	if (adaptive == ISC_TRUE) {
+		sctx->limit_min = ISC_MIN(limit, LDAP_CONCURRENCY_MIN);
+		sctx->limit_max = limit_max;
+	} else {
+		sctx->limit_min = limit;
+		sctx->limit_max = limit;
+	}
+	sctx->limit_latency = (isc_uint64_t)latency * 1000;
+	sctx->limit_memory = (size_t)memory * 1024 * 1024;
+	sctx->latency_sum = 0;
+	sctx->latency_cnt = 0;
+	BROADCAST(&sctx->limit_cond);
+	UNLOCK(&sctx->limit_lock);
+
+	CHECK(sync_event_pool_fill(sctx, (adaptive == ISC_TRUE)
+					 ? limit_max : limit, limit));
+
+	log_debug(1, "syncrepl concurrency limit: %u%s", limit,
+		  adaptive == ISC_TRUE ? " (adaptive)" : "");
+
+cleanup:
+	return result;
+}
+
 /**
  * Wait until there is a free slot in syncrepl 'queue' - this limits number
- * of unprocessed ISC events to #LDAP_CONCURRENCY_LIMIT.
+ * of unprocessed ISC events to the current window size.
  *
  * End of syncrepl event processing has to be signalled by
  * sync_concurr_limit_signal() call.
@@ -559,32 +744,221 @@ sync_concurr_limit_wait(sync_ctx_t *sctx) {
 
 	REQUIRE(sctx != NULL);
 
+	LOCK(&sctx->limit_lock);
 	while (ldap_instance_isexiting(sctx->inst) == ISC_FALSE) {
+		if (sctx->limit_used < sctx->limit) {
+			if (++sctx->limit_used > sctx->limit_peak)
+				sctx->limit_peak = sctx->limit_used;
+			CLEANUP_WITH(ISC_R_SUCCESS);
+		}
+
 		result = isc_time_nowplusinterval(&abs_timeout,
 						  &shutdown_timeout);
 		INSIST(result == ISC_R_SUCCESS);
 
-		result = semaphore_wait_timed(&sctx->concurr_limit,
-					      &shutdown_timeout);
-		if (result == ISC_R_SUCCESS)
-			goto cleanup;
+		WAITUNTIL(&sctx->limit_cond, &sctx->limit_lock, &abs_timeout);
 	}
 
 	result = ISC_R_SHUTTINGDOWN;
 
 cleanup:
+	UNLOCK(&sctx->limit_lock);
+	return result;
+}
+
+/**
+ * Get syncrepl event from the pool or allocate a new one if the pool
+ * is empty. The event holds reference to the LDAP instance which is
+ * released when the event is freed by isc_event_free().
+ */
+isc_result_t
+sync_event_create(sync_ctx_t *sctx, isc_taskaction_t action,
+		  ldap_syncreplevent_t **evp) {
+	isc_result_t result;
+	ldap_syncreplevent_t *ev = NULL;
+
+	REQUIRE(sctx != NULL);
+	REQUIRE(evp != NULL && *evp == NULL);
+
+	LOCK(&sctx->pool_lock);
+	ev = HEAD(sctx->pool);
+	if (ev != NULL) {
+		UNLINK(sctx->pool, ev, ev_link);
+		sctx->pool_free--;
+	}
+	UNLOCK(&sctx->pool_lock);
+	if (ev == NULL)
+		CHECKED_MEM_GET_PTR(sctx->mctx, ev);
+
+	ZERO_PTR(ev);
+	ISC_EVENT_INIT(ev, sizeof(*ev), 0, NULL, LDAPDB_EVENT_SYNCREPL_UPDATE,
+		       action, NULL, sctx->inst, sync_event_destroy, sctx);
+	ldap_instance_attach(sctx->inst, &ev->inst);
+
+	*evp = ev;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Take a free slot in syncrepl 'queue' if there is one, do not wait.
+ *
+ * @retval ISC_R_SUCCESS Slot was taken, it has to be freed by
+ *                       sync_concurr_limit_signal() call.
+ * @retval ISC_R_QUOTA   All slots are used at the moment.
+ */
+isc_result_t
+sync_concurr_limit_trywait(sync_ctx_t *sctx) {
+	isc_result_t result;
+
+	REQUIRE(sctx != NULL);
+
+	LOCK(&sctx->limit_lock);
+	if (sctx->limit_used < sctx->limit) {
+		if (++sctx->limit_used > sctx->limit_peak)
+			sctx->limit_peak = sctx->limit_used;
+		result = ISC_R_SUCCESS;
+	} else {
+		result = ISC_R_QUOTA;
+	}
+	UNLOCK(&sctx->limit_lock);
+
 	return result;
 }
 
+/**
+ * Take a slot in syncrepl 'queue' even if all slots are used at the moment.
+ * It is intended for events which must not block the caller and whose
+ * number is bounded by other means. Subsequent callers of
+ * sync_concurr_limit_wait() wait until the queue drains below the limit.
+ *
+ * The slot has to be freed by sync_concurr_limit_signal() call.
+ */
+void
+sync_concurr_limit_take(sync_ctx_t *sctx) {
+	REQUIRE(sctx != NULL);
+
+	LOCK(&sctx->limit_lock);
+	if (++sctx->limit_used > sctx->limit_peak)
+		sctx->limit_peak = sctx->limit_used;
+	UNLOCK(&sctx->limit_lock);
+}
+
+/**
+ * Adjust window size according to average queue latency measured
+ * in the last round and memory used by the LDAP instance.
+ *
+ * Window is halved if latency or memory limit was exceeded and it grows
+ * by one quarter if latency is below half of the target.
+ *
+ * @pre sctx->limit_lock is locked.
+ */
+static void
+sync_concurr_limit_adapt(sync_ctx_t *sctx) {
+	isc_uint64_t latency;
+	size_t inuse;
+	unsigned int limit;
+
+	latency = sctx->latency_sum / sctx->latency_cnt;
+	inuse = isc_mem_inuse(sctx->mctx);
+	limit = sctx->limit;
+
+	if ((sctx->limit_memory != 0 && inuse > sctx->limit_memory)
+	    || latency > sctx->limit_latency)
+		limit = ISC_MAX(sctx->limit_min, limit / 2);
+	else if (latency < sctx->limit_latency / 2)
+		limit = ISC_MIN(sctx->limit_max, limit + limit / 4 + 1);
+
+	if (limit != sctx->limit) {
+		log_debug(5, "syncrepl concurrency limit changed %u -> %u "
+			  "(latency %u ms, memory in use %zu bytes)",
+			  sctx->limit, limit, (unsigned int)(latency / 1000),
+			  inuse);
+		if (limit > sctx->limit)
+			BROADCAST(&sctx->limit_cond);
+		sctx->limit = limit;
+	}
+	sctx->latency_sum = 0;
+	sctx->latency_cnt = 0;
+}
+
 /**
  * Signal that syncrepl event was processed and the slot in concurrency limit
  * can be freed.
+ *
+ * @param[in] ev Processed event or NULL if the event was not sent.
+ *               Time spent in queue by the event is used in adaptive mode.
  */
 void
-sync_concurr_limit_signal(sync_ctx_t *sctx) {
+sync_concurr_limit_signal(sync_ctx_t *sctx, ldap_syncreplevent_t *ev) {
+	isc_time_t now;
+
+	REQUIRE(sctx != NULL);
+
+	LOCK(&sctx->limit_lock);
+	INSIST(sctx->limit_used > 0);
+	sctx->limit_used--;
+	if (sctx->limit_adaptive == ISC_TRUE && ev != NULL
+	    && isc_time_isepoch(&ev->sent) == ISC_FALSE
+	    && isc_time_now(&now) == ISC_R_SUCCESS) {
+		sctx->latency_sum += isc_time_microdiff(&now, &ev->sent);
+		sctx->latency_cnt++;
+		if (sctx->latency_cnt >= sctx->limit)
+			sync_concurr_limit_adapt(sctx);
+	}
+	BROADCAST(&sctx->limit_cond);
+	UNLOCK(&sctx->limit_lock);
+}
+
+/**
+ * Get current and peak number of events in syncrepl 'queue'
+ * and the current window size.
+ */
+void
+sync_concurr_limit_getstats(sync_ctx_t *sctx, unsigned int *usedp,
+			    unsigned int *peakp, unsigned int *limitp) {
+	REQUIRE(sctx != NULL);
+
+	LOCK(&sctx->limit_lock);
+	*usedp = sctx->limit_used;
+	*peakp = sctx->limit_peak;
+	*limitp = sctx->limit;
+	UNLOCK(&sctx->limit_lock);
+}
+
+/**
+ * Wait until all syncrepl events sent so far are processed, i.e. until
+ * all slots in concurrency limit are free again.
+ *
+ * @retval ISC_R_SUCCESS  All events were processed.
+ * @retval ISC_R_TIMEDOUT Some events were not processed in time.
+ */
+isc_result_t
+sync_concurr_limit_drain(sync_ctx_t *sctx) {
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_time_t abs_timeout;
+	unsigned int used;
+
 	REQUIRE(sctx != NULL);
 
-	semaphore_signal(&sctx->concurr_limit);
+	LOCK(&sctx->limit_lock);
+	while ((used = sctx->limit_used) > 0) {
+		result = isc_time_nowplusinterval(&abs_timeout,
+						  &shutdown_timeout);
+		INSIST(result == ISC_R_SUCCESS);
+
+		result = WAITUNTIL(&sctx->limit_cond, &sctx->limit_lock,
+				   &abs_timeout);
+		/* give up only if no event was processed in time */
+		if (result == ISC_R_TIMEDOUT && sctx->limit_used == used)
+			break;
+		result = ISC_R_SUCCESS;
+	}
+	UNLOCK(&sctx->limit_lock);
+
+	return result;
 }
 
 /**
@@ -609,6 +983,7 @@ sync_event_send(sync_ctx_t *sctx, isc_task_t *task, ldap_syncreplevent_t **ev,
 	/* overflow is not a problem as long as the modulo is smaller than
 	 * constant used by sync_concurr_limit_wait() */
 	(*ev)->seqid = seqid = ++sctx->next_id % 0xffffffff;
+	RUNTIME_CHECK(isc_time_now(&(*ev)->sent) == ISC_R_SUCCESS);
 	isc_task_send(task, (isc_event_t **)ev);
 	while (synchronous == ISC_TRUE && sctx->last_id != seqid) {
 		if (ldap_instance_isexiting(sctx->inst) == ISC_TRUE)
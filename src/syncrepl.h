@@ -51,11 +51,31 @@ sync_task_add(sync_ctx_t *sctx, isc_task_t *task) ATTR_NONNULLS ATTR_CHECKRESULT
 isc_result_t
 sync_barrier_wait(sync_ctx_t *sctx, const char *inst_name) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+sync_concurr_limit_configure(sync_ctx_t *sctx, settings_set_t *set) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 sync_concurr_limit_wait(sync_ctx_t *sctx) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+sync_concurr_limit_trywait(sync_ctx_t *sctx) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+sync_concurr_limit_take(sync_ctx_t *sctx) ATTR_NONNULLS;
+
 void
-sync_concurr_limit_signal(sync_ctx_t *sctx) ATTR_NONNULLS;
+sync_concurr_limit_signal(sync_ctx_t *sctx, ldap_syncreplevent_t *ev) ATTR_NONNULL(1);
+
+void
+sync_concurr_limit_getstats(sync_ctx_t *sctx, unsigned int *usedp,
+			    unsigned int *peakp, unsigned int *limitp) ATTR_NONNULLS;
+
+isc_result_t
+sync_concurr_limit_drain(sync_ctx_t *sctx) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+sync_event_create(sync_ctx_t *sctx, isc_taskaction_t action,
+		  ldap_syncreplevent_t **evp) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
 sync_event_send(sync_ctx_t *sctx, isc_task_t *task, ldap_syncreplevent_t **ev,
@@ -7,6 +7,7 @@
 
 #include <isc/event.h>
 #include <isc/refcount.h>
+#include <isc/time.h>
 #include <dns/name.h>
 
 #include "util.h"
@@ -42,12 +43,12 @@ typedef struct settings_set	settings_set_t;
 typedef struct ldap_syncreplevent ldap_syncreplevent_t;
 struct ldap_syncreplevent {
 	ISC_EVENT_COMMON(ldap_syncreplevent_t);
-	isc_mem_t *mctx;
-	char *dbname;
+	ldap_instance_t *inst; /* reference released by isc_event_free() */
 	char *prevdn;
 	int chgtype;
 	ldap_entry_t *entry;
 	isc_uint32_t seqid;
+	isc_time_t sent; /* time when the event was sent to task */
 };
 
 #endif /* !_LD_TYPES_H_ */
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/diff.h>
+#include <dns/name.h>
+
+#include "util.h"
+#include "zone_batch.h"
+
+/**
+ * Zone batch accumulates changes made by consecutive SyncRepl events
+ * to the same zone. Changes are kept in the batch until it is flushed,
+ * then they are applied to RBTDB in one version together with SOA serial
+ * increment, written to journal and serial is written back to LDAP.
+ *
+ * Changes of each name are computed against data in RBTDB so the batch
+ * has to be flushed before the next change of a name which is already
+ * in the batch, see zone_batch_hasname().
+ */
+struct zone_batch {
+	isc_mem_t	*mctx;
+	isc_mutex_t	lock;
+	/* Changes not applied to RBTDB yet. */
+	dns_diff_t	diff;
+	/* Number of events merged into diff. */
+	unsigned int	changes;
+	/* Time when the first change was merged into empty batch. */
+	isc_time_t	first;
+	/* Flush event was sent and was not processed yet. */
+	isc_boolean_t	pending;
+	/* Statistics: events and SOA serial increments since creation. */
+	isc_uint64_t	changes_total;
+	isc_uint64_t	serials_total;
+	isc_time_t	created;
+};
+
+isc_result_t
+zone_batch_create(isc_mem_t *mctx, zone_batch_t **batchp) {
+	isc_result_t result;
+	zone_batch_t *batch = NULL;
+
+	REQUIRE(batchp != NULL && *batchp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, batch);
+	ZERO_PTR(batch);
+	isc_mem_attach(mctx, &batch->mctx);
+	CHECK(isc_mutex_init(&batch->lock));
+	dns_diff_init(batch->mctx, &batch->diff);
+	RUNTIME_CHECK(isc_time_now(&batch->created) == ISC_R_SUCCESS);
+
+	*batchp = batch;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (batch != NULL)
+		MEM_PUT_AND_DETACH(batch);
+	return result;
+}
+
+/**
+ * Destroy the batch. Changes which were not flushed are lost,
+ * the batch has to be flushed before the zone is destroyed.
+ */
+void
+zone_batch_destroy(zone_batch_t **batchp) {
+	zone_batch_t *batch;
+
+	REQUIRE(batchp != NULL);
+
+	batch = *batchp;
+	if (batch == NULL)
+		return;
+
+	dns_diff_clear(&batch->diff);
+	DESTROYLOCK(&batch->lock);
+	MEM_PUT_AND_DETACH(batch);
+	*batchp = NULL;
+}
+
+/**
+ * Merge changes from one event into the batch.
+ *
+ * @param[in,out] diff     Changes not applied to RBTDB.
+ *                         All tuples are moved to the batch.
+ * @param[out]    changesp Number of events merged into the batch so far.
+ */
+void
+zone_batch_add(zone_batch_t *batch, dns_diff_t *diff, unsigned int *changesp) {
+	dns_difftuple_t *tp = NULL;
+
+	LOCK(&batch->lock);
+	if (batch->changes == 0)
+		RUNTIME_CHECK(isc_time_now(&batch->first) == ISC_R_SUCCESS);
+	while ((tp = HEAD(diff->tuples)) != NULL) {
+		ISC_LIST_UNLINK(diff->tuples, tp, link);
+		dns_diff_append(&batch->diff, &tp);
+	}
+	batch->changes++;
+	batch->changes_total++;
+	if (changesp != NULL)
+		*changesp = batch->changes;
+	UNLOCK(&batch->lock);
+}
+
+/**
+ * Move all accumulated changes to the diff and reset the batch.
+ * State of the flush event is not changed.
+ *
+ * Non-empty batch is counted as one SOA serial increment.
+ */
+void
+zone_batch_take(zone_batch_t *batch, dns_diff_t *diff) {
+	dns_difftuple_t *tp = NULL;
+
+	LOCK(&batch->lock);
+	if (HEAD(batch->diff.tuples) != NULL)
+		batch->serials_total++;
+	while ((tp = HEAD(batch->diff.tuples)) != NULL) {
+		ISC_LIST_UNLINK(batch->diff.tuples, tp, link);
+		dns_diff_append(diff, &tp);
+	}
+	batch->changes = 0;
+	UNLOCK(&batch->lock);
+}
+
+/**
+ * @retval ISC_TRUE  The batch contains change of the name.
+ * @retval ISC_FALSE Otherwise.
+ */
+isc_boolean_t
+zone_batch_hasname(zone_batch_t *batch, dns_name_t *name) {
+	dns_difftuple_t *tp;
+	isc_boolean_t found = ISC_FALSE;
+
+	LOCK(&batch->lock);
+	for (tp = HEAD(batch->diff.tuples);
+	     tp != NULL && found == ISC_FALSE;
+	     tp = NEXT(tp, link))
+		found = dns_name_equal(&tp->name, name);
+	UNLOCK(&batch->lock);
+
+	return found;
+}
+
+unsigned int
+zone_batch_changes(zone_batch_t *batch) {
+	unsigned int changes;
+
+	LOCK(&batch->lock);
+	changes = batch->changes;
+	UNLOCK(&batch->lock);
+
+	return changes;
+}
+
+/**
+ * @param[in] max_delay Maximal time in milliseconds for which the oldest
+ *                      change can wait in the batch.
+ *
+ * @retval ISC_TRUE  The batch is not empty and the oldest change
+ *                   waits for max_delay or longer.
+ * @retval ISC_FALSE Otherwise.
+ */
+isc_boolean_t
+zone_batch_expired(zone_batch_t *batch, isc_uint32_t max_delay) {
+	isc_boolean_t expired = ISC_FALSE;
+	isc_time_t now;
+
+	LOCK(&batch->lock);
+	if (batch->changes > 0 && isc_time_now(&now) == ISC_R_SUCCESS)
+		expired = ISC_TF(isc_time_microdiff(&now, &batch->first)
+				 >= (isc_uint64_t)max_delay * 1000);
+	UNLOCK(&batch->lock);
+
+	return expired;
+}
+
+/**
+ * Set flag which indicates that flush event for this batch was sent.
+ *
+ * @returns Previous value of the flag.
+ */
+isc_boolean_t
+zone_batch_setpending(zone_batch_t *batch, isc_boolean_t pending) {
+	isc_boolean_t previous;
+
+	LOCK(&batch->lock);
+	previous = batch->pending;
+	batch->pending = pending;
+	UNLOCK(&batch->lock);
+
+	return previous;
+}
+
+/**
+ * Get statistics for the zone.
+ *
+ * @param[out] changesp Number of events merged into the batch so far.
+ * @param[out] serialsp Number of SOA serial increments so far.
+ * @param[out] agep     Seconds since the batch was created.
+ */
+void
+zone_batch_getstats(zone_batch_t *batch, isc_uint64_t *changesp,
+		    isc_uint64_t *serialsp, unsigned int *agep) {
+	isc_time_t now;
+
+	LOCK(&batch->lock);
+	*changesp = batch->changes_total;
+	*serialsp = batch->serials_total;
+	UNLOCK(&batch->lock);
+	RUNTIME_CHECK(isc_time_now(&now) == ISC_R_SUCCESS);
+	*agep = isc_time_seconds(&now) - isc_time_seconds(&batch->created);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_ZONE_BATCH_H_
+#define SRC_ZONE_BATCH_H_
+
+#include <isc/types.h>
+
+#include <dns/diff.h>
+
+#include "util.h"
+
+typedef struct zone_batch zone_batch_t;
+
+isc_result_t
+zone_batch_create(isc_mem_t *mctx, zone_batch_t **batchp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+zone_batch_destroy(zone_batch_t **batchp) ATTR_NONNULLS;
+
+void
+zone_batch_add(zone_batch_t *batch, dns_diff_t *diff,
+	       unsigned int *changesp) ATTR_NONNULL(1,2);
+
+void
+zone_batch_take(zone_batch_t *batch, dns_diff_t *diff) ATTR_NONNULLS;
+
+isc_boolean_t
+zone_batch_hasname(zone_batch_t *batch, dns_name_t *name) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+unsigned int
+zone_batch_changes(zone_batch_t *batch) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_boolean_t
+zone_batch_expired(zone_batch_t *batch, isc_uint32_t max_delay) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_boolean_t
+zone_batch_setpending(zone_batch_t *batch, isc_boolean_t pending) ATTR_NONNULLS;
+
+void
+zone_batch_getstats(zone_batch_t *batch, isc_uint64_t *changesp,
+		    isc_uint64_t *serialsp, unsigned int *agep) ATTR_NONNULLS;
+
+#endif /* SRC_ZONE_BATCH_H_ */
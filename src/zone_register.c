@@ -3,7 +3,9 @@
  */
 
 #include <isc/mem.h>
+#include <isc/refcount.h>
 #include <isc/rwlock.h>
+#include <isc/thread.h>
 #include <isc/util.h>
 #include <isc/md5.h>
 #include <isc/string.h>
@@ -34,27 +36,81 @@
  * (idnsZoneActive = FALSE). Iterators return all zones including disabled ones.
  * Disabled zones are identified by "active" boolean = FALSE in settings_set_t
  * of the particular zone.
+ *
+ * Zone register is read by all zone tasks and it is modified only when
+ * a zone is added or removed. The lock is split into shards: reader locks
+ * only the shard selected by its thread so readers running on different
+ * CPUs do not write to the same cache line. Writer has to lock all shards.
+ *
+ * zr_get_zone_handle() returns reference to all information about a zone
+ * with single lookup. The information stays valid until the handle
+ * is detached, even if the zone is removed from ZR in the meantime.
  */
 
+/* Number of lock shards, has to be power of 2. */
+#define ZR_LOCK_SHARDS	8
+#define ZR_CACHELINE	64
+
+typedef union zr_lock {
+	isc_rwlock_t	rwlock;
+	/* each shard starts on a separate cache line */
+	unsigned char	pad[(sizeof(isc_rwlock_t) / ZR_CACHELINE + 1)
+			    * ZR_CACHELINE];
+} zr_lock_t;
+
 struct zone_register {
 	isc_mem_t	*mctx;
-	isc_rwlock_t	rwlock;
+	zr_lock_t	locks[ZR_LOCK_SHARDS];
+	unsigned int	locks_ready;
 	dns_rbt_t	*rbt;
 	settings_set_t	*global_settings;
 	ldap_instance_t *ldap_inst;
 };
 
-typedef struct {
+struct zone_info {
+	isc_mem_t	*mctx;
+	isc_refcount_t	references;
 	dns_zone_t	*raw;
 	dns_zone_t	*secure;
 	char		*dn;
 	settings_set_t	*settings;
 	dns_db_t	*ldapdb;
-} zone_info_t;
+	/* zone was activated before the end of initial synchronization */
+	isc_boolean_t	activated;
+};
 
 /* Callback for dns_rbt_create(). */
 static void delete_zone_info(void *arg1, void *arg2);
 
+/**
+ * Get lock shard for the current thread.
+ */
+static inline isc_rwlock_t *
+zr_rdlock_shard(zone_register_t *zr) {
+	unsigned long self = (unsigned long)isc_thread_self();
+
+	/* thread IDs are often aligned pointers, mix upper bits in */
+	self ^= self >> 12;
+	self ^= self >> 7;
+	return &zr->locks[self & (ZR_LOCK_SHARDS - 1)].rwlock;
+}
+
+static inline void
+zr_wrlock(zone_register_t *zr) {
+	unsigned int i;
+
+	for (i = 0; i < ZR_LOCK_SHARDS; i++)
+		RWLOCK(&zr->locks[i].rwlock, isc_rwlocktype_write);
+}
+
+static inline void
+zr_wrunlock(zone_register_t *zr) {
+	unsigned int i;
+
+	for (i = ZR_LOCK_SHARDS; i > 0; i--)
+		RWUNLOCK(&zr->locks[i - 1].rwlock, isc_rwlocktype_write);
+}
+
 /**
  * Zone specific settings from idnsZone object:
  * NAME 'idnsZone'
@@ -88,7 +144,8 @@ zr_rbt_iter_init(zone_register_t *zr, rbt_iterator_t **iter,
 	if (zr->rbt == NULL)
 		return ISC_R_NOTFOUND;
 
-	return rbt_iter_first(zr->mctx, zr->rbt, &zr->rwlock, iter, nodename);
+	return rbt_iter_first(zr->mctx, zr->rbt, zr_rdlock_shard(zr), iter,
+			      nodename);
 }
 
 isc_mem_t *
@@ -116,7 +173,10 @@ zr_create(isc_mem_t *mctx, ldap_instance_t *ldap_inst,
 	ZERO_PTR(zr);
 	isc_mem_attach(mctx, &zr->mctx);
 	CHECK(dns_rbt_create(mctx, delete_zone_info, mctx, &zr->rbt));
-	CHECK(isc_rwlock_init(&zr->rwlock, 0, 0));
+	for (zr->locks_ready = 0; zr->locks_ready < ZR_LOCK_SHARDS;
+	     zr->locks_ready++)
+		CHECK(isc_rwlock_init(&zr->locks[zr->locks_ready].rwlock,
+				      0, 0));
 	zr->global_settings = glob_settings;
 	zr->ldap_inst = ldap_inst;
 
@@ -127,6 +187,8 @@ cleanup:
 	if (zr != NULL) {
 		if (zr->rbt != NULL)
 			dns_rbt_destroy(&zr->rbt);
+		while (zr->locks_ready > 0)
+			isc_rwlock_destroy(&zr->locks[--zr->locks_ready].rwlock);
 		MEM_PUT_AND_DETACH(zr);
 	}
 
@@ -168,10 +230,11 @@ zr_destroy(zone_register_t **zrp)
 		}
 	} while (result == ISC_R_SUCCESS);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+	zr_wrlock(zr);
 	dns_rbt_destroy(&zr->rbt);
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
-	isc_rwlock_destroy(&zr->rwlock);
+	zr_wrunlock(zr);
+	while (zr->locks_ready > 0)
+		isc_rwlock_destroy(&zr->locks[--zr->locks_ready].rwlock);
 	MEM_PUT_AND_DETACH(zr);
 
 	*zrp = NULL;
@@ -275,6 +338,13 @@ create_zone_info(isc_mem_t * const mctx, dns_zone_t * const raw,
 
 	CHECKED_MEM_GET_PTR(mctx, zinfo);
 	ZERO_PTR(zinfo);
+	isc_mem_attach(mctx, &zinfo->mctx);
+	result = isc_refcount_init(&zinfo->references, 1);
+	if (result != ISC_R_SUCCESS) {
+		MEM_PUT_AND_DETACH(zinfo);
+		zinfo = NULL;
+		goto cleanup;
+	}
 	CHECKED_MEM_STRDUP(mctx, dn, zinfo->dn);
 	dns_zone_attach(raw, &zinfo->raw);
 	if (secure != NULL)
@@ -314,28 +384,52 @@ cleanup:
 }
 
 /**
- * Delete a zone info structure. The two arguments are of type void * so the
- * function can be used as a node deleter for the red-black tree.
+ * Release reference to zone info obtained from zr_get_zone_handle().
+ * Zone info is freed when the zone was removed from ZR and all
+ * handles were detached.
  */
-static void ATTR_NONNULL(2)
-delete_zone_info(void *arg1, void *arg2)
+void
+zr_zone_handle_detach(zone_info_t **zinfop)
 {
-	zone_info_t *zinfo = arg1;
-	isc_mem_t *mctx = arg2;
+	zone_info_t *zinfo;
+	unsigned int refs;
 
+	REQUIRE(zinfop != NULL);
+
+	zinfo = *zinfop;
 	if (zinfo == NULL)
 		return;
+	*zinfop = NULL;
+
+	isc_refcount_decrement(&zinfo->references, &refs);
+	if (refs > 0)
+		return;
 
 	settings_set_free(&zinfo->settings);
 	if (zinfo->dn != NULL)
-		isc_mem_free(mctx, zinfo->dn);
+		isc_mem_free(zinfo->mctx, zinfo->dn);
 	if (zinfo->raw != NULL)
 		dns_zone_detach(&zinfo->raw);
 	if (zinfo->secure != NULL)
 		dns_zone_detach(&zinfo->secure);
 	if (zinfo->ldapdb != NULL)
 		dns_db_detach(&zinfo->ldapdb);
-	SAFE_MEM_PUT_PTR(mctx, zinfo);
+	isc_refcount_destroy(&zinfo->references);
+	MEM_PUT_AND_DETACH(zinfo);
+}
+
+/**
+ * Delete a zone info structure. The two arguments are of type void * so the
+ * function can be used as a node deleter for the red-black tree.
+ */
+static void ATTR_NONNULL(2)
+delete_zone_info(void *arg1, void *arg2)
+{
+	zone_info_t *zinfo = arg1;
+
+	UNUSED(arg2);
+
+	zr_zone_handle_detach(&zinfo);
 }
 
 /**
@@ -381,7 +475,7 @@ zr_add_zone(zone_register_t * const zr, dns_db_t * const ldapdb,
 
 	name = dns_zone_getorigin(raw);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+	zr_wrlock(zr);
 
 	/*
 	 * First make sure the node doesn't exist. Partial matches mean
@@ -401,7 +495,7 @@ zr_add_zone(zone_register_t * const zr, dns_db_t * const ldapdb,
 	CHECK(dns_rbt_addname(zr->rbt, name, new_zinfo));
 
 cleanup:
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+	zr_wrunlock(zr);
 
 	if (result != ISC_R_SUCCESS) {
 		if (new_zinfo != NULL)
@@ -419,12 +513,12 @@ zr_del_zone(zone_register_t *zr, dns_name_t *origin)
 	REQUIRE(zr != NULL);
 	REQUIRE(origin != NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+	zr_wrlock(zr);
 
 	CHECK(dns_rbt_deletename(zr->rbt, origin, ISC_FALSE));
 
 cleanup:
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+	zr_wrunlock(zr);
 
 	if (result == ISC_R_NOTFOUND)
 		result = ISC_R_SUCCESS;
@@ -447,13 +541,15 @@ zr_get_zone_dbs(zone_register_t *zr, dns_name_t *name, dns_db_t **ldapdbp,
 {
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
+	isc_rwlock_t *lock;
 	dns_db_t *ldapdb = NULL;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
 	REQUIRE(ldapdbp != NULL || rbtdbp != NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	lock = zr_rdlock_shard(zr);
+	RWLOCK(lock, isc_rwlocktype_read);
 
 	CHECK(getzinfo(zr, name, &zinfo));
 	dns_db_attach(zinfo->ldapdb, &ldapdb);
@@ -463,7 +559,7 @@ zr_get_zone_dbs(zone_register_t *zr, dns_name_t *name, dns_db_t **ldapdbp,
 		dns_db_attach(ldapdb_get_rbtdb(ldapdb), rbtdbp);
 
 cleanup:
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	RWUNLOCK(lock, isc_rwlocktype_read);
 
 	if (ldapdb != NULL)
 		dns_db_detach(&ldapdb);
@@ -482,18 +578,78 @@ zr_get_zone_dn(zone_register_t *zr, dns_name_t *name, const char **dn)
 {
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
+	isc_rwlock_t *lock;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
 	REQUIRE(dn != NULL && *dn == NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	lock = zr_rdlock_shard(zr);
+	RWLOCK(lock, isc_rwlocktype_read);
 
 	result = getzinfo(zr, name, &zinfo);
 	if (result == ISC_R_SUCCESS)
 		*dn = zinfo->dn;
 
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	RWUNLOCK(lock, isc_rwlocktype_read);
+
+	return result;
+}
+
+/**
+ * Set flag which indicates that the zone was already activated
+ * during the current initial synchronization.
+ *
+ * @param[out] previousp Previous value of the flag. Can be NULL.
+ */
+isc_result_t
+zr_set_zone_activated(zone_register_t *zr, dns_name_t *name,
+		      isc_boolean_t activated, isc_boolean_t *previousp)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+
+	zr_wrlock(zr);
+
+	result = getzinfo(zr, name, &zinfo);
+	if (result == ISC_R_SUCCESS) {
+		if (previousp != NULL)
+			*previousp = zinfo->activated;
+		zinfo->activated = activated;
+	}
+
+	zr_wrunlock(zr);
+
+	return result;
+}
+
+/**
+ * Get flag which indicates that the zone was already activated
+ * during the current initial synchronization.
+ */
+isc_result_t
+zr_get_zone_activated(zone_register_t *zr, dns_name_t *name,
+		      isc_boolean_t *activatedp)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+	isc_rwlock_t *lock;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+	REQUIRE(activatedp != NULL);
+
+	lock = zr_rdlock_shard(zr);
+	RWLOCK(lock, isc_rwlocktype_read);
+
+	result = getzinfo(zr, name, &zinfo);
+	if (result == ISC_R_SUCCESS)
+		*activatedp = zinfo->activated;
+
+	RWUNLOCK(lock, isc_rwlocktype_read);
 
 	return result;
 }
@@ -515,6 +671,7 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 {
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
+	isc_rwlock_t *lock;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
@@ -522,7 +679,8 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 	REQUIRE(rawp == NULL || *rawp == NULL);
 	REQUIRE(securep == NULL || *securep == NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	lock = zr_rdlock_shard(zr);
+	RWLOCK(lock, isc_rwlocktype_read);
 
 	result = getzinfo(zr, name, &zinfo);
 	if (result == ISC_R_SUCCESS) {
@@ -532,7 +690,7 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 			dns_zone_attach(zinfo->secure, securep);
 	}
 
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	RWUNLOCK(lock, isc_rwlocktype_read);
 
 	return result;
 }
@@ -547,22 +705,101 @@ zr_get_zone_settings(zone_register_t *zr, dns_name_t *name, settings_set_t **set
 {
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
+	isc_rwlock_t *lock;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
 	REQUIRE(set != NULL && *set == NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	lock = zr_rdlock_shard(zr);
+	RWLOCK(lock, isc_rwlocktype_read);
 
 	result = getzinfo(zr, name, &zinfo);
 	if (result == ISC_R_SUCCESS)
 		*set = zinfo->settings;
 
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	RWUNLOCK(lock, isc_rwlocktype_read);
+
+	return result;
+}
+
+/**
+ * Find zone with origin 'name' in the zone register and return reference
+ * to all information about the zone. All data available through the handle
+ * stay valid until the handle is detached by zr_zone_handle_detach().
+ *
+ * @retval ISC_R_SUCCESS  Exact match on zone origin was found.
+ * @retval ISC_R_NOTFOUND Zone is not managed by this LDAP instance.
+ */
+isc_result_t
+zr_get_zone_handle(zone_register_t *zr, dns_name_t *name,
+		   zone_info_t **zinfop)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+	isc_rwlock_t *lock;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+	REQUIRE(zinfop != NULL && *zinfop == NULL);
+
+	lock = zr_rdlock_shard(zr);
+	RWLOCK(lock, isc_rwlocktype_read);
+
+	result = getzinfo(zr, name, &zinfo);
+	if (result == ISC_R_SUCCESS) {
+		isc_refcount_increment(&zinfo->references, NULL);
+		*zinfop = zinfo;
+	}
+
+	RWUNLOCK(lock, isc_rwlocktype_read);
 
 	return result;
 }
 
+/**
+ * @returns Raw zone. Caller has to attach the zone if it needs the pointer
+ *          after the handle is detached.
+ */
+dns_zone_t *
+zinfo_getraw(const zone_info_t *zinfo)
+{
+	return zinfo->raw;
+}
+
+/**
+ * @returns Secure zone or NULL if the zone is not signed inline.
+ */
+dns_zone_t *
+zinfo_getsecure(const zone_info_t *zinfo)
+{
+	return zinfo->secure;
+}
+
+dns_db_t *
+zinfo_getldapdb(const zone_info_t *zinfo)
+{
+	return zinfo->ldapdb;
+}
+
+dns_db_t *
+zinfo_getrbtdb(const zone_info_t *zinfo)
+{
+	return ldapdb_get_rbtdb(zinfo->ldapdb);
+}
+
+const char *
+zinfo_getdn(const zone_info_t *zinfo)
+{
+	return zinfo->dn;
+}
+
+settings_set_t *
+zinfo_getsettings(const zone_info_t *zinfo)
+{
+	return zinfo->settings;
+}
+
 /**
  * Delete a zone from plain BIND. LDAP zones require further steps for complete
  * removal, like deletion from zone register etc.
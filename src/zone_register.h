@@ -11,6 +11,8 @@
 #include "rbt_helper.h"
 #include "ldap_helper.h"
 
+typedef struct zone_info zone_info_t;
+
 isc_result_t
 zr_create(isc_mem_t *mctx, ldap_instance_t *ldap_inst,
 	  settings_set_t *glob_settings, zone_register_t **zrp) ATTR_NONNULLS;
@@ -39,9 +41,43 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 		dns_zone_t ** const rawp, dns_zone_t ** const securep)
 		ATTR_NONNULL(1,2,3) ATTR_CHECKRESULT;
 
+isc_result_t
+zr_set_zone_activated(zone_register_t *zr, dns_name_t *name,
+		      isc_boolean_t activated, isc_boolean_t *previousp)
+		      ATTR_NONNULL(1,2) ATTR_CHECKRESULT;
+
+isc_result_t
+zr_get_zone_activated(zone_register_t *zr, dns_name_t *name,
+		      isc_boolean_t *activatedp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 zr_get_zone_settings(zone_register_t *zr, dns_name_t *name, settings_set_t **set) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+zr_get_zone_handle(zone_register_t *zr, dns_name_t *name,
+		   zone_info_t **zinfop) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+zr_zone_handle_detach(zone_info_t **zinfop) ATTR_NONNULLS;
+
+dns_zone_t *
+zinfo_getraw(const zone_info_t *zinfo) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+dns_zone_t *
+zinfo_getsecure(const zone_info_t *zinfo) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+dns_db_t *
+zinfo_getldapdb(const zone_info_t *zinfo) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+dns_db_t *
+zinfo_getrbtdb(const zone_info_t *zinfo) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+const char *
+zinfo_getdn(const zone_info_t *zinfo) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+settings_set_t *
+zinfo_getsettings(const zone_info_t *zinfo) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 zr_get_zone_path(isc_mem_t *mctx, settings_set_t *settings,
 		 dns_name_t *zone_name, const char *last_component,